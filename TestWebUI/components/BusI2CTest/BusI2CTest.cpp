@@ -6,6 +6,7 @@
 
 #include "BusI2CTest.h"
 #include "RaftUtils.h"
+#include "RaftBusSystem.h"
 
 static const char *MODULE_PREFIX = "BusI2CTest";
 
@@ -70,6 +71,33 @@ void BusI2CTest::loop()
     }
 }
 
+void BusI2CTest::addRestAPIEndpoints(RestAPIEndpointManager& endpointManager)
+{
+    // I2C stats
+    endpointManager.addEndpoint("i2cstats", RestAPIEndpoint::ENDPOINT_CALLBACK, RestAPIEndpoint::ENDPOINT_GET,
+                std::bind(&BusI2CTest::apiI2CStats, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
+                "I2C bus stats for each bus by name");
+}
+
+RaftRetCode BusI2CTest::apiI2CStats(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo)
+{
+    // Debug JSON for each bus (includes the I2C loop stats)
+    String jsonStr;
+    for (RaftBus* pBus : raftBusSystem.getBusList())
+    {
+        if (!pBus)
+            continue;
+        RaftBusDevicesIF* pDevicesIF = pBus->getBusDevicesIF();
+        if (!pDevicesIF)
+            continue;
+        if (jsonStr.length() > 0)
+            jsonStr += ",";
+        jsonStr += "\"" + pBus->getBusName() + "\":" + pDevicesIF->getDebugJSON(true);
+    }
+    jsonStr = "\"buses\":{" + jsonStr + "}";
+    return Raft::setJsonResult(reqStr.c_str(), respStr, true, nullptr, jsonStr.c_str());
+}
+
 #ifdef TURN_ON_COMPLEX_POWER_INITIALLY
 void BusI2CTest::setPower3V3OnAllSlots(RaftBus* pBus)
 {
@@ -8,6 +8,7 @@
 
 #include "RaftArduino.h"
 #include "RaftSysMod.h"
+#include "RestAPIEndpointManager.h"
 
 // #define TURN_ON_COMPLEX_POWER_INITIALLY
 
@@ -36,10 +37,16 @@ protected:
     // Loop (called frequently)
     virtual void loop() override final;
 
+    // Add endpoints
+    virtual void addRestAPIEndpoints(RestAPIEndpointManager& endpointManager) override final;
+
 private:
     // Example of how to control loop rate
     uint32_t _lastLoopMs = 0;
 
+    // API returning I2C bus stats (loop phase histograms, bus utilisation, poll rates, etc)
+    RaftRetCode apiI2CStats(const String &reqStr, String& respStr, const APISourceInfo& sourceInfo);
+
 #ifdef TURN_ON_COMPLEX_POWER_INITIALLY
     // Setup flag for power control on bus
     bool _busPowerInit = false;
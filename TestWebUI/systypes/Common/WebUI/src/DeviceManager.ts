@@ -62,6 +62,14 @@ export class DeviceManager {
     // Cached device type data
     private _cachedDeviceTypeRecs: DeviceTypeInfoRecs = {};
 
+    // Device type info version (published as "_tv" with the device data) - cached type info is kept (including
+    // in local storage between page loads) while this is unchanged
+    private _deviceTypeInfoVersion: number | null = null;
+    private DEVICE_TYPE_INFO_STORAGE_KEY = "deviceTypeInfoCache";
+
+    // Device type requests in progress (so only one request is made for each type)
+    private _pendingDeviceTypeRequests: { [deviceType: string]: Promise<DeviceTypeInfo> } = {};
+
     // Test device type data
     private _testDeviceTypeRecs: DeviceTypeInfoTestJsonFile | null = null;
     private _testDataGen = new TestDataGen();
@@ -250,6 +258,12 @@ export class DeviceManager {
         // Iterate over the buses
         Object.entries(data).forEach(([busName, devices]) => {
 
+            // Check the device type info version before any type info is requested
+            const devTypeInfoVersion = (devices as unknown as { _tv?: number })._tv;
+            if (typeof devTypeInfoVersion === "number") {
+                this.checkDeviceTypeInfoVersion(devTypeInfoVersion);
+            }
+
             // Check for bus status info
             if (devices && typeof devices === "object" && "_s" in devices) {
                 // console.log(`DeviceManager bus status ${JSON.stringify(devices._s)}`);
@@ -313,8 +327,9 @@ export class DeviceManager {
                 // Iterate attribute groups
                 Object.entries(attrGroups).forEach(([attrGroupName, msgHexStr]) => {
 
-                    // Check valid
-                    if (attrGroupName.startsWith("_") || (typeof msgHexStr != 'string')) {
+                    // Check valid (poll groups other than the main one "x" are published under their own names
+                    // and aren't described by the resp schema so aren't decoded)
+                    if (attrGroupName.startsWith("_") || (typeof msgHexStr != 'string') || (attrGroupName !== "x")) {
                         return;
                     }
 
@@ -440,8 +455,23 @@ export class DeviceManager {
         if (deviceType in this._cachedDeviceTypeRecs) {
             return this._cachedDeviceTypeRecs[deviceType];
         }
-        
+
+        // Check if a request is already in progress
+        if (deviceType in this._pendingDeviceTypeRequests) {
+            return this._pendingDeviceTypeRequests[deviceType];
+        }
+
         // Get the device type info from the server
+        const request = this.fetchDeviceTypeInfo(busName, deviceType, emptyRec);
+        this._pendingDeviceTypeRequests[deviceType] = request;
+        try {
+            return await request;
+        } finally {
+            delete this._pendingDeviceTypeRequests[deviceType];
+        }
+    }
+
+    private async fetchDeviceTypeInfo(busName: string, deviceType: string, emptyRec: DeviceTypeInfo): Promise<DeviceTypeInfo> {
         try {
             const getDevTypeInfoResponse = await fetch(this._serverAddressPrefix + this._urlPrefix + "/devman/typeinfo?bus=" + busName + "&type=" + deviceType);
             if (!getDevTypeInfoResponse.ok) {
@@ -451,6 +481,7 @@ export class DeviceManager {
             const devTypeInfo = await getDevTypeInfoResponse.json();
             if ("devinfo" in devTypeInfo) {
                 this._cachedDeviceTypeRecs[deviceType] = devTypeInfo.devinfo;
+                this.storeCachedDeviceTypeInfo();
                 return devTypeInfo.devinfo;
             }
             return emptyRec;
@@ -460,6 +491,44 @@ export class DeviceManager {
         }
     }
 
+    ////////////////////////////////////////////////////////////////////////////
+    // Device type info version
+    ////////////////////////////////////////////////////////////////////////////
+
+    private checkDeviceTypeInfoVersion(version: number) {
+
+        // Cached type info is still valid if the version is unchanged
+        if (version === this._deviceTypeInfoVersion) {
+            return;
+        }
+        this._deviceTypeInfoVersion = version;
+
+        // Use type info stored for this version (e.g. before the page was reloaded) or discard the cache
+        this._cachedDeviceTypeRecs = {};
+        try {
+            const stored = JSON.parse(window.localStorage.getItem(this.DEVICE_TYPE_INFO_STORAGE_KEY) || "{}");
+            if (stored && (stored.version === version) && stored.recs && (typeof stored.recs === "object")) {
+                this._cachedDeviceTypeRecs = stored.recs;
+            }
+        } catch (error) {
+            console.warn(`DeviceManager checkDeviceTypeInfoVersion stored type info invalid ${error}`);
+        }
+    }
+
+    private storeCachedDeviceTypeInfo() {
+        if (this._deviceTypeInfoVersion === null) {
+            return;
+        }
+        try {
+            window.localStorage.setItem(this.DEVICE_TYPE_INFO_STORAGE_KEY, JSON.stringify({
+                version: this._deviceTypeInfoVersion,
+                recs: this._cachedDeviceTypeRecs
+            }));
+        } catch (error) {
+            console.warn(`DeviceManager storeCachedDeviceTypeInfo failed ${error}`);
+        }
+    }
+
     ////////////////////////////////////////////////////////////////////////////
     // Send action to device
     ////////////////////////////////////////////////////////////////////////////
@@ -24,13 +24,15 @@
 // #define DEBUG_POLL_TIME_FOR_ADDR 0x1d
 // #define DEBUG_I2C_LENGTH_MISMATCH_WITH_BUTTON_GPIO_NUM 5
 // #define DEBUG_ADD_TO_QUEUED_REC_FIFO
+// #define DEBUG_POLL_SCHEDULER_JITTER_STATS
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Constructor and destructor
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-BusAccessor::BusAccessor(RaftBus& raftBus, BusReqAsyncFn busI2CReqAsyncFn) :
+BusAccessor::BusAccessor(RaftBus& raftBus, BusReqAsyncFn busI2CReqAsyncFn, BusPollScheduler* pPollScheduler) :
         _raftBus(raftBus),
+        _pPollScheduler(pPollScheduler),
         _busI2CReqAsyncFn(busI2CReqAsyncFn)
 {
     // Create the mutex for the polling list
@@ -53,10 +55,29 @@ void BusAccessor::setup(const RaftJsonIF& config)
     // Setup
     _lowLoadBus = config.getLong("lowLoad", 0) != 0;
 
+    // Request lanes
+    getAddrList(config, "reqHighPriAddrs", _highPriAddrs);
+    String laneService = config.getString("reqLaneService", "strict");
+    _reqLaneWeighted = laneService.equalsIgnoreCase("weighted");
+    _reqLaneWeight = config.getLong("reqLaneWeight", REQ_LANE_WEIGHT_DEFAULT);
+    if (_reqLaneWeight == 0)
+        _reqLaneWeight = 1;
+    _reqPreemptScan = config.getBool("reqPreemptScan", false);
+
+    // Direct completion (results delivered on the I2C task rather than through the response queue)
+    _reqDirectCompletionAll = config.getBool("reqDirectCompletion", false);
+    getAddrList(config, "reqDirectAddrs", _reqDirectCompletionAddrs);
+
+    // Poll scheduler "rr" (round-robin), "edf" (earliest-deadline-first) or "unified" (shared with ident polls)
+    String pollScheduler = config.getString("pollScheduler", "rr");
+    pollScheduler.toLowerCase();
+
     // Obtain semaphore to polling vector
     if (xSemaphoreTake(_pollingMutex, pdMS_TO_TICKS(10)) == pdTRUE)
     {
-        _scheduler.clear();
+        _useEDFScheduler = pollScheduler == "edf";
+        _useSharedScheduler = (pollScheduler == "unified") && _pPollScheduler;
+        rebuildScheduler();
         xSemaphoreGive(_pollingMutex);
     }
 }
@@ -69,7 +90,7 @@ void BusAccessor::loop()
 {
     // Stats
     _raftBus.getBusStats().respQueueCount(_responseQueue.count());
-    _raftBus.getBusStats().reqQueueCount(_requestQueue.count());
+    _raftBus.getBusStats().reqQueueCount(_requestQueues[REQ_LANE_HIGH].count() + _requestQueues[REQ_LANE_NORMAL].count());
 
     // See if there are any results awaiting callback
     for (uint32_t i = 0; i < RESPONSE_FIFO_SLOTS; i++)
@@ -120,6 +141,9 @@ void BusAccessor::clear(bool incPolling)
         {
             // Clear all lists
             _scheduler.clear();
+            _schedulerEDF.clear();
+            if (_pPollScheduler)
+                _pPollScheduler->removeMatching(BusPollScheduler::POLL_KEY_POLL_LIST_FLAG, BusPollScheduler::POLL_KEY_POLL_LIST_FLAG);
             _pollingVector.clear();
 
             // Return semaphore
@@ -131,52 +155,76 @@ void BusAccessor::clear(bool incPolling)
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Process request queue
 // Called from thread function in BusI2C
+// High lane requests are sent first (up to a limit per call) and then a normal lane request if the
+// lane service allows it
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 void BusAccessor::processRequestQueue(bool isPaused)
 {
-    // Get from request FIFO
-    BusRequestInfo reqRec;
-    if (_requestQueue.get(reqRec))
+    // High lane
+    QueuedRequest queuedReq;
+    uint32_t highLaneMax = _reqLaneWeighted ? _reqLaneWeight : REQ_HIGH_LANE_MAX_PER_LOOP;
+    for (uint32_t i = 0; i < highLaneMax; i++)
     {
+        if (!_requestQueues[REQ_LANE_HIGH].get(queuedReq))
+            break;
+        sendQueuedRequest(queuedReq, REQ_LANE_HIGH, isPaused);
+    }
+
+    // Normal lane (with strict service only when the high lane is empty)
+    if (!_reqLaneWeighted && (_requestQueues[REQ_LANE_HIGH].count() > 0))
+        return;
+    if (_requestQueues[REQ_LANE_NORMAL].get(queuedReq))
+        sendQueuedRequest(queuedReq, REQ_LANE_NORMAL, isPaused);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Send a request from the request queue
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BusAccessor::sendQueuedRequest(QueuedRequest& queuedReq, RequestLane lane, bool isPaused)
+{
+    BusRequestInfo& reqRec = queuedReq.reqRec;
+
 #ifdef DEBUG_REQ_QUEUE_COMMANDS
-        // Address and slot
-        BusElemAddrType address = reqRec.getAddress();
-        // Debug
-        String writeDataStr;
-        Raft::getHexStrFromBytes(reqRec.getWriteData(), reqRec.getWriteDataLen(), writeDataStr);
-        LOG_I(MODULE_PREFIX, "i2cWorkerTask reqQ got addr@slotNum %s write %s", 
-                    BusI2CAddrAndSlot::toString(address).c_str(), writeDataStr.c_str());
+    // Address and slot
+    BusElemAddrType address = reqRec.getAddress();
+    // Debug
+    String writeDataStr;
+    Raft::getHexStrFromBytes(reqRec.getWriteData(), reqRec.getWriteDataLen(), writeDataStr);
+    LOG_I(MODULE_PREFIX, "i2cWorkerTask reqQ got addr@slotNum %s lane %d write %s", 
+                BusI2CAddrAndSlot::toString(address).c_str(), lane, writeDataStr.c_str());
 #endif
 
-        // Debug one address only
+    // Debug one address only
 #ifdef DEBUG_REQ_QUEUE_ONE_ADDR
-        if (BusI2CAddrAndSlot::getI2CAddr(address) != DEBUG_REQ_QUEUE_ONE_ADDR)
-            return;
+    if (BusI2CAddrAndSlot::getI2CAddr(address) != DEBUG_REQ_QUEUE_ONE_ADDR)
+        return;
 #endif
 
-        // Check if paused
-        if (isPaused)
+    // Check if paused
+    if (isPaused)
+    {
+        // Check is firmware update
+        if (reqRec.isFWUpdate() || (reqRec.getBusReqType() == BUS_REQ_TYPE_SEND_IF_PAUSED))
         {
-            // Check is firmware update
-            if (reqRec.isFWUpdate() || (reqRec.getBusReqType() == BUS_REQ_TYPE_SEND_IF_PAUSED))
-            {
-                // Make the request
-                _busI2CReqAsyncFn(&reqRec, 0);
-                // LOG_I(MODULE_PREFIX, "worker sending fw len %d", reqRec.getWriteDataLen());
-            }
-            else
-            {
-                // Debug
-                // LOG_I(MODULE_PREFIX, "worker not sending as paused");
-            }
+            // Make the request
+            _busI2CReqAsyncFn(&reqRec, 0);
+            // LOG_I(MODULE_PREFIX, "worker sending fw len %d", reqRec.getWriteDataLen());
         }
         else
         {
-            // Make the request
-            _busI2CReqAsyncFn(&reqRec, 0);
+            // Debug
+            // LOG_I(MODULE_PREFIX, "worker not sending as paused");
         }
+        return;
     }
+
+    // Latency
+    _reqLaneLatency[lane].record(micros() - queuedReq.queuedUs);
+
+    // Make the request
+    _busI2CReqAsyncFn(&reqRec, 0);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -190,51 +238,96 @@ void BusAccessor::processPolling()
     if (xSemaphoreTake(_pollingMutex, 0) == pdTRUE)
     {
         // Get the next element to poll
-        int pollListIdx = _scheduler.getNext();
+        int pollListIdx = _useEDFScheduler ? _schedulerEDF.getNext(micros()) : _scheduler.getNext();
         if (pollListIdx >= 0)
-        {
-            // Check valid - if list is empty or has shrunk this test can fail
-            // Polling can be suspended if too many failures occur
-            BusRequestInfo* pReqRec = NULL;
-            if ((pollListIdx < _pollingVector.size()) &&
-                            (_pollingVector[pollListIdx].suspendCount < MAX_CONSEC_FAIL_POLLS_BEFORE_SUSPEND))
-            {
-                // Get request details
-                pReqRec = &_pollingVector[pollListIdx].pollReq;
-            }
+            pollEntry(pollListIdx);
 
-            // Check ready to poll
-            if (pReqRec)
-            {
-                // Debug poll timing
-#ifdef DEBUG_POLL_TIME_FOR_ADDR
-                BusElemAddrType address = pReqRec->getAddress();
-                if (pReqRec->isPolling() && (BusI2CAddrAndSlot::getI2CAddr(address) == DEBUG_POLL_TIME_FOR_ADDR))
-                {
-                    LOG_I(MODULE_PREFIX, "i2cWorker polling addr@slotNum %s elapsed %ld", 
-                                BusI2CAddrAndSlot::toString(address).c_str(), 
-                                Raft::timeElapsed(millis(), _debugLastPollTimeMs));
-                    _debugLastPollTimeMs = millis();
-                }
+#ifdef DEBUG_POLL_SCHEDULER_JITTER_STATS
+        debugReportJitterStats();
 #endif
-                // Send poll request
-                RaftRetCode sendResult = _busI2CReqAsyncFn(pReqRec, pollListIdx);
-                // Check for failed send and not barred temporarily
-                if ((sendResult != RAFT_OK) && (sendResult != RAFT_BUS_BARRED))
-                {
-                    // Increment the suspend count if required
-                    if (pollListIdx < _pollingVector.size())
-                        if (_pollingVector[pollListIdx].suspendCount < MAX_CONSEC_FAIL_POLLS_BEFORE_SUSPEND)
-                            _pollingVector[pollListIdx].suspendCount++;
-                }
-            }
-        }
 
         // Free the semaphore
         xSemaphoreGive(_pollingMutex);
     }
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Process a specific polling list entry
+// Called from thread function in BusI2C when the shared poll scheduler is in use
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BusAccessor::processPollingEntry(uint32_t pollListIdx)
+{
+    // Obtain semaphore to polling vector
+    if (xSemaphoreTake(_pollingMutex, 0) == pdTRUE)
+    {
+        pollEntry(pollListIdx);
+
+        // Free the semaphore
+        xSemaphoreGive(_pollingMutex);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Poll an entry in the polling list
+// Assumes polling mutex already taken
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BusAccessor::pollEntry(int pollListIdx)
+{
+    // Check valid - if list is empty or has shrunk this test can fail
+    // Polling can be suspended if too many failures occur
+    BusRequestInfo* pReqRec = NULL;
+    if ((pollListIdx < _pollingVector.size()) &&
+                    (_pollingVector[pollListIdx].suspendCount < MAX_CONSEC_FAIL_POLLS_BEFORE_SUSPEND))
+    {
+        // Get request details
+        pReqRec = &_pollingVector[pollListIdx].pollReq;
+    }
+
+    // Check ready to poll
+    if (pReqRec)
+    {
+        // Debug poll timing
+#ifdef DEBUG_POLL_TIME_FOR_ADDR
+        BusElemAddrType address = pReqRec->getAddress();
+        if (pReqRec->isPolling() && (BusI2CAddrAndSlot::getI2CAddr(address) == DEBUG_POLL_TIME_FOR_ADDR))
+        {
+            LOG_I(MODULE_PREFIX, "i2cWorker polling addr@slotNum %s elapsed %ld", 
+                        BusI2CAddrAndSlot::toString(address).c_str(), 
+                        Raft::timeElapsed(millis(), _debugLastPollTimeMs));
+            _debugLastPollTimeMs = millis();
+        }
+#endif
+        // Send poll request
+        RaftRetCode sendResult = _busI2CReqAsyncFn(pReqRec, pollListIdx);
+        // Check for failed send and not barred temporarily
+        if ((sendResult != RAFT_OK) && (sendResult != RAFT_BUS_BARRED))
+        {
+            // Increment the suspend count if required
+            if (pollListIdx < _pollingVector.size())
+                if (_pollingVector[pollListIdx].suspendCount < MAX_CONSEC_FAIL_POLLS_BEFORE_SUSPEND)
+                    _pollingVector[pollListIdx].suspendCount++;
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get time until next poll is due
+// Called from thread function in BusI2C
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t BusAccessor::getMsUntilPollDue(uint32_t curTimeMs)
+{
+    // Obtain semaphore to polling vector - if not available then the list is being changed so poll soon
+    if (xSemaphoreTake(_pollingMutex, 0) != pdTRUE)
+        return 0;
+    uint32_t msUntilDue = _useEDFScheduler ? _schedulerEDF.getMsUntilNextDue(micros()) : 
+                    _scheduler.getMsUntilNextDue(curTimeMs);
+    xSemaphoreGive(_pollingMutex);
+    return msUntilDue;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Handle response to I2C request
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -282,6 +375,14 @@ void BusAccessor::handleResponse(const BusRequestInfo* pReqRec, RaftRetCode send
             // LOG_D(MODULE_PREFIX, "loop retval %d", reqResult.isResultOk());
         }
     }
+    else if (isDirectCompletion(pReqRec->getAddress()))
+    {
+        // Deliver the result now (on the I2C task)
+        _raftBus.getBusStats().cmdComplete();
+        BusRequestCallbackType callback = reqResult.getCallback();
+        if (callback)
+            callback(reqResult.getCallbackParam(), reqResult);
+    }
     else
     {
         // Add to the response queue
@@ -371,11 +472,7 @@ bool BusAccessor::addToPollingList(BusRequestInfo& busReqInfo)
 
         // Update scheduler with the polling list if required
         if (addedOk)
-        {
-            _scheduler.clear();
-            for (PollingVectorItem& pollItem : _pollingVector)
-                _scheduler.addNode(pollItem.pollReq.getPollFreqHz());
-        }
+            rebuildScheduler();
 
         // Return semaphore
         xSemaphoreGive(_pollingMutex);
@@ -384,6 +481,54 @@ bool BusAccessor::addToPollingList(BusRequestInfo& busReqInfo)
     return false;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Rebuild the active scheduler from the polling list
+// Assumes polling mutex already taken
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BusAccessor::rebuildScheduler()
+{
+    _scheduler.clear();
+    _schedulerEDF.clear();
+    if (_pPollScheduler)
+        _pPollScheduler->removeMatching(BusPollScheduler::POLL_KEY_POLL_LIST_FLAG, BusPollScheduler::POLL_KEY_POLL_LIST_FLAG);
+    uint64_t timeNowUs = micros();
+    for (uint32_t i = 0; i < _pollingVector.size(); i++)
+    {
+        double pollFreqHz = _pollingVector[i].pollReq.getPollFreqHz();
+        if (_useSharedScheduler)
+            _pPollScheduler->addOrUpdate(BusPollScheduler::pollListKey(i), 
+                        pollFreqHz > 0 ? (uint64_t)(1000000.0 / pollFreqHz) : POLL_LIST_DEFAULT_INTERVAL_US,
+                        BusPollScheduler::POLL_PRIORITY_LOW, timeNowUs);
+        else if (_useEDFScheduler)
+            _schedulerEDF.addNode(pollFreqHz, timeNowUs);
+        else
+            _scheduler.addNode(pollFreqHz);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Debug report of EDF scheduler jitter statistics
+// Assumes polling mutex already taken
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BusAccessor::debugReportJitterStats()
+{
+    if (!_useEDFScheduler || !Raft::isTimeout(millis(), _debugLastJitterReportMs, 10000))
+        return;
+    _debugLastJitterReportMs = millis();
+    for (uint32_t i = 0; i < _pollingVector.size(); i++)
+    {
+        uint32_t pollCount = 0, avgLateUs = 0, maxLateUs = 0, missedCount = 0;
+        if (!_schedulerEDF.getJitterStats(i, pollCount, avgLateUs, maxLateUs, missedCount))
+            continue;
+        LOG_I(MODULE_PREFIX, "jitterStats addr@slotNum %s pollCount %d avgLateUs %d maxLateUs %d missed %d",
+                    BusI2CAddrAndSlot::toString(_pollingVector[i].pollReq.getAddress()).c_str(),
+                    pollCount, avgLateUs, maxLateUs, missedCount);
+    }
+    _schedulerEDF.clearJitterStats();
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Add to the queued request FIFO
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -393,8 +538,12 @@ bool BusAccessor::addToQueuedReqFIFO(BusRequestInfo& reqRec)
     // Result
     bool retc = false;
 
-    // Send to the request FIFO
-    retc = _requestQueue.put(reqRec, ADD_REQ_TO_QUEUE_MAX_MS);
+    // Send to the request FIFO for the lane
+    RequestLane lane = getRequestLane(reqRec);
+    QueuedRequest queuedReq;
+    queuedReq.reqRec = reqRec;
+    queuedReq.queuedUs = micros();
+    retc = _requestQueues[lane].put(queuedReq, ADD_REQ_TO_QUEUE_MAX_MS);
 
 #ifdef DEBUG_ADD_TO_QUEUED_REC_FIFO
     // Debug
@@ -413,9 +562,9 @@ bool BusAccessor::addToQueuedReqFIFO(BusRequestInfo& reqRec)
 #ifdef WARN_ON_REQUEST_BUFFER_FULL
         if (Raft::isTimeout(millis(), _reqBufferFullLastWarnMs, BETWEEN_BUF_FULL_WARNINGS_MIN_MS))
         {
-            int msgsWaiting = _requestQueue.count();
-            LOG_W(MODULE_PREFIX, "addToQueuedReqFIFO %s req buffer full - waiting %d", 
-                    _raftBus.getBusName().c_str(), msgsWaiting
+            int msgsWaiting = _requestQueues[lane].count();
+            LOG_W(MODULE_PREFIX, "addToQueuedReqFIFO %s req buffer full - lane %d waiting %d", 
+                    _raftBus.getBusName().c_str(), lane, msgsWaiting
                 );
             _reqBufferFullLastWarnMs = millis();
         }
@@ -424,3 +573,40 @@ bool BusAccessor::addToQueuedReqFIFO(BusRequestInfo& reqRec)
 
     return retc;
 }
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get the lane for a queued request
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BusAccessor::RequestLane BusAccessor::getRequestLane(const BusRequestInfo& busReqInfo) const
+{
+    for (BusElemAddrType highPriAddr : _highPriAddrs)
+    {
+        if (highPriAddr == busReqInfo.getAddress())
+            return REQ_LANE_HIGH;
+    }
+    return REQ_LANE_NORMAL;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get debug JSON
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+String BusAccessor::getDebugJSON() const
+{
+    return "{\"hi\":" + _reqLaneLatency[REQ_LANE_HIGH].getJSON() + 
+                ",\"norm\":" + _reqLaneLatency[REQ_LANE_NORMAL].getJSON() + "}";
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get a list of addresses from config (an array of strings in hex or decimal with the slot in bits 8+)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BusAccessor::getAddrList(const RaftJsonIF& config, const char* pKey, std::vector<BusElemAddrType>& addrList)
+{
+    addrList.clear();
+    std::vector<String> addrStrs;
+    config.getArrayElems(pKey, addrStrs);
+    for (const String& addrStr : addrStrs)
+        addrList.push_back(strtoul(addrStr.c_str(), nullptr, 0));
+}
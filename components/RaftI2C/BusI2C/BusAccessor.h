@@ -12,14 +12,19 @@
 #include "RaftThreading.h"
 #include "RaftBus.h"
 #include "BusI2CScheduler.h"
+#include "BusI2CSchedulerEDF.h"
+#include "BusPollScheduler.h"
 #include "ThreadSafeQueue.h"
 #include "BusRequestResult.h"
 #include "RaftI2CCentralIF.h"
+#include "BusI2CLatencyHistogram.h"
+#include "BusI2CMemPlacement.h"
 
 class BusAccessor {
 public:
     // Constructor and destructor
-    BusAccessor(RaftBus& raftBus, BusReqAsyncFn busI2CReqAsyncFn);
+    // If a poll scheduler is provided it can be selected (in config) to schedule the polling list
+    BusAccessor(RaftBus& raftBus, BusReqAsyncFn busI2CReqAsyncFn, BusPollScheduler* pPollScheduler = nullptr);
     ~BusAccessor();
 
     // Setup and loop
@@ -39,6 +44,30 @@ public:
     // Polling
     void processPolling();
 
+    // Poll a specific polling list entry (when the shared poll scheduler has determined it is due)
+    void processPollingEntry(uint32_t pollListIdx);
+
+    // Check if a queued request is waiting
+    bool isRequestPending()
+    {
+        for (auto& requestQueue : _requestQueues)
+            if (requestQueue.count() > 0)
+                return true;
+        return false;
+    }
+
+    // Check if a scan step should be cut short as a high priority request is waiting (if configured)
+    bool isScanPreemptRequired()
+    {
+        return _reqPreemptScan && (_requestQueues[REQ_LANE_HIGH].count() > 0);
+    }
+
+    // Get debug JSON (request latency per lane)
+    String getDebugJSON() const;
+
+    // Get time in ms until the next poll is due (UINT32_MAX if nothing to poll)
+    uint32_t getMsUntilPollDue(uint32_t curTimeMs);
+
 private:
     // Bus base
     RaftBus& _raftBus;
@@ -61,17 +90,59 @@ private:
     };
 
     // Polling vector and mutex controlling access
-    std::vector<PollingVectorItem> _pollingVector;
+    std::vector<PollingVectorItem, BusI2CBulkAllocator<PollingVectorItem>> _pollingVector;
     SemaphoreHandle_t _pollingMutex = nullptr;
     static const int MAX_POLLING_LIST_RECS = 30;
     static const int MAX_POLLING_LIST_RECS_LOW_LOAD = 4;
     static const int MAX_CONSEC_FAIL_POLLS_BEFORE_SUSPEND = 2;
+    static const uint64_t POLL_LIST_DEFAULT_INTERVAL_US = 1000000;
 
     // Polling and queued requests
     static const int REQUEST_FIFO_SLOTS = 40;
     static const int REQUEST_FIFO_SLOTS_LOW_LOAD = 3;
     static const uint32_t ADD_REQ_TO_QUEUE_MAX_MS = 2;
-    ThreadSafeQueue<BusRequestInfo> _requestQueue;
+
+    // Queued requests are in priority lanes - requests to addresses in reqHighPriAddrs are in the high lane
+    // The high lane is served first - "strict" service only serves the normal lane when the high lane is empty
+    // and "weighted" service serves one normal request after every reqLaneWeight high requests
+    enum RequestLane
+    {
+        REQ_LANE_HIGH,
+        REQ_LANE_NORMAL,
+        REQ_LANE_COUNT
+    };
+    class QueuedRequest
+    {
+    public:
+        BusRequestInfo reqRec;
+        uint64_t queuedUs = 0;
+    };
+    ThreadSafeQueue<QueuedRequest> _requestQueues[REQ_LANE_COUNT];
+    std::vector<BusElemAddrType> _highPriAddrs;
+    bool _reqLaneWeighted = false;
+    uint32_t _reqLaneWeight = REQ_LANE_WEIGHT_DEFAULT;
+    bool _reqPreemptScan = false;
+    static const uint32_t REQ_LANE_WEIGHT_DEFAULT = 4;
+    static const uint32_t REQ_HIGH_LANE_MAX_PER_LOOP = 8;
+
+    // Latency (time from queueing to sending) for each lane
+    BusI2CLatencyHistogram _reqLaneLatency[REQ_LANE_COUNT];
+
+    // Direct completion - results of queued requests (to addresses in reqDirectAddrs or all requests if
+    // reqDirectCompletion is set) are delivered by calling the request's callback on the I2C task as soon as
+    // the transaction completes (rather than through the response queue which is serviced from loop()) so
+    // these callbacks must be short and must not block
+    bool _reqDirectCompletionAll = false;
+    std::vector<BusElemAddrType> _reqDirectCompletionAddrs;
+    bool isDirectCompletion(BusElemAddrType address) const
+    {
+        if (_reqDirectCompletionAll)
+            return true;
+        for (BusElemAddrType directAddr : _reqDirectCompletionAddrs)
+            if (directAddr == address)
+                return true;
+        return false;
+    }
 
     // Response FIFO
     static const int RESPONSE_FIFO_SLOTS = 40;
@@ -84,8 +155,12 @@ private:
     uint32_t _respBufferFullLastWarnMs = 0;
     uint32_t _reqBufferFullLastWarnMs = 0;
 
-    // Scheduling helper
+    // Scheduling helpers - round-robin (default), earliest-deadline-first or the shared poll scheduler
     BusI2CScheduler _scheduler;
+    BusI2CSchedulerEDF _schedulerEDF;
+    bool _useEDFScheduler = false;
+    BusPollScheduler* _pPollScheduler = nullptr;
+    bool _useSharedScheduler = false;
 
     // Bus i2c request function
     BusReqAsyncFn _busI2CReqAsyncFn = nullptr;
@@ -95,10 +170,17 @@ private:
 
     // Debug
     uint32_t _debugLastPollTimeMs = 0;
+    uint32_t _debugLastJitterReportMs = 0;
 
     // Helpers
     bool addToPollingList(BusRequestInfo& busReqInfo);
     bool addToQueuedReqFIFO(BusRequestInfo& busReqInfo);
+    RequestLane getRequestLane(const BusRequestInfo& busReqInfo) const;
+    static void getAddrList(const RaftJsonIF& config, const char* pKey, std::vector<BusElemAddrType>& addrList);
+    void sendQueuedRequest(QueuedRequest& queuedReq, RequestLane lane, bool isPaused);
+    void rebuildScheduler();
+    void pollEntry(int pollListIdx);
+    void debugReportJitterStats();
 
     // Debug
     static constexpr const char* MODULE_PREFIX = "RaftI2CBusAccessor";    
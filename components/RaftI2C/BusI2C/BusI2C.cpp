@@ -13,6 +13,7 @@
 #include "RaftJsonPrefixed.h"
 #include "esp_task_wdt.h"
 #include "BusI2CConsts.h"
+#include "BusI2CMemPlacement.h"
 
 #if defined(I2C_USE_RAFT_I2C)
 #include "RaftI2CCentral.h"
@@ -39,32 +40,46 @@
 // #define DEBUG_BUS_HIATUS
 // #define DEBUG_LOOP_TIMING_WITH_GPIO_NUM 19
 
+// Number of buses setup (used to assign default task cores)
+uint32_t BusI2C::_numBusesSetup = 0;
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Constructor
 BusI2C::BusI2C(BusElemStatusCB busElemStatusCB, BusOperationStatusCB busOperationStatusCB,
                 RaftI2CCentralIF* pI2CCentralIF)
     : RaftBus(busElemStatusCB, busOperationStatusCB),
-        _busStatusMgr(*this),
+        _busStatusMgr(*this, &_pollScheduler, &_syncSample),
         _busPowerController(
             std::bind(&BusI2C::i2cSendSync, this, std::placeholders::_1, std::placeholders::_2)
         ),
         _busStuckHandler(
-            std::bind(&BusI2C::i2cSendSync, this, std::placeholders::_1, std::placeholders::_2)
+            std::bind(&BusI2C::i2cSendSync, this, std::placeholders::_1, std::placeholders::_2),
+            std::bind(&BusI2C::i2cBusRecoveryClocking, this, std::placeholders::_1, std::placeholders::_2)
         ),
         _busMultiplexers(_busPowerController, _busStuckHandler, _busStatusMgr, _busElemTracker,
             std::bind(&BusI2C::i2cSendSync, this, std::placeholders::_1, std::placeholders::_2)
         ),
         _deviceIdentMgr(_busStatusMgr,
-            std::bind(&BusI2C::i2cSendSync, this, std::placeholders::_1, std::placeholders::_2)
+            std::bind(&BusI2C::i2cSendSync, this, std::placeholders::_1, std::placeholders::_2),
+            std::bind(&BusI2C::getDebugJSON, this, std::placeholders::_1)
         ),
         _busScanner(_busStatusMgr, _busElemTracker, _busMultiplexers, _busPowerController, _deviceIdentMgr,
-            std::bind(&BusI2C::i2cSendSync, this, std::placeholders::_1, std::placeholders::_2) 
+            std::bind(&BusI2C::i2cSendSync, this, std::placeholders::_1, std::placeholders::_2),
+            std::bind(&BusI2C::i2cProbeBurst, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3,
+                        std::placeholders::_4),
+            &_topologyCache, &_clockSpeeds, &_accessTiming,
+            std::bind(&BusAccessor::isScanPreemptRequired, &_busAccessor)
         ),
         _devicePollingMgr(_busStatusMgr, _busMultiplexers,
-            std::bind(&BusI2C::i2cSendSync, this, std::placeholders::_1, std::placeholders::_2)
+            std::bind(&BusI2C::i2cSendSync, this, std::placeholders::_1, std::placeholders::_2),
+            std::bind(&BusI2C::i2cSendSyncBatch, this, std::placeholders::_1, std::placeholders::_2,
+                        std::placeholders::_3, std::placeholders::_4, std::placeholders::_5),
+            &_syncSample,
+            std::bind(&BusI2C::i2cSendGeneralCall, this, std::placeholders::_1, std::placeholders::_2)
         ),
         _busAccessor(*this,
-            std::bind(&BusI2C::i2cSendAsync, this, std::placeholders::_1, std::placeholders::_2)
+            std::bind(&BusI2C::i2cSendAsync, this, std::placeholders::_1, std::placeholders::_2),
+            &_pollScheduler
         )
 {
     // Init
@@ -124,8 +139,10 @@ bool BusI2C::setup(const RaftJsonIF& config)
     _sclPin = ConfigPinMap::getPinFromName(pinName.c_str());
     _freq = config.getLong("i2cFreq", 100000);
     _i2cFilter = config.getLong("i2cFilter", RaftI2CCentralIF::DEFAULT_BUS_FILTER_LEVEL);
+    _i2cBlockingWait = config.getBool("i2cBlockingWait", false);
     _busName = config.getString("name", "");
-    UBaseType_t taskCore = config.getLong("taskCore", DEFAULT_TASK_CORE);
+    // Task core defaults to one per bus so that two buses run in parallel on multi-core chips
+    UBaseType_t taskCore = config.getLong("taskCore", getDefaultTaskCore(_numBusesSetup++));
     BaseType_t taskPriority = config.getLong("taskPriority", DEFAULT_TASK_PRIORITY);
     int taskStackSize = config.getLong("taskStack", DEFAULT_TASK_STACK_SIZE_BYTES);
 
@@ -134,8 +151,40 @@ bool BusI2C::setup(const RaftJsonIF& config)
     _loopFastUnyieldUs = config.getLong("fastScanMaxUnyieldMs", I2C_BUS_FAST_MAX_UNYIELD_DEFAUT_MS) * 1000;
     _loopSlowUnyieldUs = config.getLong("slowScanMaxUnyieldMs", I2C_BUS_SLOW_MAX_UNYIELD_DEFAUT_MS) * 1000;
 
-    // Bus status manager
+    // Loop mode - "yield" (fixed yield on each loop) or "event" (sleep until work is due or a request arrives)
+    _loopEventDriven = config.getString("loopMode", "yield").equalsIgnoreCase("event");
+    _loopEventMaxSleepMs = config.getLong("loopMaxSleepMs", I2C_BUS_LOOP_EVENT_MAX_SLEEP_MS);
+    _loopEventMaxUnyieldMs = config.getLong("loopMaxUnyieldMs", I2C_BUS_LOOP_EVENT_MAX_UNYIELD_MS);
+
+    // Poll budget
+    _pollBudgetUs = config.getLong("pollBudgetUs", I2C_BUS_POLL_BUDGET_DEFAULT_US);
+
+    // Memory placement (before anything allocates bulk buffers)
+    BusI2CMemPlacement::setup(config);
+
+    // Clock speeds
+    _clockSpeeds.setup(config, _freq);
+    _curAccessFreq = _freq;
+
+    // Access timing (learned timeouts)
+    _accessTiming.setup(config);
+    _curAccessOverheadUs = 0;
+
+    // Poll scheduler
+    _pollScheduler.clear();
+    _pollScheduler.setup(config);
+
+    // Loop stats
+    _loopStats.setup(config);
+
+    // Sync sample settings (before the bus status manager which uses them when registering ident polls)
+    RaftJsonPrefixed syncSampleConfig(config, "syncSample");
+    _syncSample.setup(syncSampleConfig);
+
+    // Bus status manager (the pending poll results ring is only allocated while the worker task isn't running)
     _busStatusMgr.setup(config);
+    if (_i2cWorkerTaskHandle == nullptr)
+        _busStatusMgr.allocPendingPollResults();
 
     // Bus mux setup
     RaftJsonPrefixed busExtenderConfig(config, "mux");
@@ -145,18 +194,26 @@ bool BusI2C::setup(const RaftJsonIF& config)
     RaftJsonPrefixed busPowerConfig(config, "pwr");
     _busPowerController.setup(busPowerConfig);
 
-    // Bus stuck handler setup
-    _busStuckHandler.setup(config);
+    // Bus stuck handler setup (after the power controller as power cycle stage timeouts depend on its timing)
+    _busStuckHandler.setup(config, _busPowerController.getPowerCycleMaxMs());
 
     // Device ident manager
     _deviceIdentMgr.setup(config);
 
+    // Topology cache (before the bus scanner which uses it at startup)
+    _topologyCache.setup(config, _i2cPort, std::bind(&DeviceIdentMgr::getDevTypeInfoVersion, &_deviceIdentMgr));
+
     // Setup bus scanner
     _busScanner.setup(config);
 
     // Setup device polling manager
     _devicePollingMgr.setup(config); 
 
+    // Sync sample is a single high priority entry in the poll scheduler
+    if (_syncSample.isEnabled())
+        _pollScheduler.addOrUpdate(BusPollScheduler::POLL_KEY_SYNC_SAMPLE, _syncSample.getPeriodMs() * 1000ULL,
+                    BusPollScheduler::POLL_PRIORITY_HIGH, micros());
+
     // Setup bus accessor
     _busAccessor.setup(config);
 
@@ -181,6 +238,9 @@ bool BusI2C::setup(const RaftJsonIF& config)
         return false;
     }
 
+    // Set wait mode for bus accesses
+    _pI2CCentral->setBlockingWait(_i2cBlockingWait);
+
     // Run post-setup on the bus power controller
     _busPowerController.postSetup();
     
@@ -192,12 +252,16 @@ bool BusI2C::setup(const RaftJsonIF& config)
     _isPaused = false;
 
     // Start the worker task
+    _i2cWorkerTaskExitRequested = false;
     BaseType_t retc = pdPASS;
     if (_i2cWorkerTaskHandle == nullptr)
     {
+        // Task name includes the port so that tasks for each bus can be distinguished
+        char taskName[16];
+        snprintf(taskName, sizeof(taskName), "I2CTask%d", _i2cPort);
         retc = xTaskCreatePinnedToCore(
                     i2cWorkerTaskStatic,
-                    "I2CTask",             // task name
+                    taskName,                               // task name
                     taskStackSize,                          // stack size of task
                     this,                                   // parameter passed to task on execute
                     taskPriority,                           // priority
@@ -206,11 +270,13 @@ bool BusI2C::setup(const RaftJsonIF& config)
     }
 
     // Debug
-    LOG_I(MODULE_PREFIX, "setup %s(%d) name %s port %d SDA %d SCL %d FREQ %d FILTER %d portTICK_PERIOD_MS %d taskCore %d taskPriority %d stackBytes %d loopYieldMs %d fastUnyieldMs %d slowUnyieldMs %d",
+    LOG_I(MODULE_PREFIX, "setup %s(%d) name %s port %d SDA %d SCL %d FREQ %d FILTER %d blockingWait %d portTICK_PERIOD_MS %d taskCore %d taskPriority %d stackBytes %d loopMode %s loopYieldMs %d fastUnyieldMs %d slowUnyieldMs %d pollBudgetUs %d bulkInPSRAM %s",
                 (retc == pdPASS) ? "OK" : "FAILED", retc, _busName.c_str(), _i2cPort,
-                _sdaPin, _sclPin, _freq, _i2cFilter, 
+                _sdaPin, _sclPin, _freq, _i2cFilter, _i2cBlockingWait,
                 portTICK_PERIOD_MS, taskCore, taskPriority, taskStackSize,
-                _loopYieldMs, (uint32_t) (_loopFastUnyieldUs/1000), (uint32_t) (_loopSlowUnyieldUs/1000));
+                _loopEventDriven ? "event" : "yield",
+                _loopYieldMs, (uint32_t) (_loopFastUnyieldUs/1000), (uint32_t) (_loopSlowUnyieldUs/1000),
+                _pollBudgetUs, BusI2CMemPlacement::isBulkInPSRAM() ? "Y" : "N");
 
     // Ok
     return true;
@@ -222,7 +288,8 @@ void BusI2C::close()
 {
     if (_i2cWorkerTaskHandle != nullptr) 
     {
-        // Shutdown task
+        // Shutdown task (notification wakes the task if it is waiting for work)
+        _i2cWorkerTaskExitRequested = true;
         xTaskNotifyGive(_i2cWorkerTaskHandle);
         uint32_t waitStartMs = millis();
         while (!Raft::isTimeout(millis(), waitStartMs, WAIT_FOR_TASK_EXIT_MS))
@@ -245,6 +312,9 @@ void BusI2C::loop()
     // Service bus scanner
     _busScanner.loop();
 
+    // Service topology cache (saves changes)
+    _topologyCache.loop();
+
     // Service bus status change detection
     bool busIsStuck = _busStuckHandler.isStuck();
     _busStatusMgr.loop(busIsStuck ? false : (_pI2CCentral ? _pI2CCentral->isOperatingOk() : false));
@@ -296,7 +366,8 @@ void BusI2C::i2cWorkerTask()
 #endif
 
     _debugLastBusLoopMs = millis();
-    while (ulTaskNotifyTake(pdTRUE, 0) == 0)
+    _loopLastSleepMs = millis();
+    while (!_i2cWorkerTaskExitRequested)
     {
 #ifdef DEBUG_LOOP_TIMING_WITH_GPIO_NUM
         for (int ii = 0; ii < 5; ii++)
@@ -308,7 +379,7 @@ void BusI2C::i2cWorkerTask()
         }
 #endif        
         // Allow other tasks to run
-        vTaskDelay(pdMS_TO_TICKS(_loopYieldMs));
+        workerTaskWait();
 
 #ifdef DEBUG_LOOP_TIMING_WITH_GPIO_NUM
         digitalWrite(DEBUG_LOOP_TIMING_WITH_GPIO_NUM, 1);
@@ -342,6 +413,7 @@ void BusI2C::i2cWorkerTask()
 
         // Stats
         _busStats.activity();
+        _loopStats.loopStart();
 
         // Check pause status
         if ((_isPaused) && (!_pauseRequested))
@@ -360,16 +432,18 @@ void BusI2C::i2cWorkerTask()
 #ifndef DEBUG_NO_SCANNING
         if (!_isPaused)
         {
-            // Service bus scanner
-            if (_busScanner.isScanPending(curTimeMs))
+            // Service bus scanner (not started if high priority requests are waiting and may preempt it)
+            if (_busScanner.isScanPending(curTimeMs) && !_busAccessor.isScanPreemptRequired())
             {
                 _busScanner.taskService(curTimeUs, _loopFastUnyieldUs, _loopSlowUnyieldUs);
             }
         }
 #endif
+        _loopStats.phaseEnd(BusI2CLoopStats::LOOP_PHASE_SCAN);
 
         // Handle requests
         _busAccessor.processRequestQueue(_isPaused);
+        _loopStats.phaseEnd(BusI2CLoopStats::LOOP_PHASE_REQ_QUEUE);
 
         // Don't do any polling when paused
         if (_isPaused)
@@ -388,6 +462,7 @@ void BusI2C::i2cWorkerTask()
 
         // Bus mux loop
         _busMultiplexers.taskService();
+        _loopStats.phaseEnd(BusI2CLoopStats::LOOP_PHASE_MUX);
 
 #ifdef DEBUG_LOOP_TIMING_WITH_GPIO_NUM
         digitalWrite(DEBUG_LOOP_TIMING_WITH_GPIO_NUM, 1);
@@ -398,6 +473,7 @@ void BusI2C::i2cWorkerTask()
 
         // Bus power controller loop
         _busPowerController.taskService(micros());
+        _loopStats.phaseEnd(BusI2CLoopStats::LOOP_PHASE_POWER);
 
 #ifdef DEBUG_LOOP_TIMING_WITH_GPIO_NUM
         digitalWrite(DEBUG_LOOP_TIMING_WITH_GPIO_NUM, 1);
@@ -406,8 +482,9 @@ void BusI2C::i2cWorkerTask()
         delayMicroseconds(1);
 #endif
 
-        // Device polling
-        _devicePollingMgr.taskService(micros());
+        // Device ident polls (and the polling list if configured) from the poll scheduler
+        servicePollScheduler();
+        _loopStats.phaseEnd(BusI2CLoopStats::LOOP_PHASE_DEV_POLL);
 
 #ifdef DEBUG_LOOP_TIMING_WITH_GPIO_NUM
         digitalWrite(DEBUG_LOOP_TIMING_WITH_GPIO_NUM, 1);
@@ -416,9 +493,12 @@ void BusI2C::i2cWorkerTask()
         delayMicroseconds(1);
 #endif
 
-        // Perform any user-defined access
-        // TODO - remove or reconsider how polling works
+        // Polling list (user-defined polls) - with the unified poll scheduler these entries are polled by
+        // servicePollScheduler() above (the accessor's own schedulers are then empty so this does nothing),
+        // otherwise the next due entry from the accessor's EDF or interval scheduler is polled here
         _busAccessor.processPolling();
+        _loopStats.phaseEnd(BusI2CLoopStats::LOOP_PHASE_ACCESSOR_POLL);
+        _loopStats.loopEnd();
 
 #ifdef DEBUG_RAFT_BUSI2C_MEASURE_I2C_LOOP_TIME
         // Debug
@@ -443,6 +523,196 @@ void BusI2C::i2cWorkerTask()
     vTaskDelete(NULL);
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Wait in the worker task between loops
+/// @note In yield mode this is a fixed delay. In event mode the task sleeps until the next work is due
+///       or it is notified (by addRequest(), pause(), close(), etc)
+void BusI2C::workerTaskWait()
+{
+    // Fixed yield
+    if (!_loopEventDriven)
+    {
+        vTaskDelay(pdMS_TO_TICKS(_loopYieldMs));
+        return;
+    }
+
+    // Time until work is due
+    uint32_t waitMs = getMsUntilWorkDue(micros());
+
+    // Ensure lower priority tasks get to run if there has been work due for too long
+    uint32_t curTimeMs = millis();
+    if ((waitMs == 0) && Raft::isTimeout(curTimeMs, _loopLastSleepMs, _loopEventMaxUnyieldMs))
+        waitMs = 1;
+    if (waitMs == 0)
+        return;
+
+    // Wait for notification or timeout (rounded up to whole ticks)
+    ulTaskNotifyTake(pdTRUE, (waitMs + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS);
+    _loopLastSleepMs = millis();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get time until the worker task has work to do
+/// @param curTimeUs - current time in us
+/// @return time in ms until work is due (0 if work is due now)
+uint32_t BusI2C::getMsUntilWorkDue(uint64_t curTimeUs)
+{
+    uint32_t curTimeMs = curTimeUs / 1000;
+    uint32_t waitMs = _loopEventMaxSleepMs;
+
+    // Hiatus
+    if (_hiatusActive)
+    {
+        uint32_t elapsedMs = Raft::timeElapsed(curTimeMs, _hiatusStartMs);
+        return elapsedMs > _hiatusForMs ? 0 : std::min(waitMs, _hiatusForMs - elapsedMs + 1);
+    }
+
+    // Queued requests and changes to pause state
+    if (_busAccessor.isRequestPending() || (_isPaused != _pauseRequested))
+        return 0;
+
+    // Nothing else to do when paused
+    if (_isPaused)
+        return waitMs;
+
+    // Power sequencing, scanning, scheduled polls and queued polls
+    waitMs = std::min(waitMs, _busPowerController.getMsUntilStateChange(curTimeMs));
+    if (waitMs > 0)
+        waitMs = std::min(waitMs, _busScanner.getMsUntilScanDue(curTimeMs));
+    if (waitMs > 0)
+        waitMs = std::min(waitMs, _pollScheduler.getMsUntilNextDue(curTimeUs));
+    if (waitMs > 0)
+        waitMs = std::min(waitMs, _devicePollingMgr.getMsUntilSyncReadoutDue(curTimeUs));
+    if (waitMs > 0)
+        waitMs = std::min(waitMs, _busAccessor.getMsUntilPollDue(curTimeMs));
+    return waitMs;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Service polls which are due from the poll scheduler
+/// @note Polls are performed (highest priority and earliest deadline first) until the bus time budget for
+///       this loop is used - at least one due poll is always performed. With slot affinity the due polls are
+///       collected first (using the estimated bus time of each for the budget) and then performed grouped by slot
+///       so each slot is only enabled once (groups are in order of the highest priority poll in each). A sync
+///       sample readout which is due is performed first and uses the budget before any other polls
+void BusI2C::servicePollScheduler()
+{
+    uint64_t budgetStartUs = micros();
+    uint64_t budgetUsedUs = 0;
+
+    // Sync sample readout (spread over loops if it exceeds the budget)
+    if (_devicePollingMgr.isSyncReadoutDue(budgetStartUs))
+    {
+        budgetUsedUs = _devicePollingMgr.syncReadout(budgetStartUs, _pollBudgetUs);
+        if (budgetUsedUs >= _pollBudgetUs)
+            return;
+    }
+
+    // Without slot affinity perform each poll as it is found
+    if (!_devicePollingMgr.isSlotAffinity())
+    {
+        for (uint32_t i = 0; i < I2C_BUS_MAX_POLLS_PER_LOOP; i++)
+        {
+            DuePoll& duePoll = _duePolls[0];
+            uint32_t budgetRemainingUs = (i == 0) && (budgetUsedUs == 0) ? UINT32_MAX : _pollBudgetUs - budgetUsedUs;
+            if (!_pollScheduler.getNextDue(micros(), budgetRemainingUs, duePoll.pollKey, duePoll.pollHandle,
+                        nullptr, &duePoll.isQuarantined))
+                break;
+            performDuePoll(duePoll, budgetUsedUs, budgetStartUs);
+            if (budgetUsedUs >= _pollBudgetUs)
+                break;
+        }
+        return;
+    }
+
+    // Collect due polls (grouped by slot or by slot group if enabled)
+    _devicePollingMgr.updateSlotGroups(&_clockSpeeds);
+    uint32_t numDuePolls = 0;
+    uint64_t estBudgetUsedUs = budgetUsedUs;
+    uint64_t timeNowUs = micros();
+    while (numDuePolls < I2C_BUS_MAX_POLLS_PER_LOOP)
+    {
+        DuePoll& duePoll = _duePolls[numDuePolls];
+        uint32_t budgetRemainingUs = (numDuePolls == 0) && (estBudgetUsedUs == 0) ? UINT32_MAX : _pollBudgetUs - estBudgetUsedUs;
+        uint32_t estBusTimeUs = 0;
+        if (!_pollScheduler.getNextDue(timeNowUs, budgetRemainingUs, duePoll.pollKey, duePoll.pollHandle, 
+                    &estBusTimeUs, &duePoll.isQuarantined))
+            break;
+        duePoll.slotKey = BusPollScheduler::isPollListKey(duePoll.pollKey) || 
+                    BusPollScheduler::isSyncSampleKey(duePoll.pollKey) ? 0 : 
+                    _devicePollingMgr.getSlotKey(BusI2CAddrAndSlot::getSlotNum(duePoll.pollKey));
+        duePoll.isDone = false;
+        numDuePolls++;
+        if (estBusTimeUs == 0)
+            estBusTimeUs = POLL_EST_BUS_TIME_UNKNOWN_US;
+        estBudgetUsedUs += estBusTimeUs;
+        if (estBudgetUsedUs >= _pollBudgetUs)
+            break;
+    }
+
+    // Perform polls grouped by slot
+    for (uint32_t groupIdx = 0; groupIdx < numDuePolls; groupIdx++)
+    {
+        if (_duePolls[groupIdx].isDone)
+            continue;
+        uint32_t groupSlotKey = _duePolls[groupIdx].slotKey;
+        for (uint32_t i = groupIdx; i < numDuePolls; i++)
+        {
+            DuePoll& duePoll = _duePolls[i];
+            if (duePoll.isDone || (duePoll.slotKey != groupSlotKey))
+                continue;
+            performDuePoll(duePoll, budgetUsedUs, budgetStartUs);
+        }
+    }
+
+    // Release the slot held from the last group
+    _devicePollingMgr.releaseSlot();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Perform a due poll and record its result and bus time
+/// @param duePoll due poll
+/// @param budgetUsedUs (out) bus time used since the start of the budget
+/// @param budgetStartUs start time of the budget
+/// @note Devices whose ident polls fail are backed-off by the poll scheduler and, once quarantined, are only
+///       probed (address only) until they respond - the bus time of failed polls isn't used for estimates
+void BusI2C::performDuePoll(DuePoll& duePoll, uint64_t& budgetUsedUs, uint64_t budgetStartUs)
+{
+    // Perform the poll (polling list entries enable their own slot so any slot held must be released first)
+    uint64_t pollStartUs = micros();
+    bool pollOk = true;
+    if (BusPollScheduler::isPollListKey(duePoll.pollKey))
+    {
+        _devicePollingMgr.releaseSlot();
+        _busAccessor.processPollingEntry(BusPollScheduler::getPollListIdx(duePoll.pollKey));
+    }
+    else if (BusPollScheduler::isSyncSampleKey(duePoll.pollKey))
+    {
+        pollOk = _devicePollingMgr.syncSample(pollStartUs);
+        _pollScheduler.recordPollResult(duePoll.pollHandle, duePoll.pollKey, pollOk, pollStartUs);
+    }
+    else
+    {
+        // Device ident poll or poll group (the key includes the group index)
+        BusElemAddrType address = BusPollScheduler::getPollKeyAddr(duePoll.pollKey);
+        uint32_t pollGroupIdx = BusPollScheduler::getPollGroupIdx(duePoll.pollKey);
+        if (duePoll.isQuarantined)
+            pollOk = _devicePollingMgr.probeDevice(address);
+        else if (pollGroupIdx == 0)
+            pollOk = _devicePollingMgr.pollDevice(pollStartUs, address);
+        else
+            pollOk = _devicePollingMgr.pollDeviceGroup(pollStartUs, address, pollGroupIdx);
+        _pollScheduler.recordPollResult(duePoll.pollHandle, duePoll.pollKey, pollOk, pollStartUs);
+    }
+    duePoll.isDone = true;
+
+    // Record bus time
+    uint64_t pollEndUs = micros();
+    if (pollOk && !duePoll.isQuarantined)
+        _pollScheduler.recordBusTime(duePoll.pollHandle, duePoll.pollKey, pollEndUs - pollStartUs);
+    budgetUsedUs = pollEndUs - budgetStartUs;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Send I2C message synchronously
 /// @param pReqRec - contains the request details including address, write data, read data length, etc
@@ -476,12 +746,19 @@ RaftRetCode BusI2C::i2cSendSync(const BusRequestInfo* pReqRec, std::vector<uint8
         uint32_t writeReqLen = pReqRec->getWriteDataLen();
 
         // Access the bus
+        uint32_t accessFreq = _clockSpeeds.getFreq(address);
+        setAccessFreq(accessFreq);
+        setAccessOverhead(_accessTiming.getOverheadUs(address));
         uint32_t numBytesRead = 0;
+        uint64_t accessStartUs = micros();
         rsltCode = _pI2CCentral->access(i2cAddr, pReqRec->getWriteData(), writeReqLen, 
                 pReadData ? pReadData->data() : pDummyReadBuf, readReqLen, numBytesRead);
 
-        // Record time of comms
+        // Record time of comms (and learn the timing of successful accesses)
         _lastI2CCommsUs = micros();
+        _loopStats.recordBusTime(_lastI2CCommsUs - accessStartUs);
+        _accessTiming.recordResult(address, rsltCode, _lastI2CCommsUs - accessStartUs, 
+                    BusI2CAccessTiming::getBitTimeUs(writeReqLen, readReqLen, accessFreq));
     }
 
 #ifdef DEBUG_I2C_SYNC_SEND_HELPER
@@ -511,6 +788,164 @@ RaftRetCode BusI2C::i2cSendSync(const BusRequestInfo* pReqRec, std::vector<uint8
     return rsltCode;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Probe a set of I2C addresses back-to-back
+/// @param pI2CAddrs - I2C addresses to probe
+/// @param numAddrs - number of addresses
+/// @param slotNum - slot the addresses are probed on (0 for the main bus) - sets the frequency
+/// @param pResults - (out) result for each address
+/// @note As with i2cSendSync the bus extender must be set before calling this function
+void BusI2C::i2cProbeBurst(const uint8_t* pI2CAddrs, uint32_t numAddrs, uint32_t slotNum, RaftRetCode* pResults)
+{
+    // Check valid
+    if (!_pI2CCentral)
+    {
+        for (uint32_t i = 0; i < numAddrs; i++)
+            pResults[i] = RAFT_BUS_NOT_INIT;
+        return;
+    }
+
+    // Barred addresses aren't probed
+    uint8_t probeAddrs[I2C_PROBE_BURST_MAX_ADDRS];
+    RaftRetCode probeResults[I2C_PROBE_BURST_MAX_ADDRS];
+    for (uint32_t addrIdx = 0; addrIdx < numAddrs; addrIdx += I2C_PROBE_BURST_MAX_ADDRS)
+    {
+        uint32_t numToProbe = 0;
+        uint32_t chunkLen = numAddrs - addrIdx < I2C_PROBE_BURST_MAX_ADDRS ? numAddrs - addrIdx : I2C_PROBE_BURST_MAX_ADDRS;
+        for (uint32_t i = 0; i < chunkLen; i++)
+        {
+            pResults[addrIdx + i] = checkAddrValidAndNotBarred(pI2CAddrs[addrIdx + i]);
+            if (pResults[addrIdx + i] == RAFT_OK)
+                probeAddrs[numToProbe++] = pI2CAddrs[addrIdx + i];
+        }
+
+        // Probe (at the frequency of the slot)
+        setAccessFreq(_clockSpeeds.getSlotAccessFreq(slotNum));
+        setAccessOverhead(0);
+        uint64_t probeStartUs = micros();
+        _pI2CCentral->probeAddresses(probeAddrs, numToProbe, probeResults);
+        _loopStats.recordBusTime(micros() - probeStartUs);
+        uint32_t probeIdx = 0;
+        for (uint32_t i = 0; i < chunkLen; i++)
+        {
+            if (pResults[addrIdx + i] == RAFT_OK)
+                pResults[addrIdx + i] = probeResults[probeIdx++];
+        }
+    }
+
+    // Record time of comms
+    _lastI2CCommsUs = micros();
+
+#ifdef DEBUG_I2C_SYNC_SEND_HELPER
+    LOG_I(MODULE_PREFIX, "I2CProbeBurst numAddrs %d", numAddrs);
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Send a batch of I2C messages synchronously
+/// @param pReqRecs - array of requests (each contains address, write data, read data length, etc)
+/// @param numReqs - number of requests
+/// @param pReadBuf - buffer for read data (data for each request is stored sequentially)
+/// @param readBufLen - length of read buffer
+/// @param maxLastReadLen - max read length of the last request (UINT32_MAX to read the length in the request)
+/// @return result code (RAFT_OK if all requests succeeded)
+/// @note As with i2cSendSync the bus extender must be set before calling this function
+RaftRetCode BusI2C::i2cSendSyncBatch(const BusRequestInfo* pReqRecs, uint32_t numReqs, uint8_t* pReadBuf, uint32_t readBufLen,
+            uint32_t maxLastReadLen)
+{
+    // Check valid
+    if (!_pI2CCentral)
+        return RAFT_BUS_NOT_INIT;
+
+    // Handle in chunks
+    uint32_t readPos = 0;
+    for (uint32_t reqIdx = 0; reqIdx < numReqs; reqIdx += I2C_SEND_BATCH_MAX_REQS)
+    {
+        // Build batch
+        RaftI2CCentralIF::AccessBatchItem batchItems[I2C_SEND_BATCH_MAX_REQS];
+        uint32_t numItems = 0;
+        uint32_t batchBitTimeUs = 0;
+        BusElemAddrType address = pReqRecs[reqIdx].getAddress();
+        uint32_t accessFreq = _clockSpeeds.getFreq(address);
+        for (; (numItems < I2C_SEND_BATCH_MAX_REQS) && (reqIdx + numItems < numReqs); numItems++)
+        {
+            const BusRequestInfo& reqRec = pReqRecs[reqIdx + numItems];
+            RaftRetCode rsltCode = checkAddrValidAndNotBarred(reqRec.getAddress());
+            if (rsltCode != RAFT_OK)
+                return rsltCode;
+            uint32_t readReqLen = reqRec.getReadReqLen();
+            if ((reqIdx + numItems + 1 == numReqs) && (readReqLen > maxLastReadLen))
+                readReqLen = maxLastReadLen;
+            if (readPos + readReqLen > readBufLen)
+                return RAFT_BUS_INVALID;
+            RaftI2CCentralIF::AccessBatchItem& item = batchItems[numItems];
+            item.address = BusI2CAddrAndSlot::getI2CAddr(reqRec.getAddress());
+            item.pWriteBuf = reqRec.getWriteData();
+            item.numToWrite = reqRec.getWriteDataLen();
+            item.pReadBuf = pReadBuf + readPos;
+            item.numToRead = readReqLen;
+            readPos += readReqLen;
+            batchBitTimeUs += BusI2CAccessTiming::getBitTimeUs(item.numToWrite, readReqLen, accessFreq);
+        }
+
+        // Access the bus (the requests in a batch are for one device and may be chained in one engine run so
+        // the timeout overhead allows for each)
+        setAccessFreq(accessFreq);
+        setAccessOverhead(_accessTiming.getOverheadUs(address) * numItems);
+        uint64_t accessStartUs = micros();
+        RaftRetCode rsltCode = _pI2CCentral->accessBatch(batchItems, numItems);
+
+        // Record time of comms (and learn the timing - the overhead is per request so the average is recorded)
+        _lastI2CCommsUs = micros();
+        _loopStats.recordBusTime(_lastI2CCommsUs - accessStartUs);
+        if (numItems > 0)
+            _accessTiming.recordResult(address, rsltCode, (_lastI2CCommsUs - accessStartUs) / numItems, 
+                        batchBitTimeUs / numItems);
+
+#ifdef DEBUG_I2C_SYNC_SEND_HELPER
+        LOG_I(MODULE_PREFIX, "I2CSendSyncBatch %s addr 0x%02x numReqs %d",
+                        Raft::getRetCodeStr(rsltCode), batchItems[0].address, numItems);
+#endif
+        if (rsltCode != RAFT_OK)
+            return rsltCode;
+    }
+    return RAFT_OK;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Broadcast to the general call address (0x00)
+/// @param pData - data to write (the first byte is the general call command)
+/// @param dataLen - length of data
+/// @return result code (RAFT_BUS_ACK_ERROR if no device acknowledged the general call)
+/// @note As with i2cSendSync the bus extender must be set before calling this function - the broadcast reaches
+///       every device on the main bus and downstream of enabled slots so it is sent at the lowest frequency in use
+RaftRetCode BusI2C::i2cSendGeneralCall(const uint8_t* pData, uint32_t dataLen)
+{
+    // Check valid
+    if (!_pI2CCentral)
+        return RAFT_BUS_NOT_INIT;
+    if (!pData || (dataLen == 0))
+        return RAFT_BUS_INVALID;
+
+    // Access the bus
+    setAccessFreq(_clockSpeeds.getProbeFreq());
+    setAccessOverhead(0);
+    uint32_t numBytesRead = 0;
+    uint8_t dummyReadBuf[1];
+    uint64_t accessStartUs = micros();
+    RaftRetCode rsltCode = _pI2CCentral->access(BusI2CSyncSample::GENERAL_CALL_ADDR, pData, dataLen, 
+                dummyReadBuf, 0, numBytesRead);
+
+    // Record time of comms
+    _lastI2CCommsUs = micros();
+    _loopStats.recordBusTime(_lastI2CCommsUs - accessStartUs);
+
+#ifdef DEBUG_I2C_SYNC_SEND_HELPER
+    LOG_I(MODULE_PREFIX, "I2CSendGeneralCall %s dataLen %d", Raft::getRetCodeStr(rsltCode), dataLen);
+#endif
+    return rsltCode;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Send I2C message asynchronously and store result in the response queue
 /// @param pReqRec - contains the request details including address, write data, read data length, etc
@@ -549,8 +984,16 @@ RaftRetCode BusI2C::i2cSendAsync(const BusRequestInfo* pReqRec, uint32_t pollLis
     rslt = RAFT_BUS_NOT_INIT;
     if (!_pI2CCentral)
         return rslt;
+    uint32_t accessFreq = _clockSpeeds.getFreq(address);
+    setAccessFreq(accessFreq);
+    setAccessOverhead(_accessTiming.getOverheadUs(address));
+    uint64_t accessStartUs = micros();
     rslt = _pI2CCentral->access(i2cAddr, pReqRec->getWriteData(), writeReqLen, 
             readBuf, readReqLen, numBytesRead);
+    uint32_t accessUs = micros() - accessStartUs;
+    _loopStats.recordBusTime(accessUs);
+    _accessTiming.recordResult(address, rslt, accessUs, 
+                BusI2CAccessTiming::getBitTimeUs(writeReqLen, readReqLen, accessFreq));
 
     // Reset bus multiplexers to turn off all slots
     _busMultiplexers.disableAllSlots(false);
@@ -612,6 +1055,7 @@ bool BusI2C::isElemResponding(uint32_t address, bool* pIsValid) const
 void BusI2C::requestScan(bool enableSlowScan, bool requestFastScan)
 {
     _busScanner.requestScan(enableSlowScan, requestFastScan);
+    wakeWorkerTask();
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -626,3 +1070,21 @@ void BusI2C::hiatus(uint32_t forPeriodMs)
     LOG_I("BusI2C", "hiatus req for %dms", forPeriodMs);
 #endif
 }
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get debug JSON (bus status with bus stuck, request latency, loop and poll rate stats and the
+///        device type info version)
+/// @param includeBraces true to include braces
+/// @return JSON string
+String BusI2C::getDebugJSON(bool includeBraces) const
+{
+    String jsonStr = _busStatusMgr.getDebugJSON(false) +
+                ",\"stk\":" + _busStuckHandler.getDebugJSON() +
+                ",\"rql\":" + _busAccessor.getDebugJSON() +
+                ",\"lp\":" + _loopStats.getJSON(micros()) +
+                ",\"rate\":" + _pollScheduler.getRateJSON() +
+                ",\"tv\":" + String(_deviceIdentMgr.getDevTypeInfoVersion());
+    if (includeBraces)
+        jsonStr = "{" + jsonStr + "}";
+    return jsonStr;
+}
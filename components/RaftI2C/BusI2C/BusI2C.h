@@ -12,6 +12,9 @@
 #include "RaftI2CCentralIF.h"
 #include "BusRequestInfo.h"
 #include "BusScanner.h"
+#include "BusTopologyCache.h"
+#include "BusI2CClockSpeeds.h"
+#include "BusI2CAccessTiming.h"
 #include "BusStatusMgr.h"
 #include "BusMultiplexers.h"
 #include "BusAccessor.h"
@@ -20,6 +23,9 @@
 #include "BusPowerController.h"
 #include "BusStuckHandler.h"
 #include "BusI2CAddrAndSlot.h"
+#include "BusPollScheduler.h"
+#include "BusI2CLoopStats.h"
+#include "BusI2CSyncSample.h"
 
 // #define DEBUG_RAFT_BUSI2C_MEASURE_I2C_LOOP_TIME
 
@@ -85,6 +91,9 @@ public:
 
         // Suspend bus accessor
         _busAccessor.pause(pause);
+
+        // Wake worker to action the change
+        wakeWorkerTask();
     }
 
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -124,13 +133,22 @@ public:
         return _busStatusMgr.isOperatingOk();
     }
 
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get debug JSON (bus status with bus stuck, request latency, loop and poll rate stats and the
+    ///        device type info version)
+    /// @param includeBraces true to include braces
+    /// @return JSON string
+    String getDebugJSON(bool includeBraces) const;
+
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Request an action (like regular polling of a device or sending a single message and getting a response)
     /// @param busReqInfo - bus request information
     /// @return true if the request was added
     virtual bool addRequest(BusRequestInfo& busReqInfo) override final
     {
-        return _busAccessor.addRequest(busReqInfo);
+        bool rslt = _busAccessor.addRequest(busReqInfo);
+        wakeWorkerTask();
+        return rslt;
     }
 
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -204,6 +222,14 @@ public:
     // Yield value on each bus processing loop
     static const uint32_t I2C_BUS_LOOP_YIELD_MS = 5;
 
+    // Event-driven loop - max time to sleep when no work is due and max time without sleeping
+    static const uint32_t I2C_BUS_LOOP_EVENT_MAX_SLEEP_MS = 10;
+    static const uint32_t I2C_BUS_LOOP_EVENT_MAX_UNYIELD_MS = 20;
+
+    // Bus time budget for polls on each bus processing loop
+    static const uint32_t I2C_BUS_POLL_BUDGET_DEFAULT_US = 2000;
+    static const uint32_t I2C_BUS_MAX_POLLS_PER_LOOP = 16;
+
     // Max fast scanning without yielding
     static const uint32_t I2C_BUS_FAST_MAX_UNYIELD_DEFAUT_MS = 10;
     static const uint32_t I2C_BUS_SLOW_MAX_UNYIELD_DEFAUT_MS = 2;
@@ -216,6 +242,7 @@ private:
     int _sclPin = -1;
     uint32_t _freq = 100000;
     uint32_t _i2cFilter = RaftI2CCentralIF::DEFAULT_BUS_FILTER_LEVEL;
+    bool _i2cBlockingWait = false;
     String _busName;
 
     // I2C device
@@ -231,12 +258,35 @@ private:
     uint32_t _loopSlowUnyieldUs = I2C_BUS_SLOW_MAX_UNYIELD_DEFAUT_MS * 1000;
     uint32_t _loopYieldMs = I2C_BUS_LOOP_YIELD_MS;
 
+    // Event-driven loop (sleeps until the next work is due or a request arrives) rather than fixed yield
+    bool _loopEventDriven = false;
+    uint32_t _loopEventMaxSleepMs = I2C_BUS_LOOP_EVENT_MAX_SLEEP_MS;
+    uint32_t _loopEventMaxUnyieldMs = I2C_BUS_LOOP_EVENT_MAX_UNYIELD_MS;
+    uint32_t _loopLastSleepMs = 0;
+
+    // Bus time budget for polls on each loop
+    uint32_t _pollBudgetUs = I2C_BUS_POLL_BUDGET_DEFAULT_US;
+
     // Init ok
     bool _initOk = false;
 
     // Task that operates the bus
     volatile TaskHandle_t _i2cWorkerTaskHandle = nullptr;
+    volatile bool _i2cWorkerTaskExitRequested = false;
     static const int DEFAULT_TASK_CORE = 0;
+
+    // Default core for a bus's worker task by the order in which buses are setup (the first bus on
+    // DEFAULT_TASK_CORE and the next on the other core on multi-core chips) so a single bus stays on
+    // DEFAULT_TASK_CORE whichever port it uses - the priority is taskPriority (or the default) for every bus
+    static uint32_t _numBusesSetup;
+    static UBaseType_t getDefaultTaskCore(uint32_t busIdx)
+    {
+#if portNUM_PROCESSORS > 1
+        return (DEFAULT_TASK_CORE + busIdx) % portNUM_PROCESSORS;
+#else
+        return DEFAULT_TASK_CORE;
+#endif
+    }
     static const int DEFAULT_TASK_PRIORITY = 5;
     static const int DEFAULT_TASK_STACK_SIZE_BYTES = 5000;
     static const uint32_t WAIT_FOR_TASK_EXIT_MS = 1000;
@@ -257,6 +307,29 @@ private:
     uint32_t _i2cMainLoopCount = 0;
 #endif
 
+    // Poll scheduler (for all periodic bus transactions)
+    BusPollScheduler _pollScheduler;
+
+    // Loop phase timing and bus utilisation
+    BusI2CLoopStats _loopStats;
+
+    // Sync sample settings (general call trigger and readout of participating devices)
+    BusI2CSyncSample _syncSample;
+
+    // Polls due on the current loop (grouped by slot or slot group when polling with slot affinity)
+    class DuePoll
+    {
+    public:
+        uint32_t pollKey = 0;
+        uint32_t pollHandle = 0;
+        uint32_t slotKey = 0;
+        bool isQuarantined = false;
+        bool isDone = false;
+    };
+    DuePoll _duePolls[I2C_BUS_MAX_POLLS_PER_LOOP];
+    static const uint32_t POLL_EST_BUS_TIME_UNKNOWN_US = 500;
+    void performDuePoll(DuePoll& duePoll, uint64_t& budgetUsedUs, uint64_t budgetStartUs);
+
     // Bus status
     BusStatusMgr _busStatusMgr;
 
@@ -275,6 +348,17 @@ private:
     // Device identifier
     DeviceIdentMgr _deviceIdentMgr;
 
+    // Topology cache
+    BusTopologyCache _topologyCache;
+
+    // Clock speeds (per slot and device) and the frequency currently set in the central
+    BusI2CClockSpeeds _clockSpeeds;
+    uint32_t _curAccessFreq = 0;
+
+    // Access timing (learned per device) and the timeout overhead currently set in the central
+    BusI2CAccessTiming _accessTiming;
+    uint32_t _curAccessOverheadUs = 0;
+
     // Bus scanner
     BusScanner _busScanner;
 
@@ -294,11 +378,46 @@ private:
     // Worker task (static version calls the other)
     static void i2cWorkerTaskStatic(void* pvParameters);
     void i2cWorkerTask();
+    void workerTaskWait();
+    uint32_t getMsUntilWorkDue(uint64_t curTimeUs);
+    void servicePollScheduler();
+    void wakeWorkerTask()
+    {
+        if (_loopEventDriven && _i2cWorkerTaskHandle)
+            xTaskNotifyGive(_i2cWorkerTaskHandle);
+    }
 
     // Helpers
     RaftRetCode i2cSendAsync(const BusRequestInfo* pReqRec, uint32_t pollListIdx);
     RaftRetCode i2cSendSync(const BusRequestInfo* pReqRec, std::vector<uint8_t>* pReadData);
+    RaftRetCode i2cSendSyncBatch(const BusRequestInfo* pReqRecs, uint32_t numReqs, uint8_t* pReadBuf, uint32_t readBufLen,
+                uint32_t maxLastReadLen);
+    static const uint32_t I2C_SEND_BATCH_MAX_REQS = 8;
+    void i2cProbeBurst(const uint8_t* pI2CAddrs, uint32_t numAddrs, uint32_t slotNum, RaftRetCode* pResults);
+    static const uint32_t I2C_PROBE_BURST_MAX_ADDRS = 32;
+    RaftRetCode i2cSendGeneralCall(const uint8_t* pData, uint32_t dataLen);
     RaftRetCode checkAddrValidAndNotBarred(BusElemAddrType address);
+    bool i2cBusRecoveryClocking(uint32_t maxSCLPulses, bool sendStop)
+    {
+        return _pI2CCentral && _pI2CCentral->busRecoveryClocking(maxSCLPulses, sendStop);
+    }
+    void setAccessFreq(uint32_t freq)
+    {
+        // The central is only called when the frequency changes
+        if (freq == _curAccessFreq)
+            return;
+        _pI2CCentral->setBusFrequency(freq);
+        _curAccessFreq = freq;
+    }
+
+    // Set timeout overhead for access
+    void setAccessOverhead(uint32_t overheadUs)
+    {
+        if (overheadUs == _curAccessOverheadUs)
+            return;
+        _pI2CCentral->setAccessOverheadUs(overheadUs);
+        _curAccessOverheadUs = overheadUs;
+    }
 
     // Debug
     static constexpr const char* MODULE_PREFIX = "RaftI2CBusI2C";    
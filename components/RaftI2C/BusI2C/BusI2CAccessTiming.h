@@ -0,0 +1,204 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Bus I2C Access Timing
+// Learned transaction timing for each device (used to set tight software timeouts)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "RaftJson.h"
+#include "RaftBus.h"
+#include "RaftUtils.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class BusI2CAccessTiming
+/// @brief Transaction timing for each device
+/// @note The overhead of a transaction (time taken beyond the bit time - start/stop conditions, clock stretching,
+///       etc) is learned from successful accesses to each address as an exponentially weighted mean and a max. Once
+///       enough accesses have been seen the software timeout overhead is the mean multiplied by a safety factor -
+///       but never less than the max observed (plus a margin) or a minimum. Device types with an i2cStretchUs in
+///       their device info use that as the overhead instead (for devices known to stretch the clock). An overhead
+///       of 0 means the central's default (worst case) timeout is used. A software timeout discards the learned
+///       timing of the device so the default timeout is used until the timing is learned again (a device slower
+///       than learned isn't repeatedly timed out). This is only accessed from the I2C task so no mutex is required
+class BusI2CAccessTiming
+{
+public:
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup
+    /// @param config configuration
+    void setup(const RaftJsonIF& config)
+    {
+        _learnEnabled = config.getBool("timeoutLearn", true);
+        _safetyFactorPC = config.getDouble("timeoutSafetyFactor", SAFETY_FACTOR_DEFAULT) * 100;
+        if (_safetyFactorPC < 100)
+            _safetyFactorPC = 100;
+        _minOverheadUs = config.getLong("timeoutMinOverheadUs", MIN_OVERHEAD_US_DEFAULT);
+        if (_minOverheadUs == 0)
+            _minOverheadUs = 1;
+        _timingRecs.clear();
+        _lastRecIdx = -1;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the minimum (bit) time for a transaction
+    /// @param numToWrite number of bytes written (excluding the address)
+    /// @param numToRead number of bytes read
+    /// @param busFreq bus frequency
+    /// @return time in us (ten bit periods per byte including the address and restart address bytes)
+    static uint32_t getBitTimeUs(uint32_t numToWrite, uint32_t numToRead, uint32_t busFreq)
+    {
+        if (busFreq == 0)
+            return 0;
+        uint64_t totalBits = (numToWrite + 1 + numToRead + 1) * 10;
+        return (totalBits * 1000000) / busFreq;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Record the time taken by a successful access
+    /// @param address address of device (inc slot)
+    /// @param elapsedUs time taken by the access
+    /// @param bitTimeUs minimum (bit) time of the access
+    void recordAccess(BusElemAddrType address, uint32_t elapsedUs, uint32_t bitTimeUs)
+    {
+        if (!_learnEnabled)
+            return;
+        int recIdx = findRec(address, true);
+        if (recIdx < 0)
+            return;
+        TimingRec& rec = _timingRecs[recIdx];
+        uint32_t overheadUs = elapsedUs > bitTimeUs ? elapsedUs - bitTimeUs : 0;
+        rec.meanOverheadUs = rec.sampleCount == 0 ? overheadUs : (rec.meanOverheadUs * 7 + overheadUs) / 8;
+        if (overheadUs > rec.maxOverheadUs)
+            rec.maxOverheadUs = overheadUs;
+        if (rec.sampleCount < UINT16_MAX)
+            rec.sampleCount++;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Record the result of an access
+    /// @param address address of device (inc slot)
+    /// @param rsltCode result of the access
+    /// @param elapsedUs time taken by the access
+    /// @param bitTimeUs minimum (bit) time of the access
+    void recordResult(BusElemAddrType address, RaftRetCode rsltCode, uint32_t elapsedUs, uint32_t bitTimeUs)
+    {
+        if (rsltCode == RAFT_OK)
+            recordAccess(address, elapsedUs, bitTimeUs);
+        else if (rsltCode == RAFT_BUS_SW_TIME_OUT)
+            recordTimeout(address);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Record a software timeout (the learned timing is discarded so the default timeout is used)
+    /// @param address address of device (inc slot)
+    void recordTimeout(BusElemAddrType address)
+    {
+        int recIdx = findRec(address, false);
+        if (recIdx < 0)
+            return;
+        TimingRec& rec = _timingRecs[recIdx];
+        rec.meanOverheadUs = 0;
+        rec.maxOverheadUs = 0;
+        rec.sampleCount = 0;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Set the overhead from a device's type (called when a device is identified)
+    /// @param address address of device
+    /// @param devTypeOverheadUs overhead from the device type record (0 if none)
+    void setDeviceTypeOverheadUs(BusElemAddrType address, uint32_t devTypeOverheadUs)
+    {
+        int recIdx = findRec(address, devTypeOverheadUs != 0);
+        if (recIdx >= 0)
+            _timingRecs[recIdx].devTypeOverheadUs = devTypeOverheadUs;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Forget timing for a device (called when a device goes offline as a different device may appear)
+    /// @param address address of device
+    void forgetDevice(BusElemAddrType address)
+    {
+        int recIdx = findRec(address, false);
+        if (recIdx < 0)
+            return;
+        _timingRecs.erase(_timingRecs.begin() + recIdx);
+        _lastRecIdx = -1;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the timeout overhead for access to a device
+    /// @param address address of device (inc slot)
+    /// @return overhead in us to add to the bit time (0 to use the default)
+    uint32_t getOverheadUs(BusElemAddrType address)
+    {
+        int recIdx = findRec(address, false);
+        if (recIdx < 0)
+            return 0;
+        const TimingRec& rec = _timingRecs[recIdx];
+        if (rec.devTypeOverheadUs != 0)
+            return rec.devTypeOverheadUs;
+        if (!_learnEnabled || (rec.sampleCount < MIN_SAMPLES_BEFORE_USE))
+            return 0;
+        uint32_t overheadUs = (uint64_t)rec.meanOverheadUs * _safetyFactorPC / 100;
+        uint32_t maxWithMarginUs = rec.maxOverheadUs + rec.maxOverheadUs / 4;
+        if (overheadUs < maxWithMarginUs)
+            overheadUs = maxWithMarginUs;
+        return overheadUs < _minOverheadUs ? _minOverheadUs : overheadUs;
+    }
+
+private:
+    // Settings
+    bool _learnEnabled = true;
+    uint32_t _safetyFactorPC = SAFETY_FACTOR_DEFAULT * 100;
+    uint32_t _minOverheadUs = MIN_OVERHEAD_US_DEFAULT;
+    static constexpr double SAFETY_FACTOR_DEFAULT = 3.0;
+    static const uint32_t MIN_OVERHEAD_US_DEFAULT = 100;
+    static const uint32_t MIN_SAMPLES_BEFORE_USE = 8;
+    static const uint32_t MAX_TIMING_RECS = 128;
+
+    // Timing records
+    class TimingRec
+    {
+    public:
+        BusElemAddrType address = 0;
+        uint32_t meanOverheadUs = 0;
+        uint32_t maxOverheadUs = 0;
+        uint32_t devTypeOverheadUs = 0;
+        uint16_t sampleCount = 0;
+    };
+    std::vector<TimingRec> _timingRecs;
+
+    // Last record found (consecutive accesses are usually to the same device)
+    int _lastRecIdx = -1;
+
+    // Find record (optionally creating it)
+    int findRec(BusElemAddrType address, bool create)
+    {
+        if ((_lastRecIdx >= 0) && (_lastRecIdx < (int)_timingRecs.size()) && (_timingRecs[_lastRecIdx].address == address))
+            return _lastRecIdx;
+        for (uint32_t i = 0; i < _timingRecs.size(); i++)
+        {
+            if (_timingRecs[i].address == address)
+            {
+                _lastRecIdx = i;
+                return i;
+            }
+        }
+        if (!create || (_timingRecs.size() >= MAX_TIMING_RECS))
+            return -1;
+        TimingRec rec;
+        rec.address = address;
+        _timingRecs.push_back(rec);
+        _lastRecIdx = _timingRecs.size() - 1;
+        return _lastRecIdx;
+    }
+
+    // Debug
+    static constexpr const char* MODULE_PREFIX = "RaftI2CAccessTiming";
+};
@@ -0,0 +1,174 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Bus I2C Clock Speeds
+// Bus frequency to use for each device (from slot configuration and device type records)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "RaftJson.h"
+#include "Logger.h"
+#include "RaftBus.h"
+#include "BusI2CAddrAndSlot.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class BusI2CClockSpeeds
+/// @brief Frequencies for access to devices
+/// @note The frequency for a device is the slot's frequency (if configured in slotFreqs) or the bus frequency.
+///       Device types with an i2cFreq in their device info are accessed at that frequency (limited to i2cMaxFreq
+///       which defaults to the bus frequency so device type frequencies are opt-in) but never faster than a
+///       configured slot frequency. Burst probes of a slot are at the slot's frequency and other probes
+///       (where the slot isn't known) are at the lowest frequency in use.
+///       This is only accessed from the I2C task so no mutex is required
+class BusI2CClockSpeeds
+{
+public:
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup
+    /// @param config configuration
+    /// @param busFreq bus frequency
+    void setup(const RaftJsonIF& config, uint32_t busFreq)
+    {
+        // Settings
+        _busFreq = busFreq;
+        _probeFreq = busFreq;
+        _maxDevTypeFreq = config.getLong("i2cMaxFreq", busFreq);
+        _devFreqs.clear();
+        _slotFreqs.clear();
+
+        // Slot frequencies
+        std::vector<String> slotFreqArray;
+        config.getArrayElems("slotFreqs", slotFreqArray);
+        for (RaftJson slotFreqElem : slotFreqArray)
+        {
+            uint32_t startSlotNum = slotFreqElem.getLong("startSlotNum", 0);
+            uint32_t numSlots = slotFreqElem.getLong("numSlots", 1);
+            uint32_t freq = slotFreqElem.getLong("freq", 0);
+            if ((startSlotNum == 0) || (freq == 0))
+            {
+                LOG_W(MODULE_PREFIX, "setup slotFreqs startSlotNum %d freq %d INVALID", startSlotNum, freq);
+                continue;
+            }
+            for (uint32_t slotNum = startSlotNum; slotNum < startSlotNum + numSlots; slotNum++)
+                _slotFreqs.push_back({slotNum, freq});
+            if (freq < _probeFreq)
+                _probeFreq = freq;
+        }
+    }
+
+    // Get bus frequency
+    uint32_t getBusFreq() const
+    {
+        return _busFreq;
+    }
+
+    // Get frequency for probing (slot not known)
+    uint32_t getProbeFreq() const
+    {
+        return _probeFreq;
+    }
+
+    // Get frequency for access to a slot (the slot's frequency if configured or the bus frequency)
+    uint32_t getSlotAccessFreq(uint32_t slotNum) const
+    {
+        uint32_t slotFreq = getSlotFreq(slotNum);
+        return slotFreq != 0 ? slotFreq : _busFreq;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Set frequency from a device's type (called when a device is identified or goes offline)
+    /// @param address address of device
+    /// @param devTypeFreq frequency from the device type record (0 if none or the device is offline)
+    void setDeviceTypeFreq(BusElemAddrType address, uint32_t devTypeFreq)
+    {
+        // Remove any existing record
+        for (auto it = _devFreqs.begin(); it != _devFreqs.end(); it++)
+        {
+            if (it->key == address)
+            {
+                _devFreqs.erase(it);
+                break;
+            }
+        }
+        _lastAddrValid = false;
+        if (devTypeFreq == 0)
+            return;
+
+        // Limit to the max device type frequency and the slot frequency (if configured)
+        uint32_t freq = devTypeFreq < _maxDevTypeFreq ? devTypeFreq : _maxDevTypeFreq;
+        uint32_t slotFreq = getSlotFreq(BusI2CAddrAndSlot::getSlotNum(address));
+        bool slotFreqConfigured = slotFreq != 0;
+        if (!slotFreqConfigured)
+            slotFreq = _busFreq;
+        if (slotFreqConfigured && (freq > slotFreq))
+            freq = slotFreq;
+        if (freq != slotFreq)
+            _devFreqs.push_back({address, freq});
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get frequency for access to a device
+    /// @param address address of device (inc slot)
+    /// @return frequency
+    uint32_t getFreq(BusElemAddrType address)
+    {
+        // Consecutive accesses are usually to the same device
+        if (_lastAddrValid && (address == _lastAddr))
+            return _lastAddrFreq;
+        uint32_t freq = 0;
+        for (const KeyAndFreq& devFreq : _devFreqs)
+        {
+            if (devFreq.key == address)
+            {
+                freq = devFreq.freq;
+                break;
+            }
+        }
+        if (freq == 0)
+            freq = getSlotFreq(BusI2CAddrAndSlot::getSlotNum(address));
+        if (freq == 0)
+            freq = _busFreq;
+        _lastAddr = address;
+        _lastAddrFreq = freq;
+        _lastAddrValid = true;
+        return freq;
+    }
+
+private:
+    // Frequencies
+    uint32_t _busFreq = 100000;
+    uint32_t _probeFreq = 100000;
+    uint32_t _maxDevTypeFreq = 100000;
+
+    // Frequency records (keyed on slot number or address)
+    class KeyAndFreq
+    {
+    public:
+        uint32_t key;
+        uint32_t freq;
+    };
+    std::vector<KeyAndFreq> _slotFreqs;
+    std::vector<KeyAndFreq> _devFreqs;
+
+    // Last address looked up
+    BusElemAddrType _lastAddr = 0;
+    uint32_t _lastAddrFreq = 0;
+    bool _lastAddrValid = false;
+
+    // Get slot frequency (0 if not configured)
+    uint32_t getSlotFreq(uint32_t slotNum) const
+    {
+        for (const KeyAndFreq& slotFreq : _slotFreqs)
+            if (slotFreq.key == slotNum)
+                return slotFreq.freq;
+        return 0;
+    }
+
+    // Debug
+    static constexpr const char* MODULE_PREFIX = "RaftI2CClockSpeeds";
+};
@@ -9,44 +9,152 @@
 #pragma once
 
 #include <stdint.h>
+#include <vector>
 #include "RaftBus.h"
 #include "RaftUtils.h"
 #include "BusI2CConsts.h"
+#include "BusI2CAddrAndSlot.h"
 
-class BusI2CElemTracker {
-
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class BusI2CAddrBits
+/// @brief Set of I2C addresses held as a bitmap so set operations and iteration work a word at a time
+class BusI2CAddrBits
+{
 public:
-    // Constructor and destructor
-    BusI2CElemTracker()
+    static const uint32_t NUM_WORDS = (I2C_BUS_ADDRESS_MAX+32)/32;
+
+    // Set, clear and test an address
+    void set(uint32_t addr)
+    {
+        if (addr <= I2C_BUS_ADDRESS_MAX)
+            _bits[addr/32] |= 1UL << (addr % 32);
+    }
+    void clear(uint32_t addr)
+    {
+        if (addr <= I2C_BUS_ADDRESS_MAX)
+            _bits[addr/32] &= ~(1UL << (addr % 32));
+    }
+    bool isSet(uint32_t addr) const
+    {
+        if (addr > I2C_BUS_ADDRESS_MAX)
+            return false;
+        return (_bits[addr/32] & (1UL << (addr % 32))) != 0;
+    }
+
+    // Check if empty
+    bool isEmpty() const
+    {
+        uint32_t orBits = 0;
+        for (uint32_t i = 0; i < NUM_WORDS; i++)
+            orBits |= _bits[i];
+        return orBits == 0;
+    }
+
+    // Number of addresses
+    uint32_t count() const
+    {
+        uint32_t numAddrs = 0;
+        for (uint32_t i = 0; i < NUM_WORDS; i++)
+            numAddrs += __builtin_popcount(_bits[i]);
+        return numAddrs;
+    }
+
+    // Check if any address is in both sets
+    bool intersects(const BusI2CAddrBits& other) const
+    {
+        uint32_t andBits = 0;
+        for (uint32_t i = 0; i < NUM_WORDS; i++)
+            andBits |= _bits[i] & other._bits[i];
+        return andBits != 0;
+    }
+
+    // Set operations
+    BusI2CAddrBits& operator|=(const BusI2CAddrBits& other)
+    {
+        for (uint32_t i = 0; i < NUM_WORDS; i++)
+            _bits[i] |= other._bits[i];
+        return *this;
+    }
+    BusI2CAddrBits operator&(const BusI2CAddrBits& other) const
+    {
+        BusI2CAddrBits result;
+        for (uint32_t i = 0; i < NUM_WORDS; i++)
+            result._bits[i] = _bits[i] & other._bits[i];
+        return result;
+    }
+    BusI2CAddrBits operator|(const BusI2CAddrBits& other) const
     {
-        // Clear found on main bus bits
-        for (int i = 0; i < TRACKER_BITS_ARRAY_SIZE; i++)
+        BusI2CAddrBits result = *this;
+        result |= other;
+        return result;
+    }
+    BusI2CAddrBits andNot(const BusI2CAddrBits& other) const
+    {
+        BusI2CAddrBits result;
+        for (uint32_t i = 0; i < NUM_WORDS; i++)
+            result._bits[i] = _bits[i] & ~other._bits[i];
+        return result;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Call a function for each address in the set (in address order)
+    /// @param fn function taking the address (uint32_t)
+    /// @note Only set bits are visited (count-trailing-zeros on each word) so sparse sets are cheap
+    template<typename Fn>
+    void forEach(Fn fn) const
+    {
+        for (uint32_t i = 0; i < NUM_WORDS; i++)
         {
-            _mainBusAddrBits[i] = 0;
-            _muxBusAddrBits[i] = 0;
+            uint32_t word = _bits[i];
+            while (word)
+            {
+                fn(i * 32 + __builtin_ctz(word));
+                word &= word - 1;
+            }
         }
     }
 
+private:
+    uint32_t _bits[NUM_WORDS] = {0};
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class BusI2CElemTracker
+/// @brief Addresses found online at any time on each slot (slot 0 is the main bus)
+class BusI2CElemTracker {
+
+public:
+    // Number of slots tracked (the slot number field of a bus element address is 6 bits)
+    static const uint32_t MAX_SLOTS = 64;
+
     ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Is address found on main bus
     /// @param addr address
     /// @return true if address found on main bus
     bool isAddrFoundOnMainBus(uint32_t addr) const
     {
-        if (addr > I2C_BUS_ADDRESS_MAX)
-            return false;
-        return (_mainBusAddrBits[addr/32] & (1 << (addr % 32))) != 0;
+        return _slotAddrBits[0].isSet(addr);
     }
 
     ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Is address found on muliplexer
     /// @param addr address
-    /// @return true if address found on multiplexer
+    /// @return true if address found on any multiplexer slot
     bool isAddrFoundOnMux(uint32_t addr) const
     {
-        if (addr > I2C_BUS_ADDRESS_MAX)
+        return _muxAddrBits.isSet(addr);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Is address found on a slot
+    /// @param addr address
+    /// @param slot slot number (0 for main bus)
+    /// @return true if address found on the slot
+    bool isAddrFoundOnSlot(uint32_t addr, uint32_t slot) const
+    {
+        if (slot >= MAX_SLOTS)
             return false;
-        return (_muxBusAddrBits[addr/32] & (1 << (addr % 32))) != 0;
+        return _slotAddrBits[slot].isSet(addr);
     }
 
     ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -55,34 +163,66 @@ public:
     /// @param slot slot number
     void setElemFound(uint32_t addr, uint16_t slot)
     {
-        if (addr > I2C_BUS_ADDRESS_MAX)
+        if ((addr > I2C_BUS_ADDRESS_MAX) || (slot >= MAX_SLOTS))
             return;
-        if (slot == 0)
-            _mainBusAddrBits[addr/32] |= (1 << (addr % 32));
-        else
-            _muxBusAddrBits[addr/32] |= (1 << (addr % 32));
+        _slotAddrBits[slot].set(addr);
+        if (slot != 0)
+            _muxAddrBits.set(addr);
+        _slotsWithElemsMask |= 1ULL << slot;
+    }
+
+    // Get addresses found on a slot (0 for main bus)
+    const BusI2CAddrBits& getSlotAddrBits(uint32_t slot) const
+    {
+        static const BusI2CAddrBits emptyBits;
+        return slot < MAX_SLOTS ? _slotAddrBits[slot] : emptyBits;
+    }
+
+    // Get addresses found on any multiplexer slot
+    const BusI2CAddrBits& getMuxAddrBits() const
+    {
+        return _muxAddrBits;
+    }
+
+    // Get addresses found on both the main bus and a slot (a main bus device responds on every slot so these
+    // conflict with the slot's devices)
+    BusI2CAddrBits getMainBusAndSlotAddrBits(uint32_t slot) const
+    {
+        return _slotAddrBits[0] & getSlotAddrBits(slot);
+    }
+
+    // Check if any address is found on both slots
+    bool isConflict(uint32_t slotA, uint32_t slotB) const
+    {
+        return getSlotAddrBits(slotA).intersects(getSlotAddrBits(slotB));
+    }
+
+    // Get mask of slots with elements found (bit N is slot N)
+    uint64_t getSlotsWithElemsMask() const
+    {
+        return _slotsWithElemsMask;
     }
 
     ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-    /// @brief Get all addresses found on mux bus
-    /// @param slot slot number
-    /// @param addrList List of addresses found on mux bus
-    void getAddrList(uint32_t slot, std::vector<uint32_t>& addrList) const
+    /// @brief Get all addresses found on a slot
+    /// @param slot slot number (0 for main bus)
+    /// @param addrList (out) addresses (including the slot number) - appended
+    void getAddrList(uint32_t slot, std::vector<BusElemAddrType>& addrList) const
     {
-        for (uint32_t addr = 0; addr <= I2C_BUS_ADDRESS_MAX; addr++)
-        {
-            if ((slot == 0) && isAddrFoundOnMainBus(addr))
-                addrList.push_back(addr);
-            else if ((slot != 0) && isAddrFoundOnMux(addr))
-                addrList.push_back(addr);
-        }
+        getSlotAddrBits(slot).forEach([&](uint32_t addr) {
+            addrList.push_back(BusI2CAddrAndSlot(addr, slot).toBusElemAddrType());
+        });
     }
 
 private:
-    // Addresses found online on main bus / mux bus at any time
-    static const uint32_t TRACKER_BITS_ARRAY_SIZE = (I2C_BUS_ADDRESS_MAX+31)/32;
-    uint32_t _mainBusAddrBits[TRACKER_BITS_ARRAY_SIZE] = {0};
-    uint32_t _muxBusAddrBits[TRACKER_BITS_ARRAY_SIZE] = {0};
+    // Addresses found online on each slot at any time (slot 0 is the main bus)
+    BusI2CAddrBits _slotAddrBits[MAX_SLOTS];
+
+    // Union of addresses found on slots other than 0
+    BusI2CAddrBits _muxAddrBits;
+
+    // Slots with any address found
+    uint64_t _slotsWithElemsMask = 0;
 
     // Debug
     static constexpr const char* MODULE_PREFIX = "BusI2CElemTracker";
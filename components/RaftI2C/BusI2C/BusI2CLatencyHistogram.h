@@ -0,0 +1,90 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Bus I2C Latency Histogram
+// Fixed-bucket histogram of times (in us)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include "RaftArduino.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class BusI2CLatencyHistogram
+/// @brief Histogram of times with fixed (roughly logarithmic) buckets
+/// @note Recording is a few compares and increments so it can be used on hot paths. Counters are updated from
+///       one task and may be read from another (reads are of individual 32-bit values so a JSON snapshot may be
+///       very slightly inconsistent but no locking is needed)
+class BusI2CLatencyHistogram
+{
+public:
+    // Bucket upper limits (us) - the last bucket holds everything above the final limit
+    static const uint32_t NUM_BUCKET_LIMITS = 10;
+    static constexpr uint32_t BUCKET_LIMITS_US[NUM_BUCKET_LIMITS] =
+                { 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000 };
+    static const uint32_t NUM_BUCKETS = NUM_BUCKET_LIMITS + 1;
+
+    // Record a time
+    void record(uint32_t timeUs)
+    {
+        uint32_t bucketIdx = 0;
+        while ((bucketIdx < NUM_BUCKET_LIMITS) && (timeUs >= BUCKET_LIMITS_US[bucketIdx]))
+            bucketIdx++;
+        _buckets[bucketIdx]++;
+        _count++;
+        _totalUs += timeUs;
+        if (timeUs > _maxUs)
+            _maxUs = timeUs;
+    }
+
+    // Clear
+    void clear()
+    {
+        for (uint32_t i = 0; i < NUM_BUCKETS; i++)
+            _buckets[i] = 0;
+        _count = 0;
+        _totalUs = 0;
+        _maxUs = 0;
+    }
+
+    // Get count and max
+    uint32_t getCount() const
+    {
+        return _count;
+    }
+    uint32_t getMaxUs() const
+    {
+        return _maxUs;
+    }
+
+    // Get mean
+    uint32_t getMeanUs() const
+    {
+        return _count == 0 ? 0 : _totalUs / _count;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get JSON
+    /// @return JSON string {"n":count,"avg":meanUs,"max":maxUs,"h":[bucket counts]}
+    String getJSON() const
+    {
+        String jsonStr = "{\"n\":" + String(_count) + ",\"avg\":" + String(getMeanUs()) +
+                    ",\"max\":" + String(_maxUs) + ",\"h\":[";
+        for (uint32_t i = 0; i < NUM_BUCKETS; i++)
+        {
+            if (i != 0)
+                jsonStr += ",";
+            jsonStr += String(_buckets[i]);
+        }
+        return jsonStr + "]}";
+    }
+
+private:
+    uint32_t _buckets[NUM_BUCKETS] = {};
+    uint32_t _count = 0;
+    uint64_t _totalUs = 0;
+    uint32_t _maxUs = 0;
+};
@@ -0,0 +1,167 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Bus I2C Loop Stats
+// Timing of each phase of the I2C worker loop and bus utilisation
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include "RaftJsonIF.h"
+#include "RaftArduino.h"
+#include "BusI2CLatencyHistogram.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class BusI2CLoopStats
+/// @brief Histograms of the time taken by each phase of the worker loop and the time the bus is busy
+/// @note Phase timing uses the CPU cycle counter (phases are far shorter than the counter's wrap period) so the
+///       overhead is a couple of register reads and a histogram update per phase. Stats are updated on the I2C
+///       task and read (for JSON) from other tasks without locking - a snapshot may be very slightly inconsistent.
+///       Bus utilisation is measured over fixed windows (the last complete window is reported) so it reflects
+///       recent activity rather than the average since the stats were cleared
+class BusI2CLoopStats
+{
+public:
+    // Phases of the worker loop (in the order they are performed)
+    enum LoopPhase
+    {
+        LOOP_PHASE_SCAN,
+        LOOP_PHASE_REQ_QUEUE,
+        LOOP_PHASE_MUX,
+        LOOP_PHASE_POWER,
+        LOOP_PHASE_DEV_POLL,
+        LOOP_PHASE_ACCESSOR_POLL,
+        LOOP_PHASE_COUNT
+    };
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup
+    /// @param config configuration
+    void setup(const RaftJsonIF& config)
+    {
+        _isEnabled = config.getBool("loopStats", true);
+        _cyclesPerUs = esp_rom_get_cpu_ticks_per_us();
+        if (_cyclesPerUs == 0)
+            _cyclesPerUs = 1;
+        clear(micros());
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Clear stats
+    /// @param timeNowUs current time in us
+    void clear(uint64_t timeNowUs)
+    {
+        for (uint32_t i = 0; i < LOOP_PHASE_COUNT; i++)
+            _phaseHists[i].clear();
+        _loopHist.clear();
+        _windowBusyUs = 0;
+        _windowStartUs = timeNowUs;
+        _lastWindowUtilPC = 0;
+    }
+
+    // Start of a loop (and of its first phase)
+    void loopStart()
+    {
+        if (!_isEnabled)
+            return;
+        _loopStartCycles = esp_cpu_get_cycle_count();
+        _phaseStartCycles = _loopStartCycles;
+    }
+
+    // End of a phase (the next phase starts)
+    void phaseEnd(LoopPhase phase)
+    {
+        if (!_isEnabled)
+            return;
+        uint32_t nowCycles = esp_cpu_get_cycle_count();
+        _phaseHists[phase].record((nowCycles - _phaseStartCycles) / _cyclesPerUs);
+        _phaseStartCycles = nowCycles;
+    }
+
+    // End of a loop
+    void loopEnd()
+    {
+        if (!_isEnabled)
+            return;
+        _loopHist.record((esp_cpu_get_cycle_count() - _loopStartCycles) / _cyclesPerUs);
+        checkUtilWindow(micros());
+    }
+
+    // Record time the bus was busy with a transaction
+    void recordBusTime(uint32_t busTimeUs)
+    {
+        if (!_isEnabled)
+            return;
+        checkUtilWindow(micros());
+        _windowBusyUs += busTimeUs;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get JSON
+    /// @param timeNowUs current time in us
+    /// @return JSON string {"util":busUtilisationPercent,"loop":{hist},"scan":{hist},"req":{hist},...}
+    String getJSON(uint64_t timeNowUs) const
+    {
+        if (!_isEnabled)
+            return "{}";
+        // Utilisation of the last complete window (0 if the windows haven't moved on - e.g. while the bus is paused)
+        uint32_t utilPC = timeNowUs < _windowStartUs + 2 * UTIL_WINDOW_US ? _lastWindowUtilPC : 0;
+        String jsonStr = "{\"util\":" + String(utilPC) + ",\"loop\":" + _loopHist.getJSON();
+        for (uint32_t i = 0; i < LOOP_PHASE_COUNT; i++)
+            jsonStr += ",\"" + String(getPhaseName((LoopPhase)i)) + "\":" + _phaseHists[i].getJSON();
+        return jsonStr + "}";
+    }
+
+private:
+    // Enabled
+    bool _isEnabled = true;
+
+    // CPU cycles per us
+    uint32_t _cyclesPerUs = 1;
+
+    // Start of current loop and phase
+    uint32_t _loopStartCycles = 0;
+    uint32_t _phaseStartCycles = 0;
+
+    // Histograms
+    BusI2CLatencyHistogram _phaseHists[LOOP_PHASE_COUNT];
+    BusI2CLatencyHistogram _loopHist;
+
+    // Bus busy time in the current utilisation window and utilisation of the last complete window
+    static const uint32_t UTIL_WINDOW_US = 1000000;
+    uint32_t _windowBusyUs = 0;
+    uint64_t _windowStartUs = 0;
+    uint32_t _lastWindowUtilPC = 0;
+
+    // Start a new utilisation window if the current one is complete
+    void checkUtilWindow(uint64_t timeNowUs)
+    {
+        uint64_t windowUs = timeNowUs - _windowStartUs;
+        if (windowUs < UTIL_WINDOW_US)
+            return;
+        uint32_t utilPC = (uint64_t)_windowBusyUs * 100 / windowUs;
+        _lastWindowUtilPC = utilPC > 100 ? 100 : utilPC;
+        _windowBusyUs = 0;
+        _windowStartUs = timeNowUs;
+    }
+
+    // Helpers
+    static const char* getPhaseName(LoopPhase phase)
+    {
+        switch (phase)
+        {
+            case LOOP_PHASE_SCAN: return "scan";
+            case LOOP_PHASE_REQ_QUEUE: return "req";
+            case LOOP_PHASE_MUX: return "mux";
+            case LOOP_PHASE_POWER: return "pwr";
+            case LOOP_PHASE_DEV_POLL: return "poll";
+            case LOOP_PHASE_ACCESSOR_POLL: return "accPoll";
+            default: return "unknown";
+        }
+    }
+};
@@ -0,0 +1,130 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Bus I2C Memory Placement
+// Placement policy for bulk buffers (PSRAM when available) and hot control structures (internal RAM)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <new>
+#include "RaftJsonIF.h"
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class BusI2CMemPlacement
+/// @brief Memory placement policy
+/// @note Bulk, cold or streaming data (pending poll result rings, poll lists, detection record and batch decoder
+///       caches and the type name index) is allocated with BusI2CBulkAllocator which prefers PSRAM when the policy
+///       allows it and falls back to internal RAM. Hot control structures (central ISR state, scheduler heaps, bus
+///       status index) use the normal heap and so stay in internal RAM. The type info JSON cache is a fixed array
+///       in DeviceIdentMgr (its strings use the normal heap). The policy applies to all buses and only affects
+///       allocations made after it is set so it is set at the start of bus setup (containers allocated earlier are
+///       re-sized by their owners)
+class BusI2CMemPlacement
+{
+public:
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup
+    /// @param config configuration - "psramBulk" (default true) allows bulk buffers in PSRAM
+    static void setup(const RaftJsonIF& config)
+    {
+        bulkInPSRAM() = config.getBool("psramBulk", true);
+    }
+
+    // Check if bulk buffers are placed in PSRAM (policy allows it and PSRAM is present)
+    static bool isBulkInPSRAM()
+    {
+        return bulkInPSRAM() && isPSRAMAvailable();
+    }
+
+    // Check if PSRAM is available
+    static bool isPSRAMAvailable()
+    {
+#if defined(ESP_PLATFORM) && defined(CONFIG_SPIRAM)
+        return heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0;
+#else
+        return false;
+#endif
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Allocate bulk memory
+    /// @param size size in bytes
+    /// @return pointer to memory (nullptr if none available)
+    static void* allocBulk(size_t size)
+    {
+#ifdef ESP_PLATFORM
+        if (isBulkInPSRAM())
+            return heap_caps_malloc_prefer(size, 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT, MALLOC_CAP_DEFAULT);
+        return heap_caps_malloc(size, MALLOC_CAP_DEFAULT);
+#else
+        return malloc(size);
+#endif
+    }
+
+    // Free bulk memory (whichever region it was allocated from)
+    static void freeBulk(void* pMem)
+    {
+#ifdef ESP_PLATFORM
+        heap_caps_free(pMem);
+#else
+        free(pMem);
+#endif
+    }
+
+private:
+    // Policy (shared by all buses)
+    static bool& bulkInPSRAM()
+    {
+        static bool bulkInPSRAM = true;
+        return bulkInPSRAM;
+    }
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class BusI2CBulkAllocator
+/// @brief Allocator for containers of bulk data (placed according to BusI2CMemPlacement)
+template <typename T>
+class BusI2CBulkAllocator
+{
+public:
+    typedef T value_type;
+
+    BusI2CBulkAllocator() noexcept
+    {
+    }
+    template <typename U>
+    BusI2CBulkAllocator(const BusI2CBulkAllocator<U>&) noexcept
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        void* pMem = BusI2CMemPlacement::allocBulk(n * sizeof(T));
+        if (!pMem)
+            abort();
+        return static_cast<T*>(pMem);
+    }
+    void deallocate(T* p, size_t n) noexcept
+    {
+        BusI2CMemPlacement::freeBulk(p);
+    }
+
+    template <typename U>
+    bool operator==(const BusI2CBulkAllocator<U>&) const noexcept
+    {
+        return true;
+    }
+    template <typename U>
+    bool operator!=(const BusI2CBulkAllocator<U>&) const noexcept
+    {
+        return false;
+    }
+};
@@ -139,3 +139,26 @@ int BusI2CScheduler::getNext()
     LOG_D(MODULE_PREFIX, "SchedulerRRP: dropped out");
     return -1;
 }
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get the time until the next poll is due
+// Only the element with the fastest rate is gated by time - all other elements are serviced on the
+// passes in between so, if the current index is not the fastest element, a poll is due immediately
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t BusI2CScheduler::getMsUntilNextDue(uint32_t curTimeMs) const
+{
+    // Check valid
+    if (_pollFreqsHz.size() == 0)
+        return UINT32_MAX;
+
+    // Check if waiting on the fastest element
+    if ((_pollCurIdx < _pollFreqsHz.size()) && (_pollCurIdx != _elemWithFastestRateIdx))
+        return 0;
+
+    // Time remaining (isTimeout requires the interval to be exceeded hence the +1)
+    uint32_t elapsedMs = Raft::timeElapsed(curTimeMs, _pollLastTimeMs);
+    if (elapsedMs > _pollMinTimeMs)
+        return 0;
+    return _pollMinTimeMs - elapsedMs + 1;
+}
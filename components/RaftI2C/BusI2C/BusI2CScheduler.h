@@ -38,6 +38,12 @@ public:
     void prepStats();
     int getNext();
 
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get time until the next poll is due
+    /// @param curTimeMs current time in ms
+    /// @return time in ms until the next poll is due (UINT32_MAX if nothing to poll)
+    uint32_t getMsUntilNextDue(uint32_t curTimeMs) const;
+
 private:
     // All these vectors should be the same length!
     std::vector<double> _pollFreqsHz;
@@ -0,0 +1,128 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Scheduler for Earliest-Deadline-First polling
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include "BusI2CSchedulerEDF.h"
+
+// #define DEBUG_POLLING_EDF_NEXT
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Add a node
+// Each node has its own interval and deadline so rates which are not integer multiples of each other
+// don't drift and a fast node doesn't change the rate at which other nodes are polled
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BusI2CSchedulerEDF::addNode(double pollFreqHz, uint64_t timeNowUs)
+{
+    // Interval
+    SchedEntry entry;
+    entry.intervalUs = DEFAULT_POLL_INTERVAL_US;
+    if (pollFreqHz > 0)
+        entry.intervalUs = (uint64_t)(1000000.0 / pollFreqHz);
+    if (entry.intervalUs < MIN_POLL_INTERVAL_US)
+        entry.intervalUs = MIN_POLL_INTERVAL_US;
+    _entries.push_back(entry);
+
+    // First poll is due now
+    HeapItem item = { timeNowUs, (uint32_t)(_entries.size() - 1) };
+    _dueHeap.push_back(item);
+    std::push_heap(_dueHeap.begin(), _dueHeap.end(), heapCompare);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get the next node index to poll
+// Returns -1 if list is empty or the earliest deadline has not yet been reached
+// The next deadline is based on the previous deadline (not the time of the poll) to avoid drift - but if
+// a whole interval has been missed the deadline is reset from now rather than bursting to catch up
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int BusI2CSchedulerEDF::getNext(uint64_t timeNowUs)
+{
+    // Check anything due
+    if (_dueHeap.empty() || (_dueHeap.front().nextDueUs > timeNowUs))
+        return -1;
+
+    // Remove earliest deadline
+    std::pop_heap(_dueHeap.begin(), _dueHeap.end(), heapCompare);
+    HeapItem& item = _dueHeap.back();
+    uint32_t pollIdx = item.idx;
+    SchedEntry& entry = _entries[pollIdx];
+
+    // Jitter stats
+    uint64_t lateUs = timeNowUs - item.nextDueUs;
+    entry.pollCount++;
+    entry.sumLateUs += lateUs;
+    if (entry.maxLateUs < lateUs)
+        entry.maxLateUs = lateUs > UINT32_MAX ? UINT32_MAX : (uint32_t)lateUs;
+
+    // Next deadline
+    item.nextDueUs += entry.intervalUs;
+    if (item.nextDueUs <= timeNowUs)
+    {
+        entry.missedCount++;
+        item.nextDueUs = timeNowUs + entry.intervalUs;
+    }
+
+#ifdef DEBUG_POLLING_EDF_NEXT
+    LOG_I(MODULE_PREFIX, "getNext idx %d lateUs %d nextDueUs %lld",
+                pollIdx, (int)lateUs, item.nextDueUs);
+#endif
+
+    // Return to heap
+    std::push_heap(_dueHeap.begin(), _dueHeap.end(), heapCompare);
+    return pollIdx;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get the time until the next poll is due
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t BusI2CSchedulerEDF::getMsUntilNextDue(uint64_t timeNowUs) const
+{
+    // Check valid
+    if (_dueHeap.empty())
+        return UINT32_MAX;
+
+    // Time remaining (rounded up to whole ms)
+    uint64_t nextDueUs = _dueHeap.front().nextDueUs;
+    if (nextDueUs <= timeNowUs)
+        return 0;
+    return (nextDueUs - timeNowUs + 999) / 1000;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get jitter statistics for a node
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool BusI2CSchedulerEDF::getJitterStats(uint32_t idx, uint32_t& pollCount, uint32_t& avgLateUs, uint32_t& maxLateUs,
+            uint32_t& missedCount) const
+{
+    if (idx >= _entries.size())
+        return false;
+    const SchedEntry& entry = _entries[idx];
+    pollCount = entry.pollCount;
+    avgLateUs = pollCount > 0 ? entry.sumLateUs / pollCount : 0;
+    maxLateUs = entry.maxLateUs;
+    missedCount = entry.missedCount;
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Clear jitter statistics
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BusI2CSchedulerEDF::clearJitterStats()
+{
+    for (SchedEntry& entry : _entries)
+    {
+        entry.pollCount = 0;
+        entry.missedCount = 0;
+        entry.sumLateUs = 0;
+        entry.maxLateUs = 0;
+    }
+}
@@ -0,0 +1,104 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Scheduler for Earliest-Deadline-First polling
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "Logger.h"
+#include "RaftUtils.h"
+#include "RaftArduino.h"
+
+class BusI2CSchedulerEDF
+{
+public:
+    BusI2CSchedulerEDF()
+    {
+    }
+
+    void clear()
+    {
+        _entries.clear();
+        _dueHeap.clear();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Add a node to the scheduler
+    /// @param pollFreqHz poll frequency in Hz (0 polls at the default interval)
+    /// @param timeNowUs current time in us (the first poll is due immediately)
+    void addNode(double pollFreqHz, uint64_t timeNowUs);
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the next node index to poll
+    /// @param timeNowUs current time in us
+    /// @return index of node to poll or -1 if nothing is due
+    int getNext(uint64_t timeNowUs);
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get time until the next poll is due
+    /// @param timeNowUs current time in us
+    /// @return time in ms until the next poll is due (UINT32_MAX if nothing to poll)
+    uint32_t getMsUntilNextDue(uint64_t timeNowUs) const;
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get jitter statistics for a node
+    /// @param idx node index
+    /// @param pollCount (out) number of polls since stats cleared
+    /// @param avgLateUs (out) average time between deadline and poll (us)
+    /// @param maxLateUs (out) maximum time between deadline and poll (us)
+    /// @param missedCount (out) number of times a whole interval was missed
+    /// @return true if index valid
+    bool getJitterStats(uint32_t idx, uint32_t& pollCount, uint32_t& avgLateUs, uint32_t& maxLateUs,
+                uint32_t& missedCount) const;
+
+    // Clear jitter statistics
+    void clearJitterStats();
+
+    // Get number of nodes
+    uint32_t size() const
+    {
+        return _entries.size();
+    }
+
+private:
+    // Entry for each node
+    class SchedEntry
+    {
+    public:
+        uint64_t intervalUs = 0;
+        uint32_t pollCount = 0;
+        uint32_t missedCount = 0;
+        uint64_t sumLateUs = 0;
+        uint32_t maxLateUs = 0;
+    };
+    std::vector<SchedEntry> _entries;
+
+    // Min-heap of next due times
+    class HeapItem
+    {
+    public:
+        uint64_t nextDueUs;
+        uint32_t idx;
+    };
+    std::vector<HeapItem> _dueHeap;
+
+    // Heap ordering (std heap functions build a max-heap so invert the comparison)
+    static bool heapCompare(const HeapItem& a, const HeapItem& b)
+    {
+        return a.nextDueUs > b.nextDueUs;
+    }
+
+    // Interval used for nodes with a zero poll rate
+    static const uint64_t DEFAULT_POLL_INTERVAL_US = 1000000;
+
+    // Minimum interval between polls of any single node
+    static const uint64_t MIN_POLL_INTERVAL_US = 1000;
+
+    // Debug
+    static constexpr const char* MODULE_PREFIX = "RaftI2CBusSchedEDF";
+};
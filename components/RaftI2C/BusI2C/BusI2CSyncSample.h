@@ -0,0 +1,145 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Bus I2C Sync Sample
+// Synchronised sampling - a general call broadcast triggers all participating devices together
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include "RaftJsonIF.h"
+#include "RaftArduino.h"
+#include "Logger.h"
+#include "RaftUtils.h"
+#include "RaftBus.h"
+#include "BusI2CAddrAndSlot.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class BusI2CSyncSample
+/// @brief Sync sample settings and the devices which participate
+/// @note When enabled a sync sample is performed every periodMs: the trigger data is broadcast to the general call
+///       address (0x00) once with all of the configured slots (slot 0 is the main bus) enabled together and then,
+///       after readDelayMs (to allow the devices' conversions to complete), every online device on those slots is
+///       read in turn using its ident poll. The readout is spread over worker loops within the poll bus time
+///       budget. All of the results carry the time of the trigger so samples from different devices line up.
+///       Participating devices are not polled individually. Only slots on multiplexers connected to the main bus
+///       can be enabled together so slots on cascaded multiplexers don't receive the trigger. The trigger data is
+///       device specific (the second byte of a general call is a command - 0x06 resets I2C devices and 0x04 makes
+///       them latch their programmable address pins so these must not be used) and triggerTimeMs appends the
+///       trigger time in ms (4 bytes big-endian) for devices which use broadcast time sync. This is only accessed
+///       from the I2C task (other than setup) so no mutex is required
+class BusI2CSyncSample
+{
+public:
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup
+    /// @param config configuration (syncSample section) - e.g. {"periodMs":100,"trigger":"0x08","slots":[0,1],
+    ///        "readDelayMs":5}
+    void setup(const RaftJsonIF& config)
+    {
+        // Settings
+        _periodMs = config.getLong("periodMs", 0);
+        _readDelayMs = config.getLong("readDelayMs", 0);
+        _triggerTimeMs = config.getBool("triggerTimeMs", false);
+        _triggerData.clear();
+        _slots.clear();
+
+        // Trigger data (hex - an odd number of digits is invalid rather than the last digit being dropped)
+        String triggerStr = config.getString("trigger", "");
+        if (triggerStr.startsWith("0x") || triggerStr.startsWith("0X"))
+            triggerStr = triggerStr.substring(2);
+        bool triggerStrValid = (triggerStr.length() % 2) == 0;
+        for (uint32_t i = 0; triggerStrValid && (i + 1 < triggerStr.length()); i += 2)
+            _triggerData.push_back(strtoul(triggerStr.substring(i, i + 2).c_str(), nullptr, 16));
+
+        // Slots (default main bus only)
+        std::vector<int> slotNums;
+        config.getArrayInts("slots", slotNums);
+        if (slotNums.size() == 0)
+            slotNums.push_back(0);
+        for (int slotNum : slotNums)
+            if ((slotNum >= 0) && (std::find(_slots.begin(), _slots.end(), (uint32_t)slotNum) == _slots.end()))
+                _slots.push_back(slotNum);
+
+        // Check valid (general call reset and write address commands must not be sent)
+        if ((_periodMs != 0) && ((_triggerData.size() == 0) ||
+                    (_triggerData[0] == GENERAL_CALL_RESET) || (_triggerData[0] == GENERAL_CALL_WRITE_ADDR)))
+        {
+            LOG_W(MODULE_PREFIX, "setup syncSample trigger %s INVALID", triggerStr.c_str());
+            _periodMs = 0;
+        }
+        if (_periodMs != 0)
+        {
+            LOG_I(MODULE_PREFIX, "setup syncSample periodMs %d trigger %s triggerTimeMs %s readDelayMs %d numSlots %d",
+                        _periodMs, triggerStr.c_str(), _triggerTimeMs ? "Y" : "N", _readDelayMs, _slots.size());
+        }
+    }
+
+    // Check if enabled
+    bool isEnabled() const
+    {
+        return _periodMs != 0;
+    }
+
+    // Get period
+    uint32_t getPeriodMs() const
+    {
+        return _periodMs;
+    }
+
+    // Get delay between the trigger and the readout
+    uint32_t getReadDelayMs() const
+    {
+        return _readDelayMs;
+    }
+
+    // Get slots triggered (slot 0 is the main bus)
+    const std::vector<uint32_t>& getSlots() const
+    {
+        return _slots;
+    }
+
+    // Check if a device participates (sync sampling enabled and the device is on one of the slots)
+    bool isParticipant(BusElemAddrType address) const
+    {
+        if (!isEnabled())
+            return false;
+        uint32_t slotNum = BusI2CAddrAndSlot::getSlotNum(address);
+        return std::find(_slots.begin(), _slots.end(), slotNum) != _slots.end();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the trigger data
+    /// @param triggerTimeMs time of the trigger (appended if configured)
+    /// @param triggerData (out) data to broadcast (the storage is reused so this doesn't allocate once sized)
+    void getTriggerData(uint32_t triggerTimeMs, std::vector<uint8_t>& triggerData) const
+    {
+        triggerData.assign(_triggerData.begin(), _triggerData.end());
+        if (!_triggerTimeMs)
+            return;
+        triggerData.resize(_triggerData.size() + sizeof(uint32_t));
+        Raft::setBEUInt32(triggerData.data(), _triggerData.size(), triggerTimeMs);
+    }
+
+    // General call address and the reset and write programmable address commands (second byte)
+    static const uint32_t GENERAL_CALL_ADDR = 0x00;
+    static const uint8_t GENERAL_CALL_RESET = 0x06;
+    static const uint8_t GENERAL_CALL_WRITE_ADDR = 0x04;
+
+private:
+    // Settings
+    uint32_t _periodMs = 0;
+    uint32_t _readDelayMs = 0;
+    bool _triggerTimeMs = false;
+    std::vector<uint8_t> _triggerData;
+    std::vector<uint32_t> _slots;
+
+    // Debug
+    static constexpr const char* MODULE_PREFIX = "RaftI2CSyncSample";
+};
@@ -6,12 +6,14 @@
 //
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+#include <string.h>
 #include "BusMultiplexers.h"
 #include "RaftJsonPrefixed.h"
 #include "BusI2CElemTracker.h"
 #include "RaftJson.h"
 #include "RaftUtils.h"
 #include "RaftThreading.h"
+#include "BusI2CAddrAndSlot.h"
 
 #define DEBUG_BUS_MUX_SETUP
 // #define DEBUG_BUS_STUCK_WITH_GPIO_NUM 18
@@ -26,6 +28,7 @@
 // #define DEBUG_BUS_MUX_RESET_MULT_LEVEL
 // #define DEBUG_CLEAR_CASCADED_MUX
 // #define DEBUG_FORCE_NO_RESET_PINS
+// #define DEBUG_SLOT_GROUPS
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Constructor
@@ -120,6 +123,12 @@ void BusMultiplexers::loop()
 /// @brief Service called from I2C task
 void BusMultiplexers::taskService()
 {
+    // Check if a power cycle has resolved a bus stuck event (once power is stable again)
+    BusStuckHandler::RecoveryStage stage = BusStuckHandler::RECOVERY_STAGE_CLOCK;
+    bool stageActioned = false;
+    if (_busStuckHandler.getRecoveryStage(stage, stageActioned) && stageActioned &&
+                _busPowerController.isSlotPowerStable(_busStuckRecoverySlotNum) && !_busStuckHandler.isStuck())
+        _busStuckHandler.recoveryResolved(millis());
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -234,6 +243,9 @@ bool BusMultiplexers::elemStateChange(uint32_t addr, uint32_t slotNum, bool elem
     // Update the slot indices
     if (changeDetected)
     {
+        // Slot groups depend on the muxes found so are cleared until updated
+        _slotGroupMasks.clear();
+
         // Update the slot indices
         _busMuxSlotIndices.clear();
         for (uint32_t i = 0; i < _busMuxRecs.size(); i++)
@@ -375,6 +387,25 @@ RaftRetCode BusMultiplexers::writeSlotMaskToMux(uint32_t muxIdx,
 /// @return OK if successful, otherwise error code which may be invalid if the slotNum doesn't exist or 
 ///         bus stuck codes if the bus is now stuck or power unstable if a device is powering up
 RaftRetCode BusMultiplexers::enableOneSlot(uint32_t slotNum)
+{
+    return enableSlots(slotNum, false);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Enable a slot along with the other slots in its slot group
+/// @param slotNum Slot number (1-based) - may be 0 for main bus
+/// @return OK if successful, otherwise error code as for enableOneSlot()
+RaftRetCode BusMultiplexers::enableSlotGroup(uint32_t slotNum)
+{
+    return enableSlots(slotNum, true);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Enable slots on bus multiplexer(s)
+/// @param slotNum Slot number (1-based) - may be 0 for main bus
+/// @param withSlotGroup Enable the other slots in the slot's group too
+/// @return Result code (as for enableOneSlot())
+RaftRetCode BusMultiplexers::enableSlots(uint32_t slotNum, bool withSlotGroup)
 {
     // If the bus is stuck at this point it implies that a main bus issue has occurred or there is an issue with the last slot
     // that was enabled (if it was definitely a single-slot issue it would have been detected after the slot was first enabled).
@@ -383,16 +414,8 @@ RaftRetCode BusMultiplexers::enableOneSlot(uint32_t slotNum)
     bool busIsStuck = _busStuckHandler.isStuck();
     if (busIsStuck)
     {
-        // Repeat here seveal times to try to clear the bus-stuck problem
-        for (uint32_t busClearAttemptIdx = 0; busClearAttemptIdx < BUS_CLEAR_ATTEMPT_REPEAT_COUNT; busClearAttemptIdx++)
-        {
-            // Attempt to clear bus-stuck (returns true if it resolved the issue)
-            if (attemptToClearBusStuck(true, slotNum))
-                break;
-        }
-
-        // Check if still stuck
-        if (_busStuckHandler.isStuck())
+        // Attempt to clear bus-stuck using the recovery ladder (returns true if it resolved the issue)
+        if (!attemptToClearBusStuck(true, slotNum))
             return RAFT_BUS_STUCK;
     }
 
@@ -422,8 +445,18 @@ RaftRetCode BusMultiplexers::enableOneSlot(uint32_t slotNum)
         return RAFT_BUS_SLOT_POWER_UNSTABLE;
     }
 
-    // Enable the slot
+    // Enable the slot (and the other slots in its group which have stable power)
     uint32_t mask = 1 << slotIdx;
+    if (withSlotGroup && (slotNum <= _slotGroupMasks.size()))
+    {
+        uint32_t groupMask = _slotGroupMasks[slotNum-1];
+        uint32_t muxSlotBase = muxIdx * I2C_BUS_MUX_SLOT_COUNT;
+        for (uint32_t groupSlotIdx = 0; groupSlotIdx < I2C_BUS_MUX_SLOT_COUNT; groupSlotIdx++)
+        {
+            if ((groupMask & (1 << groupSlotIdx)) && _busPowerController.isSlotPowerStable(muxSlotBase + groupSlotIdx + 1))
+                mask |= 1 << groupSlotIdx;
+        }
+    }
     bool slotSetOk = setSlotEnables(muxIdx, mask, false) == RAFT_OK;
 
     // Check if bus is now stuck - if we have an issue at this point it is probably due to a single slot because
@@ -432,25 +465,140 @@ RaftRetCode BusMultiplexers::enableOneSlot(uint32_t slotNum)
     busIsStuck = _busStuckHandler.isStuck();
     if (busIsStuck)
     {
-        // Repeat here seveal times to try to clear the bus-stuck problem
-        for (uint32_t busClearAttemptIdx = 0; busClearAttemptIdx < BUS_CLEAR_ATTEMPT_REPEAT_COUNT; busClearAttemptIdx++)
+        // If the bus is stuck at this point then it is not possible to enable a slot
+        // so try to clear the bus-stuck problem in any way possible
+        // (returns true if it resolved the issue)
+        if (!attemptToClearBusStuck(true, slotNum))
+            return RAFT_BUS_STUCK;
+    }
+
+    // Return result
+    return slotSetOk ? RAFT_OK : RAFT_BUS_ACK_ERROR;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Enable a set of slots together
+/// @param slotNums Slot numbers (1-based - 0 for the main bus is ignored)
+/// @return OK if successful, otherwise error code as for enableOneSlot()
+RaftRetCode BusMultiplexers::enableSlotSet(const std::vector<uint32_t>& slotNums)
+{
+    // Clear bus stuck if required
+    if (_busStuckHandler.isStuck() && !attemptToClearBusStuck(false, 0))
+        return RAFT_BUS_STUCK;
+
+    // Start with all slots disabled and then enable the slots on each main bus connected mux
+    disableAllSlots(false);
+    bool slotSetOk = true;
+    for (uint32_t muxIdx = 0; muxIdx < _busMuxRecs.size(); muxIdx++)
+    {
+        const BusMux& busMux = _busMuxRecs[muxIdx];
+        if (!busMux.isOnline || (busMux.muxConnSlotNum != 0))
+            continue;
+        uint32_t mask = 0;
+        for (uint32_t slotNum : slotNums)
         {
-            // If the bus is stuck at this point then it is not possible to enable a slot
-            // so try to clear the bus-stuck problem in any way possible
-            // (returns true if it resolved the issue)
-            if (attemptToClearBusStuck(true, slotNum))
-                break;
+            uint32_t slotMuxIdx = 0;
+            uint32_t slotIdx = 0;
+            if (getMuxAndSlotIdx(slotNum, slotMuxIdx, slotIdx) && (slotMuxIdx == muxIdx) && 
+                        _busPowerController.isSlotPowerStable(slotNum))
+                mask |= 1 << slotIdx;
         }
+        if (mask != 0)
+            slotSetOk &= setSlotEnables(muxIdx, mask, false) == RAFT_OK;
     }
 
-    // Check for bus still stuck
-    if (_busStuckHandler.isStuck())
+    // Check if bus is now stuck
+    if (_busStuckHandler.isStuck() && !attemptToClearBusStuck(false, 0))
         return RAFT_BUS_STUCK;
-
-    // Return result
     return slotSetOk ? RAFT_OK : RAFT_BUS_ACK_ERROR;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Update slot groups from the topology
+/// @param addresses Addresses (inc slot) of all elements found on the bus
+/// @param pClockSpeeds clock speeds (slots are only grouped with others of the same frequency) - may be nullptr
+void BusMultiplexers::updateSlotGroups(const std::vector<BusElemAddrType>& addresses, const BusI2CClockSpeeds* pClockSpeeds)
+{
+    // Clear groups
+    _slotGroupMasks.assign(_busMuxRecs.size() * I2C_BUS_MUX_SLOT_COUNT, 0);
+
+    // Group slots on each mux connected to the main bus
+    for (uint32_t muxIdx = 0; muxIdx < _busMuxRecs.size(); muxIdx++)
+    {
+        const BusMux& busMux = _busMuxRecs[muxIdx];
+        if (!busMux.isOnline || (busMux.muxConnSlotNum != 0))
+            continue;
+
+        // Addresses found on each slot of this mux
+        uint32_t muxSlotBase = muxIdx * I2C_BUS_MUX_SLOT_COUNT;
+        BusI2CAddrBits slotAddrBits[I2C_BUS_MUX_SLOT_COUNT];
+        uint32_t occupiedMask = 0;
+        for (BusElemAddrType address : addresses)
+        {
+            BusI2CAddrAndSlot addrAndSlot = BusI2CAddrAndSlot::fromBusElemAddrType(address);
+            if ((addrAndSlot.slotNum <= muxSlotBase) || (addrAndSlot.slotNum > muxSlotBase + I2C_BUS_MUX_SLOT_COUNT) ||
+                        (addrAndSlot.i2cAddr > I2C_BUS_ADDRESS_MAX))
+                continue;
+            uint32_t slotIdx = addrAndSlot.slotNum - muxSlotBase - 1;
+            slotAddrBits[slotIdx].set(addrAndSlot.i2cAddr);
+            occupiedMask |= 1 << slotIdx;
+        }
+
+        // Slots leading to cascaded muxes are not grouped
+        for (const BusMux& cascadedMux : _busMuxRecs)
+        {
+            if (cascadedMux.isOnline && (cascadedMux.muxConnSlotNum > muxSlotBase) && 
+                        (cascadedMux.muxConnSlotNum <= muxSlotBase + I2C_BUS_MUX_SLOT_COUNT))
+                occupiedMask &= ~(1 << (cascadedMux.muxConnSlotNum - muxSlotBase - 1));
+        }
+
+        // Frequency of each slot
+        uint32_t slotFreqs[I2C_BUS_MUX_SLOT_COUNT] = {};
+        if (pClockSpeeds)
+        {
+            for (uint32_t slotIdx = 0; slotIdx < I2C_BUS_MUX_SLOT_COUNT; slotIdx++)
+                slotFreqs[slotIdx] = pClockSpeeds->getSlotAccessFreq(muxSlotBase + slotIdx + 1);
+        }
+
+        // Form groups in slot order by adding each slot with the same frequency and no addresses in common with
+        // the group so far
+        uint32_t groupedMask = 0;
+        for (uint32_t slotIdx = 0; slotIdx < I2C_BUS_MUX_SLOT_COUNT; slotIdx++)
+        {
+            if (!(occupiedMask & (1 << slotIdx)) || (groupedMask & (1 << slotIdx)))
+                continue;
+            uint32_t groupMask = 1 << slotIdx;
+            BusI2CAddrBits groupAddrBits = slotAddrBits[slotIdx];
+            for (uint32_t otherSlotIdx = slotIdx + 1; otherSlotIdx < I2C_BUS_MUX_SLOT_COUNT; otherSlotIdx++)
+            {
+                if (!(occupiedMask & (1 << otherSlotIdx)) || (groupedMask & (1 << otherSlotIdx)))
+                    continue;
+                if ((slotFreqs[otherSlotIdx] != slotFreqs[slotIdx]) || 
+                            groupAddrBits.intersects(slotAddrBits[otherSlotIdx]))
+                    continue;
+                groupMask |= 1 << otherSlotIdx;
+                groupAddrBits |= slotAddrBits[otherSlotIdx];
+            }
+            groupedMask |= groupMask;
+
+            // A group of one slot is the same as no group
+            if (groupMask == (1UL << slotIdx))
+                continue;
+            for (uint32_t groupSlotIdx = 0; groupSlotIdx < I2C_BUS_MUX_SLOT_COUNT; groupSlotIdx++)
+                if (groupMask & (1 << groupSlotIdx))
+                    _slotGroupMasks[muxSlotBase + groupSlotIdx] = groupMask;
+        }
+    }
+
+#ifdef DEBUG_SLOT_GROUPS
+    String debugStr;
+    for (uint32_t i = 0; i < _slotGroupMasks.size(); i++)
+        if (_slotGroupMasks[i] != 0)
+            debugStr += String(i+1) + ":" + String(_slotGroupMasks[i], 16) + " ";
+    LOG_I(MODULE_PREFIX, "updateSlotGroups numAddrs %d groups %s", addresses.size(), debugStr.c_str());
+#endif
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Disable all slots on bus multiplexers
 void BusMultiplexers::disableAllSlots(bool force)
@@ -638,6 +786,9 @@ uint32_t BusMultiplexers::getNextSlotNum(uint32_t slotNum)
 /// @param failAfterSlotSet Bus stuck after setting slot (so an individual slot maybe at fault)
 /// @param slotNum Slot number (1-based) (valid if after slot set)
 /// @return True if succeeded in clearing the bus stuck problem
+/// @note The stages of the recovery ladder (configured in the bus stuck handler) are worked through in order
+///       with each given its timeout to clear the bus. A power cycle can't complete here so, once started, it
+///       is given its timeout (on subsequent attempts) before escalating to the next stage
 bool BusMultiplexers::attemptToClearBusStuck(bool failAfterSlotSet, uint32_t slotNum)
 {
 #ifdef DEBUG_BUS_STUCK
@@ -657,49 +808,102 @@ bool BusMultiplexers::attemptToClearBusStuck(bool failAfterSlotSet, uint32_t slo
     }
 #endif
 
-    // Attempt to clear the bus-stuck issue by clocking the bus
-    _busStuckHandler.clearStuckByClocking();
-
-#ifdef DEBUG_BUS_STUCK_WITH_GPIO_NUM
-    delayMicroseconds(10);
-    for (int i = 0; i < 3; i++)
-    {
-        digitalWrite(DEBUG_BUS_STUCK_WITH_GPIO_NUM, HIGH);
-        delayMicroseconds(1);
-        digitalWrite(DEBUG_BUS_STUCK_WITH_GPIO_NUM, LOW);
-        delayMicroseconds(1);
-    }
-    delayMicroseconds(10);
-#endif
+    // Start recovery (continues the ladder if already in progress)
+    _busStuckHandler.recoveryStart(millis());
 
-    // Check if still stuck
-    bool busIsStuck = _busStuckHandler.isStuck();
-    if (busIsStuck)
+    // Work up the recovery ladder
+    BusStuckHandler::RecoveryStage stage = BusStuckHandler::RECOVERY_STAGE_CLOCK;
+    bool stageActioned = false;
+    while (_busStuckHandler.getRecoveryStage(stage, stageActioned))
     {
-        // Clear the stuck bus problem by initially disabling all slots 
-        disableAllSlots(true);
-
-        // Check if failure occurred after the slot was set
-        if (failAfterSlotSet && _busPowerController.isSlotPowerControlled(slotNum))
+        // A power cycle in progress is given its timeout before escalating
+        if (stageActioned)
         {
-            // Inform the bus status manager that a slot is powering down
-            std::vector<BusElemAddrType> listOfAddr;
-            _busElemTracker.getAddrList(slotNum, listOfAddr);
-            _busStatusMgr.goingOffline(listOfAddr);
+            if (!_busStuckHandler.isRecoveryStageTimedOut(millis()))
+                return false;
+            _busStuckHandler.recoveryStageNext();
+            continue;
+        }
 
-            // Start power cycling the slot
-            _busPowerController.powerCycleSlot(slotNum);
+        // Action the stage
+        bool isPowerCycle = false;
+        bool stageApplicable = true;
+        switch (stage)
+        {
+            case BusStuckHandler::RECOVERY_STAGE_CLOCK:
+                // Clock the bus to release a device holding SDA
+                _busStuckHandler.clearStuckByClocking();
+                break;
+            case BusStuckHandler::RECOVERY_STAGE_STOP:
+                // Send a STOP to release devices part way through a transaction
+                _busStuckHandler.clearStuckBySendingStop();
+                break;
+            case BusStuckHandler::RECOVERY_STAGE_MUX_RESET:
+                // Disable all slots (using reset pins if available) to isolate the slot at fault
+                disableAllSlots(true);
+                break;
+            case BusStuckHandler::RECOVERY_STAGE_SLOT_POWER_CYCLE:
+            {
+                // Only possible if failure occurred after the slot was set and the slot is power controlled
+                stageApplicable = failAfterSlotSet && (slotNum != 0) && _busPowerController.isSlotPowerControlled(slotNum);
+                if (!stageApplicable)
+                    break;
+
+                // Inform the bus status manager that a slot is powering down
+                disableAllSlots(true);
+                std::vector<BusElemAddrType> listOfAddr;
+                _busElemTracker.getAddrList(slotNum, listOfAddr);
+                _busStatusMgr.goingOffline(listOfAddr);
+
+                // Start power cycling the slot
+                _busPowerController.powerCycleSlot(slotNum);
+                _busStuckRecoverySlotNum = slotNum;
+                isPowerCycle = true;
+                break;
+            }
+            case BusStuckHandler::RECOVERY_STAGE_BUS_POWER_CYCLE:
+            {
+                // Only possible if the main bus is power controlled
+                stageApplicable = _busPowerController.isSlotPowerControlled(0);
+                if (!stageApplicable)
+                    break;
+
+                // Inform the bus status manager that the bus is powering down
+                disableAllSlots(true);
+                std::vector<BusElemAddrType> listOfAddr;
+                _busElemTracker.getAddrList(0, listOfAddr);
+                _busStatusMgr.goingOffline(listOfAddr);
+
+                // Clear the stuck bus problem by power cycling the entire bus
+                _busPowerController.powerCycleSlot(0);
+                _busStuckRecoverySlotNum = 0;
+                isPowerCycle = true;
+                break;
+            }
+            default:
+                stageApplicable = false;
+                break;
         }
-        else
+
+        // Skip stages which aren't applicable
+        if (!stageApplicable)
         {
-            // Inform the bus status manager that the bus is powering down
-            std::vector<BusElemAddrType> listOfAddr;
-            _busElemTracker.getAddrList(0, listOfAddr);
-            _busStatusMgr.goingOffline(listOfAddr);
+            _busStuckHandler.recoveryStageNext();
+            continue;
+        }
+        _busStuckHandler.recoveryStageActioned(millis());
 
-            // Clear the stuck bus problem by power cycling the entire bus
-            _busPowerController.powerCycleSlot(0);
+        // Power cycles are checked for completion in taskService()
+        if (isPowerCycle)
+            return false;
+
+        // Wait for the bus to clear (up to the stage timeout)
+        if (_busStuckHandler.recoveryWaitForClear())
+        {
+            _busStuckHandler.recoveryResolved(millis());
+            break;
         }
+        _busStuckHandler.recoveryStageNext();
     }
 
 #ifdef DEBUG_BUS_STUCK_WITH_GPIO_NUM
@@ -12,6 +12,7 @@
 #include "BusStuckHandler.h"
 #include "BusStatusMgr.h"
 #include "BusI2CElemTracker.h"
+#include "BusI2CClockSpeeds.h"
 #include "RaftJsonIF.h"
 #include "driver/gpio.h"
 
@@ -110,6 +111,40 @@ public:
     /// @param force Force disable even if the status indicates it is not necessary
     void disableAllSlots(bool force);
 
+    /// @brief Enable a set of slots together (e.g. so a broadcast reaches the devices on all of them)
+    /// @param slotNums Slot numbers (1-based - 0 for the main bus is ignored as the main bus is always reached)
+    /// @return OK if successful, otherwise error code as for enableOneSlot()
+    /// @note Only slots on multiplexers connected to the main bus are enabled (a cascaded multiplexer's slots
+    ///       can't be enabled alongside others) and slots which do not have stable power are left disabled
+    RaftRetCode enableSlotSet(const std::vector<uint32_t>& slotNums);
+
+    /// @brief Enable a slot along with the other slots in its slot group (see updateSlotGroups())
+    /// @param slotNum Slot number (1-based) - may be 0 for main bus
+    /// @return OK if successful, otherwise error code as for enableOneSlot()
+    /// @note Slots in the group which do not have stable power are left disabled
+    RaftRetCode enableSlotGroup(uint32_t slotNum);
+
+    /// @brief Update slot groups from the topology
+    /// @param addresses Addresses (inc slot) of all elements found on the bus
+    /// @param pClockSpeeds clock speeds (slots are only grouped with others of the same frequency) - may be nullptr
+    /// @note Slots on the same (main bus connected) multiplexer are grouped when no address is found on more than
+    ///       one slot in the group - so all slots in a group can be enabled together and their devices accessed
+    ///       without mux switching. Slots with no elements or with a cascaded multiplexer are not grouped and
+    ///       slots with different frequencies (slotFreqs) are kept apart as a slow slot's wiring would be
+    ///       connected while accessing a device on a faster slot
+    void updateSlotGroups(const std::vector<BusElemAddrType>& addresses, const BusI2CClockSpeeds* pClockSpeeds = nullptr);
+
+    /// @brief Get slot group key
+    /// @param slotNum Slot number (1-based) - may be 0 for main bus
+    /// @return Lowest slot number in the slot's group (or slotNum if the slot is not grouped)
+    uint32_t getSlotGroupKey(uint32_t slotNum) const
+    {
+        if ((slotNum == 0) || (slotNum > _slotGroupMasks.size()) || (_slotGroupMasks[slotNum-1] == 0))
+            return slotNum;
+        uint32_t muxSlotBase = ((slotNum-1) / I2C_BUS_MUX_SLOT_COUNT) * I2C_BUS_MUX_SLOT_COUNT;
+        return muxSlotBase + __builtin_ctz(_slotGroupMasks[slotNum-1]) + 1;
+    }
+
     /// @brief Get bus multiplexer slot indices
     /// @return Valid indices of bus multiplexer slots
     const std::vector<uint8_t>& getSlotIndices() const
@@ -130,9 +165,6 @@ public:
     static const uint32_t I2C_BUS_MUX_ALL_CHANS_OFF = 0;
     static const uint32_t I2C_BUS_MUX_ALL_CHANS_ON = 0xff;
 
-    // Number of times to retry bus stuck recovery
-    static const uint32_t BUS_CLEAR_ATTEMPT_REPEAT_COUNT = 5;
-
     // Max number of recurse levels mux connected to mux connected to mux etc
     static const uint32_t MAX_RECURSE_LEVEL_MUX_CONNECTIONS = 5;
 
@@ -146,6 +178,9 @@ private:
     // Bus stuck handler
     BusStuckHandler& _busStuckHandler;
 
+    // Slot being power cycled to recover from a bus stuck event (0 for main bus)
+    uint32_t _busStuckRecoverySlotNum = 0;
+
     // Bus status manager
     BusStatusMgr& _busStatusMgr;
 
@@ -195,6 +230,10 @@ private:
     // Bus mux slot indices (that have been found on discovered bus multiplexers)
     std::vector<uint8_t> _busMuxSlotIndices;
 
+    // Slot group masks (indexed by slot number - 1) - each is the mask of slots on the same mux which are enabled
+    // together with the slot (0 if the slot is not grouped)
+    std::vector<uint8_t> _slotGroupMasks;
+
     // Flag indicating at least one second-level mux is detected
     // A second-level mux is where one mux is connected via another mux
     bool _secondLevelMuxDetected = false;
@@ -222,6 +261,13 @@ private:
     RaftRetCode writeSlotMaskToMux(uint32_t muxIdx, 
                 uint32_t slotMask, bool force, uint32_t recurseLevel);
 
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Enable slots on bus multiplexer(s)
+    /// @param slotNum Slot number (1-based) - may be 0 for main bus
+    /// @param withSlotGroup Enable the other slots in the slot's group too
+    /// @return Result code (as for enableOneSlot())
+    RaftRetCode enableSlots(uint32_t slotNum, bool withSlotGroup);
+
     /// @brief Disable all slots on cascaded bus multiplexers
     void clearCascadedMuxes(uint32_t muxIdx);
 
@@ -0,0 +1,472 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Bus Poll Scheduler
+// Single scheduler for all periodic bus transactions (device ident polls and the polling list)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include "BusPollScheduler.h"
+#include "Logger.h"
+
+// #define DEBUG_POLL_SCHEDULER_NEXT
+// #define DEBUG_POLL_SCHEDULER_CHANGES
+// #define DEBUG_POLL_SCHEDULER_BACKOFF
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Constructor and destructor
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BusPollScheduler::BusPollScheduler()
+{
+    _schedMutex = xSemaphoreCreateMutex();
+}
+
+BusPollScheduler::~BusPollScheduler()
+{
+    if (_schedMutex)
+        vSemaphoreDelete(_schedMutex);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Setup
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BusPollScheduler::setup(const RaftJsonIF& config)
+{
+    // Obtain semaphore
+    if (xSemaphoreTake(_schedMutex, pdMS_TO_TICKS(10)) != pdTRUE)
+        return;
+
+    // Back-off and quarantine settings
+    _backoffMaxUs = config.getLong("pollBackoffMaxMs", BACKOFF_MAX_MS_DEFAULT) * 1000ULL;
+    _quarantineFails = config.getLong("pollQuarantineFails", QUARANTINE_FAILS_DEFAULT);
+    _quarantineProbeUs = config.getLong("pollQuarantineProbeMs", QUARANTINE_PROBE_MS_DEFAULT) * 1000ULL;
+    if (_quarantineProbeUs < MIN_POLL_INTERVAL_US)
+        _quarantineProbeUs = MIN_POLL_INTERVAL_US;
+
+    // Return semaphore
+    xSemaphoreGive(_schedMutex);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Clear all entries
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BusPollScheduler::clear()
+{
+    // Obtain semaphore
+    if (xSemaphoreTake(_schedMutex, pdMS_TO_TICKS(10)) != pdTRUE)
+        return;
+    _entries.clear();
+    _activeCount = 0;
+    _quarantinedCount = 0;
+    for (auto& heap : _dueHeaps)
+        heap.clear();
+    _heapItemCount = 0;
+
+    // Return semaphore
+    xSemaphoreGive(_schedMutex);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Add or update an entry
+// Entries are looked up linearly - this only happens when devices are identified or the polling list
+// changes - whereas finding the next due entry is O(log n)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BusPollScheduler::addOrUpdate(uint32_t pollKey, uint64_t intervalUs, PollPriority priority, uint64_t timeNowUs)
+{
+    // Check priority
+    if (priority >= POLL_PRIORITY_COUNT)
+        priority = POLL_PRIORITY_LOW;
+
+    // Obtain semaphore
+    if (xSemaphoreTake(_schedMutex, pdMS_TO_TICKS(10)) != pdTRUE)
+        return;
+
+    // Find existing entry (or a free one)
+    int entryIdx = findEntry(pollKey);
+    if (entryIdx >= 0)
+    {
+        invalidateEntry(entryIdx);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < _entries.size(); i++)
+        {
+            if (!_entries[i].isActive)
+            {
+                entryIdx = i;
+                break;
+            }
+        }
+        if (entryIdx < 0)
+        {
+            _entries.push_back(PollEntry());
+            entryIdx = _entries.size() - 1;
+        }
+    }
+
+    // Set entry
+    PollEntry& entry = _entries[entryIdx];
+    entry.pollKey = pollKey;
+    entry.intervalUs = intervalUs < MIN_POLL_INTERVAL_US ? MIN_POLL_INTERVAL_US : intervalUs;
+    entry.priority = priority;
+    entry.isActive = true;
+    entry.backoffLevel = 0;
+    entry.consecFails = 0;
+    entry.lastDueValid = false;
+    entry.achievedIntervalUs = 0;
+    _activeCount++;
+
+    // Add to heap (due now)
+    std::vector<HeapItem>& heap = _dueHeaps[priority];
+    heap.push_back({ timeNowUs, (uint32_t)entryIdx, entry.generation });
+    std::push_heap(heap.begin(), heap.end(), heapCompare);
+    _heapItemCount++;
+    compactHeapsIfRequired();
+
+#ifdef DEBUG_POLL_SCHEDULER_CHANGES
+    LOG_I(MODULE_PREFIX, "addOrUpdate key %08x intervalUs %d priority %d count %d",
+                pollKey, (int)entry.intervalUs, priority, _activeCount);
+#endif
+
+    // Return semaphore
+    xSemaphoreGive(_schedMutex);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Remove an entry
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BusPollScheduler::remove(uint32_t pollKey)
+{
+    removeMatching(UINT32_MAX, pollKey);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Remove all matching entries
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BusPollScheduler::removeMatching(uint32_t keyMask, uint32_t keyValue)
+{
+    // Obtain semaphore
+    if (xSemaphoreTake(_schedMutex, pdMS_TO_TICKS(10)) != pdTRUE)
+        return;
+
+    // Invalidate matching entries - their heap items are discarded lazily
+    for (uint32_t i = 0; i < _entries.size(); i++)
+    {
+        if (_entries[i].isActive && ((_entries[i].pollKey & keyMask) == keyValue))
+        {
+            invalidateEntry(i);
+#ifdef DEBUG_POLL_SCHEDULER_CHANGES
+            LOG_I(MODULE_PREFIX, "remove key %08x count %d", _entries[i].pollKey, _activeCount);
+#endif
+        }
+    }
+    compactHeapsIfRequired();
+
+    // Return semaphore
+    xSemaphoreGive(_schedMutex);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get the next due entry
+// Higher priorities are checked first and, within a priority, the earliest deadline wins. The next deadline
+// is based on the previous deadline (to avoid drift) unless a whole interval has been missed. Quarantined
+// entries are only probed (which takes little bus time) so they aren't limited by the budget
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool BusPollScheduler::getNextDue(uint64_t timeNowUs, uint32_t maxBusTimeUs, uint32_t& pollKey, uint32_t& pollHandle,
+            uint32_t* pEstBusTimeUs, bool* pIsQuarantined)
+{
+    // Obtain semaphore
+    if (xSemaphoreTake(_schedMutex, pdMS_TO_TICKS(1)) != pdTRUE)
+        return false;
+
+    // Find highest priority heap with a due entry
+    bool isDue = false;
+    for (auto& heap : _dueHeaps)
+    {
+        if (!discardStaleTop(heap) || (heap.front().nextDueUs > timeNowUs))
+            continue;
+
+        // Check budget
+        PollEntry& entry = _entries[heap.front().entryIdx];
+        if (!entry.isQuarantined && (entry.estBusTimeUs > maxBusTimeUs))
+            break;
+
+        // Reschedule
+        std::pop_heap(heap.begin(), heap.end(), heapCompare);
+        HeapItem& item = heap.back();
+        uint64_t intervalUs = entry.isQuarantined ? _quarantineProbeUs : entry.intervalUs;
+        item.nextDueUs += intervalUs;
+        if (item.nextDueUs <= timeNowUs)
+            item.nextDueUs = timeNowUs + intervalUs;
+        pollKey = entry.pollKey;
+        pollHandle = item.entryIdx;
+        if (pEstBusTimeUs)
+            *pEstBusTimeUs = entry.isQuarantined ? 0 : entry.estBusTimeUs;
+        if (pIsQuarantined)
+            *pIsQuarantined = entry.isQuarantined;
+        std::push_heap(heap.begin(), heap.end(), heapCompare);
+        isDue = true;
+
+        // Achieved interval (smoothed)
+        if (entry.lastDueValid)
+        {
+            uint32_t achievedUs = timeNowUs - entry.lastDueUs;
+            entry.achievedIntervalUs = entry.achievedIntervalUs == 0 ? achievedUs :
+                        (entry.achievedIntervalUs * 7 + achievedUs) / 8;
+        }
+        entry.lastDueUs = timeNowUs;
+        entry.lastDueValid = true;
+
+#ifdef DEBUG_POLL_SCHEDULER_NEXT
+        LOG_I(MODULE_PREFIX, "getNextDue key %08x priority %d estBusTimeUs %d",
+                    pollKey, entry.priority, entry.estBusTimeUs);
+#endif
+        break;
+    }
+
+    // Return semaphore
+    xSemaphoreGive(_schedMutex);
+    return isDue;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get configured and achieved rates
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+String BusPollScheduler::getRateJSON() const
+{
+    // Obtain semaphore
+    if (xSemaphoreTake(_schedMutex, pdMS_TO_TICKS(1)) != pdTRUE)
+        return "[]";
+
+    // Create JSON
+    String jsonStr;
+    for (const PollEntry& entry : _entries)
+    {
+        if (!entry.isActive)
+            continue;
+        if (jsonStr.length() > 0)
+            jsonStr += ",";
+        jsonStr += "{\"k\":" + String(entry.pollKey) + ",\"c\":" + String((uint32_t)entry.intervalUs) +
+                    ",\"a\":" + String(entry.achievedIntervalUs) + ",\"q\":" + String(entry.isQuarantined ? 1 : 0) + "}";
+    }
+
+    // Return semaphore
+    xSemaphoreGive(_schedMutex);
+    return "[" + jsonStr + "]";
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Record bus time for a poll
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BusPollScheduler::recordBusTime(uint32_t pollHandle, uint32_t pollKey, uint32_t busTimeUs)
+{
+    // Obtain semaphore
+    if (xSemaphoreTake(_schedMutex, pdMS_TO_TICKS(1)) != pdTRUE)
+        return;
+
+    // Update estimate (entry may have been removed or reused since the poll) - probes of quarantined entries
+    // aren't representative of the poll's bus time
+    if ((pollHandle < _entries.size()) && _entries[pollHandle].isActive && (_entries[pollHandle].pollKey == pollKey) &&
+                !_entries[pollHandle].isQuarantined)
+    {
+        PollEntry& entry = _entries[pollHandle];
+        entry.estBusTimeUs = entry.estBusTimeUs == 0 ? busTimeUs : (entry.estBusTimeUs * 3 + busTimeUs) / 4;
+    }
+
+    // Return semaphore
+    xSemaphoreGive(_schedMutex);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Record poll result
+// getNextDue() has already rescheduled the entry at its normal interval so a failure reschedules it again
+// (the earlier heap item becomes stale) and a successful probe makes the entry due immediately
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BusPollScheduler::recordPollResult(uint32_t pollHandle, uint32_t pollKey, bool pollOk, uint64_t timeNowUs)
+{
+    // Obtain semaphore
+    if (xSemaphoreTake(_schedMutex, pdMS_TO_TICKS(1)) != pdTRUE)
+        return;
+
+    // Check entry (may have been removed or reused since the poll)
+    if ((pollHandle >= _entries.size()) || !_entries[pollHandle].isActive || (_entries[pollHandle].pollKey != pollKey))
+    {
+        xSemaphoreGive(_schedMutex);
+        return;
+    }
+    PollEntry& entry = _entries[pollHandle];
+
+    if (pollOk)
+    {
+        // Restore full rate
+        if (entry.isQuarantined)
+        {
+            LOG_I(MODULE_PREFIX, "recordPollResult key %08x restored after %d fails", pollKey, entry.consecFails);
+            entry.isQuarantined = false;
+            _quarantinedCount--;
+            rescheduleEntry(pollHandle, timeNowUs);
+        }
+        entry.backoffLevel = 0;
+        entry.consecFails = 0;
+    }
+    else
+    {
+        // Count failures
+        if (entry.consecFails < UINT16_MAX)
+            entry.consecFails++;
+
+        // Quarantine (or probe again later if already quarantined)
+        if (!entry.isQuarantined && (_quarantineFails != 0) && (entry.consecFails >= _quarantineFails))
+        {
+            LOG_W(MODULE_PREFIX, "recordPollResult key %08x quarantined after %d fails", pollKey, entry.consecFails);
+            entry.isQuarantined = true;
+            _quarantinedCount++;
+        }
+        if (entry.isQuarantined)
+        {
+            rescheduleEntry(pollHandle, timeNowUs + addJitter(_quarantineProbeUs));
+        }
+        else if (_backoffMaxUs != 0)
+        {
+            // Exponential back-off
+            if (entry.backoffLevel < BACKOFF_MAX_LEVEL)
+                entry.backoffLevel++;
+            rescheduleEntry(pollHandle, timeNowUs + addJitter(getBackoffDelayUs(entry)));
+        }
+
+#ifdef DEBUG_POLL_SCHEDULER_BACKOFF
+        LOG_I(MODULE_PREFIX, "recordPollResult key %08x fails %d level %d quarantined %d",
+                    pollKey, entry.consecFails, entry.backoffLevel, entry.isQuarantined);
+#endif
+    }
+
+    // Return semaphore
+    xSemaphoreGive(_schedMutex);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get time until the next entry is due
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t BusPollScheduler::getMsUntilNextDue(uint64_t timeNowUs)
+{
+    // Obtain semaphore - if not available then entries are changing so check again soon
+    if (xSemaphoreTake(_schedMutex, pdMS_TO_TICKS(1)) != pdTRUE)
+        return 0;
+
+    // Earliest deadline over all priorities
+    uint64_t nextDueUs = UINT64_MAX;
+    for (auto& heap : _dueHeaps)
+    {
+        if (discardStaleTop(heap) && (heap.front().nextDueUs < nextDueUs))
+            nextDueUs = heap.front().nextDueUs;
+    }
+
+    // Return semaphore
+    xSemaphoreGive(_schedMutex);
+
+    // Convert to ms (rounding up)
+    if (nextDueUs == UINT64_MAX)
+        return UINT32_MAX;
+    if (nextDueUs <= timeNowUs)
+        return 0;
+    return (nextDueUs - timeNowUs + 999) / 1000;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Helpers (all assume semaphore already taken)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int BusPollScheduler::findEntry(uint32_t pollKey) const
+{
+    for (uint32_t i = 0; i < _entries.size(); i++)
+    {
+        if (_entries[i].isActive && (_entries[i].pollKey == pollKey))
+            return i;
+    }
+    return -1;
+}
+
+void BusPollScheduler::invalidateEntry(uint32_t entryIdx)
+{
+    PollEntry& entry = _entries[entryIdx];
+    if (!entry.isActive)
+        return;
+    entry.isActive = false;
+    entry.generation++;
+    entry.estBusTimeUs = 0;
+    _activeCount--;
+    if (entry.isQuarantined)
+    {
+        entry.isQuarantined = false;
+        _quarantinedCount--;
+    }
+}
+
+void BusPollScheduler::rescheduleEntry(uint32_t entryIdx, uint64_t nextDueUs)
+{
+    // Existing heap items for the entry become stale
+    PollEntry& entry = _entries[entryIdx];
+    entry.generation++;
+    std::vector<HeapItem>& heap = _dueHeaps[entry.priority];
+    heap.push_back({ nextDueUs, entryIdx, entry.generation });
+    std::push_heap(heap.begin(), heap.end(), heapCompare);
+    _heapItemCount++;
+    compactHeapsIfRequired();
+}
+
+uint64_t BusPollScheduler::getBackoffDelayUs(const PollEntry& entry) const
+{
+    // Interval doubled for each level (limited to the max but never less than the interval)
+    if (entry.intervalUs >= _backoffMaxUs)
+        return entry.intervalUs;
+    if (entry.intervalUs > (_backoffMaxUs >> entry.backoffLevel))
+        return _backoffMaxUs;
+    return entry.intervalUs << entry.backoffLevel;
+}
+
+bool BusPollScheduler::discardStaleTop(std::vector<HeapItem>& heap)
+{
+    while (!heap.empty())
+    {
+        const HeapItem& top = heap.front();
+        const PollEntry& entry = _entries[top.entryIdx];
+        if (entry.isActive && (entry.generation == top.generation))
+            return true;
+        std::pop_heap(heap.begin(), heap.end(), heapCompare);
+        heap.pop_back();
+        _heapItemCount--;
+    }
+    return false;
+}
+
+void BusPollScheduler::compactHeapsIfRequired()
+{
+    // Rebuild heaps without stale items if they are accumulating
+    if (_heapItemCount <= _activeCount * 2 + 8)
+        return;
+    _heapItemCount = 0;
+    for (auto& heap : _dueHeaps)
+    {
+        heap.erase(std::remove_if(heap.begin(), heap.end(),
+                [this](const HeapItem& item) {
+                    const PollEntry& entry = _entries[item.entryIdx];
+                    return !entry.isActive || (entry.generation != item.generation);
+                }),
+                heap.end());
+        std::make_heap(heap.begin(), heap.end(), heapCompare);
+        _heapItemCount += heap.size();
+    }
+}
@@ -0,0 +1,234 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Bus Poll Scheduler
+// Single scheduler for all periodic bus transactions (device ident polls and the polling list)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "RaftThreading.h"
+#include "RaftUtils.h"
+#include "RaftJsonIF.h"
+#include "RaftArduino.h"
+
+class BusPollScheduler
+{
+public:
+    BusPollScheduler();
+    ~BusPollScheduler();
+
+    // Priorities (lower value is higher priority)
+    enum PollPriority
+    {
+        POLL_PRIORITY_HIGH = 0,
+        POLL_PRIORITY_NORMAL = 1,
+        POLL_PRIORITY_LOW = 2,
+        POLL_PRIORITY_COUNT = 3
+    };
+
+    // Keys used for entries from the polling list (ident polls are keyed on device address)
+    static const uint32_t POLL_KEY_POLL_LIST_FLAG = 0x80000000;
+    static uint32_t pollListKey(uint32_t pollListIdx)
+    {
+        return POLL_KEY_POLL_LIST_FLAG | pollListIdx;
+    }
+    static bool isPollListKey(uint32_t pollKey)
+    {
+        return (pollKey & POLL_KEY_POLL_LIST_FLAG) != 0;
+    }
+    static uint32_t getPollListIdx(uint32_t pollKey)
+    {
+        return pollKey & ~POLL_KEY_POLL_LIST_FLAG;
+    }
+
+    // Keys used for device poll groups (group 0 is the ident poll keyed on device address alone)
+    static const uint32_t POLL_KEY_GROUP_SHIFT = 16;
+    static const uint32_t POLL_KEY_GROUP_MASK = 0xff;
+    static const uint32_t POLL_KEY_ADDR_MASK = 0xffff;
+    static uint32_t pollGroupKey(uint32_t address, uint32_t groupIdx)
+    {
+        return (address & POLL_KEY_ADDR_MASK) | ((groupIdx & POLL_KEY_GROUP_MASK) << POLL_KEY_GROUP_SHIFT);
+    }
+    static uint32_t getPollGroupIdx(uint32_t pollKey)
+    {
+        return (pollKey >> POLL_KEY_GROUP_SHIFT) & POLL_KEY_GROUP_MASK;
+    }
+    static uint32_t getPollKeyAddr(uint32_t pollKey)
+    {
+        return pollKey & POLL_KEY_ADDR_MASK;
+    }
+
+    // Key used for the sync sample (trigger and readout of all participating devices)
+    static const uint32_t POLL_KEY_SYNC_SAMPLE = 0x40000000;
+    static bool isSyncSampleKey(uint32_t pollKey)
+    {
+        return pollKey == POLL_KEY_SYNC_SAMPLE;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup (back-off and quarantine of failing entries)
+    /// @param config configuration
+    void setup(const RaftJsonIF& config);
+
+    // Clear all entries
+    void clear();
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Add an entry or update an existing one (the entry becomes due immediately)
+    /// @param pollKey key identifying the entry
+    /// @param intervalUs interval between polls (us)
+    /// @param priority priority of the entry
+    /// @param timeNowUs current time in us
+    void addOrUpdate(uint32_t pollKey, uint64_t intervalUs, PollPriority priority, uint64_t timeNowUs);
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Remove an entry
+    /// @param pollKey key identifying the entry
+    void remove(uint32_t pollKey);
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Remove all entries where (pollKey & keyMask) == keyValue
+    /// @param keyMask mask applied to keys
+    /// @param keyValue value to match
+    void removeMatching(uint32_t keyMask, uint32_t keyValue);
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the next due entry (highest priority first, then earliest deadline) and reschedule it
+    /// @param timeNowUs current time in us
+    /// @param maxBusTimeUs remaining bus time budget (an entry with a larger estimated bus time isn't returned)
+    /// @param pollKey (out) key of the entry due
+    /// @param pollHandle (out) handle to pass to recordBusTime()
+    /// @param pEstBusTimeUs (out) estimated bus time of the entry (0 if not known yet) - may be nullptr
+    /// @param pIsQuarantined (out) true if the entry is quarantined (so only a cheap probe should be performed)
+    ///        - may be nullptr
+    /// @return true if an entry is due
+    bool getNextDue(uint64_t timeNowUs, uint32_t maxBusTimeUs, uint32_t& pollKey, uint32_t& pollHandle,
+                uint32_t* pEstBusTimeUs = nullptr, bool* pIsQuarantined = nullptr);
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Record the bus time taken by a poll (used to estimate bus time for budgeting)
+    /// @param pollHandle handle returned from getNextDue()
+    /// @param pollKey key returned from getNextDue()
+    /// @param busTimeUs bus time taken (us)
+    void recordBusTime(uint32_t pollHandle, uint32_t pollKey, uint32_t busTimeUs);
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Record the result of a poll (or of a probe when quarantined)
+    /// @param pollHandle handle returned from getNextDue()
+    /// @param pollKey key returned from getNextDue()
+    /// @param pollOk true if the poll succeeded
+    /// @param timeNowUs current time in us
+    /// @note Consecutive failures back-off the entry exponentially (with jitter so failing entries don't
+    ///       synchronise) and, after quarantineFails failures, the entry is quarantined and only probed at the
+    ///       quarantine probe interval. The first success restores the full poll rate
+    void recordPollResult(uint32_t pollHandle, uint32_t pollKey, bool pollOk, uint64_t timeNowUs);
+
+    // Get number of quarantined entries
+    uint32_t getQuarantinedCount() const
+    {
+        return _quarantinedCount;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get time until the next entry is due
+    /// @param timeNowUs current time in us
+    /// @return time in ms until the next entry is due (UINT32_MAX if no entries)
+    uint32_t getMsUntilNextDue(uint64_t timeNowUs);
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the configured and achieved poll interval of each entry
+    /// @return JSON string [{"k":pollKey,"c":configuredIntervalUs,"a":achievedIntervalUs,"q":isQuarantined},...]
+    String getRateJSON() const;
+
+    // Get number of entries
+    uint32_t getCount() const
+    {
+        return _activeCount;
+    }
+
+private:
+    // Mutex (entries are added and removed from other tasks)
+    SemaphoreHandle_t _schedMutex = nullptr;
+
+    // Entry
+    class PollEntry
+    {
+    public:
+        uint32_t pollKey = 0;
+        uint64_t intervalUs = 0;
+        uint32_t estBusTimeUs = 0;
+        uint32_t generation = 0;
+        uint8_t priority = POLL_PRIORITY_NORMAL;
+        bool isActive = false;
+        bool isQuarantined = false;
+        uint8_t backoffLevel = 0;
+        uint16_t consecFails = 0;
+        bool lastDueValid = false;
+        uint64_t lastDueUs = 0;
+        uint32_t achievedIntervalUs = 0;
+    };
+    std::vector<PollEntry> _entries;
+    uint32_t _activeCount = 0;
+    uint32_t _quarantinedCount = 0;
+
+    // Back-off and quarantine settings (back-off is disabled if the max is 0, quarantine if fails is 0)
+    uint64_t _backoffMaxUs = BACKOFF_MAX_MS_DEFAULT * 1000;
+    uint32_t _quarantineFails = QUARANTINE_FAILS_DEFAULT;
+    uint64_t _quarantineProbeUs = QUARANTINE_PROBE_MS_DEFAULT * 1000;
+    static const uint32_t BACKOFF_MAX_MS_DEFAULT = 2000;
+    static const uint32_t QUARANTINE_FAILS_DEFAULT = 10;
+    static const uint32_t QUARANTINE_PROBE_MS_DEFAULT = 1000;
+    static const uint32_t BACKOFF_MAX_LEVEL = 16;
+
+    // Jitter (xorshift is ample for spreading retries)
+    uint32_t _jitterState = 0x2545f491;
+    uint64_t addJitter(uint64_t delayUs)
+    {
+        _jitterState ^= _jitterState << 13;
+        _jitterState ^= _jitterState >> 17;
+        _jitterState ^= _jitterState << 5;
+        // +/- 25%
+        uint64_t jitterRangeUs = delayUs / 2;
+        if (jitterRangeUs == 0)
+            return delayUs;
+        return delayUs - delayUs / 4 + (_jitterState % jitterRangeUs);
+    }
+
+    // Heap item - an item is stale (and discarded when reached) if the generation doesn't match the entry
+    class HeapItem
+    {
+    public:
+        uint64_t nextDueUs;
+        uint32_t entryIdx;
+        uint32_t generation;
+    };
+
+    // Min-heap of deadlines for each priority
+    std::vector<HeapItem> _dueHeaps[POLL_PRIORITY_COUNT];
+    uint32_t _heapItemCount = 0;
+
+    // Heap ordering (std heap functions build a max-heap so invert the comparison)
+    static bool heapCompare(const HeapItem& a, const HeapItem& b)
+    {
+        return a.nextDueUs > b.nextDueUs;
+    }
+
+    // Minimum interval between polls of any entry
+    static const uint64_t MIN_POLL_INTERVAL_US = 1000;
+
+    // Helpers
+    int findEntry(uint32_t pollKey) const;
+    void invalidateEntry(uint32_t entryIdx);
+    void rescheduleEntry(uint32_t entryIdx, uint64_t nextDueUs);
+    uint64_t getBackoffDelayUs(const PollEntry& entry) const;
+    bool discardStaleTop(std::vector<HeapItem>& heap);
+    void compactHeapsIfRequired();
+
+    // Debug
+    static constexpr const char* MODULE_PREFIX = "RaftI2CPollSched";
+};
@@ -41,6 +41,13 @@ void BusPowerController::setup(const RaftJsonIF& config)
     if (_powerControlEnabled)
         return;
 
+    // Power sequencing timing
+    _startupPowerOffMs = config.getLong("startupOffMs", STARTUP_POWER_OFF_MS);
+    _powerCycleOffMs = config.getLong("cycleOffMs", POWER_CYCLE_OFF_TIME_MS);
+    _voltageStabilizingMs = config.getLong("stableMs", VOLTAGE_STABILIZING_TIME_MS);
+    _powerOnBatchMaxSlots = config.getLong("pwrOnBatch", 0);
+    _powerOnStaggerMs = config.getLong("pwrOnStaggerMs", 0);
+
     // Check voltage level names are present (otherwise power control is disabled)
     config.getArrayElems("voltageLevels", _voltageLevelNames);
 
@@ -282,6 +289,12 @@ bool BusPowerController::postSetup()
     // Turn all power off
     powerOffAll();
 
+    // The startup power off time starts now
+    uint32_t timeNowMs = millis();
+    for (SlotPowerControlGroup& slotGroup : _slotPowerCtrlGroups)
+        for (SlotPowerControlRec& slotRec : slotGroup.slotRecs)
+            slotRec.setState(SLOT_POWER_OFF_PRE_INIT, timeNowMs);
+
     // Hardware is now initialized
     _hardwareInitialized = true;
     return true;
@@ -378,23 +391,30 @@ void BusPowerController::powerCycleSlot(uint32_t slotNum)
     // Check for slot 0 (power cycle bus)
     if (slotNum == 0)
     {
-        // Turn off the main bus power
+        // Turn off the main bus power (and power it on again once the cycling off time has elapsed)
         setVoltageLevel(0, POWER_CONTROL_OFF, true);
+        setSlotState(0, SLOT_POWER_OFF_PENDING_CYCLING, millis());
         return;
     }
 
-    // Turn the slot power off
-    setVoltageLevel(slotNum, POWER_CONTROL_OFF, true);
+    // Turn the slot power off (IO expander changes are written on the next service so that power cycling
+    // several slots in a row results in one write per IO expander)
+    setVoltageLevel(slotNum, POWER_CONTROL_OFF, false);
 
-    // Set the state to power off pending cycling
-    setSlotState(slotNum, SLOT_POWER_OFF_PENDING_CYCLING, millis());
+    // Set the state to power off pending cycling (the off time is restarted when the IO expander is written)
+    SlotPowerControlRec* pSlotRec = getSlotRecord(slotNum);
+    if (pSlotRec)
+    {
+        pSlotRec->setState(SLOT_POWER_OFF_PENDING_CYCLING, millis());
+        pSlotRec->offWritePending = true;
+    }
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Task loop (called from I2C task)
 void BusPowerController::taskService(uint64_t timeNowUs)
 {
-    // Enaure hardware initialized
+    // Ensure hardware initialized
     if (!_hardwareInitialized)
         return;
 
@@ -416,7 +436,7 @@ void BusPowerController::taskService(uint64_t timeNowUs)
                 case SLOT_POWER_OFF_PERMANENTLY:
                     break;
                 case SLOT_POWER_OFF_PRE_INIT:
-                    if (Raft::isTimeout(millis(), slotRec.pwrCtrlStateLastMs, STARTUP_POWER_OFF_MS))
+                    if (Raft::isTimeout(timeNowMs, slotRec.pwrCtrlStateLastMs, _startupPowerOffMs))
                     {
 #ifdef DEBUG_POWER_CONTROL_STATES
                         LOG_I(MODULE_PREFIX, "taskService slotNum %d now off pending cycling", slotNum);
@@ -426,16 +446,20 @@ void BusPowerController::taskService(uint64_t timeNowUs)
                     }
                     break;
                 case SLOT_POWER_ON_WAIT_STABLE:
-                    if (Raft::isTimeout(millis(), slotRec.pwrCtrlStateLastMs, VOLTAGE_STABILIZING_TIME_MS))
+                    if (Raft::isTimeout(timeNowMs, slotRec.pwrCtrlStateLastMs, _voltageStabilizingMs))
                     {
 #ifdef DEBUG_POWER_CONTROL_STATES
                         LOG_I(MODULE_PREFIX, "taskService slotNum %d voltage is stable", slotNum);
 #endif
                         slotRec.setState(SLOT_POWER_ON_LOW_V, timeNowMs);
+                        if (slotNum < MAX_SLOTS)
+                            _newlyStableSlots |= (1ULL << slotNum);
                     }
                     break;
                 case SLOT_POWER_OFF_PENDING_CYCLING:
-                    if (Raft::isTimeout(millis(), slotRec.pwrCtrlStateLastMs, POWER_CYCLE_OFF_TIME_MS))
+                    if (!slotRec.offWritePending &&
+                                Raft::isTimeout(timeNowMs, slotRec.pwrCtrlStateLastMs, _powerCycleOffMs) &&
+                                isPowerOnAllowed(timeNowMs))
                     {
 #ifdef DEBUG_POWER_CONTROL_STATES
                         LOG_I(MODULE_PREFIX, "taskService slotNum %d state is wait_stable", slotNum);
@@ -455,6 +479,107 @@ void BusPowerController::taskService(uint64_t timeNowUs)
 
     // Action changes to I2C IO expanders
     actionI2CIOStateChanges(false);
+
+    // The off time of slots being power cycled starts once the power off has been written
+    uint32_t offWrittenMs = millis();
+    for (SlotPowerControlGroup& slotGroup : _slotPowerCtrlGroups)
+    {
+        for (SlotPowerControlRec& slotRec : slotGroup.slotRecs)
+        {
+            if (!slotRec.offWritePending)
+                continue;
+            slotRec.offWritePending = false;
+            if (slotRec.pwrCtrlState == SLOT_POWER_OFF_PENDING_CYCLING)
+                slotRec.setState(SLOT_POWER_OFF_PENDING_CYCLING, offWrittenMs);
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Check if a slot can be powered on now (limits the number of slots powered on together)
+/// @param timeNowMs current time in ms
+/// @return true if the slot can be powered on (the slot is counted in the current batch)
+bool BusPowerController::isPowerOnAllowed(uint32_t timeNowMs)
+{
+    // Check if limited
+    if (_powerOnBatchMaxSlots == 0)
+        return true;
+
+    // Start a new batch once the stagger time has elapsed
+    if (!_powerOnBatchStarted || Raft::isTimeout(timeNowMs, _powerOnBatchStartMs, _powerOnStaggerMs))
+    {
+        _powerOnBatchStarted = true;
+        _powerOnBatchStartMs = timeNowMs;
+        _powerOnBatchCount = 0;
+    }
+
+    // Check if the batch is full
+    if (_powerOnBatchCount >= _powerOnBatchMaxSlots)
+        return false;
+    _powerOnBatchCount++;
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get time until the next power sequencing state change
+/// @param timeNowMs current time in ms
+/// @return time in ms (UINT32_MAX if no state change is pending)
+uint32_t BusPowerController::getMsUntilStateChange(uint32_t timeNowMs) const
+{
+    // Ensure hardware initialized
+    if (!_hardwareInitialized)
+        return UINT32_MAX;
+
+    // Find the earliest state change
+    uint32_t msUntilChange = UINT32_MAX;
+    for (const SlotPowerControlGroup& slotGroup : _slotPowerCtrlGroups)
+    {
+        for (const SlotPowerControlRec& slotRec : slotGroup.slotRecs)
+        {
+            uint32_t stateTimeoutMs = getStateTimeoutMs(slotRec.pwrCtrlState);
+            if ((slotRec.pwrCtrlState != SLOT_POWER_OFF_PRE_INIT) &&
+                        (slotRec.pwrCtrlState != SLOT_POWER_ON_WAIT_STABLE) &&
+                        (slotRec.pwrCtrlState != SLOT_POWER_OFF_PENDING_CYCLING))
+                continue;
+            uint32_t elapsedMs = Raft::timeElapsed(timeNowMs, slotRec.pwrCtrlStateLastMs);
+            uint32_t msUntilSlotChange = elapsedMs >= stateTimeoutMs ? 0 : stateTimeoutMs - elapsedMs;
+
+            // A power off waiting to be written is actioned on the next service
+            if (slotRec.offWritePending)
+                msUntilSlotChange = 0;
+
+            // Slots waiting to power on may be held back until the next batch
+            if ((msUntilSlotChange == 0) && (slotRec.pwrCtrlState == SLOT_POWER_OFF_PENDING_CYCLING) &&
+                        (_powerOnBatchMaxSlots != 0) && _powerOnBatchStarted &&
+                        (_powerOnBatchCount >= _powerOnBatchMaxSlots))
+            {
+                uint32_t batchElapsedMs = Raft::timeElapsed(timeNowMs, _powerOnBatchStartMs);
+                msUntilSlotChange = batchElapsedMs >= _powerOnStaggerMs ? 0 : _powerOnStaggerMs - batchElapsedMs;
+            }
+            if (msUntilSlotChange < msUntilChange)
+                msUntilChange = msUntilSlotChange;
+        }
+    }
+    return msUntilChange;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the longest time a power cycle can take (off time, waiting for a power-on batch and the voltage
+///        stabilizing time)
+/// @return time in ms
+uint32_t BusPowerController::getPowerCycleMaxMs() const
+{
+    // When power-on is batched the worst case is every slot waiting to power on with the slot being cycled in
+    // the last batch (and the first batch only just started)
+    uint32_t numBatchWaits = 0;
+    if (_powerOnBatchMaxSlots != 0)
+    {
+        uint32_t numSlots = 0;
+        for (const SlotPowerControlGroup& slotGroup : _slotPowerCtrlGroups)
+            numSlots += slotGroup.slotRecs.size();
+        numBatchWaits = (numSlots + _powerOnBatchMaxSlots - 1) / _powerOnBatchMaxSlots;
+    }
+    return _powerCycleOffMs + numBatchWaits * _powerOnStaggerMs + _voltageStabilizingMs;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -463,7 +588,7 @@ void BusPowerController::taskService(uint64_t timeNowUs)
 /// @return True if slot is power controlled
 bool BusPowerController::isSlotPowerControlled(uint32_t slotNum)
 {
-    // Enaure hardware initialized
+    // Ensure hardware initialized
     if (!_hardwareInitialized)
         return false;
 
@@ -599,101 +724,145 @@ BusPowerController::SlotPowerControlRec* BusPowerController::getSlotRecord(uint3
 /// @param force Force the action (even if not dirty)
 void BusPowerController::actionI2CIOStateChanges(bool force)
 {
-    // Iterate through power control records
-    for (IOExpanderRec& pwrCtrlRec : _ioExpanderRecs)
+    // Iterate through power control records - those on the same mux channel are updated together
+    for (uint32_t recIdx = 0; recIdx < _ioExpanderRecs.size(); recIdx++)
     {
-        // Update power control registers
-        pwrCtrlRec.update(force, _busReqSyncFn);
-    }
-}
+        IOExpanderRec& pwrCtrlRec = _ioExpanderRecs[recIdx];
+        if (!pwrCtrlRec.isUpdateNeeded(force))
+            continue;
 
-/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/// @brief Update power control registers for all slots
-void BusPowerController::IOExpanderRec::update(bool force, BusReqSyncFn busI2CReqSyncFn)
-{
-    // Check if io expander is dirty
-    if (force || ioRegDirty)
-    {
-        bool rsltOk = false;
-        
-        // Setup multiplexer (if the power controller is connected via a multiplexer)
-        if (muxAddr != 0)
+        // Check this mux channel wasn't handled with an earlier record
+        bool alreadyHandled = false;
+        for (uint32_t prevIdx = 0; prevIdx < recIdx; prevIdx++)
         {
-            // Check reset pin is output and set to 1
-            if (muxResetPin >= 0)
+            if (_ioExpanderRecs[prevIdx].isOnSameMuxChan(pwrCtrlRec))
             {
-                pinMode(muxResetPin, OUTPUT);
-                digitalWrite(muxResetPin, HIGH);
-#ifdef DEBUG_POWER_CONTROL_BIT_SETTINGS
-                LOG_I(MODULE_PREFIX, "update muxResetPin %d set to HIGH", muxResetPin);
-#endif                
+                alreadyHandled = true;
+                break;
             }
-
-            // Set the mux channel
-            uint8_t muxWriteData[1] = { (uint8_t)(1 << muxChanIdx) };
-            BusRequestInfo reqRec(BUS_REQ_TYPE_FAST_SCAN,
-                        muxAddr,
-                        0, sizeof(muxWriteData),
-                        muxWriteData,
-                        0,
-                        0, 
-                        nullptr, 
-                        this);
-            busI2CReqSyncFn(&reqRec, nullptr);
         }
+        if (alreadyHandled)
+            continue;
 
-        // Set the output register first (to avoid unexpected power changes)
-        uint8_t outputPortData[3] = { PCA9535_OUTPUT_PORT_0, 
-                    uint8_t(outputsReg & 0xff), 
-                    uint8_t(outputsReg >> 8)};
-        BusRequestInfo reqRec(BUS_REQ_TYPE_FAST_SCAN,
-                    addr,
-                    0, sizeof(outputPortData),
-                    outputPortData,
-                    0,
-                    0, 
-                    nullptr, 
-                    this);
-        rsltOk = busI2CReqSyncFn(&reqRec, nullptr) == RAFT_OK;
-
-        // Write the configuration register
-        uint8_t configPortData[3] = { PCA9535_CONFIG_PORT_0, 
-                    uint8_t(configReg & 0xff), 
-                    uint8_t(configReg >> 8)};
-        BusRequestInfo reqRec2(BUS_REQ_TYPE_FAST_SCAN,
-                    addr,
-                    0, sizeof(configPortData),
-                    configPortData,
-                    0,
-                    0, 
-                    nullptr, 
-                    this);
-        rsltOk &= busI2CReqSyncFn(&reqRec2, nullptr) == RAFT_OK;
+        // Setup multiplexer (if the power controller is connected via a multiplexer)
+        selectIOExpanderMuxChan(pwrCtrlRec, true);
 
-        // Clear multiplexer
-        if (muxAddr != 0)
+        // Update all power controllers on this mux channel
+        for (uint32_t chanRecIdx = recIdx; chanRecIdx < _ioExpanderRecs.size(); chanRecIdx++)
         {
-            // Clear the mux channel
-            uint8_t muxWriteData[1] = { 0 };
-            BusRequestInfo reqRec(BUS_REQ_TYPE_FAST_SCAN,
-                        muxAddr,
-                        0, sizeof(muxWriteData),
-                        muxWriteData,
-                        0,
-                        0, 
-                        nullptr, 
-                        this);
-            busI2CReqSyncFn(&reqRec, nullptr);
+            IOExpanderRec& chanRec = _ioExpanderRecs[chanRecIdx];
+            if (chanRec.isOnSameMuxChan(pwrCtrlRec) && chanRec.isUpdateNeeded(force))
+                chanRec.update(force, _busReqSyncFn);
         }
 
-        // Clear the dirty flag if result is ok
-        ioRegDirty = !rsltOk;
+        // Clear multiplexer
+        selectIOExpanderMuxChan(pwrCtrlRec, false);
+    }
+}
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Select (or deselect) the mux channel an IO expander is connected to
+/// @param ioExpRec IO expander record
+/// @param select true to select the channel, false to deselect all channels
+void BusPowerController::selectIOExpanderMuxChan(const IOExpanderRec& ioExpRec, bool select)
+{
+    // Check if connected via a multiplexer
+    if (ioExpRec.muxAddr == 0)
+        return;
+
+    // Check reset pin is output and set to 1
+    if (select && (ioExpRec.muxResetPin >= 0))
+    {
+        pinMode(ioExpRec.muxResetPin, OUTPUT);
+        digitalWrite(ioExpRec.muxResetPin, HIGH);
 #ifdef DEBUG_POWER_CONTROL_BIT_SETTINGS
-        LOG_I(MODULE_PREFIX, "update addr 0x%02x outputReg 0x%04x configReg 0x%04x force %d rslt %s", 
-                addr, outputsReg, configReg, force, rsltOk ? "OK" : "FAIL");
+        LOG_I(MODULE_PREFIX, "selectIOExpanderMuxChan muxResetPin %d set to HIGH", ioExpRec.muxResetPin);
+#endif                
+    }
+
+    // Set (or clear) the mux channel
+    uint8_t muxWriteData[1] = { select ? (uint8_t)(1 << ioExpRec.muxChanIdx) : (uint8_t)0 };
+    BusRequestInfo reqRec(BUS_REQ_TYPE_FAST_SCAN,
+                ioExpRec.muxAddr,
+                0, sizeof(muxWriteData),
+                muxWriteData,
+                0,
+                0, 
+                nullptr, 
+                this);
+    _busReqSyncFn(&reqRec, nullptr);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Write changed power control registers
+/// @param force Write all registers (even if not changed)
+/// @param busI2CReqSyncFn function to call to perform I2C request
+void BusPowerController::IOExpanderRec::update(bool force, BusReqSyncFn busI2CReqSyncFn)
+{
+    // Set the output register first (to avoid unexpected power changes)
+    bool writeAllOutputs = force || !writtenOutputsValid;
+    RaftRetCode outputsRslt = writeReg16(PCA9535_OUTPUT_PORT_0, outputsReg, writtenOutputsReg, writeAllOutputs, 
+                busI2CReqSyncFn);
+    writtenOutputsValid = outputsRslt == RAFT_OK;
+    writtenOutputsReg = outputsReg;
+
+    // Write the configuration register
+    bool writeAllConfig = force || !writtenConfigValid;
+    RaftRetCode configRslt = writeReg16(PCA9535_CONFIG_PORT_0, configReg, writtenConfigReg, writeAllConfig, 
+                busI2CReqSyncFn);
+    writtenConfigValid = configRslt == RAFT_OK;
+    writtenConfigReg = configReg;
+
+    // Clear the dirty flag if result is ok
+    bool rsltOk = writtenOutputsValid && writtenConfigValid;
+    ioRegDirty = !rsltOk;
+
+#ifdef DEBUG_POWER_CONTROL_BIT_SETTINGS
+    LOG_I(MODULE_PREFIX, "update addr 0x%02x outputReg 0x%04x configReg 0x%04x force %d rslt %s", 
+            addr, outputsReg, configReg, force, rsltOk ? "OK" : "FAIL");
 #endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Write the changed bytes of a 16 bit (two port) register
+/// @param regPort0 register address for port 0 (port 1 follows)
+/// @param regVal value to write
+/// @param prevVal value previously written
+/// @param writeAll true to write both ports (even if not changed)
+/// @param busI2CReqSyncFn function to call to perform I2C request
+/// @return result code (OK if nothing needed writing)
+RaftRetCode BusPowerController::IOExpanderRec::writeReg16(uint8_t regPort0, uint16_t regVal, uint16_t prevVal, 
+                bool writeAll, BusReqSyncFn busI2CReqSyncFn)
+{
+    // Determine which ports have changed
+    bool port0Changed = writeAll || ((regVal & 0xff) != (prevVal & 0xff));
+    bool port1Changed = writeAll || ((regVal >> 8) != (prevVal >> 8));
+    if (!port0Changed && !port1Changed)
+        return RAFT_OK;
+
+    // Write from the first changed port (the register address auto-increments to port 1)
+    uint8_t writeData[3] = { regPort0, uint8_t(regVal & 0xff), uint8_t(regVal >> 8) };
+    uint8_t* pWriteData = writeData;
+    uint32_t writeLen = sizeof(writeData);
+    if (!port0Changed)
+    {
+        writeData[1] = regPort0 + 1;
+        pWriteData = writeData + 1;
+        writeLen = 2;
+    }
+    else if (!port1Changed)
+    {
+        writeLen = 2;
     }
+    BusRequestInfo reqRec(BUS_REQ_TYPE_FAST_SCAN,
+                addr,
+                0, writeLen,
+                pWriteData,
+                0,
+                0, 
+                nullptr, 
+                this);
+    return busI2CReqSyncFn(&reqRec, nullptr);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
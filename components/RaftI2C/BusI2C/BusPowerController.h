@@ -34,6 +34,27 @@ public:
     // Check if slot has stable power
     bool isSlotPowerStable(uint32_t slotNum);
 
+    /// @brief Get slots which have become stable since last cleared
+    /// @param clear true to clear the record of newly stable slots
+    /// @return bit mask of slots (bit N is slot N)
+    uint64_t getNewlyStableSlots(bool clear)
+    {
+        uint64_t newlyStableSlots = _newlyStableSlots;
+        if (clear)
+            _newlyStableSlots = 0;
+        return newlyStableSlots;
+    }
+
+    /// @brief Get time until the next power sequencing state change
+    /// @param timeNowMs current time in ms
+    /// @return time in ms (UINT32_MAX if no state change is pending)
+    uint32_t getMsUntilStateChange(uint32_t timeNowMs) const;
+
+    /// @brief Get the longest time a power cycle can take (off time, waiting for a power-on batch and the voltage
+    ///        stabilizing time)
+    /// @return time in ms
+    uint32_t getPowerCycleMaxMs() const;
+
     /// @brief Power cycle slot
     /// @param slotNum slot number (1 based) (0 to power cycle bus)
     void powerCycleSlot(uint32_t slotNum);
@@ -75,11 +96,27 @@ private:
     // Voltage level names
     std::vector<String> _voltageLevelNames;
 
-    // State machine timeouts
+    // State machine timeouts (defaults)
     static const uint32_t STARTUP_POWER_OFF_MS = 100;
     static const uint32_t VOLTAGE_STABILIZING_TIME_MS = 100;
     static const uint32_t POWER_CYCLE_OFF_TIME_MS = 500;
 
+    // State machine timeouts
+    uint32_t _startupPowerOffMs = STARTUP_POWER_OFF_MS;
+    uint32_t _voltageStabilizingMs = VOLTAGE_STABILIZING_TIME_MS;
+    uint32_t _powerCycleOffMs = POWER_CYCLE_OFF_TIME_MS;
+
+    // Power-on sequencing - slots are switched on in batches of up to _powerOnBatchMaxSlots (0 for no limit)
+    // with batches separated by _powerOnStaggerMs to limit inrush current
+    uint32_t _powerOnBatchMaxSlots = 0;
+    uint32_t _powerOnStaggerMs = 0;
+    uint32_t _powerOnBatchStartMs = 0;
+    uint32_t _powerOnBatchCount = 0;
+    bool _powerOnBatchStarted = false;
+
+    // Slots which have become stable (bit N is slot N)
+    uint64_t _newlyStableSlots = 0;
+
     // Voltage level pin record
     struct VoltageLevelPinRec
     {
@@ -135,7 +172,10 @@ private:
         SlotPowerControlState pwrCtrlState = SLOT_POWER_OFF_PRE_INIT;
 
         // Time of last state change
-        uint16_t pwrCtrlStateLastMs = 0;
+        uint32_t pwrCtrlStateLastMs = 0;
+
+        // Power off (for cycling) is set but not yet written to the IO expander - the off time starts when written
+        bool offWritePending = false;
 
         // Virtual pin records for each voltage level
         std::vector<VoltageLevelPinRec> voltageLevelPins;
@@ -175,11 +215,27 @@ private:
         {
         }
 
-        /// @brief Update power control registers for all slots
+        /// @brief Check if registers need to be written
         /// @param force true to force update (even if not dirty)
+        /// @return true if an update is needed
+        bool isUpdateNeeded(bool force) const
+        {
+            return force || ioRegDirty;
+        }
+
+        /// @brief Write changed power control registers (the mux channel must already be set if on a mux)
+        /// @param force true to write all registers (even if not changed)
         /// @param busI2CReqSyncFn function to call to perform I2C request
         void update(bool force, BusReqSyncFn busI2CReqSyncFn);
 
+        /// @brief Check if on the same mux channel as another IO expander
+        /// @param other other IO expander record
+        /// @return true if on the same mux channel (or both on the main bus)
+        bool isOnSameMuxChan(const IOExpanderRec& other) const
+        {
+            return (muxAddr == other.muxAddr) && ((muxAddr == 0) || (muxChanIdx == other.muxChanIdx));
+        }
+
         // Power controller address
         uint8_t addr = 0;
 
@@ -207,6 +263,17 @@ private:
 
         // IO register is dirty
         bool ioRegDirty = true;
+
+        // Register values last written to the device (only valid once written ok) - only registers (or register
+        // bytes) that have changed are written
+        uint16_t writtenOutputsReg = 0;
+        uint16_t writtenConfigReg = 0;
+        bool writtenOutputsValid = false;
+        bool writtenConfigValid = false;
+
+    private:
+        RaftRetCode writeReg16(uint8_t regPort0, uint16_t regVal, uint16_t prevVal, bool writeAll, 
+                        BusReqSyncFn busI2CReqSyncFn);
     };
 
     // IO exander records
@@ -256,11 +323,37 @@ private:
 
     /// @brief Action state changes in I2C IO expanders
     /// @param force true to force action
+    /// @note all pending changes for each expander are written together and expanders on the same mux channel
+    ///       are updated with a single channel selection
     void actionI2CIOStateChanges(bool force);
 
+    /// @brief Select (or deselect) the mux channel an IO expander is connected to
+    /// @param ioExpRec IO expander record
+    /// @param select true to select the channel, false to deselect all channels
+    void selectIOExpanderMuxChan(const IOExpanderRec& ioExpRec, bool select);
+
     /// @brief Turn all power off
     void powerOffAll();
 
+    /// @brief Check if a slot can be powered on now (limits the number of slots powered on together)
+    /// @param timeNowMs current time in ms
+    /// @return true if the slot can be powered on (the slot is counted in the current batch)
+    bool isPowerOnAllowed(uint32_t timeNowMs);
+
+    /// @brief Get the time in a state before the next state change
+    /// @param state power control state
+    /// @return time in ms (0 if the state doesn't time out)
+    uint32_t getStateTimeoutMs(SlotPowerControlState state) const
+    {
+        switch (state)
+        {
+            case SLOT_POWER_OFF_PRE_INIT: return _startupPowerOffMs;
+            case SLOT_POWER_ON_WAIT_STABLE: return _voltageStabilizingMs;
+            case SLOT_POWER_OFF_PENDING_CYCLING: return _powerCycleOffMs;
+            default: return 0;
+        }
+    }
+
     // Debug
     static constexpr const char* MODULE_PREFIX = "RaftI2CBusPwrCtrl";        
 };
@@ -11,6 +11,7 @@
 #include "BusRequestInfo.h"
 #include "DeviceTypeRecords.h"
 #include "BusI2CAddrAndSlot.h"
+#include <algorithm>
 
 // #define DEBUG_ELEM_STATUS_UPDATE
 // #define DEBUG_MOVE_TO_NORMAL_SCANNING
@@ -22,17 +23,26 @@
 // #define DEBUG_FORCE_SIMPLE_LINEAR_SCANNING
 // #define DEBUG_LIMIT_SCAN_ADDRS_TO_LIST 0x6a, 0x70
 // #define DEBUG_SCAN_MODE
+// #define DEBUG_SCAN_PERFORMED
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Constructor
 BusScanner::BusScanner(BusStatusMgr& busStatusMgr, BusI2CElemTracker& busElemTracker, BusMultiplexers& busMultiplexers, 
-                BusPowerController& powerController, DeviceIdentMgr& deviceIdentMgr, BusReqSyncFn busI2CReqSyncFn) :
+                BusPowerController& powerController, DeviceIdentMgr& deviceIdentMgr, BusReqSyncFn busI2CReqSyncFn,
+                BusProbeBurstFn busProbeBurstFn, BusTopologyCache* pTopologyCache,
+                BusI2CClockSpeeds* pClockSpeeds, BusI2CAccessTiming* pAccessTiming,
+                BusScanPreemptFn busScanPreemptFn) :
     _busStatusMgr(busStatusMgr),
     _busElemTracker(busElemTracker),
     _busMultiplexers(busMultiplexers),
     _powerController(powerController),
     _deviceIdentMgr(deviceIdentMgr),
-    _busReqSyncFn(busI2CReqSyncFn)
+    _busReqSyncFn(busI2CReqSyncFn),
+    _busProbeBurstFn(busProbeBurstFn),
+    _pTopologyCache(pTopologyCache),
+    _pClockSpeeds(pClockSpeeds),
+    _pAccessTiming(pAccessTiming),
+    _busScanPreemptFn(busScanPreemptFn)
 {
 }
 
@@ -49,8 +59,20 @@ void BusScanner::setup(const RaftJsonIF& config)
     // Bus scan period
     _slowScanPeriodMs = config.getLong("busScanPeriodMs", I2C_BUS_SLOW_SCAN_DEFAULT_PERIOD_MS);
 
+    // Burst scanning at startup (requires a probe burst function)
+    _burstScanEnabled = config.getBool("scanBurst", false) && _busProbeBurstFn;
+
+    // Adaptive scanning (when slow scanning)
+    _adaptiveScanEnabled = config.getBool("scanAdaptive", false);
+    int32_t adaptiveScanMaxLevel = config.getLong("scanAdaptiveMaxLevel", ADAPTIVE_SCAN_MAX_LEVEL_DEFAULT);
+    _adaptiveScanMaxLevel = adaptiveScanMaxLevel < 1 ? 1 : 
+                (adaptiveScanMaxLevel > ADAPTIVE_SCAN_MAX_LEVEL_LIMIT ? ADAPTIVE_SCAN_MAX_LEVEL_LIMIT : adaptiveScanMaxLevel);
+    _adaptiveScanRecs.clear();
+
     // Debug
-    LOG_I(MODULE_PREFIX, "setup busScanPeriodMs %d", _slowScanPeriodMs);
+    LOG_I(MODULE_PREFIX, "setup busScanPeriodMs %d scanBurst %s scanAdaptive %s maxLevel %d", 
+                _slowScanPeriodMs, _burstScanEnabled ? "Y" : "N", 
+                _adaptiveScanEnabled ? "Y" : "N", _adaptiveScanMaxLevel);
 
     // Get scan priority lists
     deviceTypeRecords.getScanPriorityLists(_scanPriorityLists);
@@ -99,6 +121,9 @@ void BusScanner::setup(const RaftJsonIF& config)
     
     // Scanner reset
     setScanMode(SCAN_MODE_IDLE);
+    _startupScanStartMs = 0;
+    _startupScanTimeMs = 0;
+    _lastSweepTimeMs = 0;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -115,15 +140,28 @@ void BusScanner::loop()
 /// @return true if fast scanning in progress
 bool BusScanner::taskService(uint64_t curTimeUs, uint64_t maxFastTimeInLoopUs, uint64_t maxSlowTimeInLoopUs)
 {
-    // Time of last scan
     uint32_t curTimeMs = curTimeUs / 1000;
-    _scanLastMs = curTimeMs;
     uint64_t scanLoopStartTimeUs = micros();
+
+    // Step device identification (sharing the time budget with scanning)
+    if (_deviceIdentMgr.isIdentPending())
+    {
+        uint64_t maxTimeInLoopUs = _scanMode == SCAN_MODE_SCAN_SLOW ? maxSlowTimeInLoopUs : maxFastTimeInLoopUs;
+        serviceIdentification(scanLoopStartTimeUs, maxTimeInLoopUs);
+        if (!isScanDue(curTimeMs) || Raft::isTimeout(micros(), scanLoopStartTimeUs, maxTimeInLoopUs))
+            return _scanMode != SCAN_MODE_SCAN_SLOW;
+    }
+
+    // Time of last scan
+    _scanLastMs = curTimeMs;
     bool sweepCompleted = false;
 
-#ifdef DEBUG_SCANNING_SWEEP_TIME
     uint32_t startingScanAddressList = _scanAddressesCurrentList;
-#endif
+
+    // Slots which have become stable are scanned first (once the startup scan has reached the slots)
+    _powerStableSlotsToScan |= _powerController.getNewlyStableSlots(true);
+    if (scanNextPowerStableSlot())
+        return _scanMode != SCAN_MODE_SCAN_SLOW;
 
     // Check scan state
     switch(_scanMode)
@@ -132,12 +170,39 @@ bool BusScanner::taskService(uint64_t curTimeUs, uint64_t maxFastTimeInLoopUs, u
         {
             // Init vars and go to scan multiplexers
             setScanMode(SCAN_MODE_MAIN_BUS_MUX_ONLY);
+            _startupScanStartMs = curTimeMs;
 
             // Disable all slots (only works if a reset pin is defined since we don't know about
             // multiplexer addresses at this stage - but could be helpful if a soft reset occurs)
             _busMultiplexers.disableAllSlots(true);
             break;
         }
+        case SCAN_MODE_SCAN_BURST:
+        {
+            // Scan slots until the time budget is used (checked between bursts)
+            while (!sweepCompleted)
+            {
+                burstScanNextSlot(sweepCompleted);
+                if ((_scanMode != SCAN_MODE_SCAN_BURST) || Raft::isTimeout(micros(), scanLoopStartTimeUs, maxFastTimeInLoopUs))
+                    break;
+                if (_busScanPreemptFn && _busScanPreemptFn())
+                    break;
+            }
+            break;
+        }
+        case SCAN_MODE_WARM_START:
+        {
+            // Revalidate cached locations until the time budget is used
+            while (!sweepCompleted)
+            {
+                warmStartScanNext(sweepCompleted);
+                if ((_scanMode != SCAN_MODE_WARM_START) || Raft::isTimeout(micros(), scanLoopStartTimeUs, maxFastTimeInLoopUs))
+                    break;
+                if (_busScanPreemptFn && _busScanPreemptFn())
+                    break;
+            }
+            break;
+        }
         case SCAN_MODE_MAIN_BUS_MUX_ONLY:
         case SCAN_MODE_MAIN_BUS:
         case SCAN_MODE_SCAN_FAST:
@@ -166,37 +231,22 @@ bool BusScanner::taskService(uint64_t curTimeUs, uint64_t maxFastTimeInLoopUs, u
                     break;
                 }
 
-                // Only scan the main bus for addresses already known to be on the main bus - otherwise
-                // they will incorrectly appear multiple times on slots because main bus devices
-                // will respond on all slots
-                if ((slotNum != 0) && _busElemTracker.isAddrFoundOnMainBus(addr))
+                // Check the address should be scanned on this slot
+                if (!isAddrToBeScanned(addr, slotNum))
                     continue;
 
-                // Avoid scanning a bus multiplexer address on the wrong slot
-                if (_busMultiplexers.isBusMultiplexer(addr))
+                // Check if the location is backed-off (adaptive scanning)
+                if ((_scanMode == SCAN_MODE_SCAN_SLOW) && _adaptiveScanEnabled && !isAdaptiveScanDue(addr, slotNum))
                 {
-                    if (!_busMultiplexers.isSlotCorrect(addr, slotNum))
-                        continue;
-                }
-
-                // Avoid scanning a bus power controller address
-                if (slotNum == 0)
-                {
-                    if (_powerController.isBusPowerController(addr, 0, 0))
-                        continue;
-                }
-                else
-                {
-                    uint32_t muxIdx = 0;
-                    uint32_t slotIdx = 0;
-                    if (!_busMultiplexers.getMuxAndSlotIdx(slotNum, muxIdx, slotIdx))
-                        continue;
-                    uint32_t muxAddr = _busMultiplexers.getAddrFromMuxIdx(muxIdx);
-                    if (_powerController.isBusPowerController(addr, muxAddr, slotIdx))
-                        continue;
+                    if (sweepCompleted)
+                        break;
+                    continue;
                 }
 
-                // Scan the address
+                // Scan the address (the debug line format matches unit_tests/analysescanfreq.py)
+#ifdef DEBUG_SCAN_PERFORMED
+                LOG_I(MODULE_PREFIX, "taskService %s scan addr %02x slot %d", getScanStateStr(_scanMode), addr, slotNum);
+#endif
                 bool failedToEnableSlot = false;
                 auto rslt = scanOneAddress(addr, slotNum, failedToEnableSlot);
                 if (!failedToEnableSlot)
@@ -208,6 +258,8 @@ bool BusScanner::taskService(uint64_t curTimeUs, uint64_t maxFastTimeInLoopUs, u
                         setScanMode(SCAN_MODE_MAIN_BUS_MUX_ONLY);
                     }
                     updateBusElemState(addr, slotNum, rslt);
+                    if (_adaptiveScanEnabled)
+                        updateAdaptiveScan(addr, slotNum, rslt == RAFT_OK);
                 }
                 else if (rslt == RAFT_BUS_STUCK)
                 {
@@ -227,6 +279,10 @@ bool BusScanner::taskService(uint64_t curTimeUs, uint64_t maxFastTimeInLoopUs, u
                 // Check sweepComplete or timeout
                 if (sweepCompleted || Raft::isTimeout(micros(), scanLoopStartTimeUs, _scanMode == SCAN_MODE_SCAN_FAST ? maxFastTimeInLoopUs : maxSlowTimeInLoopUs))
                     break;
+
+                // Check for preemption by high priority requests
+                if (_busScanPreemptFn && _busScanPreemptFn())
+                    break;
             }
             break;
         }
@@ -235,14 +291,21 @@ bool BusScanner::taskService(uint64_t curTimeUs, uint64_t maxFastTimeInLoopUs, u
     // Check if a sweep has completed
     if (sweepCompleted)
     {
-#ifdef DEBUG_SCANNING_SWEEP_TIME
-        if (startingScanAddressList < _scanPriorityRecs.size())
+        // Sweep time
+        uint32_t sweepEndMs = millis();
+        if (_scanMode == SCAN_MODE_SCAN_BURST)
         {
-            uint32_t sweepTimeMs = Raft::timeElapsed(curTimeMs, _scanPriorityRecs[startingScanAddressList]._debugScanSweepStartMs);
-            LOG_I(MODULE_PREFIX, "taskService %s priority %d sweep completed time %dms (next priority %d)", 
-                        getScanStateStr(_scanMode), startingScanAddressList, sweepTimeMs, _scanAddressesCurrentList);
-            _scanPriorityRecs[startingScanAddressList]._debugScanSweepStartMs = millis();
+            _lastSweepTimeMs = Raft::timeElapsed(sweepEndMs, _burstSweepStartMs);
+            _burstSweepStartMs = sweepEndMs;
         }
+        else if (startingScanAddressList < _scanPriorityRecs.size())
+        {
+            _lastSweepTimeMs = Raft::timeElapsed(sweepEndMs, _scanPriorityRecs[startingScanAddressList].sweepStartMs);
+            _scanPriorityRecs[startingScanAddressList].sweepStartMs = sweepEndMs;
+        }
+#ifdef DEBUG_SCANNING_SWEEP_TIME
+        LOG_I(MODULE_PREFIX, "taskService %s priority %d sweep completed time %dms (next priority %d)", 
+                    getScanStateStr(_scanMode), startingScanAddressList, _lastSweepTimeMs, _scanAddressesCurrentList);
 #endif
 
         _scanStateRepeatCount++;
@@ -251,40 +314,110 @@ bool BusScanner::taskService(uint64_t curTimeUs, uint64_t maxFastTimeInLoopUs, u
             switch (_scanMode)
             {
                 case SCAN_MODE_MAIN_BUS_MUX_ONLY:
+                    // At startup revalidate the cached topology first
+                    if (_pTopologyCache && (_pTopologyCache->getStartupRecs().size() > 0) && (_startupScanTimeMs == 0))
+                        setScanMode(SCAN_MODE_WARM_START);
+                    else
+                        setScanMode(SCAN_MODE_MAIN_BUS);
+                    break;
+                case SCAN_MODE_WARM_START:
                     setScanMode(SCAN_MODE_MAIN_BUS);
                     break;
                 case SCAN_MODE_MAIN_BUS: 
-                    setScanMode(SCAN_MODE_SCAN_FAST);
+                    setScanMode(_burstScanEnabled && (_startupScanTimeMs == 0) ? SCAN_MODE_SCAN_BURST : SCAN_MODE_SCAN_FAST);
                      break;
+                case SCAN_MODE_SCAN_BURST:
                 case SCAN_MODE_SCAN_FAST: 
                     setScanMode(SCAN_MODE_SCAN_SLOW);
                     break;
                 default: 
                     break;
             }
+
+            // Record startup scan time
+            if ((_scanMode == SCAN_MODE_SCAN_SLOW) && (_startupScanTimeMs == 0))
+            {
+                _startupScanTimeMs = Raft::timeElapsed(sweepEndMs, _startupScanStartMs);
+                if (_startupScanTimeMs == 0)
+                    _startupScanTimeMs = 1;
+                LOG_I(MODULE_PREFIX, "taskService startup scan complete %dms", _startupScanTimeMs);
+            }
         }
     }
     return _scanMode != SCAN_MODE_SCAN_SLOW;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/// @brief Check if a scan is pending
+/// @brief Check if a scan (or a device identification step) is pending
 /// @return true if a scan is pending
 bool BusScanner::isScanPending(uint32_t curTimeMs)
+{
+    if (_deviceIdentMgr.isIdentPending() && (_deviceIdentMgr.getMsUntilIdentStepDue(micros()) == 0))
+        return true;
+    return isScanDue(curTimeMs);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Check if a scan is due
+/// @return true if a scan is due
+bool BusScanner::isScanDue(uint32_t curTimeMs)
 {
     switch(_scanMode)
     {
         case SCAN_MODE_IDLE:
         case SCAN_MODE_MAIN_BUS_MUX_ONLY:
+        case SCAN_MODE_WARM_START:
         case SCAN_MODE_MAIN_BUS:
+        case SCAN_MODE_SCAN_BURST:
         case SCAN_MODE_SCAN_FAST:
             return true;
         case SCAN_MODE_SCAN_SLOW:
+            if ((_powerStableSlotsToScan != 0) || (_powerController.getNewlyStableSlots(false) != 0))
+                return true;
             return _slowScanEnabled && ((_slowScanPeriodMs == 0) || (Raft::isTimeout(curTimeMs, _scanLastMs, _slowScanPeriodMs)));
     }
     return false;
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get time until the next scan is due
+/// @param curTimeMs Current time in ms
+/// @return time in ms until a scan is due (UINT32_MAX if no scan is scheduled)
+uint32_t BusScanner::getMsUntilScanDue(uint32_t curTimeMs) const
+{
+    return std::min(getMsUntilScanSweepDue(curTimeMs), _deviceIdentMgr.getMsUntilIdentStepDue(micros()));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get time until the next scan sweep step is due
+/// @param curTimeMs Current time in ms
+/// @return time in ms until a scan is due (UINT32_MAX if no scan is scheduled)
+uint32_t BusScanner::getMsUntilScanSweepDue(uint32_t curTimeMs) const
+{
+    switch(_scanMode)
+    {
+        case SCAN_MODE_IDLE:
+        case SCAN_MODE_MAIN_BUS_MUX_ONLY:
+        case SCAN_MODE_WARM_START:
+        case SCAN_MODE_MAIN_BUS:
+        case SCAN_MODE_SCAN_BURST:
+        case SCAN_MODE_SCAN_FAST:
+            return 0;
+        case SCAN_MODE_SCAN_SLOW:
+        {
+            if ((_powerStableSlotsToScan != 0) || (_powerController.getNewlyStableSlots(false) != 0))
+                return 0;
+            if (!_slowScanEnabled)
+                return UINT32_MAX;
+            uint32_t elapsedMs = Raft::timeElapsed(curTimeMs, _scanLastMs);
+            if ((_slowScanPeriodMs == 0) || (elapsedMs > _slowScanPeriodMs))
+                return 0;
+            return _slowScanPeriodMs - elapsedMs + 1;
+        }
+    }
+    return UINT32_MAX;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Set scan mode
 /// @param scanMode Scan mode
@@ -302,6 +435,10 @@ void BusScanner::setScanMode(BusScanMode scanMode, uint32_t repeatCount)
     _scanMode = scanMode;
     _scanStateRepeatMax = repeatCount;
     _scanLastMs = 0;
+    _burstSlotIdx = 0;
+    _warmStartRecIdx = 0;
+    _burstSweepStartMs = millis();
+    _scanPriorityRecs[_scanAddressesCurrentList].sweepStartMs = _burstSweepStartMs;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -508,6 +645,252 @@ uint32_t BusScanner::getSlotNumFromSlotIdx(ScanPriorityRec& scanRec, bool& sweep
     return slotNum;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Burst scan the next slot
+/// @param sweepCompleted (out) Sweep completed (all slots scanned)
+/// @note The slot is enabled once and all addresses are probed back-to-back - results are then processed
+///       (including device identification) with the slot still enabled
+void BusScanner::burstScanNextSlot(bool& sweepCompleted)
+{
+    // Check for all slots done
+    const std::vector<uint8_t>& slotIndices = _busMultiplexers.getSlotIndices();
+    if (_burstSlotIdx >= slotIndices.size())
+    {
+        _burstSlotIdx = 0;
+        sweepCompleted = true;
+        return;
+    }
+    uint32_t slotNum = slotIndices[_burstSlotIdx] + 1;
+    _burstSlotIdx++;
+
+    // Scan the slot
+    burstScanSlot(slotNum);
+
+    // Check for sweep completed
+    if ((_scanMode == SCAN_MODE_SCAN_BURST) && (_burstSlotIdx >= slotIndices.size()))
+    {
+        _burstSlotIdx = 0;
+        sweepCompleted = true;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Burst scan a slot (all addresses on the slot are probed with the slot enabled once)
+/// @param slotNum Slot number (1-based)
+void BusScanner::burstScanSlot(uint32_t slotNum)
+{
+    // Build list of addresses to probe
+    uint32_t numAddrs = 0;
+    for (uint32_t addr = I2C_BUS_ADDRESS_MIN; addr <= I2C_BUS_ADDRESS_MAX; addr++)
+    {
+        if (isAddrToBeScanned(addr, slotNum))
+            _burstAddrs[numAddrs++] = addr;
+    }
+
+    // Enable the slot
+    auto rslt = _busMultiplexers.enableOneSlot(slotNum);
+    if (rslt == RAFT_OK)
+    {
+        // Probe all addresses and process results
+        _busProbeBurstFn(_burstAddrs, numAddrs, slotNum, _burstResults);
+        for (uint32_t i = 0; i < numAddrs; i++)
+        {
+            if (_busMultiplexers.elemStateChange(_burstAddrs[i], slotNum, _burstResults[i] == RAFT_OK))
+            {
+                // Change to a mux state so move back to scanning muliplexers
+                setScanMode(SCAN_MODE_MAIN_BUS_MUX_ONLY);
+            }
+            updateBusElemState(_burstAddrs[i], slotNum, _burstResults[i]);
+            if (_adaptiveScanEnabled)
+                updateAdaptiveScan(_burstAddrs[i], slotNum, _burstResults[i] == RAFT_OK);
+        }
+    }
+    else if (rslt == RAFT_BUS_STUCK)
+    {
+        // Update state for all elements to offline and indicate that the bus is failing
+        _busStatusMgr.informBusStuck();
+#ifdef DEBUG_CANT_ENABLE_SLOT
+        LOG_I(MODULE_PREFIX, "burstScanSlot bus stuck attempting to set slotNum %d", slotNum);
+#endif
+    }
+
+    // Disable all slots
+    _busMultiplexers.disableAllSlots(false);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Scan the next slot which has become stable since it was last scanned
+/// @return true if a slot was scanned
+bool BusScanner::scanNextPowerStableSlot()
+{
+    // Slots are scanned once the startup scan has reached the slots (before that they will be scanned anyway)
+    if ((_powerStableSlotsToScan == 0) || ((_scanMode != SCAN_MODE_SCAN_BURST) && 
+                (_scanMode != SCAN_MODE_SCAN_FAST) && (_scanMode != SCAN_MODE_SCAN_SLOW)))
+        return false;
+
+    // Without burst probing a (restarted) fast scan covers the newly stable slots
+    if (!_busProbeBurstFn)
+    {
+        _powerStableSlotsToScan = 0;
+        setScanMode(SCAN_MODE_SCAN_FAST);
+        return false;
+    }
+
+    // Get the lowest numbered slot and check it exists (slot 0 is the main bus which is always scanned)
+    uint32_t slotNum = __builtin_ctzll(_powerStableSlotsToScan);
+    _powerStableSlotsToScan &= ~(1ULL << slotNum);
+    const std::vector<uint8_t>& slotIndices = _busMultiplexers.getSlotIndices();
+    bool slotExists = false;
+    for (uint8_t slotIdx : slotIndices)
+    {
+        if (slotIdx + 1U == slotNum)
+        {
+            slotExists = true;
+            break;
+        }
+    }
+    if (!slotExists)
+        return false;
+
+    // Scan the slot
+#ifdef DEBUG_SCAN_PERFORMED
+    LOG_I(MODULE_PREFIX, "scanNextPowerStableSlot %s slot %d", getScanStateStr(_scanMode), slotNum);
+#endif
+    burstScanSlot(slotNum);
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Revalidate the next location in the cached topology
+/// @param sweepCompleted (out) Sweep completed (all cached locations checked)
+void BusScanner::warmStartScanNext(bool& sweepCompleted)
+{
+    // Check for all locations done
+    const std::vector<BusTopologyCache::TopologyRec>& recs = _pTopologyCache->getStartupRecs();
+    if (_warmStartRecIdx >= recs.size())
+    {
+        _warmStartRecIdx = 0;
+        sweepCompleted = true;
+        return;
+    }
+    BusI2CAddrAndSlot addrAndSlot = BusI2CAddrAndSlot::fromBusElemAddrType(recs[_warmStartRecIdx].address);
+    _warmStartRecIdx++;
+
+    // Check the location is still valid (e.g. the slot exists)
+    if (isAddrToBeScanned(addrAndSlot.i2cAddr, addrAndSlot.slotNum))
+    {
+        // Scan the address
+        bool failedToEnableSlot = false;
+        auto rslt = scanOneAddress(addrAndSlot.i2cAddr, addrAndSlot.slotNum, failedToEnableSlot);
+        if (!failedToEnableSlot)
+        {
+            if (_busMultiplexers.elemStateChange(addrAndSlot.i2cAddr, addrAndSlot.slotNum, rslt == RAFT_OK))
+                setScanMode(SCAN_MODE_MAIN_BUS_MUX_ONLY);
+            updateBusElemState(addrAndSlot.i2cAddr, addrAndSlot.slotNum, rslt);
+        }
+        else if (rslt == RAFT_BUS_STUCK)
+        {
+            _busStatusMgr.informBusStuck();
+        }
+
+        // Disable all slots
+        _busMultiplexers.disableAllSlots(false);
+    }
+
+    // Check for sweep completed
+    if ((_scanMode == SCAN_MODE_WARM_START) && (_warmStartRecIdx >= recs.size()))
+    {
+        _warmStartRecIdx = 0;
+        sweepCompleted = true;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Check if an address should be scanned on a slot
+/// @param addr Address
+/// @param slotNum SlotNum (1-based, 0 for main bus)
+/// @return true if the address should be scanned
+bool BusScanner::isAddrToBeScanned(uint32_t addr, uint32_t slotNum)
+{
+    // Only scan the main bus for addresses already known to be on the main bus - otherwise
+    // they will incorrectly appear multiple times on slots because main bus devices
+    // will respond on all slots
+    if ((slotNum != 0) && _busElemTracker.isAddrFoundOnMainBus(addr))
+        return false;
+
+    // Avoid scanning a bus multiplexer address on the wrong slot
+    if (_busMultiplexers.isBusMultiplexer(addr))
+    {
+        if (!_busMultiplexers.isSlotCorrect(addr, slotNum))
+            return false;
+    }
+
+    // Avoid scanning a bus power controller address
+    if (slotNum == 0)
+        return !_powerController.isBusPowerController(addr, 0, 0);
+    uint32_t muxIdx = 0;
+    uint32_t slotIdx = 0;
+    if (!_busMultiplexers.getMuxAndSlotIdx(slotNum, muxIdx, slotIdx))
+        return false;
+    uint32_t muxAddr = _busMultiplexers.getAddrFromMuxIdx(muxIdx);
+    return !_powerController.isBusPowerController(addr, muxAddr, slotIdx);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get adaptive scan record for a location (records are added as slots are seen)
+/// @param addr Address
+/// @param slotNum SlotNum (1-based, 0 for main bus)
+/// @return pointer to record or nullptr if invalid
+BusScanner::AdaptiveScanRec* BusScanner::getAdaptiveScanRec(uint32_t addr, uint32_t slotNum)
+{
+    if ((addr >= ADAPTIVE_SCAN_ADDRS_PER_SLOT) || (slotNum > ADAPTIVE_SCAN_MAX_SLOT_NUM))
+        return nullptr;
+    uint32_t recIdx = slotNum * ADAPTIVE_SCAN_ADDRS_PER_SLOT + addr;
+    if (recIdx >= _adaptiveScanRecs.size())
+        _adaptiveScanRecs.resize((slotNum + 1) * ADAPTIVE_SCAN_ADDRS_PER_SLOT);
+    return &_adaptiveScanRecs[recIdx];
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Check if an adaptive scan of a location is due (counts down the back-off for the location)
+/// @param addr Address
+/// @param slotNum SlotNum (1-based, 0 for main bus)
+/// @return true if the location should be scanned on this visit
+bool BusScanner::isAdaptiveScanDue(uint32_t addr, uint32_t slotNum)
+{
+    AdaptiveScanRec* pRec = getAdaptiveScanRec(addr, slotNum);
+    if (!pRec || (pRec->countdown == 0))
+        return true;
+    pRec->countdown--;
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Update adaptive scan back-off for a location based on a scan result
+/// @param addr Address
+/// @param slotNum SlotNum (1-based, 0 for main bus)
+/// @param isResponding true if the location responded
+void BusScanner::updateAdaptiveScan(uint32_t addr, uint32_t slotNum, bool isResponding)
+{
+    AdaptiveScanRec* pRec = getAdaptiveScanRec(addr, slotNum);
+    if (!pRec)
+        return;
+    if (isResponding)
+    {
+        pRec->level = 0;
+        pRec->hasResponded = true;
+    }
+    else
+    {
+        uint8_t maxLevel = pRec->hasResponded ? ADAPTIVE_SCAN_KNOWN_MAX_LEVEL : _adaptiveScanMaxLevel;
+        if (pRec->level < maxLevel)
+            pRec->level++;
+        else
+            pRec->level = maxLevel;
+    }
+    pRec->countdown = (1 << pRec->level) - 1;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Request a bus scan
 /// @param enableSlowScan Enable slow scan
@@ -518,6 +901,9 @@ void BusScanner::requestScan(bool enableSlowScan, bool requestFastScan)
     if (requestFastScan)
     {
         setScanMode(SCAN_MODE_SCAN_FAST);
+
+        // Forget adaptive scan back-off so that all locations are checked again
+        _adaptiveScanRecs.clear();
     }
     _slowScanEnabled = enableSlowScan;
 }
@@ -569,19 +955,85 @@ void BusScanner::updateBusElemState(uint32_t i2cAddr, uint32_t slot, RaftRetCode
         _busElemTracker.setElemFound(i2cAddr, slot);
     }
 
+    // Change to offline removes the location from the topology cache
+    if (isChange && !isOnline && _pTopologyCache)
+        _pTopologyCache->update(address, false, 0);
+
+    // Change to offline cancels any identification in progress
+    if (isChange && !isOnline)
+        _deviceIdentMgr.cancelIdentify(address);
+
+    // Change to offline reverts to the slot frequency
+    if (isChange && !isOnline && _pClockSpeeds)
+        _pClockSpeeds->setDeviceTypeFreq(address, 0);
+    if (isChange && !isOnline && _pAccessTiming)
+        _pAccessTiming->forgetDevice(address);
+
 #ifdef DEBUG_BUS_SCANNER
     LOG_I(MODULE_PREFIX, "updateBusElemState addr %02x slot %d accessResult %d isOnline %d isChange %d", 
                 addr, slot, accessResult, isOnline, isChange);
 #endif
 
-    // Change to online so start device identification
+    // Change to online so start device identification (checking the cached type first if there is one) - this
+    // is performed incrementally by serviceIdentification so polling of other devices continues meanwhile
     if (isChange && isOnline)
     {
-        // Attempt to identify the device
-        DeviceStatus deviceStatus;
-        _deviceIdentMgr.identifyDevice(address, deviceStatus);
+        uint16_t deviceTypeIdxHint = UINT16_MAX;
+        if (_pTopologyCache)
+            _pTopologyCache->getDeviceTypeHint(address, deviceTypeIdxHint);
+        _deviceIdentMgr.queueIdentify(address, deviceTypeIdxHint);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Step device identification (one detection read or init request per step) with the slot enabled
+/// @param loopStartTimeUs Start time of the service loop
+/// @param maxTimeInLoopUs Maximum time allowed in the service loop
+void BusScanner::serviceIdentification(uint64_t loopStartTimeUs, uint64_t maxTimeInLoopUs)
+{
+    int32_t enabledSlotNum = -1;
+    BusElemAddrType address = 0;
+    while (_deviceIdentMgr.getNextIdentStepAddr(micros(), address))
+    {
+        // Enable the slot (if not already enabled) - if this fails identification is retried on the next service
+        uint32_t slotNum = BusI2CAddrAndSlot::getSlotNum(address);
+        if ((int32_t)slotNum != enabledSlotNum)
+        {
+            if (_busMultiplexers.enableOneSlot(slotNum) != RAFT_OK)
+                break;
+            enabledSlotNum = slotNum;
+        }
+
+        // Step
+        if (_deviceIdentMgr.stepIdentify(micros(), address, _identDeviceStatus) == DeviceIdentMgr::IDENT_STEP_COMPLETE)
+            handleIdentComplete(address, _identDeviceStatus);
 
-        // Set device status into bus status manager for this address
-        _busStatusMgr.setBusElemDeviceStatus(address, deviceStatus);
+        // Check timeout and preemption by high priority requests
+        if (Raft::isTimeout(micros(), loopStartTimeUs, maxTimeInLoopUs))
+            break;
+        if (_busScanPreemptFn && _busScanPreemptFn())
+            break;
     }
+
+    // Disable all slots
+    if (enabledSlotNum >= 0)
+        _busMultiplexers.disableAllSlots(false);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Handle completion of device identification
+/// @param address Address
+/// @param deviceStatus Device status (device type is invalid if not identified)
+void BusScanner::handleIdentComplete(BusElemAddrType address, const DeviceStatus& deviceStatus)
+{
+    if (_pTopologyCache)
+        _pTopologyCache->update(address, true, deviceStatus.getDeviceTypeIndex());
+    if (_pClockSpeeds)
+        _pClockSpeeds->setDeviceTypeFreq(address, _deviceIdentMgr.getDeviceTypeI2CFreq(deviceStatus.getDeviceTypeIndex()));
+    if (_pAccessTiming)
+        _pAccessTiming->setDeviceTypeOverheadUs(address, 
+                    _deviceIdentMgr.getDeviceTypeI2CStretchUs(deviceStatus.getDeviceTypeIndex()));
+
+    // Set device status into bus status manager for this address
+    _busStatusMgr.setBusElemDeviceStatus(address, deviceStatus);
 }
@@ -16,14 +16,29 @@
 #include "BusMultiplexers.h"
 #include "RaftI2CCentralIF.h"
 #include "DeviceIdentMgr.h"
+#include "BusTopologyCache.h"
+#include "BusI2CClockSpeeds.h"
+#include "BusI2CAccessTiming.h"
 
 // #define DEBUG_SCANNING_SWEEP_TIME
 
+// Bus probe burst function (synchronous) - probes each I2C address in turn (on the currently enabled slot which
+// sets the frequency) storing a result for each (a failed probe doesn't stop the remainder)
+typedef std::function<void(const uint8_t* pI2CAddrs, uint32_t numAddrs, uint32_t slotNum, 
+                RaftRetCode* pResults)> BusProbeBurstFn;
+
+// Bus scan preempt function - returns true if the current scan step should end early (so that waiting
+// high priority requests can be sent)
+typedef std::function<bool()> BusScanPreemptFn;
+
 class BusScanner {
 
 public:
     BusScanner(BusStatusMgr& busStatusMgr, BusI2CElemTracker& busElemTracker, BusMultiplexers& BusMultiplexers,
-                BusPowerController& powerController, DeviceIdentMgr& deviceIdentMgr, BusReqSyncFn busI2CReqSyncFn);
+                BusPowerController& powerController, DeviceIdentMgr& deviceIdentMgr, BusReqSyncFn busI2CReqSyncFn,
+                BusProbeBurstFn busProbeBurstFn = nullptr, BusTopologyCache* pTopologyCache = nullptr,
+                BusI2CClockSpeeds* pClockSpeeds = nullptr, BusI2CAccessTiming* pAccessTiming = nullptr,
+                BusScanPreemptFn busScanPreemptFn = nullptr);
     ~BusScanner();
     void setup(const RaftJsonIF& config);
     void loop();
@@ -34,6 +49,12 @@ public:
     /// @return true if a scan is pending
     bool isScanPending(uint32_t curTimeMs);
 
+    ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get time until the next scan is due
+    /// @param curTimeMs Current time in ms
+    /// @return time in ms until a scan is due (UINT32_MAX if no scan is scheduled)
+    uint32_t getMsUntilScanDue(uint32_t curTimeMs) const;
+
     ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Service called from I2C task
     /// @param curTimeUs Current time in microseconds
@@ -42,6 +63,22 @@ public:
     /// @return true if fast scanning in progress
     bool taskService(uint64_t curTimeUs, uint64_t maxFastTimeInLoopUs, uint64_t maxSlowTimeInLoopUs);
 
+    ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get time taken by the startup scan (from the first scan until slow scanning starts)
+    /// @return time in ms (0 if the startup scan hasn't completed)
+    uint32_t getStartupScanTimeMs() const
+    {
+        return _startupScanTimeMs;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get time taken by the last completed sweep
+    /// @return time in ms (0 if no sweep has completed)
+    uint32_t getLastSweepTimeMs() const
+    {
+        return _lastSweepTimeMs;
+    }
+
     // Scan period
     static const uint32_t I2C_BUS_SLOW_SCAN_DEFAULT_PERIOD_MS = 5;
 
@@ -50,7 +87,9 @@ private:
     enum BusScanMode {
         SCAN_MODE_IDLE,
         SCAN_MODE_MAIN_BUS_MUX_ONLY,
+        SCAN_MODE_WARM_START,
         SCAN_MODE_MAIN_BUS,
+        SCAN_MODE_SCAN_BURST,
         SCAN_MODE_SCAN_FAST,
         SCAN_MODE_SCAN_SLOW
     };
@@ -62,7 +101,9 @@ private:
         {
             case SCAN_MODE_IDLE: return "IDLE";
             case SCAN_MODE_MAIN_BUS_MUX_ONLY: return "MAIN_MUX";
+            case SCAN_MODE_WARM_START: return "WARM_START";
             case SCAN_MODE_MAIN_BUS: return "MAIN_BUS";
+            case SCAN_MODE_SCAN_BURST: return "SCAN_BURST";
             case SCAN_MODE_SCAN_FAST: return "SCAN_FAST";
             case SCAN_MODE_SCAN_SLOW: return "SCAN_SLOW";
         }
@@ -89,10 +130,7 @@ private:
         uint16_t maxCount = 0;
         uint16_t scanListIndex = 0;
         uint16_t scanSlotNum = 0;
-#ifdef DEBUG_SCANNING_SWEEP_TIME
-        uint32_t _debugScanSweepStartMs = 0;
-#endif
-
+        uint32_t sweepStartMs = 0;
     };
     std::vector<ScanPriorityRec> _scanPriorityRecs;
 
@@ -102,6 +140,46 @@ private:
     // Enable slow scanning
     bool _slowScanEnabled = true;
 
+    // Burst scanning - after the main bus has been scanned at startup each slot is enabled once and all
+    // addresses on it are probed back-to-back
+    bool _burstScanEnabled = false;
+    uint16_t _burstSlotIdx = 0;
+    uint32_t _burstSweepStartMs = 0;
+    static const uint32_t BURST_SCAN_MAX_ADDRS = I2C_BUS_ADDRESS_MAX - I2C_BUS_ADDRESS_MIN + 1;
+    uint8_t _burstAddrs[BURST_SCAN_MAX_ADDRS];
+    RaftRetCode _burstResults[BURST_SCAN_MAX_ADDRS];
+
+    // Slots which have become scannable (power stable) and are waiting to be scanned (bit N is slot N) - these
+    // are scanned as soon as the startup scan has reached the slots rather than waiting for the next sweep
+    uint64_t _powerStableSlotsToScan = 0;
+
+    // Adaptive scanning - when slow scanning, locations (address and slot) which don't respond are backed off
+    // exponentially (scanned on one in 2^level visits) while locations which respond are scanned on every visit
+    // Locations which have responded in the past are only backed off a little so that re-connection is quick
+    bool _adaptiveScanEnabled = false;
+    uint8_t _adaptiveScanMaxLevel = ADAPTIVE_SCAN_MAX_LEVEL_DEFAULT;
+    static const uint8_t ADAPTIVE_SCAN_MAX_LEVEL_DEFAULT = 6;
+    static const uint8_t ADAPTIVE_SCAN_MAX_LEVEL_LIMIT = 15;
+    static const uint8_t ADAPTIVE_SCAN_KNOWN_MAX_LEVEL = 1;
+    class AdaptiveScanRec
+    {
+    public:
+        uint16_t countdown = 0;
+        uint8_t level = 0;
+        bool hasResponded = false;
+    };
+    std::vector<AdaptiveScanRec> _adaptiveScanRecs;
+    static const uint32_t ADAPTIVE_SCAN_ADDRS_PER_SLOT = I2C_BUS_ADDRESS_MAX + 1;
+    static const uint32_t ADAPTIVE_SCAN_MAX_SLOT_NUM = 63;
+    AdaptiveScanRec* getAdaptiveScanRec(uint32_t addr, uint32_t slotNum);
+    bool isAdaptiveScanDue(uint32_t addr, uint32_t slotNum);
+    void updateAdaptiveScan(uint32_t addr, uint32_t slotNum, bool isResponding);
+
+    // Scan timing
+    uint32_t _startupScanStartMs = 0;
+    uint32_t _startupScanTimeMs = 0;
+    uint32_t _lastSweepTimeMs = 0;
+
     // Status manager
     BusStatusMgr& _busStatusMgr;
 
@@ -120,6 +198,24 @@ private:
     // Bus i2c request function (synchronous)
     BusReqSyncFn _busReqSyncFn = nullptr;
 
+    // Bus probe burst function (synchronous)
+    BusProbeBurstFn _busProbeBurstFn = nullptr;
+
+    // Topology cache - locations in the cached topology are revalidated first at startup (after muxes are
+    // found) and the cached device type is checked first when identifying
+    BusTopologyCache* _pTopologyCache = nullptr;
+    uint16_t _warmStartRecIdx = 0;
+
+    // Clock speeds - device type frequencies are set when a device is identified
+    BusI2CClockSpeeds* _pClockSpeeds = nullptr;
+
+    // Access timing - device type overheads are set when a device is identified and learned timing is
+    // forgotten when it goes offline
+    BusI2CAccessTiming* _pAccessTiming = nullptr;
+
+    // Scan preempt function (checked between addresses)
+    BusScanPreemptFn _busScanPreemptFn = nullptr;
+
     /// @brief Set scan mode
     /// @param scanMode Scan mode
     void setScanMode(BusScanMode scanMode, uint32_t maxRepeat = BusAddrStatus::ADDR_RESP_COUNT_FAIL_MAX_DEFAULT+1);
@@ -133,6 +229,30 @@ private:
 
     // Helpers
     void updateBusElemState(uint32_t addr, uint32_t slotNum, RaftRetCode accessResult);
+    bool isScanDue(uint32_t curTimeMs);
+    uint32_t getMsUntilScanSweepDue(uint32_t curTimeMs) const;
+
+    // Device identification (stepped incrementally from taskService)
+    DeviceStatus _identDeviceStatus;
+    void serviceIdentification(uint64_t loopStartTimeUs, uint64_t maxTimeInLoopUs);
+    void handleIdentComplete(BusElemAddrType address, const DeviceStatus& deviceStatus);
+    bool isAddrToBeScanned(uint32_t addr, uint32_t slotNum);
+
+    /// @brief Burst scan the next slot (all addresses on the slot are probed with the slot enabled once)
+    /// @param sweepCompleted (out) Sweep completed (all slots scanned)
+    void burstScanNextSlot(bool& sweepCompleted);
+
+    /// @brief Burst scan a slot (all addresses on the slot are probed with the slot enabled once)
+    /// @param slotNum Slot number (1-based)
+    void burstScanSlot(uint32_t slotNum);
+
+    /// @brief Scan the next slot which has become stable since it was last scanned
+    /// @return true if a slot was scanned
+    bool scanNextPowerStableSlot();
+
+    /// @brief Revalidate the next location in the cached topology
+    /// @param sweepCompleted (out) Sweep completed (all cached locations checked)
+    void warmStartScanNext(bool& sweepCompleted);
 
     /// @brief Set current address and get slot to scan next (based on scan mode)
     /// @param addr (out) Address
@@ -10,6 +10,8 @@
 #include "Logger.h"
 #include "RaftUtils.h"
 #include "DeviceIdentMgr.h"
+#include "DeviceTypeRecords.h"
+#include "BusI2CSyncSample.h"
 #include <algorithm>
 
 // #define DEBUG_HANDLE_BUS_ELEM_STATE_CHANGES
@@ -22,15 +24,26 @@
 // #define DEBUG_ACCESS_BARRING_FOR_MS
 // #define DEBUG_HANDLE_BUS_DEVICE_INFO
 // #define DEBUG_HANDLE_POLL_RESULT
+// #define DEBUG_POLL_BUFFER_BUDGET
+// #define DEBUG_POLL_RESULT_FILTER
+// #define DEBUG_POLL_GROUPS
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Constructor
 /// @param raftBus raft bus
-BusStatusMgr::BusStatusMgr(RaftBus& raftBus) :
-    _raftBus(raftBus)
+/// @param pPollScheduler poll scheduler (maybe nullptr)
+/// @param pSyncSample sync sample settings (maybe nullptr)
+BusStatusMgr::BusStatusMgr(RaftBus& raftBus, BusPollScheduler* pPollScheduler, 
+            const BusI2CSyncSample* pSyncSample) :
+    _raftBus(raftBus),
+    _pPollScheduler(pPollScheduler),
+    _pSyncSample(pSyncSample)
 {
     // Bus element status change detection
     _busElemStatusMutex = xSemaphoreCreateMutex();
+
+    // Address index
+    _addrStatusIndex.assign(ADDR_INDEX_TABLE_SIZE, ADDR_INDEX_INVALID);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -58,10 +71,36 @@ void BusStatusMgr::setup(const RaftJsonIF& config)
     _busOperationStatus = BUS_OPERATION_UNKNOWN;
     _busElemStatusChangeDetected = false;
     _addrStatus.clear();
+    _pollRepeatState.clear();
+    rebuildAddrStatusIndex();
+
+    // Remove all ident polls from the poll scheduler
+    if (_pPollScheduler)
+        _pPollScheduler->removeMatching(BusPollScheduler::POLL_KEY_POLL_LIST_FLAG, 0);
+
+    // Change-only mode - poll results which are unchanged from the previous result aren't stored
+    _pollChangeOnly = config.getBool("pollChangeOnly", false);
+    _pollChangeOnlyMaxMs = config.getLong("pollChangeOnlyMaxMs", POLL_CHANGE_ONLY_MAX_MS_DEFAULT);
+    _pollRepeatTotal = 0;
+
+    // Poll buffer budget (0 for no limit)
+    _pollBufferBudget.setup(config.getLong("pollBufMaxBytes", 0));
+    _pollBufferGrowthPending = false;
+
+    // Poll result filters (per device type)
+    _pollFilterConfigs.clear();
+    _pollFilters.clear();
+    config.getArrayElems("pollFilters", _pollFilterConfigs);
+
+    // Poll groups
+    _pollGroups.clear();
+    _pollGroupResultsDropped = 0;
 
     // Debug
-    LOG_I(MODULE_PREFIX, "task lockupDetect addr %02x (valid %s)",
-                _addrForLockupDetect, _addrForLockupDetectValid ? "Y" : "N");
+    LOG_I(MODULE_PREFIX, "task lockupDetect addr %02x (valid %s) pollChangeOnly %s maxMs %d pollBufMaxBytes %d numPollFilters %d",
+                _addrForLockupDetect, _addrForLockupDetectValid ? "Y" : "N",
+                _pollChangeOnly ? "Y" : "N", _pollChangeOnlyMaxMs, _pollBufferBudget.getMaxBytes(),
+                _pollFilterConfigs.size());
 
 }
 
@@ -208,6 +247,12 @@ bool BusStatusMgr::updateBusElemState(BusElemAddrType address, bool elemRespondi
             newAddrStatus.address = address;
             _addrStatus.push_back(newAddrStatus);
             pAddrStatus = &_addrStatus.back();
+            _pollRepeatState.resize(_addrStatus.size());
+
+            // Add to index
+            int key = getAddrIndexKey(address);
+            if (key >= 0)
+                _addrStatusIndex[key] = _addrStatus.size() - 1;
         }
 
         // Check if we found a record
@@ -239,10 +284,27 @@ bool BusStatusMgr::updateBusElemState(BusElemAddrType address, bool elemRespondi
         // Check for spurious record detected
         if (flagSpuriousRecord)
         {
-            // Remove the record
-            _addrStatus.erase(std::remove_if(_addrStatus.begin(), _addrStatus.end(), 
-                [address](BusAddrStatus& addrStatus) { return addrStatus.address == address; }), 
-                _addrStatus.end());
+            // Remove the record (and its repeat detection state)
+            int recIdx = findAddrStatusIdx(address);
+            if (recIdx >= 0)
+            {
+                _addrStatus.erase(_addrStatus.begin() + recIdx);
+                if (recIdx < _pollRepeatState.size())
+                    _pollRepeatState.erase(_pollRepeatState.begin() + recIdx);
+            }
+            rebuildAddrStatusIndex();
+
+            // Stop ident polling
+            if (_pPollScheduler)
+                _pPollScheduler->remove(address);
+
+            // Release poll buffer quota
+            _pollBufferBudget.remove(address);
+            applyPollBufferBudget();
+
+            // Remove poll result filter and poll groups
+            setPollFilter(address, nullptr);
+            setPollGroups(address, nullptr);
         }
 
         // Return semaphore
@@ -275,6 +337,20 @@ bool BusStatusMgr::updateBusElemState(BusElemAddrType address, bool elemRespondi
     return isNewStatusChange;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Rebuild address index
+/// @note Assumes semaphore already taken
+void BusStatusMgr::rebuildAddrStatusIndex()
+{
+    std::fill(_addrStatusIndex.begin(), _addrStatusIndex.end(), ADDR_INDEX_INVALID);
+    for (uint32_t i = 0; i < _addrStatus.size(); i++)
+    {
+        int key = getAddrIndexKey(_addrStatus[i].address);
+        if (key >= 0)
+            _addrStatusIndex[key] = i;
+    }
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Check if an element is online
 /// @param address address
@@ -408,6 +484,13 @@ bool BusStatusMgr::barElemAccessGet(uint32_t timeNowMs, BusElemAddrType address)
 /// @param deviceStatus device status
 void BusStatusMgr::setBusElemDeviceStatus(BusElemAddrType address, const DeviceStatus& deviceStatus)
 {
+    // Build the poll result filter (if configured) and poll groups for the device type before taking the
+    // semaphore as these parse the device type's JSON and allocate storage
+    AddrPollFilter addrPollFilter;
+    bool hasPollFilter = buildPollFilter(address, deviceStatus.getDeviceTypeIndex(), addrPollFilter);
+    AddrPollGroups addrPollGroups;
+    bool hasPollGroups = buildPollGroups(address, deviceStatus.getDeviceTypeIndex(), addrPollGroups);
+
     // Obtain sempahore
     if (xSemaphoreTake(_busElemStatusMutex, pdMS_TO_TICKS(1)) != pdTRUE)
         return;
@@ -424,19 +507,211 @@ void BusStatusMgr::setBusElemDeviceStatus(BusElemAddrType address, const DeviceS
         {
             pAddrStatus->isNewlyIdentified = true;
         }
+
+        // Register ident polling with the poll scheduler (devices which participate in sync sampling are
+        // polled by the sync sample instead)
+        if (_pPollScheduler)
+        {
+            const DevicePollingInfo& pollInfo = deviceStatus.deviceIdentPolling;
+            if ((pollInfo.pollReqs.size() > 0) && !(_pSyncSample && _pSyncSample->isParticipant(address)))
+                _pPollScheduler->addOrUpdate(address, pollInfo.pollIntervalUs, 
+                            BusPollScheduler::POLL_PRIORITY_NORMAL, micros());
+            else
+                _pPollScheduler->remove(address);
+        }
+
+        // Poll buffer quota
+        const DevicePollingInfo& pollInfo = deviceStatus.deviceIdentPolling;
+        if ((deviceStatus.getDeviceTypeIndex() != DeviceStatus::DEVICE_TYPE_INDEX_INVALID) &&
+                    (pollInfo.numPollResultsToStore > 0))
+        {
+            // The device status holds an aggregator sized to the request
+            _pollBufferBudget.setRequest(address, pollInfo.numPollResultsToStore, pollInfo.pollResultSizeIncTimestamp);
+            _pollBufferBudget.setApplied(address, pollInfo.numPollResultsToStore);
+        }
+        else
+            _pollBufferBudget.remove(address);
+        applyPollBufferBudget();
+
+        // Poll result filter
+        setPollFilter(address, hasPollFilter ? &addrPollFilter : nullptr);
+
+        // Poll groups of the device type (if any)
+        setPollGroups(address, hasPollGroups ? &addrPollGroups : nullptr);
     }
 
     // Return semaphore
     xSemaphoreGive(_busElemStatusMutex);
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Build the poll result filter for a device (if its device type has a filter configured)
+/// @param address address
+/// @param deviceTypeIdx device type index
+/// @param addrPollFilter (out) filter
+/// @return true if the device has a filter
+/// @note Doesn't require the semaphore (the filter configs are only changed by setup)
+bool BusStatusMgr::buildPollFilter(BusElemAddrType address, uint16_t deviceTypeIdx, AddrPollFilter& addrPollFilter) const
+{
+    if ((_pollFilterConfigs.size() == 0) || (deviceTypeIdx == DeviceStatus::DEVICE_TYPE_INDEX_INVALID))
+        return false;
+
+    // Find the filter config for the device type
+    DeviceTypeRecord devTypeRec;
+    if (!deviceTypeRecords.getDeviceInfo(deviceTypeIdx, devTypeRec) || !devTypeRec.deviceType)
+        return false;
+    for (RaftJson filterConfig : _pollFilterConfigs)
+    {
+        if (!filterConfig.getString("devType", "").equals(devTypeRec.deviceType))
+            continue;
+        addrPollFilter.address = address;
+        bool isValid = addrPollFilter.filter.setupFromConfig(filterConfig, devTypeRec.devInfoJson);
+#ifdef DEBUG_POLL_RESULT_FILTER
+        LOG_I(MODULE_PREFIX, "buildPollFilter address %s devType %s %s",
+                    BusI2CAddrAndSlot::toString(address).c_str(), devTypeRec.deviceType, isValid ? "OK" : "INVALID");
+#endif
+        return isValid;
+    }
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Set the poll result filter for a device (replacing any existing filter)
+/// @param address address
+/// @param pAddrPollFilter filter (moved from) - nullptr to remove the filter
+/// @note Assumes semaphore already taken
+void BusStatusMgr::setPollFilter(BusElemAddrType address, AddrPollFilter* pAddrPollFilter)
+{
+    _pollFilters.erase(std::remove_if(_pollFilters.begin(), _pollFilters.end(),
+                [address](const AddrPollFilter& addrPollFilter) { return addrPollFilter.address == address; }),
+                _pollFilters.end());
+    if (pAddrPollFilter)
+        _pollFilters.push_back(std::move(*pAddrPollFilter));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Build the poll groups for a device (set up from its device type with storage for each group)
+/// @param address address
+/// @param deviceTypeIdx device type index
+/// @param addrPollGroups (out) poll groups
+/// @return true if the device has poll groups
+/// @note Semaphore should not be taken - parsing the groups and allocating their storage is done before
+///       the groups are swapped in with setPollGroups()
+bool BusStatusMgr::buildPollGroups(BusElemAddrType address, uint16_t deviceTypeIdx, AddrPollGroups& addrPollGroups) const
+{
+    // Get the groups of the device type
+    if (!_pPollScheduler || (deviceTypeIdx == DeviceStatus::DEVICE_TYPE_INDEX_INVALID))
+        return false;
+    DeviceTypeRecord devTypeRec;
+    if (!deviceTypeRecords.getDeviceInfo(deviceTypeIdx, devTypeRec))
+        return false;
+    addrPollGroups.address = address;
+    DevicePollGroup::getPollGroups(address, devTypeRec, addrPollGroups.groups);
+    if (addrPollGroups.groups.size() == 0)
+        return false;
+
+    // Storage for each group
+    addrPollGroups.aggregators.resize(addrPollGroups.groups.size());
+    for (uint32_t i = 0; i < addrPollGroups.groups.size(); i++)
+    {
+        const DevicePollingInfo& pollInfo = addrPollGroups.groups[i].pollInfo;
+        addrPollGroups.aggregators[i].init(pollInfo.numPollResultsToStore, pollInfo.pollResultSizeIncTimestamp);
+    }
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Set the poll groups for a device (replacing any existing groups) and register them with the poll scheduler
+/// @param address address
+/// @param pAddrPollGroups poll groups (moved into the list) - nullptr to remove the groups
+/// @note Assumes semaphore already taken
+void BusStatusMgr::setPollGroups(BusElemAddrType address, AddrPollGroups* pAddrPollGroups)
+{
+    // Remove any existing groups and their polls
+    for (auto it = _pollGroups.begin(); it != _pollGroups.end(); )
+    {
+        if (it->address != address)
+        {
+            ++it;
+            continue;
+        }
+        if (_pPollScheduler)
+        {
+            for (uint32_t groupIdx = 1; groupIdx <= it->groups.size(); groupIdx++)
+                _pPollScheduler->remove(BusPollScheduler::pollGroupKey(address, groupIdx));
+        }
+        it = _pollGroups.erase(it);
+    }
+    if (!_pPollScheduler || !pAddrPollGroups)
+        return;
+
+    // Polls for each group
+    for (uint32_t i = 0; i < pAddrPollGroups->groups.size(); i++)
+    {
+        const DevicePollingInfo& pollInfo = pAddrPollGroups->groups[i].pollInfo;
+        _pPollScheduler->addOrUpdate(BusPollScheduler::pollGroupKey(address, i + 1), pollInfo.pollIntervalUs,
+                    BusPollScheduler::POLL_PRIORITY_NORMAL, micros());
+
+#ifdef DEBUG_POLL_GROUPS
+        LOG_I(MODULE_PREFIX, "setPollGroups address %s group %d name %s intervalUs %d resultSize %d numToStore %d varLen %s",
+                    BusI2CAddrAndSlot::toString(address).c_str(), i + 1, pAddrPollGroups->groups[i].name.c_str(),
+                    (int)pollInfo.pollIntervalUs, pollInfo.pollResultSizeIncTimestamp, pollInfo.numPollResultsToStore,
+                    pAddrPollGroups->groups[i].varLenRead.isVarLen ? "Y" : "N");
+#endif
+    }
+    _pollGroups.push_back(std::move(*pAddrPollGroups));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Apply the poll buffer budget - rebalance and resize the aggregators of devices whose quota differs from
+///        their size
+/// @note Resizing an aggregator discards the results it holds so aggregators are shrunk straight away (to keep
+///       within the limit) but only grown when they are empty (checked again each time responses are taken from
+///       an aggregator). Assumes semaphore already taken
+void BusStatusMgr::applyPollBufferBudget()
+{
+    _pollBufferBudget.rebalance(_pollBufferChangedAddrs);
+    applyPollBufferQuotas();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Resize the aggregators of devices whose quota differs from their size (growth is deferred until the
+///        aggregator is empty)
+/// @note Assumes semaphore already taken
+void BusStatusMgr::applyPollBufferQuotas()
+{
+    _pollBufferGrowthPending = false;
+    _pollBufferBudget.getPendingAddrs(_pollBufferChangedAddrs);
+    for (uint32_t address : _pollBufferChangedAddrs)
+    {
+        BusAddrStatus* pAddrStatus = findAddrStatusRecordEditable(address);
+        uint32_t numResults = 0, resultSize = 0;
+        if (!pAddrStatus || !_pollBufferBudget.getQuota(address, numResults, resultSize))
+            continue;
+        if ((numResults > _pollBufferBudget.getApplied(address)) && (pAddrStatus->deviceStatus.dataAggregator.count() > 0))
+        {
+            _pollBufferGrowthPending = true;
+            continue;
+        }
+        pAddrStatus->deviceStatus.dataAggregator.init(numResults, resultSize);
+        _pollBufferBudget.setApplied(address, numResults);
+#ifdef DEBUG_POLL_BUFFER_BUDGET
+        LOG_I(MODULE_PREFIX, "applyPollBufferBudget addr %04x numResults %d (requested %d) resultSize %d",
+                    address, numResults, pAddrStatus->deviceStatus.deviceIdentPolling.numPollResultsToStore,
+                    resultSize);
+#endif
+    }
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Get device type index by address
 /// @param address address
 /// @return device type index
-uint16_t BusStatusMgr::getDeviceTypeIndexByAddr(BusElemAddrType address) const
+uint16_t BusStatusMgr::getDeviceTypeIndexByAddr(BusElemAddrType address, uint32_t* pPollResultSize) const
 {
     // Obtain semaphore
+    if (pPollResultSize)
+        *pPollResultSize = 0;
     if (xSemaphoreTake(_busElemStatusMutex, pdMS_TO_TICKS(1)) != pdTRUE)
         return DeviceStatus::DEVICE_TYPE_INDEX_INVALID;
 
@@ -447,6 +722,8 @@ uint16_t BusStatusMgr::getDeviceTypeIndexByAddr(BusElemAddrType address) const
     {
         // Get device type index
         deviceTypeIndex = pAddrStatus->deviceStatus.getDeviceTypeIndex();
+        if (pPollResultSize)
+            *pPollResultSize = pAddrStatus->deviceStatus.deviceIdentPolling.pollResultSizeIncTimestamp;
     }
 
     // Return semaphore
@@ -508,41 +785,124 @@ void BusStatusMgr::informBusStuck()
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Get pending ident poll requests for a single device
+// Get ident poll for a specific address
+// The poll scheduler determines when the poll is due so no time check is made here
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-bool BusStatusMgr::getPendingIdentPoll(uint64_t timeNowUs, DevicePollingInfo& pollInfo)
+bool BusStatusMgr::getIdentPoll(uint64_t timeNowUs, BusElemAddrType address, DevicePollingInfo& pollInfo)
 {
     // Obtain semaphore
     if (xSemaphoreTake(_busElemStatusMutex, pdMS_TO_TICKS(1)) != pdTRUE)
         return false;
 
-    // Check for any pending requests
-    for (BusAddrStatus& addrStatus : _addrStatus)
+    // Find address record
+    bool pollValid = false;
+    BusAddrStatus* pAddrStatus = findAddrStatusRecordEditable(address);
+    if (pAddrStatus && (pAddrStatus->deviceStatus.deviceIdentPolling.pollReqs.size() > 0))
     {
-        // Check if a poll is due
-        if (addrStatus.deviceStatus.getPendingIdentPollInfo(timeNowUs, pollInfo))
-        {
-            // Return semaphore
-            xSemaphoreGive(_busElemStatusMutex);
-            return true;
-        }
+        DevicePollingInfo& identPolling = pAddrStatus->deviceStatus.deviceIdentPolling;
+        identPolling.lastPollTimeUs = timeNowUs;
+        pollInfo = identPolling;
+        pollValid = true;
     }
 
     // Return semaphore
     xSemaphoreGive(_busElemStatusMutex);
-    return false;
+    return pollValid;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/// @brief Store poll results
+// Get poll group for a specific address
+// The poll scheduler determines when the poll is due so no time check is made here
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool BusStatusMgr::getPollGroup(BusElemAddrType address, uint32_t groupIdx, DevicePollingInfo& pollInfo,
+                DevicePollGroup::VarLenRead& varLenRead)
+{
+    // Obtain semaphore
+    if (xSemaphoreTake(_busElemStatusMutex, pdMS_TO_TICKS(1)) != pdTRUE)
+        return false;
+
+    // Find the group
+    const AddrPollGroups* pAddrPollGroups = findPollGroups(address);
+    bool pollValid = pAddrPollGroups && (groupIdx >= 1) && (groupIdx <= pAddrPollGroups->groups.size());
+    if (pollValid)
+    {
+        const DevicePollGroup& pollGroup = pAddrPollGroups->groups[groupIdx - 1];
+        pollInfo = pollGroup.pollInfo;
+        varLenRead = pollGroup.varLenRead;
+    }
+
+    // Return semaphore
+    xSemaphoreGive(_busElemStatusMutex);
+    return pollValid;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Handle poll group results
+/// @param timeNowUs time in us
+/// @param address address
+/// @param groupIdx group index (1 onwards)
+/// @param pollResultData poll result data
+/// @return true if result stored
+/// @note Results are dropped (and counted) if the mutex isn't available - the pending results ring, filters and
+///       change-only mode only apply to the ident poll
+bool BusStatusMgr::handlePollGroupResult(uint64_t timeNowUs, BusElemAddrType address, uint32_t groupIdx,
+                        const std::vector<uint8_t>& pollResultData)
+{
+    // Obtain semaphore
+    if (xSemaphoreTake(_busElemStatusMutex, pdMS_TO_TICKS(1)) != pdTRUE)
+    {
+        _pollGroupResultsDropped++;
+        return false;
+    }
+
+    // Add result to the group's aggregator
+    bool putResult = false;
+    AddrPollGroups* pAddrPollGroups = findPollGroups(address);
+    if (pAddrPollGroups && (groupIdx >= 1) && (groupIdx <= pAddrPollGroups->aggregators.size()))
+    {
+        putResult = pAddrPollGroups->aggregators[groupIdx - 1].put(timeNowUs, pollResultData);
+        uint32_t timeNowMs = timeNowUs / 1000;
+        _lastIdentPollUpdateTimeMs = timeNowMs;
+        _lastPollOrStatusUpdateTimeMs = timeNowMs;
+    }
+
+    // Return semaphore
+    xSemaphoreGive(_busElemStatusMutex);
+    return putResult;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Handle poll results
 /// @param timeNowUs time in us (passed in to aid testing)
 /// @param address address
 /// @param pollResultData poll result data
 /// @param pPollInfo pointer to device polling info (maybe nullptr)
-/// @return true if result stored
+/// @return true if result stored (or absorbed by the device's poll result filter)
 bool BusStatusMgr::handlePollResult(uint64_t timeNowUs, BusElemAddrType address, 
                         const std::vector<uint8_t>& pollResultData, const DevicePollingInfo* pPollInfo)
+{
+    // Poll result filter - only the reduced results it outputs are stored (others are absorbed)
+    PollResultFilter* pPollFilter = _pollFilters.size() > 0 ? findPollFilter(address) : nullptr;
+    if (pPollFilter)
+    {
+        if (!pPollFilter->process(pollResultData, _pollFilterResult))
+            return true;
+        return storePollResult(timeNowUs, address, _pollFilterResult, pPollInfo);
+    }
+    return storePollResult(timeNowUs, address, pollResultData, pPollInfo);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Store poll result (after any filtering)
+/// @param timeNowUs time in us
+/// @param address address
+/// @param pollResultData poll result data
+/// @param pPollInfo poll info (maybe nullptr)
+/// @return true if result stored
+bool BusStatusMgr::storePollResult(uint64_t timeNowUs, BusElemAddrType address, 
+                        const std::vector<uint8_t>& pollResultData, const DevicePollingInfo* pPollInfo)
 {
     // Callback
     RaftDeviceDataChangeCB pCallback = nullptr;
@@ -550,40 +910,40 @@ bool BusStatusMgr::handlePollResult(uint64_t timeNowUs, BusElemAddrType address,
     uint16_t deviceTypeIdx = 0;
     uint32_t timeNowMs = timeNowUs / 1000;
 
-    // Obtain semaphore
+    // Obtain semaphore - if this fails (the consumer holds it) then the result is stored in the pending
+    // results ring and moved to the device's aggregator later
     if (xSemaphoreTake(_busElemStatusMutex, pdMS_TO_TICKS(1)) != pdTRUE)
-        return false;
+        return _pendingPollResults.put(address, timeNowUs, pollResultData.data(), pollResultData.size());
+
+    // Store any pending results first to maintain order
+    std::vector<DataChangeCBRec> pendingDataChangeCBs;
+    storePendingPollResults(pendingDataChangeCBs);
 
     // Find address record
-    BusAddrStatus* pAddrStatus = findAddrStatusRecordEditable(address);
+    int recIdx = findAddrStatusIdx(address);
+    BusAddrStatus* pAddrStatus = recIdx >= 0 ? &_addrStatus[recIdx] : nullptr;
     bool putResult = false;
-    if (pAddrStatus)
+    bool isRepeat = pAddrStatus && isRepeatPollResult(recIdx, pollResultData, timeNowMs);
+    if (isRepeat)
+    {
+        // Unchanged result is counted rather than stored (and isn't reported as a data change)
+        putResult = true;
+    }
+    else if (pAddrStatus)
     {
         // Add result to aggregator
         putResult = pAddrStatus->deviceStatus.storePollResults(timeNowUs, pollResultData, pPollInfo);
 
         // Check for callback
-        pCallback = pAddrStatus->getDataChangeCB();
-        if (pCallback)
-        {
-            // Check min time between reports
-            if (Raft::isTimeout(timeNowMs, pAddrStatus->lastDataChangeReportTimeMs, pAddrStatus->minTimeBetweenReportsMs))
-            {
-                // Get device type index and callback info
-                deviceTypeIdx = pAddrStatus->deviceStatus.getDeviceTypeIndex();
-                pCallbackInfo = pAddrStatus->getCallbackInfo();
-                pAddrStatus->lastDataChangeReportTimeMs = timeNowMs;
-            }
-            else
-            {
-                pCallback = nullptr;
-            }
-        }
+        getDataChangeCBIfDue(*pAddrStatus, timeNowMs, pCallback, deviceTypeIdx, pCallbackInfo);
     }
 
     // Store time of last status update
-    _lastIdentPollUpdateTimeMs = timeNowMs;
-    _lastPollOrStatusUpdateTimeMs = timeNowMs;
+    if (!isRepeat)
+    {
+        _lastIdentPollUpdateTimeMs = timeNowMs;
+        _lastPollOrStatusUpdateTimeMs = timeNowMs;
+    }
 
     // Return semaphore
     xSemaphoreGive(_busElemStatusMutex);
@@ -592,7 +952,8 @@ bool BusStatusMgr::handlePollResult(uint64_t timeNowUs, BusElemAddrType address,
     LOG_I(MODULE_PREFIX, "handlePollResult address %04x pAddrStatus %p", address, pAddrStatus);
 #endif
 
-    // Check if a callback is required
+    // Check if callbacks are required (pending results first to maintain order)
+    callDataChangeCBs(pendingDataChangeCBs);
     if (pCallback)
     {
         // Call the callback
@@ -661,6 +1022,10 @@ uint32_t BusStatusMgr::getBusElemPollResponses(BusElemAddrType address, bool& is
     if (xSemaphoreTake(_busElemStatusMutex, pdMS_TO_TICKS(1)) != pdTRUE)
         return 0;
 
+    // Store any pending results
+    std::vector<DataChangeCBRec> pendingDataChangeCBs;
+    storePendingPollResults(pendingDataChangeCBs);
+
     // Find address record
     uint32_t numResponses = 0;
     BusAddrStatus* pAddrStatus = findAddrStatusRecordEditable(address);
@@ -676,11 +1041,248 @@ uint32_t BusStatusMgr::getBusElemPollResponses(BusElemAddrType address, bool& is
         numResponses = pAddrStatus->deviceStatus.dataAggregator.get(devicePollResponseData, responseSize, maxResponsesToReturn);
     }
 
+    // Apply any quota growth which was waiting for the aggregator to drain
+    if (_pollBufferGrowthPending)
+        applyPollBufferQuotas();
+
     // Return semaphore
     xSemaphoreGive(_busElemStatusMutex);
+
+    // Data change callbacks for pending results
+    callDataChangeCBs(pendingDataChangeCBs);
     return numResponses;
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the total size of queued poll responses
+/// @param numAddresses (out) number of addresses with records
+/// @param numResponses (out) total number of queued responses
+/// @return total size of queued poll responses in bytes
+uint32_t BusStatusMgr::getQueuedPollResponsesSize(uint32_t& numAddresses, uint32_t& numResponses) const
+{
+    numAddresses = 0;
+    numResponses = 0;
+
+    // Obtain semaphore
+    if (xSemaphoreTake(_busElemStatusMutex, pdMS_TO_TICKS(1)) != pdTRUE)
+        return 0;
+
+    // Sum sizes
+    uint32_t totalBytes = 0;
+    for (const BusAddrStatus& addrStatus : _addrStatus)
+    {
+        uint32_t count = addrStatus.deviceStatus.dataAggregator.count();
+        numAddresses++;
+        numResponses += count;
+        totalBytes += count * addrStatus.deviceStatus.deviceIdentPolling.pollResultSizeIncTimestamp;
+    }
+    for (const AddrPollGroups& addrPollGroups : _pollGroups)
+    {
+        for (uint32_t i = 0; i < addrPollGroups.aggregators.size(); i++)
+        {
+            uint32_t count = addrPollGroups.aggregators[i].count();
+            numResponses += count;
+            totalBytes += count * addrPollGroups.groups[i].pollInfo.pollResultSizeIncTimestamp;
+        }
+    }
+
+    // Return semaphore
+    xSemaphoreGive(_busElemStatusMutex);
+    return totalBytes;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Visit bus element poll responses for a specific address without copying them
+/// @param address - address of device to get responses for
+/// @param maxResponsesToReturn - maximum number of responses to visit (0 for no limit)
+/// @param visitor - called with a read-only view of the responses
+/// @return number of responses visited
+uint32_t BusStatusMgr::visitBusElemPollResponses(BusElemAddrType address, uint32_t maxResponsesToReturn,
+            const BusElemPollResponsesVisitor& visitor)
+{
+    // Obtain semaphore
+    if (xSemaphoreTake(_busElemStatusMutex, pdMS_TO_TICKS(1)) != pdTRUE)
+        return 0;
+
+    // Store any pending results
+    std::vector<DataChangeCBRec> pendingDataChangeCBs;
+    storePendingPollResults(pendingDataChangeCBs);
+
+    // Find address record
+    uint32_t numResponses = 0;
+    BusAddrStatus* pAddrStatus = findAddrStatusRecordEditable(address);
+    if (pAddrStatus)
+    {
+        // Get results from aggregator into reused storage and visit
+        uint32_t responseSize = 0;
+        numResponses = pAddrStatus->deviceStatus.dataAggregator.get(_visitPollResponseData, responseSize, maxResponsesToReturn);
+        visitor(pAddrStatus->isOnline, pAddrStatus->deviceStatus.getDeviceTypeIndex(), 
+                    _visitPollResponseData, responseSize, numResponses);
+    }
+
+    // Apply any quota growth which was waiting for the aggregator to drain
+    if (_pollBufferGrowthPending)
+        applyPollBufferQuotas();
+
+    // Return semaphore
+    xSemaphoreGive(_busElemStatusMutex);
+
+    // Data change callbacks for pending results
+    callDataChangeCBs(pendingDataChangeCBs);
+    return numResponses;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Visit bus element poll group responses without copying them
+/// @param address - address of device to get responses for
+/// @param visitor - called for each group with responses
+/// @return number of responses visited
+uint32_t BusStatusMgr::visitBusElemPollGroupResponses(BusElemAddrType address, 
+            const BusElemPollGroupResponsesVisitor& visitor)
+{
+    // Obtain semaphore
+    if (xSemaphoreTake(_busElemStatusMutex, pdMS_TO_TICKS(1)) != pdTRUE)
+        return 0;
+
+    // Visit the responses of each group
+    uint32_t numResponses = 0;
+    AddrPollGroups* pAddrPollGroups = findPollGroups(address);
+    if (pAddrPollGroups)
+    {
+        for (uint32_t i = 0; i < pAddrPollGroups->aggregators.size(); i++)
+        {
+            uint32_t responseSize = 0;
+            uint32_t numGroupResponses = pAddrPollGroups->aggregators[i].get(_visitPollResponseData, responseSize, 0);
+            if (numGroupResponses == 0)
+                continue;
+            visitor(pAddrPollGroups->groups[i].name, _visitPollResponseData, responseSize, numGroupResponses);
+            numResponses += numGroupResponses;
+        }
+    }
+
+    // Return semaphore
+    xSemaphoreGive(_busElemStatusMutex);
+    return numResponses;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Check if a poll result repeats the previous one (in change-only mode)
+/// @param recIdx index of address record
+/// @param pollResultData poll result data (starts with the timestamp which is ignored in the comparison)
+/// @param timeNowMs time of poll result in ms
+/// @return true if the result is a repeat (and shouldn't be stored)
+/// @note Assumes semaphore already taken. A repeat is still stored after pollChangeOnlyMaxMs so that
+///       consumers can see the device is alive
+bool BusStatusMgr::isRepeatPollResult(uint32_t recIdx, const std::vector<uint8_t>& pollResultData, uint32_t timeNowMs)
+{
+    // Check enabled
+    if (!_pollChangeOnly || (recIdx >= _pollRepeatState.size()))
+        return false;
+    PollRepeatState& repeatState = _pollRepeatState[recIdx];
+
+    // Compare (excluding timestamp)
+    const uint32_t tsSize = DevicePollingInfo::POLL_RESULT_TIMESTAMP_SIZE;
+    bool isSame = repeatState.isValid && (pollResultData.size() == repeatState.lastData.size() + tsSize) &&
+            (pollResultData.size() >= tsSize) &&
+            (memcmp(pollResultData.data() + tsSize, repeatState.lastData.data(), repeatState.lastData.size()) == 0);
+    if (isSame && ((_pollChangeOnlyMaxMs == 0) || !Raft::isTimeout(timeNowMs, repeatState.lastStoredMs, _pollChangeOnlyMaxMs)))
+    {
+        repeatState.repeatCount++;
+        _pollRepeatTotal++;
+        return true;
+    }
+
+    // Record as the last stored result
+    if (pollResultData.size() >= tsSize)
+        repeatState.lastData.assign(pollResultData.begin() + tsSize, pollResultData.end());
+    else
+        repeatState.lastData.clear();
+    repeatState.isValid = true;
+    repeatState.repeatCount = 0;
+    repeatState.lastStoredMs = timeNowMs;
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get count of unchanged poll results not stored since the last stored result (change-only mode)
+/// @param address address
+/// @return repeat count
+uint32_t BusStatusMgr::getPollResultRepeatCount(BusElemAddrType address) const
+{
+    // Obtain semaphore
+    if (xSemaphoreTake(_busElemStatusMutex, pdMS_TO_TICKS(1)) != pdTRUE)
+        return 0;
+
+    // Find record
+    uint32_t repeatCount = 0;
+    int recIdx = findAddrStatusIdx(address);
+    if ((recIdx >= 0) && (recIdx < _pollRepeatState.size()))
+        repeatCount = _pollRepeatState[recIdx].repeatCount;
+
+    // Return semaphore
+    xSemaphoreGive(_busElemStatusMutex);
+    return repeatCount;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Store pending poll results in device aggregators
+/// @param dataChangeCBs (out) data change callbacks to make once the semaphore is returned
+/// @note Assumes semaphore already taken (so only one consumer of the ring at a time)
+void BusStatusMgr::storePendingPollResults(std::vector<DataChangeCBRec>& dataChangeCBs)
+{
+    uint32_t address = 0;
+    uint64_t timeUs = 0;
+    while (_pendingPollResults.get(address, timeUs, _pendingPollResultData))
+    {
+        int recIdx = findAddrStatusIdx(address);
+        if (recIdx < 0)
+            continue;
+        if (isRepeatPollResult(recIdx, _pendingPollResultData, timeUs / 1000))
+            continue;
+        BusAddrStatus* pAddrStatus = &_addrStatus[recIdx];
+        pAddrStatus->deviceStatus.storePollResults(timeUs, _pendingPollResultData, 
+                            &pAddrStatus->deviceStatus.deviceIdentPolling);
+        _lastIdentPollUpdateTimeMs = timeUs / 1000;
+        _lastPollOrStatusUpdateTimeMs = timeUs / 1000;
+
+        // Check for callback
+        DataChangeCBRec dataChangeCB;
+        if (getDataChangeCBIfDue(*pAddrStatus, timeUs / 1000, dataChangeCB.pCallback, 
+                            dataChangeCB.deviceTypeIdx, dataChangeCB.pCallbackInfo))
+        {
+            dataChangeCB.pollResultData = _pendingPollResultData;
+            dataChangeCBs.push_back(std::move(dataChangeCB));
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the data change callback for an address if one is registered and a report is due
+/// @param addrStatus address status
+/// @param timeNowMs time of the poll result (ms)
+/// @param pCallback (out) callback (nullptr if none due)
+/// @param deviceTypeIdx (out) device type index
+/// @param pCallbackInfo (out) callback info
+/// @return true if a callback is due
+/// @note Assumes semaphore already taken
+bool BusStatusMgr::getDataChangeCBIfDue(BusAddrStatus& addrStatus, uint32_t timeNowMs, RaftDeviceDataChangeCB& pCallback,
+                uint16_t& deviceTypeIdx, const void*& pCallbackInfo)
+{
+    // Check for callback and min time between reports
+    pCallback = addrStatus.getDataChangeCB();
+    if (!pCallback || !Raft::isTimeout(timeNowMs, addrStatus.lastDataChangeReportTimeMs, addrStatus.minTimeBetweenReportsMs))
+    {
+        pCallback = nullptr;
+        return false;
+    }
+
+    // Get device type index and callback info
+    deviceTypeIdx = addrStatus.deviceStatus.getDeviceTypeIndex();
+    pCallbackInfo = addrStatus.getCallbackInfo();
+    addrStatus.lastDataChangeReportTimeMs = timeNowMs;
+    return true;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Get debug JSON
 /// @return JSON string
@@ -698,10 +1300,18 @@ String BusStatusMgr::getDebugJSON(bool includeBraces) const
             jsonStr += ",";
         jsonStr += addrStatus.getJson();
     }
+    String pollBufJson = _pollBufferBudget.getJSON();
+    uint32_t numPollGroups = 0;
+    for (const AddrPollGroups& addrPollGroups : _pollGroups)
+        numPollGroups += addrPollGroups.groups.size();
 
     // Return semaphore
     xSemaphoreGive(_busElemStatusMutex);
-    jsonStr = "\"o\":" + String(_busOperationStatus ? 1 : 0) + ",\"d\":[" + jsonStr + "]";
+    jsonStr = "\"o\":" + String(_busOperationStatus ? 1 : 0) + ",\"pd\":" + String(getPollResultsDroppedCount()) + 
+                ",\"pr\":" + String(_pollRepeatTotal) + 
+                ",\"pbuf\":" + pollBufJson +
+                ",\"pg\":" + String(numPollGroups) + ",\"pgd\":" + String(_pollGroupResultsDropped) +
+                ",\"d\":[" + jsonStr + "]";
     if (includeBraces)
         jsonStr = "{" + jsonStr + "}";
     return jsonStr;
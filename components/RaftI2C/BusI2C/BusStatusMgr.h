@@ -14,19 +14,47 @@
 #include "RaftUtils.h"
 #include "DeviceStatus.h"
 #include "BusAddrStatus.h"
+#include "BusPollScheduler.h"
+#include "PollResultRing.h"
+#include "PollBufferBudget.h"
+#include "PollResultFilter.h"
+#include "DevicePollGroup.h"
 #include <list>
+#include <functional>
+
+// Visitor for bus element poll responses - the poll response data is only valid during the call
+typedef std::function<void(bool isOnline, uint16_t deviceTypeIndex, const std::vector<uint8_t>& pollResponseData,
+                uint32_t responseSize, uint32_t numResponses)> BusElemPollResponsesVisitor;
+
+// Visitor for bus element poll group responses (called for each poll group with responses)
+typedef std::function<void(const String& groupName, const std::vector<uint8_t>& pollResponseData,
+                uint32_t responseSize, uint32_t numResponses)> BusElemPollGroupResponsesVisitor;
+
+class BusI2CSyncSample;
 
 class BusStatusMgr {
 
 public:
     // Constructor and destructor
-    BusStatusMgr(RaftBus& raftBus);
+    // If a poll scheduler is provided then ident polls are registered with it as devices are identified
+    // If sync sample settings are provided then devices which participate aren't registered with the poll scheduler
+    BusStatusMgr(RaftBus& raftBus, BusPollScheduler* pPollScheduler = nullptr, 
+                const BusI2CSyncSample* pSyncSample = nullptr);
     ~BusStatusMgr();
 
     // Setup & loop
     void setup(const RaftJsonIF& config);
     void loop(bool hwIsOperatingOk);
 
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Allocate the pending poll results ring (according to the current memory placement policy)
+    /// @note the ring is written by the I2C task without locking so this must only be called while the I2C task
+    ///       is not running
+    void allocPendingPollResults()
+    {
+        _pendingPollResults.setSize(PollResultRing::DEFAULT_SIZE_BYTES);
+    }
+
     // Get bus operation status
     BusOperationStatus isOperatingOk() const
     {
@@ -50,16 +78,26 @@ public:
     // Set bus element device status (which includes device type and can be empty) for an address
     void setBusElemDeviceStatus(BusElemAddrType address, const DeviceStatus& deviceStatus);
 
-    // Get device type index by address
-    uint16_t getDeviceTypeIndexByAddr(BusElemAddrType address) const;
+    // Get device type index by address (and optionally the size of each poll result including the timestamp)
+    uint16_t getDeviceTypeIndexByAddr(BusElemAddrType address, uint32_t* pPollResultSize = nullptr) const;
 
-    // Get pending ident poll
-    bool getPendingIdentPoll(uint64_t timeNowUs, DevicePollingInfo& pollInfo);
+    // Get ident poll for a specific address (used when the poll scheduler has determined the poll is due)
+    bool getIdentPoll(uint64_t timeNowUs, BusElemAddrType address, DevicePollingInfo& pollInfo);
 
-    // Handle poll result
+    // Handle poll result (passed through the device's poll result filter if there is one)
     bool handlePollResult(uint64_t timeNowUs, BusElemAddrType address, 
                     const std::vector<uint8_t>& pollResultData, const DevicePollingInfo* pPollInfo);
 
+    // Get poll group (1 onwards - group 0 is the ident poll) for a specific address (used when the poll scheduler
+    // has determined the poll is due) - only the poll info and variable length read are copied so that the
+    // caller's storage is reused from poll to poll
+    bool getPollGroup(BusElemAddrType address, uint32_t groupIdx, DevicePollingInfo& pollInfo,
+                    DevicePollGroup::VarLenRead& varLenRead);
+
+    // Handle poll group result (1 onwards)
+    bool handlePollGroupResult(uint64_t timeNowUs, BusElemAddrType address, uint32_t groupIdx,
+                    const std::vector<uint8_t>& pollResultData);
+
     /// @brief Get latest timestamp of change to device info (online/offline, new data, etc)
     /// @param includeElemOnlineStatusChanges include changes in online status of elements
     /// @param includeDeviceDataUpdates include new data updates
@@ -86,6 +124,31 @@ public:
                 std::vector<uint8_t>& devicePollResponseData, 
                 uint32_t& responseSize, uint32_t maxResponsesToReturn);
 
+    ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the total size of queued poll responses (used to estimate the size of published data)
+    /// @param numAddresses (out) number of addresses with records
+    /// @param numResponses (out) total number of queued responses
+    /// @return total size of queued poll responses in bytes
+    uint32_t getQueuedPollResponsesSize(uint32_t& numAddresses, uint32_t& numResponses) const;
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Visit bus element poll responses for a specific address without copying them
+    /// @param address - address of device to get responses for
+    /// @param maxResponsesToReturn - maximum number of responses to visit (0 for no limit)
+    /// @param visitor - called (with the status mutex held) with a read-only view of the responses which are
+    ///                  then consumed - the visitor must not call back into BusStatusMgr
+    /// @return number of responses visited
+    uint32_t visitBusElemPollResponses(BusElemAddrType address, uint32_t maxResponsesToReturn,
+                const BusElemPollResponsesVisitor& visitor);
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Visit bus element poll group responses (groups other than the ident poll) without copying them
+    /// @param address - address of device to get responses for
+    /// @param visitor - called (with the status mutex held) for each group with responses which are then consumed
+    ///                  - the visitor must not call back into BusStatusMgr
+    /// @return number of responses visited
+    uint32_t visitBusElemPollGroupResponses(BusElemAddrType address, const BusElemPollGroupResponsesVisitor& visitor);
+
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Register for device data notifications
     /// @param addrAndSlot address
@@ -104,6 +167,20 @@ public:
     /// @brief Inform that the bus is stuck
     void informBusStuck();
 
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get count of poll results dropped because the pending results ring was full
+    /// @return count
+    uint32_t getPollResultsDroppedCount() const
+    {
+        return _pendingPollResults.getDroppedCount();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get count of unchanged poll results not stored since the last stored result (change-only mode)
+    /// @param address address
+    /// @return repeat count
+    uint32_t getPollResultRepeatCount(BusElemAddrType address) const;
+
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Get debug JSON
     /// @return JSON string
@@ -116,31 +193,170 @@ private:
     // Bus base
     RaftBus& _raftBus;
 
+    // Poll scheduler (maybe nullptr)
+    BusPollScheduler* _pPollScheduler = nullptr;
+
+    // Sync sample settings (maybe nullptr)
+    const BusI2CSyncSample* _pSyncSample = nullptr;
+
     // Address status
     std::vector<BusAddrStatus> _addrStatus;
     static const uint32_t ADDR_STATUS_MAX = 50;
 
-    // Find address record
+    // Address index - maps slot (6 bits) and 7-bit I2C address (as laid out in BusI2CAddrAndSlot) to the
+    // index of the record in _addrStatus
+    static const uint32_t ADDR_INDEX_TABLE_SIZE = 64 * 128;
+    static const uint8_t ADDR_INDEX_INVALID = 0xff;
+    static_assert(ADDR_STATUS_MAX < ADDR_INDEX_INVALID, "ADDR_STATUS_MAX too large for address index");
+    std::vector<uint8_t> _addrStatusIndex;
+
+    // Get address index key (-1 if the address can't be indexed)
+    static int getAddrIndexKey(BusElemAddrType address)
+    {
+        if ((address & ~0x3f7fUL) != 0)
+            return -1;
+        return (((address >> 8) & 0x3f) << 7) | (address & 0x7f);
+    }
+
+    // Rebuild address index (after records are removed)
     // Assumes semaphore already taken
-    const BusAddrStatus* findAddrStatusRecord(BusElemAddrType address) const
+    void rebuildAddrStatusIndex();
+
+    // Find address record index (-1 if not found)
+    // Assumes semaphore already taken
+    int findAddrStatusIdx(BusElemAddrType address) const
     {
-        for (const BusAddrStatus& addrStatus : _addrStatus)
+        int key = getAddrIndexKey(address);
+        if (key >= 0)
         {
-            if (addrStatus.address == address)
-                return &addrStatus;
+            uint8_t idx = _addrStatusIndex[key];
+            if ((idx < _addrStatus.size()) && (_addrStatus[idx].address == address))
+                return idx;
+            return -1;
         }
-        return nullptr;
+        for (uint32_t i = 0; i < _addrStatus.size(); i++)
+        {
+            if (_addrStatus[i].address == address)
+                return i;
+        }
+        return -1;
+    }
+
+    // Find address record
+    // Assumes semaphore already taken
+    const BusAddrStatus* findAddrStatusRecord(BusElemAddrType address) const
+    {
+        int idx = findAddrStatusIdx(address);
+        return idx >= 0 ? &_addrStatus[idx] : nullptr;
     }
 
     // Find address record editable
     // Assumes semaphore already taken
     BusAddrStatus* findAddrStatusRecordEditable(BusElemAddrType address)
     {
-        for (BusAddrStatus& addrStatus : _addrStatus)
-        {
-            if (addrStatus.address == address)
-                return &addrStatus;
-        }
+        int idx = findAddrStatusIdx(address);
+        return idx >= 0 ? &_addrStatus[idx] : nullptr;
+    }
+
+    // Poll results which arrived when the mutex was held elsewhere - written without locking by the I2C task
+    // (the only producer) and moved into the device aggregators when the mutex is next obtained. A minimal ring
+    // is created here and the full size allocated by allocPendingPollResults() before the I2C task starts
+    PollResultRing _pendingPollResults{0};
+    std::vector<uint8_t> _pendingPollResultData;
+
+    // Data change callbacks are made after the mutex is released so those due for pending results are
+    // collected by the caller of storePendingPollResults()
+    class DataChangeCBRec
+    {
+    public:
+        RaftDeviceDataChangeCB pCallback = nullptr;
+        uint16_t deviceTypeIdx = 0;
+        const void* pCallbackInfo = nullptr;
+        std::vector<uint8_t> pollResultData;
+    };
+    void storePendingPollResults(std::vector<DataChangeCBRec>& dataChangeCBs);
+    bool getDataChangeCBIfDue(BusAddrStatus& addrStatus, uint32_t timeNowMs, RaftDeviceDataChangeCB& pCallback,
+                    uint16_t& deviceTypeIdx, const void*& pCallbackInfo);
+    static void callDataChangeCBs(const std::vector<DataChangeCBRec>& dataChangeCBs)
+    {
+        for (const DataChangeCBRec& rec : dataChangeCBs)
+            rec.pCallback(rec.deviceTypeIdx, rec.pollResultData, rec.pCallbackInfo);
+    }
+
+    // Poll response data for visitors (storage reused between calls - only accessed with the mutex held)
+    std::vector<uint8_t> _visitPollResponseData;
+
+    // Change-only mode - a poll result which is byte-identical (ignoring the timestamp) to the last stored
+    // result is counted as a repeat rather than being stored
+    bool _pollChangeOnly = false;
+    uint32_t _pollChangeOnlyMaxMs = POLL_CHANGE_ONLY_MAX_MS_DEFAULT;
+    static const uint32_t POLL_CHANGE_ONLY_MAX_MS_DEFAULT = 1000;
+    uint32_t _pollRepeatTotal = 0;
+    class PollRepeatState
+    {
+    public:
+        std::vector<uint8_t> lastData;
+        uint32_t repeatCount = 0;
+        uint32_t lastStoredMs = 0;
+        bool isValid = false;
+    };
+
+    // Repeat detection state (same order as _addrStatus)
+    std::vector<PollRepeatState> _pollRepeatState;
+    bool isRepeatPollResult(uint32_t recIdx, const std::vector<uint8_t>& pollResultData, uint32_t timeNowMs);
+
+    // Poll buffer budget - bounds the total memory of the device data aggregators (quotas are applied
+    // by resizing the aggregators whose size differs from their quota - storage reused)
+    PollBufferBudget _pollBufferBudget;
+    std::vector<uint32_t> _pollBufferChangedAddrs;
+    void applyPollBufferBudget();
+
+    // Quotas which are larger than the aggregator size are applied once the aggregator has been drained (the
+    // flag is set when any are pending so the drain checks are skipped otherwise)
+    bool _pollBufferGrowthPending = false;
+    void applyPollBufferQuotas();
+
+    // Poll result filters - configured per device type and set up for each device of that type when identified
+    // (only accessed from the I2C task which is the only caller of handlePollResult and setBusElemDeviceStatus)
+    std::vector<String> _pollFilterConfigs;
+    class AddrPollFilter
+    {
+    public:
+        BusElemAddrType address = 0;
+        PollResultFilter filter;
+    };
+    std::vector<AddrPollFilter> _pollFilters;
+    std::vector<uint8_t> _pollFilterResult;
+    bool buildPollFilter(BusElemAddrType address, uint16_t deviceTypeIdx, AddrPollFilter& addrPollFilter) const;
+    void setPollFilter(BusElemAddrType address, AddrPollFilter* pAddrPollFilter);
+    bool storePollResult(uint64_t timeNowUs, BusElemAddrType address, 
+                    const std::vector<uint8_t>& pollResultData, const DevicePollingInfo* pPollInfo);
+    PollResultFilter* findPollFilter(BusElemAddrType address)
+    {
+        for (AddrPollFilter& addrPollFilter : _pollFilters)
+            if (addrPollFilter.address == address)
+                return &addrPollFilter.filter;
+        return nullptr;
+    }
+
+    // Poll groups - polls of a device other than its ident poll (from the device type's pollInfo) each polled
+    // at its own interval by the poll scheduler and stored in its own aggregator (group i is element i-1)
+    class AddrPollGroups
+    {
+    public:
+        BusElemAddrType address = 0;
+        std::vector<DevicePollGroup> groups;
+        std::vector<PollDataAggregator> aggregators;
+    };
+    std::vector<AddrPollGroups> _pollGroups;
+    uint32_t _pollGroupResultsDropped = 0;
+    bool buildPollGroups(BusElemAddrType address, uint16_t deviceTypeIdx, AddrPollGroups& addrPollGroups) const;
+    void setPollGroups(BusElemAddrType address, AddrPollGroups* pAddrPollGroups);
+    AddrPollGroups* findPollGroups(BusElemAddrType address)
+    {
+        for (AddrPollGroups& addrPollGroups : _pollGroups)
+            if (addrPollGroups.address == address)
+                return &addrPollGroups;
         return nullptr;
     }
 
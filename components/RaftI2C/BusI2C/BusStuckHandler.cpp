@@ -9,14 +9,17 @@
 #include "BusStuckHandler.h"
 #include "Logger.h"
 #include "RaftUtils.h"
+#include "RaftJson.h"
 #include "driver/gpio.h"
 
 // #define DEBUG_BUS_STUCK_HANDLER
+// #define DEBUG_BUS_STUCK_RECOVERY
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Constructor
-BusStuckHandler::BusStuckHandler(BusReqSyncFn busReqSyncFn) :
-    _busReqSyncFn(busReqSyncFn)
+BusStuckHandler::BusStuckHandler(BusReqSyncFn busReqSyncFn, BusRecoveryClockingFn busRecoveryClockingFn) :
+    _busReqSyncFn(busReqSyncFn),
+    _busRecoveryClockingFn(busRecoveryClockingFn)
 {
 }
 
@@ -29,14 +32,48 @@ BusStuckHandler::~BusStuckHandler()
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Setup
 /// @param config Configuration
-void BusStuckHandler::setup(const RaftJsonIF& config)
+/// @param powerCycleMaxMs longest time a slot or bus power cycle can take
+void BusStuckHandler::setup(const RaftJsonIF& config, uint32_t powerCycleMaxMs)
 {
     // Get the bus pins so we can check if they are pulled-up ok
     _sdaPin = (gpio_num_t) config.getLong("sdaPin", -1);
     _sclPin = (gpio_num_t) config.getLong("sclPin", -1);
 
-   // Debug
-    LOG_I(MODULE_PREFIX, "setup sdaPin %d sclPin %d", _sdaPin, _sclPin);
+    // Recovery ladder - stages are escalated in order with each allowed its timeout to clear the bus (power cycle
+    // stages default to the power cycle time so they aren't abandoned before the power is back and stable)
+    _maxSCLPulses = config.getLong("stuckSCLPulses", I2C_BUS_STUCK_SCL_PULSES_DEFAULT);
+    _recoveryLadder.clear();
+    std::vector<String> ladderStrs;
+    config.getArrayElems("stuckLadder", ladderStrs);
+    for (RaftJson ladderElem : ladderStrs)
+    {
+        String stageName = ladderElem.getString("stage", "");
+        uint32_t stageIdx = 0;
+        for (; stageIdx < RECOVERY_STAGE_COUNT; stageIdx++)
+        {
+            if (stageName.equalsIgnoreCase(getRecoveryStageName((RecoveryStage)stageIdx)))
+                break;
+        }
+        if (stageIdx >= RECOVERY_STAGE_COUNT)
+        {
+            LOG_W(MODULE_PREFIX, "setup stuckLadder stage %s INVALID", stageName.c_str());
+            continue;
+        }
+        RecoveryStage stage = (RecoveryStage)stageIdx;
+        _recoveryLadder.push_back({stage, (uint32_t)ladderElem.getLong("timeoutMs", getRecoveryStageDefaultTimeoutMs(stage, powerCycleMaxMs))});
+    }
+    if (_recoveryLadder.size() == 0)
+    {
+        for (uint32_t stageIdx = 0; stageIdx < RECOVERY_STAGE_COUNT; stageIdx++)
+            _recoveryLadder.push_back({(RecoveryStage)stageIdx, getRecoveryStageDefaultTimeoutMs((RecoveryStage)stageIdx, powerCycleMaxMs)});
+    }
+    _recoveryActive = false;
+
+    // Debug
+    String ladderStr;
+    for (const RecoveryLadderRec& ladderRec : _recoveryLadder)
+        ladderStr += Raft::formatString(50, "%s(%dms) ", getRecoveryStageName(ladderRec.stage), ladderRec.timeoutMs);
+    LOG_I(MODULE_PREFIX, "setup sdaPin %d sclPin %d sclPulses %d ladder %s", _sdaPin, _sclPin, _maxSCLPulses, ladderStr.c_str());
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -65,8 +102,13 @@ bool BusStuckHandler::isStuck()
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Clear bus stuck by clocking
-void BusStuckHandler::clearStuckByClocking()
+/// @return true if the bus is no longer stuck
+bool BusStuckHandler::clearStuckByClocking()
 {
+    // Use direct clocking of SCL if supported as this stops as soon as SDA is released
+    if (_busRecoveryClockingFn && _busRecoveryClockingFn(_maxSCLPulses, false))
+        return !isStuck();
+
     // Iterate
     for (int i = 0; i < I2C_BUS_STUCK_REPEAT_COUNT; i++)
     {
@@ -81,4 +123,139 @@ void BusStuckHandler::clearStuckByClocking()
                     this);
         _busReqSyncFn(&reqRec, nullptr);
     }
+    return !isStuck();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Send a STOP condition to release devices part way through a transaction
+/// @return true if the bus is no longer stuck
+bool BusStuckHandler::clearStuckBySendingStop()
+{
+    // Only possible with direct clocking
+    if (_busRecoveryClockingFn)
+        _busRecoveryClockingFn(0, true);
+    return !isStuck();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Start (or continue) recovery from a bus stuck event
+/// @param timeNowMs current time in ms
+void BusStuckHandler::recoveryStart(uint32_t timeNowMs)
+{
+    // Check already in progress
+    if (_recoveryActive)
+        return;
+    _recoveryActive = true;
+    _recoveryStageActioned = false;
+    _recoveryLadderIdx = 0;
+    _recoveryStartMs = timeNowMs;
+    _recoveryStageStartMs = timeNowMs;
+    _stuckEventCount++;
+#ifdef DEBUG_BUS_STUCK_RECOVERY
+    LOG_I(MODULE_PREFIX, "recoveryStart event %d", _stuckEventCount);
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the current recovery stage
+/// @param stage (out) recovery stage
+/// @param stageActioned (out) true if the stage action has been performed (and is awaiting its timeout)
+/// @return false if the ladder is exhausted (the next recoveryStart begins it again)
+bool BusStuckHandler::getRecoveryStage(RecoveryStage& stage, bool& stageActioned) const
+{
+    if (!_recoveryActive || (_recoveryLadderIdx >= _recoveryLadder.size()))
+        return false;
+    stage = _recoveryLadder[_recoveryLadderIdx].stage;
+    stageActioned = _recoveryStageActioned;
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Record that the current stage has been actioned
+/// @param timeNowMs current time in ms
+void BusStuckHandler::recoveryStageActioned(uint32_t timeNowMs)
+{
+    _recoveryStageActioned = true;
+    _recoveryStageStartMs = timeNowMs;
+#ifdef DEBUG_BUS_STUCK_RECOVERY
+    if (_recoveryLadderIdx < _recoveryLadder.size())
+        LOG_I(MODULE_PREFIX, "recoveryStageActioned %s", getRecoveryStageName(_recoveryLadder[_recoveryLadderIdx].stage));
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Check if the current stage has timed out
+/// @param timeNowMs current time in ms
+/// @return true if timed out
+bool BusStuckHandler::isRecoveryStageTimedOut(uint32_t timeNowMs) const
+{
+    if (_recoveryLadderIdx >= _recoveryLadder.size())
+        return true;
+    return Raft::isTimeout(timeNowMs, _recoveryStageStartMs, _recoveryLadder[_recoveryLadderIdx].timeoutMs);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Move to the next recovery stage
+void BusStuckHandler::recoveryStageNext()
+{
+    _recoveryStageActioned = false;
+    _recoveryLadderIdx++;
+
+    // Check for ladder exhausted - recovery starts again on the next attempt
+    if (_recoveryLadderIdx >= _recoveryLadder.size())
+    {
+        _ladderExhaustedCount++;
+        _recoveryActive = false;
+        LOG_W(MODULE_PREFIX, "recoveryStageNext bus still stuck after all recovery stages");
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Wait for the bus to clear after a stage has been actioned (up to the stage timeout)
+/// @return true if the bus is no longer stuck
+bool BusStuckHandler::recoveryWaitForClear()
+{
+    while (isStuck())
+    {
+        if (isRecoveryStageTimedOut(millis()))
+            return false;
+        delayMicroseconds(10);
+    }
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Record that the current stage resolved the bus stuck event
+/// @param timeNowMs current time in ms
+void BusStuckHandler::recoveryResolved(uint32_t timeNowMs)
+{
+    if (!_recoveryActive)
+        return;
+    if (_recoveryLadderIdx < _recoveryLadder.size())
+        _resolvedCounts[_recoveryLadder[_recoveryLadderIdx].stage]++;
+    _lastRecoveryMs = Raft::timeElapsed(timeNowMs, _recoveryStartMs);
+    if (_lastRecoveryMs > _maxRecoveryMs)
+        _maxRecoveryMs = _lastRecoveryMs;
+    _recoveryActive = false;
+#ifdef DEBUG_BUS_STUCK_RECOVERY
+    LOG_I(MODULE_PREFIX, "recoveryResolved stage %s recoveryMs %d", 
+                _recoveryLadderIdx < _recoveryLadder.size() ? getRecoveryStageName(_recoveryLadder[_recoveryLadderIdx].stage) : "",
+                _lastRecoveryMs);
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get debug JSON (recovery stats)
+/// @return JSON string
+String BusStuckHandler::getDebugJSON() const
+{
+    String resolvedStr;
+    for (uint32_t stageIdx = 0; stageIdx < RECOVERY_STAGE_COUNT; stageIdx++)
+    {
+        if (resolvedStr.length() > 0)
+            resolvedStr += ",";
+        resolvedStr += Raft::formatString(50, "\"%s\":%d", getRecoveryStageName((RecoveryStage)stageIdx), _resolvedCounts[stageIdx]);
+    }
+    return Raft::formatString(100, "{\"n\":%d,\"fail\":%d,\"lastMs\":%d,\"maxMs\":%d,\"res\":{", 
+                _stuckEventCount, _ladderExhaustedCount, _lastRecoveryMs, _maxRecoveryMs) + resolvedStr + "}}";
 }
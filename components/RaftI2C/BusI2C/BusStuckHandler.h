@@ -9,19 +9,29 @@
 #pragma once
 
 #include <stdint.h>
+#include <vector>
+#include <functional>
 #include "RaftJsonIF.h"
 #include "BusRequestInfo.h"
 #include "driver/gpio.h"
 
+// Bus recovery clocking function - pulses SCL (up to maxSCLPulses) until SDA is released and then sends a
+// STOP if required - returns false if not supported or the bus lines are still held
+typedef std::function<bool(uint32_t maxSCLPulses, bool sendStop)> BusRecoveryClockingFn;
+
 class BusStuckHandler
 {
 public:
     // Constructor and destructor
-    BusStuckHandler(BusReqSyncFn busReqSyncFn);
+    BusStuckHandler(BusReqSyncFn busReqSyncFn, BusRecoveryClockingFn busRecoveryClockingFn = nullptr);
     virtual ~BusStuckHandler();
 
-    // Setup
-    void setup(const RaftJsonIF& config);
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup
+    /// @param config configuration
+    /// @param powerCycleMaxMs longest time a slot or bus power cycle can take (the power cycle stage timeouts
+    ///        default to this plus a margin)
+    void setup(const RaftJsonIF& config, uint32_t powerCycleMaxMs);
 
     // Service
     void loop();
@@ -31,12 +41,80 @@ public:
 
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Clear bus stuck problems by clocking the bus
-    void clearStuckByClocking();
+    /// @return true if the bus is no longer stuck
+    bool clearStuckByClocking();
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Send a STOP condition to release devices part way through a transaction
+    /// @return true if the bus is no longer stuck
+    bool clearStuckBySendingStop();
+
+    // Recovery ladder stages (in default order of escalation)
+    enum RecoveryStage
+    {
+        RECOVERY_STAGE_CLOCK,
+        RECOVERY_STAGE_STOP,
+        RECOVERY_STAGE_MUX_RESET,
+        RECOVERY_STAGE_SLOT_POWER_CYCLE,
+        RECOVERY_STAGE_BUS_POWER_CYCLE,
+        RECOVERY_STAGE_COUNT
+    };
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Start (or continue) recovery from a bus stuck event
+    /// @param timeNowMs current time in ms
+    void recoveryStart(uint32_t timeNowMs);
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the current recovery stage
+    /// @param stage (out) recovery stage
+    /// @param stageActioned (out) true if the stage action has been performed (and is awaiting its timeout)
+    /// @return false if the ladder is exhausted (the next recoveryStart begins it again)
+    bool getRecoveryStage(RecoveryStage& stage, bool& stageActioned) const;
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Record that the current stage has been actioned
+    /// @param timeNowMs current time in ms
+    void recoveryStageActioned(uint32_t timeNowMs);
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Check if the current stage has timed out
+    /// @param timeNowMs current time in ms
+    /// @return true if timed out
+    bool isRecoveryStageTimedOut(uint32_t timeNowMs) const;
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Move to the next recovery stage
+    void recoveryStageNext();
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Wait for the bus to clear after a stage has been actioned (up to the stage timeout)
+    /// @return true if the bus is no longer stuck
+    bool recoveryWaitForClear();
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Record that the current stage resolved the bus stuck event
+    /// @param timeNowMs current time in ms
+    void recoveryResolved(uint32_t timeNowMs);
+
+    // Check if recovery is in progress
+    bool isRecoveryActive() const
+    {
+        return _recoveryActive;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get debug JSON (recovery stats)
+    /// @return JSON string
+    String getDebugJSON() const;
 
     // Address to use when attempting to clear bus-stuck problems
     static const uint32_t I2C_BUS_STUCK_CLEAR_ADDR = 0x77;
     static const uint32_t I2C_BUS_STUCK_REPEAT_COUNT = 3;
 
+    // Max SCL pulses when clearing by clocking (a device may be part way through a read of several bytes)
+    static const uint32_t I2C_BUS_STUCK_SCL_PULSES_DEFAULT = 24;
+
 private:
     // Pins
     gpio_num_t _sdaPin = GPIO_NUM_NC;
@@ -45,6 +123,62 @@ private:
     // Bus I2C Request Sync function
     BusReqSyncFn _busReqSyncFn = nullptr;
 
+    // Bus recovery clocking function
+    BusRecoveryClockingFn _busRecoveryClockingFn = nullptr;
+
+    // Recovery ladder (stages and the time allowed for each to clear the bus before escalating)
+    class RecoveryLadderRec
+    {
+    public:
+        RecoveryStage stage;
+        uint32_t timeoutMs;
+    };
+    std::vector<RecoveryLadderRec> _recoveryLadder;
+    uint32_t _maxSCLPulses = I2C_BUS_STUCK_SCL_PULSES_DEFAULT;
+
+    // Recovery state
+    bool _recoveryActive = false;
+    bool _recoveryStageActioned = false;
+    uint16_t _recoveryLadderIdx = 0;
+    uint32_t _recoveryStartMs = 0;
+    uint32_t _recoveryStageStartMs = 0;
+
+    // Recovery stats
+    uint32_t _stuckEventCount = 0;
+    uint32_t _resolvedCounts[RECOVERY_STAGE_COUNT] = {};
+    uint32_t _ladderExhaustedCount = 0;
+    uint32_t _lastRecoveryMs = 0;
+    uint32_t _maxRecoveryMs = 0;
+
+    // Helpers
+    static const char* getRecoveryStageName(RecoveryStage stage)
+    {
+        switch (stage)
+        {
+            case RECOVERY_STAGE_CLOCK: return "clock";
+            case RECOVERY_STAGE_STOP: return "stop";
+            case RECOVERY_STAGE_MUX_RESET: return "muxReset";
+            case RECOVERY_STAGE_SLOT_POWER_CYCLE: return "slotPower";
+            case RECOVERY_STAGE_BUS_POWER_CYCLE: return "busPower";
+            default: return "unknown";
+        }
+    }
+    static uint32_t getRecoveryStageDefaultTimeoutMs(RecoveryStage stage, uint32_t powerCycleMaxMs)
+    {
+        switch (stage)
+        {
+            case RECOVERY_STAGE_CLOCK: return 1;
+            case RECOVERY_STAGE_STOP: return 1;
+            case RECOVERY_STAGE_MUX_RESET: return 2;
+            case RECOVERY_STAGE_SLOT_POWER_CYCLE: return powerCycleMaxMs + POWER_CYCLE_TIMEOUT_MARGIN_MS;
+            case RECOVERY_STAGE_BUS_POWER_CYCLE: return powerCycleMaxMs + POWER_CYCLE_TIMEOUT_MARGIN_MS;
+            default: return 0;
+        }
+    }
+
+    // Margin allowed beyond the power cycle time for devices to release the bus once powered
+    static const uint32_t POWER_CYCLE_TIMEOUT_MARGIN_MS = 200;
+
     // Debug
-    static constexpr const char* MODULE_PREFIX = "RaftI2CBusStuck";    
+    static constexpr const char* MODULE_PREFIX = "RaftI2CBusStuck";
 };
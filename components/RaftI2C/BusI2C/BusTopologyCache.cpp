@@ -0,0 +1,276 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Bus Topology Cache
+// Last known bus topology (device locations and types) persisted to NVS for warm-start detection
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include <algorithm>
+#include "BusTopologyCache.h"
+#include "Logger.h"
+#include "RaftUtils.h"
+#include "nvs.h"
+
+// #define DEBUG_TOPOLOGY_CACHE_UPDATE
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Constructor and destructor
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BusTopologyCache::BusTopologyCache()
+{
+    _cacheMutex = xSemaphoreCreateMutex();
+}
+
+BusTopologyCache::~BusTopologyCache()
+{
+    if (_cacheMutex)
+        vSemaphoreDelete(_cacheMutex);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Setup
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BusTopologyCache::setup(const RaftJsonIF& config, uint32_t i2cPort, BusDevTypeTableHashFn devTypeTableHashFn)
+{
+    // Settings
+    _isEnabled = config.getBool("topologyCache", false);
+    _saveAfterStableMs = config.getLong("topologyCacheSaveMs", SAVE_AFTER_STABLE_MS_DEFAULT);
+    _minSaveIntervalMs = config.getLong("topologyCacheMinSaveMs", MIN_SAVE_INTERVAL_MS_DEFAULT);
+    _devTypeTableHash = 0;
+    snprintf(_nvsKey, sizeof(_nvsKey), "port%d", (int)i2cPort);
+    _startupRecs.clear();
+    _curRecs.clear();
+    _savedRecs.clear();
+    _isDirty = false;
+    _lastSaveMs = 0;
+    if (!_isEnabled)
+        return;
+
+    // Hash of the device type table
+    if (devTypeTableHashFn)
+        _devTypeTableHash = devTypeTableHashFn();
+
+    // Load (the loaded records are what is in NVS)
+    bool loadOk = load();
+    if (loadOk)
+    {
+        _savedRecs = _startupRecs;
+        sortByAddress(_savedRecs);
+    }
+
+    // Debug
+    LOG_I(MODULE_PREFIX, "setup %s numRecs %d devTypeTableHash %08x",
+                loadOk ? "loaded" : "no valid cache", _startupRecs.size(), _devTypeTableHash);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Service
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BusTopologyCache::loop()
+{
+    // Check if save required (flash writes are limited to one per minimum save interval)
+    if (!_isEnabled || !_isDirty || !Raft::isTimeout(millis(), _lastChangeMs, _saveAfterStableMs))
+        return;
+    if ((_lastSaveMs != 0) && !Raft::isTimeout(millis(), _lastSaveMs, _minSaveIntervalMs))
+        return;
+
+    // Obtain semaphore and copy records
+    if (xSemaphoreTake(_cacheMutex, pdMS_TO_TICKS(1)) != pdTRUE)
+        return;
+    std::vector<TopologyRec> recsToSave = _curRecs;
+    _isDirty = false;
+
+    // Return semaphore
+    xSemaphoreGive(_cacheMutex);
+
+    // Devices can go offline and come back (or be found in a different order) so only save if the topology
+    // differs from the one in NVS
+    sortByAddress(recsToSave);
+    if (isSameTopology(recsToSave, _savedRecs))
+        return;
+
+    // Save (outside the mutex as flash writes can be slow)
+    _lastSaveMs = millis();
+    if (save(recsToSave))
+        _savedRecs.swap(recsToSave);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get device type hint
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool BusTopologyCache::getDeviceTypeHint(BusElemAddrType address, uint16_t& deviceTypeIdx) const
+{
+    // Startup records are only changed in setup() so no mutex is needed
+    for (const TopologyRec& rec : _startupRecs)
+    {
+        if (rec.address == address)
+        {
+            deviceTypeIdx = rec.deviceTypeIdx;
+            return true;
+        }
+    }
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Update topology
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BusTopologyCache::update(BusElemAddrType address, bool isOnline, uint16_t deviceTypeIdx)
+{
+    // Check enabled
+    if (!_isEnabled)
+        return;
+
+    // Obtain semaphore
+    if (xSemaphoreTake(_cacheMutex, pdMS_TO_TICKS(10)) != pdTRUE)
+        return;
+
+    // Find and update record
+    bool isChanged = false;
+    auto it = _curRecs.begin();
+    for (; it != _curRecs.end(); it++)
+    {
+        if (it->address == address)
+            break;
+    }
+    if (isOnline)
+    {
+        if (it == _curRecs.end())
+        {
+            if (_curRecs.size() < MAX_RECS)
+            {
+                TopologyRec rec;
+                rec.address = address;
+                rec.deviceTypeIdx = deviceTypeIdx;
+                _curRecs.push_back(rec);
+                isChanged = true;
+            }
+        }
+        else if (it->deviceTypeIdx != deviceTypeIdx)
+        {
+            it->deviceTypeIdx = deviceTypeIdx;
+            isChanged = true;
+        }
+    }
+    else if (it != _curRecs.end())
+    {
+        _curRecs.erase(it);
+        isChanged = true;
+    }
+    if (isChanged)
+    {
+        _isDirty = true;
+        _lastChangeMs = millis();
+    }
+
+    // Return semaphore
+    xSemaphoreGive(_cacheMutex);
+
+#ifdef DEBUG_TOPOLOGY_CACHE_UPDATE
+    if (isChanged)
+        LOG_I(MODULE_PREFIX, "update addr 0x%04x %s type %d", address, isOnline ? "online" : "offline", deviceTypeIdx);
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Load from NVS
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool BusTopologyCache::load()
+{
+    // Open NVS
+    nvs_handle_t nvsHandle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvsHandle) != ESP_OK)
+        return false;
+
+    // Read blob
+    std::vector<uint8_t> blob;
+    size_t blobLen = 0;
+    bool loadOk = false;
+    if ((nvs_get_blob(nvsHandle, _nvsKey, nullptr, &blobLen) == ESP_OK) && (blobLen >= sizeof(CacheHeader)))
+    {
+        blob.resize(blobLen);
+        if (nvs_get_blob(nvsHandle, _nvsKey, blob.data(), &blobLen) == ESP_OK)
+        {
+            // Check header (the cache is only valid for the same device type table)
+            CacheHeader header;
+            memcpy(&header, blob.data(), sizeof(header));
+            if ((header.version == NVS_FORMAT_VERSION) && (header.devTypeTableHash == _devTypeTableHash) &&
+                        (header.numRecs <= MAX_RECS) &&
+                        (blobLen == sizeof(CacheHeader) + header.numRecs * sizeof(TopologyRec)))
+            {
+                _startupRecs.resize(header.numRecs);
+                if (header.numRecs > 0)
+                    memcpy(_startupRecs.data(), blob.data() + sizeof(CacheHeader), header.numRecs * sizeof(TopologyRec));
+                loadOk = true;
+            }
+        }
+    }
+    nvs_close(nvsHandle);
+    return loadOk;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Sort records by address and check if two record sets (sorted by address) are the same
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BusTopologyCache::sortByAddress(std::vector<TopologyRec>& recs)
+{
+    std::sort(recs.begin(), recs.end(), 
+                [](const TopologyRec& a, const TopologyRec& b) { return a.address < b.address; });
+}
+
+bool BusTopologyCache::isSameTopology(const std::vector<TopologyRec>& recs1, const std::vector<TopologyRec>& recs2)
+{
+    if (recs1.size() != recs2.size())
+        return false;
+    for (uint32_t i = 0; i < recs1.size(); i++)
+    {
+        if ((recs1[i].address != recs2[i].address) || (recs1[i].deviceTypeIdx != recs2[i].deviceTypeIdx))
+            return false;
+    }
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Save to NVS
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool BusTopologyCache::save(const std::vector<TopologyRec>& recs)
+{
+    // Build blob
+    CacheHeader header;
+    header.version = NVS_FORMAT_VERSION;
+    header.devTypeTableHash = _devTypeTableHash;
+    header.numRecs = recs.size();
+    std::vector<uint8_t> blob(sizeof(CacheHeader) + recs.size() * sizeof(TopologyRec));
+    memcpy(blob.data(), &header, sizeof(header));
+    if (recs.size() > 0)
+        memcpy(blob.data() + sizeof(CacheHeader), recs.data(), recs.size() * sizeof(TopologyRec));
+
+    // Write to NVS
+    nvs_handle_t nvsHandle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvsHandle) != ESP_OK)
+    {
+        LOG_W(MODULE_PREFIX, "save failed to open NVS");
+        return false;
+    }
+    bool saveOk = (nvs_set_blob(nvsHandle, _nvsKey, blob.data(), blob.size()) == ESP_OK) &&
+                (nvs_commit(nvsHandle) == ESP_OK);
+    nvs_close(nvsHandle);
+
+    // Debug
+    if (saveOk)
+        LOG_I(MODULE_PREFIX, "save numRecs %d", recs.size());
+    else
+        LOG_W(MODULE_PREFIX, "save failed numRecs %d", recs.size());
+    return saveOk;
+}
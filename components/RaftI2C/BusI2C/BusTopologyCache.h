@@ -0,0 +1,120 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Bus Topology Cache
+// Last known bus topology (device locations and types) persisted to NVS for warm-start detection
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <functional>
+#include "RaftJson.h"
+#include "RaftThreading.h"
+#include "RaftBus.h"
+
+// Device type table hash function (only called if the cache is enabled as hashing the table takes time)
+typedef std::function<uint32_t()> BusDevTypeTableHashFn;
+
+class BusTopologyCache
+{
+public:
+    BusTopologyCache();
+    ~BusTopologyCache();
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup (loads the cached topology if enabled)
+    /// @param config configuration
+    /// @param i2cPort I2C port (used to identify the cache in NVS)
+    /// @param devTypeTableHashFn gets the hash of the device type table (the cache is discarded if this has changed)
+    void setup(const RaftJsonIF& config, uint32_t i2cPort, BusDevTypeTableHashFn devTypeTableHashFn);
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Service (called from main loop - saves changes once the topology has been stable for a while and
+    ///        the minimum interval since the last save has passed)
+    void loop();
+
+    // Check if enabled
+    bool isEnabled() const
+    {
+        return _isEnabled;
+    }
+
+    // Record of a device location
+    class TopologyRec
+    {
+    public:
+        uint16_t address = 0;
+        uint16_t deviceTypeIdx = 0;
+    };
+
+    // Get locations loaded at startup (used to revalidate the previous topology first)
+    const std::vector<TopologyRec>& getStartupRecs() const
+    {
+        return _startupRecs;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get device type at a location in the cached topology
+    /// @param address address of device
+    /// @param deviceTypeIdx (out) device type index
+    /// @return true if the location is in the cached topology
+    bool getDeviceTypeHint(BusElemAddrType address, uint16_t& deviceTypeIdx) const;
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Update the topology (called from the I2C task when a device goes online or offline)
+    /// @param address address of device
+    /// @param isOnline true if the device is online
+    /// @param deviceTypeIdx device type index (if online)
+    void update(BusElemAddrType address, bool isOnline, uint16_t deviceTypeIdx);
+
+private:
+    // Settings
+    bool _isEnabled = false;
+    uint32_t _saveAfterStableMs = SAVE_AFTER_STABLE_MS_DEFAULT;
+    static const uint32_t SAVE_AFTER_STABLE_MS_DEFAULT = 10000;
+    uint32_t _minSaveIntervalMs = MIN_SAVE_INTERVAL_MS_DEFAULT;
+    static const uint32_t MIN_SAVE_INTERVAL_MS_DEFAULT = 60000;
+    uint32_t _devTypeTableHash = 0;
+    char _nvsKey[16] = {0};
+
+    // Mutex (updates are from the I2C task and saving is from the main loop)
+    SemaphoreHandle_t _cacheMutex = nullptr;
+
+    // Topology loaded at startup and current topology
+    std::vector<TopologyRec> _startupRecs;
+    std::vector<TopologyRec> _curRecs;
+
+    // Changed since last save
+    bool _isDirty = false;
+    uint32_t _lastChangeMs = 0;
+
+    // Topology in NVS (sorted by address - only accessed from the main loop after setup) and time of last save
+    // (0 if not saved since setup)
+    std::vector<TopologyRec> _savedRecs;
+    uint32_t _lastSaveMs = 0;
+
+    // NVS format
+    static constexpr const char* NVS_NAMESPACE = "raftI2CTopo";
+    static const uint32_t NVS_FORMAT_VERSION = 1;
+    static const uint32_t MAX_RECS = 256;
+    class CacheHeader
+    {
+    public:
+        uint32_t version;
+        uint32_t devTypeTableHash;
+        uint32_t numRecs;
+    };
+
+    // Helpers
+    bool load();
+    bool save(const std::vector<TopologyRec>& recs);
+    static void sortByAddress(std::vector<TopologyRec>& recs);
+    static bool isSameTopology(const std::vector<TopologyRec>& recs1, const std::vector<TopologyRec>& recs2);
+
+    // Debug
+    static constexpr const char* MODULE_PREFIX = "RaftI2CTopoCache";
+};
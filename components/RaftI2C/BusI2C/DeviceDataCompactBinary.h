@@ -0,0 +1,136 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Device Data Compact Binary
+// Compact (versioned) binary format for queued device data
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "DeviceDataSink.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class DeviceDataCompactBinary
+/// @brief Encoder for the compact binary format
+/// @note The format is:
+///       message header:  magic (0xDB), version, bus number (varint)
+///       per device:      block length (varint - bytes following), address (varint), device type index (varint),
+///                        flags (bit 0 online, bit 1 repeat count follows), repeat count (varint - only if
+///                        flagged), number of responses (varint), response size excluding timestamp (varint)
+///       per response:    timestamp (varint - the full timestamp for the first response and the delta from the
+///                        previous response for the rest, modulo the timestamp size), response data
+///       so the address, type and online flag appear once per device rather than once per response and steady
+///       poll rates give 1 byte timestamps. The repeat count is the number of unchanged poll results which were
+///       not stored since the last stored one (change-only mode)
+class DeviceDataCompactBinary
+{
+public:
+    // Set in connMode to select the compact format
+    static const uint32_t CONN_MODE_COMPACT_FLAG = 0x80000000;
+
+    // Format identification
+    static const uint8_t FORMAT_MAGIC = 0xDB;
+    static const uint8_t FORMAT_VERSION = 2;
+
+    // Flags
+    static const uint8_t DEVICE_FLAG_ONLINE = 0x01;
+    static const uint8_t DEVICE_FLAG_REPEAT_COUNT = 0x02;
+
+    // Check if connMode selects the compact format
+    static bool isCompact(uint32_t connMode)
+    {
+        return (connMode & CONN_MODE_COMPACT_FLAG) != 0;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Write message header
+    /// @param sink sink to write to
+    /// @param connMode connection mode (inc bus number)
+    static void writeHeader(DeviceDataSink& sink, uint32_t connMode)
+    {
+        uint8_t hdr[2 + MAX_VARINT_LEN] = { FORMAT_MAGIC, FORMAT_VERSION };
+        uint32_t hdrLen = 2 + putVarint(hdr + 2, connMode & ~CONN_MODE_COMPACT_FLAG);
+        sink.append(hdr, hdrLen);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Generate device block
+    /// @param devMsg (out) device block (storage is reused)
+    /// @param address address of device
+    /// @param deviceTypeIndex index of device type
+    /// @param isOnline true if device online
+    /// @param pollResponseData poll responses (each starting with a timestamp)
+    /// @param responseSize size of each response (inc timestamp)
+    /// @param timestampSize size of timestamp at the start of each response (big-endian)
+    /// @param repeatCount number of unchanged poll results not stored since the last stored result
+    static void genDeviceBlock(std::vector<uint8_t>& devMsg, uint32_t address, uint16_t deviceTypeIndex,
+                bool isOnline, const std::vector<uint8_t>& pollResponseData, uint32_t responseSize, uint32_t timestampSize,
+                uint32_t repeatCount = 0)
+    {
+        // Check sizes
+        if ((timestampSize > 4) || ((pollResponseData.size() > 0) && (responseSize < timestampSize)))
+            return;
+        uint32_t numResponses = responseSize > 0 ? pollResponseData.size() / responseSize : 0;
+        uint32_t dataSize = responseSize > timestampSize ? responseSize - timestampSize : 0;
+        uint32_t tsMask = timestampSize >= 4 ? 0xffffffff : (1UL << (timestampSize * 8)) - 1;
+
+        // Device header (after space for the block length which is inserted at the end)
+        devMsg.resize(numResponses * (dataSize + MAX_VARINT_LEN) + MAX_VARINT_LEN * 6 + 1);
+        uint8_t* pBase = devMsg.data();
+        uint32_t pos = MAX_VARINT_LEN;
+        pos += putVarint(pBase + pos, address);
+        pos += putVarint(pBase + pos, deviceTypeIndex);
+        pBase[pos++] = (isOnline ? DEVICE_FLAG_ONLINE : 0) | (repeatCount > 0 ? DEVICE_FLAG_REPEAT_COUNT : 0);
+        if (repeatCount > 0)
+            pos += putVarint(pBase + pos, repeatCount);
+        pos += putVarint(pBase + pos, numResponses);
+        pos += putVarint(pBase + pos, dataSize);
+
+        // Responses
+        const uint8_t* pResp = pollResponseData.data();
+        uint32_t prevTs = 0;
+        for (uint32_t i = 0; i < numResponses; i++)
+        {
+            uint32_t ts = 0;
+            for (uint32_t j = 0; j < timestampSize; j++)
+                ts = (ts << 8) | pResp[j];
+            pos += putVarint(pBase + pos, i == 0 ? ts : (ts - prevTs) & tsMask);
+            prevTs = ts;
+            memcpy(pBase + pos, pResp + timestampSize, dataSize);
+            pos += dataSize;
+            pResp += responseSize;
+        }
+
+        // Block length at the start (moved down to follow it directly)
+        uint8_t lenBuf[MAX_VARINT_LEN];
+        uint32_t lenLen = putVarint(lenBuf, pos - MAX_VARINT_LEN);
+        uint32_t startPos = MAX_VARINT_LEN - lenLen;
+        memcpy(pBase + startPos, lenBuf, lenLen);
+        devMsg.erase(devMsg.begin() + pos, devMsg.end());
+        devMsg.erase(devMsg.begin(), devMsg.begin() + startPos);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Put an unsigned LEB128 varint
+    /// @param pBuf buffer (must have space for MAX_VARINT_LEN bytes)
+    /// @param val value
+    /// @return number of bytes written
+    static uint32_t putVarint(uint8_t* pBuf, uint32_t val)
+    {
+        uint32_t len = 0;
+        while (val >= 0x80)
+        {
+            pBuf[len++] = (val & 0x7f) | 0x80;
+            val >>= 7;
+        }
+        pBuf[len++] = val;
+        return len;
+    }
+
+    // Max length of varint (32 bit value)
+    static const uint32_t MAX_VARINT_LEN = 5;
+};
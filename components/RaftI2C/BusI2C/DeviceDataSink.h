@@ -0,0 +1,143 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Device Data Sink
+// Destinations for device data (JSON or binary) which is written incrementally
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <functional>
+#include "RaftArduino.h"
+
+class DeviceDataSink
+{
+public:
+    virtual ~DeviceDataSink()
+    {
+    }
+
+    // Reserve space for the output (from an estimate of the total size)
+    virtual void reserve(uint32_t numBytes) = 0;
+
+    // Append data
+    virtual void append(const uint8_t* pData, uint32_t len) = 0;
+    virtual void append(const String& str)
+    {
+        append((const uint8_t*)str.c_str(), str.length());
+    }
+    void append(const char* pStr)
+    {
+        append((const uint8_t*)pStr, strlen(pStr));
+    }
+    void append(const std::vector<uint8_t>& data)
+    {
+        append(data.data(), data.size());
+    }
+
+    // Finish (flushes any buffered data)
+    virtual void finish()
+    {
+    }
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class DeviceDataStringSink
+/// @brief Sink which appends to a String
+class DeviceDataStringSink : public DeviceDataSink
+{
+public:
+    DeviceDataStringSink(String& str) : _str(str)
+    {
+    }
+    using DeviceDataSink::append;
+    virtual void reserve(uint32_t numBytes) override
+    {
+        _str.reserve(_str.length() + numBytes);
+    }
+    virtual void append(const uint8_t* pData, uint32_t len) override
+    {
+        _str.concat((const char*)pData, len);
+    }
+    virtual void append(const String& str) override
+    {
+        _str += str;
+    }
+private:
+    String& _str;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class DeviceDataVectorSink
+/// @brief Sink which appends to a byte vector
+class DeviceDataVectorSink : public DeviceDataSink
+{
+public:
+    DeviceDataVectorSink(std::vector<uint8_t>& vec) : _vec(vec)
+    {
+    }
+    using DeviceDataSink::append;
+    virtual void reserve(uint32_t numBytes) override
+    {
+        _vec.reserve(_vec.size() + numBytes);
+    }
+    virtual void append(const uint8_t* pData, uint32_t len) override
+    {
+        _vec.insert(_vec.end(), pData, pData + len);
+    }
+private:
+    std::vector<uint8_t>& _vec;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class DeviceDataChunkSink
+/// @brief Sink which writes into a caller-supplied buffer and calls a flush function each time it fills
+/// @note No allocation is performed - the flush function is called with each chunk (and from finish())
+class DeviceDataChunkSink : public DeviceDataSink
+{
+public:
+    typedef std::function<void(const uint8_t* pChunk, uint32_t chunkLen)> FlushFn;
+    DeviceDataChunkSink(uint8_t* pBuf, uint32_t bufLen, FlushFn flushFn) :
+        _pBuf(pBuf), _bufLen(bufLen), _flushFn(flushFn)
+    {
+    }
+    using DeviceDataSink::append;
+    virtual void reserve(uint32_t numBytes) override
+    {
+    }
+    virtual void append(const uint8_t* pData, uint32_t len) override
+    {
+        if (_bufLen == 0)
+        {
+            if (_flushFn && (len > 0))
+                _flushFn(pData, len);
+            return;
+        }
+        while (len > 0)
+        {
+            uint32_t toCopy = len < _bufLen - _bufPos ? len : _bufLen - _bufPos;
+            memcpy(_pBuf + _bufPos, pData, toCopy);
+            _bufPos += toCopy;
+            pData += toCopy;
+            len -= toCopy;
+            if (_bufPos >= _bufLen)
+                finish();
+        }
+    }
+    virtual void finish() override
+    {
+        if ((_bufPos > 0) && _flushFn)
+            _flushFn(_pBuf, _bufPos);
+        _bufPos = 0;
+    }
+private:
+    uint8_t* _pBuf = nullptr;
+    uint32_t _bufLen = 0;
+    uint32_t _bufPos = 0;
+    FlushFn _flushFn;
+};
@@ -12,6 +12,8 @@
 #include "RaftDevice.h"
 #include "BusI2CAddrAndSlot.h"
 #include "Logger.h"
+#include <algorithm>
+#include <string.h>
 
 // #define DEBUG_DEVICE_IDENT_MGR
 // #define DEBUG_DEVICE_IDENT_MGR_DETAIL
@@ -21,10 +23,23 @@
 // Consructor
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-DeviceIdentMgr::DeviceIdentMgr(BusStatusMgr& BusStatusMgr, BusReqSyncFn busReqSyncFn) :
+DeviceIdentMgr::DeviceIdentMgr(BusStatusMgr& BusStatusMgr, BusReqSyncFn busReqSyncFn, BusDebugJSONFn busDebugJSONFn) :
     _busStatusMgr(BusStatusMgr),
-    _busReqSyncFn(busReqSyncFn)
+    _busReqSyncFn(busReqSyncFn),
+    _busDebugJSONFn(busDebugJSONFn)
 {
+    _devTypeInfoCacheMutex = xSemaphoreCreateMutex();
+    _batchDecoderCacheMutex = xSemaphoreCreateMutex();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Destructor
+DeviceIdentMgr::~DeviceIdentMgr()
+{
+    if (_devTypeInfoCacheMutex)
+        vSemaphoreDelete(_devTypeInfoCacheMutex);
+    if (_batchDecoderCacheMutex)
+        vSemaphoreDelete(_batchDecoderCacheMutex);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -35,6 +50,12 @@ void DeviceIdentMgr::setup(const RaftJsonIF& config)
 {
     // Enabled
     _isEnabled = config.getBool("identEnable", true);
+    _detectionRecsCache.clear();
+    if (_batchDecoderCacheMutex && (xSemaphoreTake(_batchDecoderCacheMutex, pdMS_TO_TICKS(10)) == pdTRUE))
+    {
+        _batchDecoderCache.clear();
+        xSemaphoreGive(_batchDecoderCacheMutex);
+    }
 
     // Debug
     LOG_I(MODULE_PREFIX, "DeviceIdentMgr setup %s", _isEnabled ? "enabled" : "disabled");
@@ -55,185 +76,443 @@ void DeviceIdentMgr::getDeviceAddresses(std::vector<BusElemAddrType>& addresses,
 /// @param address address of device
 /// @param deviceStatus (out) device status
 /// @note This is called from within the scanning code so the device should already be selected if it is on a bus extender, etc.
-void DeviceIdentMgr::identifyDevice(BusElemAddrType address, DeviceStatus& deviceStatus)
+void DeviceIdentMgr::identifyDevice(BusElemAddrType address, DeviceStatus& deviceStatus, uint16_t deviceTypeIdxHint)
 {
-    // Clear device status
-    deviceStatus.clear();
+    // Perform all steps (waiting when required)
+    queueIdentify(address, deviceTypeIdxHint);
+    while (true)
+    {
+        IdentStepResult stepResult = stepIdentify(micros(), address, deviceStatus);
+        if (stepResult == IDENT_STEP_COMPLETE)
+            break;
+        if (stepResult == IDENT_STEP_WAITING)
+            delay(1);
+    }
+}
 
-    // Check if enabled
-    if (!_isEnabled)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Queue incremental identification of a device
+/// @param address address of device
+/// @param deviceTypeIdxHint device type to check first (e.g. from a cached topology) or UINT16_MAX if none
+void DeviceIdentMgr::queueIdentify(BusElemAddrType address, uint16_t deviceTypeIdxHint)
+{
+    // Restart if already queued
+    cancelIdentify(address);
+    if (_identJobs.size() >= IDENT_JOBS_MAX)
     {
+        LOG_W(MODULE_PREFIX, "queueIdentify too many pending address %s", BusI2CAddrAndSlot::toString(address).c_str());
+        return;
+    }
+    IdentJob identJob;
+    identJob.address = address;
+
+    // Check if this address is in the range of any known device (no candidates if identification is disabled)
+    if (_isEnabled)
+        identJob.deviceTypeIdxs = deviceTypeRecords.getDeviceTypeIdxsForAddr(BusI2CAddrAndSlot::getI2CAddr(address));
+
+    // Check the hinted type first (if it is valid for this address)
+    auto hintIt = std::find(identJob.deviceTypeIdxs.begin(), identJob.deviceTypeIdxs.end(), deviceTypeIdxHint);
+    if (hintIt != identJob.deviceTypeIdxs.end())
+        std::rotate(identJob.deviceTypeIdxs.begin(), hintIt, hintIt + 1);
+    _identJobs.push_back(identJob);
+
 #ifdef DEBUG_DEVICE_IDENT_MGR
-        LOG_I(MODULE_PREFIX, "Device identification disabled");
+    LOG_I(MODULE_PREFIX, "queueIdentify address %s numCandidateTypes %d hint %d", 
+                BusI2CAddrAndSlot::toString(address).c_str(), identJob.deviceTypeIdxs.size(), deviceTypeIdxHint);
 #endif
-        return;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Cancel incremental identification of a device
+/// @param address address of device
+void DeviceIdentMgr::cancelIdentify(BusElemAddrType address)
+{
+    _identJobs.erase(std::remove_if(_identJobs.begin(), _identJobs.end(), 
+                [address](const IdentJob& identJob) { return identJob.address == address; }),
+                _identJobs.end());
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the address of the next identification step which is ready to perform
+/// @param timeNowUs time now
+/// @param address (out) address
+/// @return true if a step is ready
+bool DeviceIdentMgr::getNextIdentStepAddr(uint64_t timeNowUs, BusElemAddrType& address) const
+{
+    for (const IdentJob& identJob : _identJobs)
+    {
+        if (!identJob.isWaiting(timeNowUs))
+        {
+            address = identJob.address;
+            return true;
+        }
     }
+    return false;
+}
 
-    // Get the raw I2C address (excluding slot number)
-    uint32_t i2cAddr = BusI2CAddrAndSlot::getI2CAddr(address);
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get time until the next identification step is ready
+/// @param timeNowUs time now
+/// @return time in ms (0 if ready now, UINT32_MAX if no identification in progress)
+uint32_t DeviceIdentMgr::getMsUntilIdentStepDue(uint64_t timeNowUs) const
+{
+    uint32_t waitMs = UINT32_MAX;
+    for (const IdentJob& identJob : _identJobs)
+    {
+        if (!identJob.isWaiting(timeNowUs))
+            return 0;
+        uint32_t jobWaitMs = (identJob.waitUs - (timeNowUs - identJob.waitStartUs)) / 1000 + 1;
+        waitMs = std::min(waitMs, jobWaitMs);
+    }
+    return waitMs;
+}
 
-    // Check if this address is in the range of any known device
-    std::vector<uint16_t> deviceTypesForAddr = deviceTypeRecords.getDeviceTypeIdxsForAddr(i2cAddr);
-    for (const auto& deviceTypeIdx : deviceTypesForAddr)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Perform one step of incremental identification
+/// @param timeNowUs time now
+/// @param address address of device (slot must be enabled if it is on a bus extender)
+/// @param deviceStatus (out) device status (set when complete)
+/// @return result
+DeviceIdentMgr::IdentStepResult DeviceIdentMgr::stepIdentify(uint64_t timeNowUs, BusElemAddrType address, 
+            DeviceStatus& deviceStatus)
+{
+    // Find the job (if there is none the identification is complete with no device type)
+    auto jobIt = std::find_if(_identJobs.begin(), _identJobs.end(), 
+                [address](const IdentJob& identJob) { return identJob.address == address; });
+    if (jobIt == _identJobs.end())
     {
-        // Get JSON definition for device
-        DeviceTypeRecord devTypeRec;
-        if (!deviceTypeRecords.getDeviceInfo(deviceTypeIdx, devTypeRec))
-            continue;
+        deviceStatus.clear();
+        return IDENT_STEP_COMPLETE;
+    }
+    IdentJob& identJob = *jobIt;
+    if (identJob.isWaiting(timeNowUs))
+        return IDENT_STEP_WAITING;
+    identJob.waitUs = 0;
 
+    // Check if all candidate types have been tried
+    if (identJob.typeListPos >= identJob.deviceTypeIdxs.size())
+    {
+        deviceStatus.clear();
+        _identJobs.erase(jobIt);
+        return IDENT_STEP_COMPLETE;
+    }
+
+    // Get JSON definition for device
+    uint16_t deviceTypeIdx = identJob.deviceTypeIdxs[identJob.typeListPos];
+    DeviceTypeRecord devTypeRec;
+    if (!deviceTypeRecords.getDeviceInfo(deviceTypeIdx, devTypeRec))
+    {
+        identJob.nextType();
+        return IDENT_STEP_PERFORMED;
+    }
+
+    // Detection
+    if (!identJob.isInitialising)
+    {
 #ifdef DEBUG_DEVICE_IDENT_MGR
-        LOG_I(MODULE_PREFIX, "identifyDevice potential deviceType %s address %s", 
-                    devTypeRec.deviceType ? devTypeRec.deviceType : "NO NAME", BusI2CAddrAndSlot::toString(address).c_str());
+        if (identJob.detectionRecPos == 0)
+            LOG_I(MODULE_PREFIX, "stepIdentify potential deviceType %s address %s", 
+                        devTypeRec.deviceType ? devTypeRec.deviceType : "NO NAME", BusI2CAddrAndSlot::toString(address).c_str());
 #endif
 
-        // Check if the detection value(s) match responses from the device
-        // Generate a bus request to read the detection value
-        if (checkDeviceTypeMatch(address, &devTypeRec))
+        // Get the next detection record with a read data check
+        std::vector<DeviceTypeRecords::DeviceDetectionRec> uncachedRecs;
+        const std::vector<DeviceTypeRecords::DeviceDetectionRec>& detectionRecs = 
+                    getDetectionRecs(&devTypeRec, deviceTypeIdx, uncachedRecs);
+        while ((identJob.detectionRecPos < detectionRecs.size()) && 
+                    (detectionRecs[identJob.detectionRecPos].checkValues.size() == 0))
+            identJob.detectionRecPos++;
+
+        // Check if all detection records have been checked
+        if (identJob.detectionRecPos >= detectionRecs.size())
         {
+            if (!identJob.detectionValuesMatch)
+            {
 #ifdef DEBUG_DEVICE_IDENT_MGR_DETAIL
-            LOG_I(MODULE_PREFIX, "identifyDevice FOUND %s", devTypeRec.devInfoJson ? devTypeRec.devInfoJson : "NO INFO");
+                LOG_I(MODULE_PREFIX, "stepIdentify CHECK FAILED %s", devTypeRec.devInfoJson ? devTypeRec.devInfoJson : "NO INFO");
 #endif
-            // Initialise the device if required
-            processDeviceInit(address, &devTypeRec);
+                identJob.nextType();
+                return IDENT_STEP_PERFORMED;
+            }
 
-            // Set device type index
-            deviceStatus.deviceTypeIndex = deviceTypeIdx;
+#ifdef DEBUG_DEVICE_IDENT_MGR_DETAIL
+            LOG_I(MODULE_PREFIX, "stepIdentify FOUND %s", devTypeRec.devInfoJson ? devTypeRec.devInfoJson : "NO INFO");
+#endif
+            // Get the initialisation bus requests
+            identJob.isInitialising = true;
+            identJob.initReqPos = 0;
+            identJob.initBusRequests.clear();
+            deviceTypeRecords.getInitBusRequests(address, &devTypeRec, identJob.initBusRequests);
+            return IDENT_STEP_PERFORMED;
+        }
 
-            // Get polling info
-            deviceTypeRecords.getPollInfo(address, &devTypeRec, deviceStatus.deviceIdentPolling);
+        // Check the detection record (a failed access means this isn't the device type)
+        const DeviceTypeRecords::DeviceDetectionRec& detectionRec = detectionRecs[identJob.detectionRecPos++];
+        bool checkValueMatch = false;
+        if (checkDetectionRec(address, detectionRec, checkValueMatch) != RAFT_OK)
+        {
+            identJob.nextType();
+            return IDENT_STEP_PERFORMED;
+        }
+        if (!checkValueMatch)
+            identJob.detectionValuesMatch = false;
+        if (detectionRec.pauseAfterSendMs > 0)
+            identJob.startWait(timeNowUs, detectionRec.pauseAfterSendMs);
+        return IDENT_STEP_PERFORMED;
+    }
 
-            // Set polling results size
-            deviceStatus.dataAggregator.init(deviceStatus.deviceIdentPolling.numPollResultsToStore, 
-                    deviceStatus.deviceIdentPolling.pollResultSizeIncTimestamp);
+    // Initialise the device (one request per step)
+    if (identJob.initReqPos < identJob.initBusRequests.size())
+    {
+        const BusRequestInfo& initBusRequest = identJob.initBusRequests[identJob.initReqPos++];
+        std::vector<uint8_t> readData;
+        BusRequestInfo reqRec(initBusRequest);
+        if (_busReqSyncFn != nullptr)
+            _busReqSyncFn(&reqRec, &readData);
+
+        // Check for bar-access time after each request
+        if (initBusRequest.getBarAccessForMsAfterSend() > 0)
+            identJob.startWait(timeNowUs, initBusRequest.getBarAccessForMsAfterSend());
+        return IDENT_STEP_PERFORMED;
+    }
+
+    // Identified
+    setIdentifiedDeviceStatus(address, &devTypeRec, deviceTypeIdx, deviceStatus);
+    _identJobs.erase(jobIt);
+    return IDENT_STEP_COMPLETE;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Set device status for an identified device
+/// @param address address of device
+/// @param pDevTypeRec device type record
+/// @param deviceTypeIdx device type index
+/// @param deviceStatus (out) device status
+void DeviceIdentMgr::setIdentifiedDeviceStatus(BusElemAddrType address, const DeviceTypeRecord* pDevTypeRec, 
+            uint16_t deviceTypeIdx, DeviceStatus& deviceStatus)
+{
+    // Set device type index
+    deviceStatus.clear();
+    deviceStatus.deviceTypeIndex = deviceTypeIdx;
+
+    // Get polling info
+    deviceTypeRecords.getPollInfo(address, pDevTypeRec, deviceStatus.deviceIdentPolling);
+
+    // Set polling results size
+    deviceStatus.dataAggregator.init(deviceStatus.deviceIdentPolling.numPollResultsToStore, 
+            deviceStatus.deviceIdentPolling.pollResultSizeIncTimestamp);
 
 #ifdef DEBUG_HANDLE_BUS_DEVICE_INFO
-            LOG_I(MODULE_PREFIX, "setBusElemDevInfo address %s numPollResToStore %d pollResSizeIncTimestamp %d", 
-                    BusI2CAddrAndSlot::toString(address).c_str(),
-                    deviceStatus.deviceIdentPolling.numPollResultsToStore,
-                    deviceStatus.deviceIdentPolling.pollResultSizeIncTimestamp);
+    LOG_I(MODULE_PREFIX, "setBusElemDevInfo address %s numPollResToStore %d pollResSizeIncTimestamp %d", 
+            BusI2CAddrAndSlot::toString(address).c_str(),
+            deviceStatus.deviceIdentPolling.numPollResultsToStore,
+            deviceStatus.deviceIdentPolling.pollResultSizeIncTimestamp);
 #endif
-            // Break out of the loop
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the bus frequency a device type can be accessed at
+/// @param deviceTypeIdx device type index
+/// @return frequency (from i2cFreq in the device type info) or 0 if not specified
+uint32_t DeviceIdentMgr::getDeviceTypeI2CFreq(uint16_t deviceTypeIdx) const
+{
+    DeviceTypeRecord devTypeRec;
+    if ((deviceTypeIdx == DeviceStatus::DEVICE_TYPE_INDEX_INVALID) || !deviceTypeRecords.getDeviceInfo(deviceTypeIdx, devTypeRec) ||
+                !devTypeRec.devInfoJson)
+        return 0;
+    RaftJson devInfo(devTypeRec.devInfoJson, false);
+    return devInfo.getLong("i2cFreq", 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the transaction overhead (max clock stretching, etc) of a device type
+/// @param deviceTypeIdx device type index
+/// @return overhead in us (from i2cStretchUs in the device type info) or 0 if not specified
+uint32_t DeviceIdentMgr::getDeviceTypeI2CStretchUs(uint16_t deviceTypeIdx) const
+{
+    DeviceTypeRecord devTypeRec;
+    if ((deviceTypeIdx == DeviceStatus::DEVICE_TYPE_INDEX_INVALID) || !deviceTypeRecords.getDeviceInfo(deviceTypeIdx, devTypeRec) ||
+                !devTypeRec.devInfoJson)
+        return 0;
+    RaftJson devInfo(devTypeRec.devInfoJson, false);
+    return devInfo.getLong("i2cStretchUs", 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get hash of the device type table
+/// @return hash (FNV-1a of each device type's name and info)
+uint32_t DeviceIdentMgr::getDeviceTypeTableHash() const
+{
+    uint32_t hash = 2166136261UL;
+    auto hashStr = [&hash](const char* pStr) {
+        while (pStr && *pStr)
+            hash = (hash ^ (uint8_t)*pStr++) * 16777619UL;
+        hash = (hash ^ 0xff) * 16777619UL;
+    };
+    for (uint16_t devTypeIdx = 0; devTypeIdx < UINT16_MAX; devTypeIdx++)
+    {
+        DeviceTypeRecord devTypeRec;
+        if (!deviceTypeRecords.getDeviceInfo(devTypeIdx, devTypeRec))
             break;
-        }
-        else
-        {
-#ifdef DEBUG_DEVICE_IDENT_MGR_DETAIL
-            LOG_I(MODULE_PREFIX, "identifyDevice CHECK FAILED %s", devTypeRec.devInfoJson ? devTypeRec.devInfoJson : "NO INFO");
-#endif
-        }
+        hashStr(devTypeRec.deviceType);
+        hashStr(devTypeRec.devInfoJson);
     }
+    return hash;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Access device and check response
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-bool DeviceIdentMgr::checkDeviceTypeMatch(BusElemAddrType address, const DeviceTypeRecord* pDevTypeRec)
+bool DeviceIdentMgr::checkDeviceTypeMatch(BusElemAddrType address, const DeviceTypeRecord* pDevTypeRec, uint16_t deviceTypeIdx)
 {
-    // Get the detection records
-    std::vector<DeviceTypeRecords::DeviceDetectionRec> detectionRecs;
-    deviceTypeRecords.getDetectionRecs(pDevTypeRec, detectionRecs);
+    // Get the detection records (parsed once for each device type)
+    std::vector<DeviceTypeRecords::DeviceDetectionRec> uncachedRecs;
+    const std::vector<DeviceTypeRecords::DeviceDetectionRec>& detectionRecs = getDetectionRecs(pDevTypeRec, deviceTypeIdx, uncachedRecs);
 
     // Check if all values match
     bool detectionValuesMatch = true;
     for (const auto& detectionRec : detectionRecs)
     {
-
-        // Check there is a read data check
-        uint32_t readDataCheckBytes = 0;
+        // Skip records without a read data check
         if (detectionRec.checkValues.size() == 0)
             continue;
-        readDataCheckBytes = detectionRec.checkValues[0].second.size();
-
-        // Create a bus request to read the detection value
-        // Create the poll request
-        BusRequestInfo reqRec(BUS_REQ_TYPE_FAST_SCAN, 
-                address,
-                0, 
-                detectionRec.writeData.size(), 
-                detectionRec.writeData.data(),
-                readDataCheckBytes,
-                detectionRec.pauseAfterSendMs, 
-                nullptr, 
-                this);
-        std::vector<uint8_t> readData;
-        RaftRetCode rslt = _busReqSyncFn != nullptr ? _busReqSyncFn(&reqRec, &readData) : RAFT_BUS_NOT_INIT;
+
+        // Access the device and check the response
+        bool checkValueMatch = false;
+        if (checkDetectionRec(address, detectionRec, checkValueMatch) != RAFT_OK)
+            return false;
+        if (!checkValueMatch)
+            detectionValuesMatch = false;
+
+        if (detectionRec.pauseAfterSendMs > 0)
+            delay(detectionRec.pauseAfterSendMs);
+    }
+
+    // Access the device and check the response
+    return detectionValuesMatch;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Check one detection record
+/// @param address address
+/// @param detectionRec detection record
+/// @param checkValueMatch (out) true if the response matches one of the check values
+/// @return result of bus access
+RaftRetCode DeviceIdentMgr::checkDetectionRec(BusElemAddrType address, 
+            const DeviceTypeRecords::DeviceDetectionRec& detectionRec, bool& checkValueMatch)
+{
+    // Check there is a read data check
+    checkValueMatch = false;
+    if (detectionRec.checkValues.size() == 0)
+        return RAFT_OK;
+    uint32_t readDataCheckBytes = detectionRec.checkValues[0].second.size();
+
+    // Create a bus request to read the detection value
+    // Create the poll request
+    BusRequestInfo reqRec(BUS_REQ_TYPE_FAST_SCAN, 
+            address,
+            0, 
+            detectionRec.writeData.size(), 
+            detectionRec.writeData.data(),
+            readDataCheckBytes,
+            detectionRec.pauseAfterSendMs, 
+            nullptr, 
+            this);
+    std::vector<uint8_t>& readData = _detectionReadData;
+    readData.clear();
+    RaftRetCode rslt = _busReqSyncFn != nullptr ? _busReqSyncFn(&reqRec, &readData) : RAFT_BUS_NOT_INIT;
 
 #ifdef DEBUG_DEVICE_IDENT_MGR
-        String writeStr;
-        Raft::getHexStrFromBytes(detectionRec.writeData.data(), detectionRec.writeData.size(), writeStr);
-        String readDataStr;
-        Raft::getHexStrFromBytes(readData.data(), readData.size(), readDataStr);
-        LOG_I(MODULE_PREFIX, "checkDeviceTypeMatch %s addr %s writeData %s rslt %d readData %s readSize %d pauseAfterMs %d", 
-                    rslt == RAFT_OK ? "OK" : "BUS ACCESS FAILED",
-                    BusI2CAddrAndSlot::toString(address).c_str(), 
-                    writeStr.c_str(), rslt, 
-                    readDataStr.c_str(), readData.size(), 
-                    detectionRec.pauseAfterSendMs);
+    String writeStr;
+    Raft::getHexStrFromBytes(detectionRec.writeData.data(), detectionRec.writeData.size(), writeStr);
+    String readDataStr;
+    Raft::getHexStrFromBytes(readData.data(), readData.size(), readDataStr);
+    LOG_I(MODULE_PREFIX, "checkDetectionRec %s addr %s writeData %s rslt %d readData %s readSize %d pauseAfterMs %d", 
+                rslt == RAFT_OK ? "OK" : "BUS ACCESS FAILED",
+                BusI2CAddrAndSlot::toString(address).c_str(), 
+                writeStr.c_str(), rslt, 
+                readDataStr.c_str(), readData.size(), 
+                detectionRec.pauseAfterSendMs);
 #endif
 
-        // Check ok result
-        if (rslt != RAFT_OK)
-            return false;
+    // Check ok result
+    if (rslt != RAFT_OK)
+        return rslt;
 
-        // Iterate through check values to see if one of them matches
-        bool checkValueMatch = false;
-        for (const auto& checkValue : detectionRec.checkValues)
-        {
+    // Iterate through check values to see if one of them matches
+    for (const auto& checkValue : detectionRec.checkValues)
+    {
 
 #ifdef DEBUG_DEVICE_IDENT_MGR
-            String readMaskStr;
-            Raft::getHexStrFromBytes(checkValue.first.data(), checkValue.first.size(), readMaskStr);
-            String readCheckStr;
-            Raft::getHexStrFromBytes(checkValue.second.data(), checkValue.second.size(), readCheckStr);
-            LOG_I(MODULE_PREFIX, "checkDeviceTypeMatch readDataMask %s readDataCheck %s VS readData %s",
-                        readMaskStr.c_str(),
-                        readCheckStr.c_str(),
-                        readDataStr.c_str());
+        String readMaskStr;
+        Raft::getHexStrFromBytes(checkValue.first.data(), checkValue.first.size(), readMaskStr);
+        String readCheckStr;
+        Raft::getHexStrFromBytes(checkValue.second.data(), checkValue.second.size(), readCheckStr);
+        LOG_I(MODULE_PREFIX, "checkDetectionRec readDataMask %s readDataCheck %s VS readData %s",
+                    readMaskStr.c_str(),
+                    readCheckStr.c_str(),
+                    readDataStr.c_str());
 #endif
 
-            // Check the read data
-            bool sizeMatch = readData.size() == checkValue.second.size();
-            if (sizeMatch)
+        // Check the read data
+        bool sizeMatch = readData.size() == checkValue.second.size();
+        if (sizeMatch)
+        {
+            bool checkByteMatch = true;
+            for (int i = 0; i < readData.size(); i++)
             {
-                bool checkByteMatch = true;
-                for (int i = 0; i < readData.size(); i++)
-                {
-                    if ((readData[i] & checkValue.first[i]) != checkValue.second[i])
-                    {
-                        checkByteMatch = false;
-                        break;
-                    }
-                }
-                if (checkByteMatch)
+                if ((readData[i] & checkValue.first[i]) != checkValue.second[i])
                 {
-                    checkValueMatch = true;
+                    checkByteMatch = false;
                     break;
                 }
             }
+            if (checkByteMatch)
+            {
+                checkValueMatch = true;
+                break;
+            }
+        }
 
 #ifdef DEBUG_DEVICE_IDENT_MGR
-            LOG_I(MODULE_PREFIX, "checkDeviceTypeMatch readData %s sizeMatch %d checkValueMatch %d", 
-                        readDataStr.c_str(), sizeMatch, checkValueMatch);
+        LOG_I(MODULE_PREFIX, "checkDetectionRec readData %s sizeMatch %d checkValueMatch %d", 
+                    readDataStr.c_str(), sizeMatch, checkValueMatch);
 #endif
-        }
+    }
 
 #ifdef DEBUG_DEVICE_IDENT_MGR
-        LOG_I(MODULE_PREFIX, "checkDeviceTypeMatch address %s %s", 
-                    BusI2CAddrAndSlot::toString(address).c_str(),
-                    checkValueMatch ? "MATCH" : "NO MATCH");
+    LOG_I(MODULE_PREFIX, "checkDetectionRec address %s %s", 
+                BusI2CAddrAndSlot::toString(address).c_str(),
+                checkValueMatch ? "MATCH" : "NO MATCH");
 #endif
+    return RAFT_OK;
+}
 
-        // Check if all values match
-        if (!checkValueMatch)
-            detectionValuesMatch = false;
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get detection records for a device type (from the cache if possible)
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-        if (detectionRec.pauseAfterSendMs > 0)
-            delay(detectionRec.pauseAfterSendMs);
+const std::vector<DeviceTypeRecords::DeviceDetectionRec>& DeviceIdentMgr::getDetectionRecs(const DeviceTypeRecord* pDevTypeRec, 
+            uint16_t deviceTypeIdx, std::vector<DeviceTypeRecords::DeviceDetectionRec>& uncachedRecs)
+{
+    // Check if the index can be cached
+    if (deviceTypeIdx >= DETECTION_RECS_CACHE_MAX_TYPES)
+    {
+        deviceTypeRecords.getDetectionRecs(pDevTypeRec, uncachedRecs);
+        return uncachedRecs;
     }
 
-    // Access the device and check the response
-    return detectionValuesMatch;
+    // Parse on first use
+    if (deviceTypeIdx >= _detectionRecsCache.size())
+        _detectionRecsCache.resize(deviceTypeIdx + 1);
+    DetectionRecsCacheEntry& cacheEntry = _detectionRecsCache[deviceTypeIdx];
+    if (!cacheEntry.isValid)
+    {
+        deviceTypeRecords.getDetectionRecs(pDevTypeRec, cacheEntry.detectionRecs);
+        cacheEntry.isValid = true;
+    }
+    return cacheEntry.detectionRecs;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -272,15 +551,29 @@ bool DeviceIdentMgr::processDeviceInit(BusElemAddrType address, const DeviceType
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 String DeviceIdentMgr::deviceStatusToJson(BusElemAddrType address, bool isOnline, uint16_t deviceTypeIndex, 
-                const std::vector<uint8_t>& devicePollResponseData, uint32_t responseSize) const
+                const std::vector<uint8_t>& devicePollResponseData, uint32_t responseSize, const String& extraJson) const
 {
     // Get device type info
     DeviceTypeRecord devTypeRec;
-    if (!deviceTypeRecords.getDeviceInfo(deviceTypeIndex, devTypeRec))
+    if (!deviceTypeRecords.getDeviceInfo(deviceTypeIndex, devTypeRec) || !devTypeRec.deviceType)
         return "";
 
-    // Get the poll response JSON
-    return deviceTypeRecords.deviceStatusToJson(address, isOnline, &devTypeRec, devicePollResponseData);
+    // The device object has the poll responses as hex ("x"), device type ("_t"), online status ("_o") and
+    // the poll group responses and repeat count (if any)
+    String hexStr;
+    Raft::getHexStrFromBytes(devicePollResponseData.data(), devicePollResponseData.size(), hexStr);
+    String jsonStr;
+    jsonStr.reserve(hexStr.length() + extraJson.length() + JSON_EST_BYTES_PER_DEVICE);
+    jsonStr += "\"";
+    jsonStr += BusI2CAddrAndSlot::toString(address);
+    jsonStr += "\":{\"x\":\"";
+    jsonStr += hexStr;
+    jsonStr += "\",\"_t\":\"";
+    jsonStr += devTypeRec.deviceType;
+    jsonStr += isOnline ? "\",\"_o\":1" : "\",\"_o\":0";
+    jsonStr += extraJson;
+    jsonStr += "}";
+    return jsonStr;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -295,7 +588,7 @@ String DeviceIdentMgr::getDevTypeInfoJsonByAddr(BusElemAddrType address, bool in
         return "{}";
 
     // Get device type info
-    return deviceTypeRecords.getDevTypeInfoJsonByTypeIdx(deviceTypeIdx, includePlugAndPlayInfo);
+    return getDevTypeInfoJsonByTypeIdx(deviceTypeIdx, includePlugAndPlayInfo);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -304,8 +597,13 @@ String DeviceIdentMgr::getDevTypeInfoJsonByAddr(BusElemAddrType address, bool in
 /// @return JSON string
 String DeviceIdentMgr::getDevTypeInfoJsonByTypeName(const String& deviceType, bool includePlugAndPlayInfo) const
 {
+    // Look up the type index (names not in the index are passed to the device type records)
+    uint16_t deviceTypeIdx = findDeviceTypeIdxByName(deviceType.c_str());
+    if (deviceTypeIdx == DeviceStatus::DEVICE_TYPE_INDEX_INVALID)
+        return deviceTypeRecords.getDevTypeInfoJsonByTypeName(deviceType, includePlugAndPlayInfo);
+
     // Get device type info
-    return deviceTypeRecords.getDevTypeInfoJsonByTypeName(deviceType, includePlugAndPlayInfo);
+    return getDevTypeInfoJsonByTypeIdx(deviceTypeIdx, includePlugAndPlayInfo);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -315,8 +613,94 @@ String DeviceIdentMgr::getDevTypeInfoJsonByTypeName(const String& deviceType, bo
 /// @return JSON string
 String DeviceIdentMgr::getDevTypeInfoJsonByTypeIdx(uint16_t deviceTypeIdx, bool includePlugAndPlayInfo) const
 {
-    // Get device type info
-    return deviceTypeRecords.getDevTypeInfoJsonByTypeIdx(deviceTypeIdx, includePlugAndPlayInfo);
+    // Check the cache
+    if (xSemaphoreTake(_devTypeInfoCacheMutex, pdMS_TO_TICKS(10)) != pdTRUE)
+        return deviceTypeRecords.getDevTypeInfoJsonByTypeIdx(deviceTypeIdx, includePlugAndPlayInfo);
+    uint32_t lruIdx = 0;
+    for (uint32_t i = 0; i < DEV_TYPE_INFO_JSON_CACHE_SIZE; i++)
+    {
+        DevTypeInfoJsonCacheEntry& cacheEntry = _devTypeInfoJsonCache[i];
+        if ((cacheEntry.deviceTypeIdx == deviceTypeIdx) && (cacheEntry.includePlugAndPlayInfo == includePlugAndPlayInfo))
+        {
+            cacheEntry.lastUsed = ++_devTypeInfoJsonCacheUseCounter;
+            String devTypeInfoJson = cacheEntry.devTypeInfoJson;
+            xSemaphoreGive(_devTypeInfoCacheMutex);
+            return devTypeInfoJson;
+        }
+        if (cacheEntry.lastUsed < _devTypeInfoJsonCache[lruIdx].lastUsed)
+            lruIdx = i;
+    }
+
+    // Get device type info and cache it in place of the least recently used entry
+    String devTypeInfoJson = deviceTypeRecords.getDevTypeInfoJsonByTypeIdx(deviceTypeIdx, includePlugAndPlayInfo);
+    DevTypeInfoJsonCacheEntry& cacheEntry = _devTypeInfoJsonCache[lruIdx];
+    cacheEntry.deviceTypeIdx = deviceTypeIdx;
+    cacheEntry.includePlugAndPlayInfo = includePlugAndPlayInfo;
+    cacheEntry.lastUsed = ++_devTypeInfoJsonCacheUseCounter;
+    cacheEntry.devTypeInfoJson = devTypeInfoJson;
+    xSemaphoreGive(_devTypeInfoCacheMutex);
+    return devTypeInfoJson;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Find device type index by name (using an index sorted by name)
+/// @param pDeviceType device type name
+/// @return device type index or DEVICE_TYPE_INDEX_INVALID if not found
+uint16_t DeviceIdentMgr::findDeviceTypeIdxByName(const char* pDeviceType) const
+{
+    if (!pDeviceType || (xSemaphoreTake(_devTypeInfoCacheMutex, pdMS_TO_TICKS(10)) != pdTRUE))
+        return DeviceStatus::DEVICE_TYPE_INDEX_INVALID;
+
+    // Build the index on first use
+    auto getTypeName = [](uint16_t devTypeIdx) {
+        DeviceTypeRecord devTypeRec;
+        if (!deviceTypeRecords.getDeviceInfo(devTypeIdx, devTypeRec) || !devTypeRec.deviceType)
+            return "";
+        return devTypeRec.deviceType;
+    };
+    if (!_devTypeNameIndexValid)
+    {
+        _devTypeNameIndex.clear();
+        for (uint16_t devTypeIdx = 0; devTypeIdx < DeviceStatus::DEVICE_TYPE_INDEX_INVALID; devTypeIdx++)
+        {
+            DeviceTypeRecord devTypeRec;
+            if (!deviceTypeRecords.getDeviceInfo(devTypeIdx, devTypeRec))
+                break;
+            _devTypeNameIndex.push_back(devTypeIdx);
+        }
+        std::stable_sort(_devTypeNameIndex.begin(), _devTypeNameIndex.end(), [&getTypeName](uint16_t a, uint16_t b) {
+            return strcmp(getTypeName(a), getTypeName(b)) < 0;
+        });
+        _devTypeNameIndexValid = true;
+    }
+
+    // Binary search
+    auto it = std::lower_bound(_devTypeNameIndex.begin(), _devTypeNameIndex.end(), pDeviceType,
+                [&getTypeName](uint16_t devTypeIdx, const char* pName) {
+                    return strcmp(getTypeName(devTypeIdx), pName) < 0;
+                });
+    uint16_t deviceTypeIdx = DeviceStatus::DEVICE_TYPE_INDEX_INVALID;
+    if ((it != _devTypeNameIndex.end()) && (strcmp(getTypeName(*it), pDeviceType) == 0))
+        deviceTypeIdx = *it;
+    xSemaphoreGive(_devTypeInfoCacheMutex);
+    return deviceTypeIdx;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get version of the device type info
+/// @return version
+uint32_t DeviceIdentMgr::getDevTypeInfoVersion() const
+{
+    if (xSemaphoreTake(_devTypeInfoCacheMutex, pdMS_TO_TICKS(10)) != pdTRUE)
+        return getDeviceTypeTableHash();
+    if (!_devTypeInfoVersionValid)
+    {
+        _devTypeInfoVersion = getDeviceTypeTableHash();
+        _devTypeInfoVersionValid = true;
+    }
+    uint32_t devTypeInfoVersion = _devTypeInfoVersion;
+    xSemaphoreGive(_devTypeInfoCacheMutex);
+    return devTypeInfoVersion;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -324,30 +708,90 @@ String DeviceIdentMgr::getDevTypeInfoJsonByTypeIdx(uint16_t deviceTypeIdx, bool
 /// @return JSON doc
 String DeviceIdentMgr::getQueuedDeviceDataJson() const
 {
-    // Return string
     String jsonStr;
+    DeviceDataStringSink sink(jsonStr);
+    sink.reserve(estimateQueuedDeviceDataSize(false));
+    getQueuedDeviceDataJson(sink);
+    return jsonStr;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Write queued device data in JSON format to a sink
+/// @param sink sink to write to
+void DeviceIdentMgr::getQueuedDeviceDataJson(DeviceDataSink& sink) const
+{
+    // Poll responses are copied out in the visitors (which are called with the bus status mutex held) and
+    // formatted after the mutex is released - the storage is reused for all devices
+    std::vector<uint8_t> pollResponseData;
+    std::vector<String> groupNames;
+    std::vector<std::vector<uint8_t>> groupResponseData;
 
     // Get list of all bus element addresses
     std::vector<BusElemAddrType> addresses;
     _busStatusMgr.getBusElemAddresses(addresses, false);
+    // The device type info version is published first so clients can check their cached type info
+    sink.append("{\"_tv\":" + String(getDevTypeInfoVersion()));
     for (auto address : addresses)
     {
-        // Get bus status for each address
-        bool isOnline = false;
-        uint16_t deviceTypeIndex = 0;
-        std::vector<uint8_t> devicePollResponseData;
-        uint32_t responseSize = 0;
-        _busStatusMgr.getBusElemPollResponses(address, isOnline, deviceTypeIndex, devicePollResponseData, responseSize, 0);
-
-        // Use device identity manager to convert to JSON
-        String jsonData = deviceStatusToJson(address, 
-                        isOnline, deviceTypeIndex, devicePollResponseData, responseSize);
-        if (jsonData.length() > 0)
+        // Copy poll group responses
+        uint32_t numGroups = 0;
+        _busStatusMgr.visitBusElemPollGroupResponses(address,
+            [&numGroups, &groupNames, &groupResponseData](const String& groupName, 
+                        const std::vector<uint8_t>& groupPollResponseData, uint32_t responseSize, uint32_t numResponses)
+            {
+                if (numGroups >= groupNames.size())
+                {
+                    groupNames.emplace_back();
+                    groupResponseData.emplace_back();
+                }
+                groupNames[numGroups] = groupName;
+                groupResponseData[numGroups].assign(groupPollResponseData.begin(), groupPollResponseData.end());
+                numGroups++;
+            });
+
+        // Copy poll responses
+        bool hasResponses = false;
+        bool devIsOnline = false;
+        uint16_t devTypeIndex = 0;
+        uint32_t devResponseSize = 0;
+        _busStatusMgr.visitBusElemPollResponses(address, 0,
+            [&hasResponses, &devIsOnline, &devTypeIndex, &devResponseSize, &pollResponseData](bool isOnline, 
+                        uint16_t deviceTypeIndex, const std::vector<uint8_t>& devicePollResponseData, 
+                        uint32_t responseSize, uint32_t numResponses)
+            {
+                hasResponses = true;
+                devIsOnline = isOnline;
+                devTypeIndex = deviceTypeIndex;
+                devResponseSize = responseSize;
+                pollResponseData.assign(devicePollResponseData.begin(), devicePollResponseData.end());
+            });
+        if (!hasResponses)
+            continue;
+
+        // Poll group responses are published in the device's JSON object as hex under the group names
+        String extraJson;
+        for (uint32_t i = 0; i < numGroups; i++)
         {
-            jsonStr += (jsonStr.length() == 0 ? "{" : ",") + jsonData;
+            String hexStr;
+            Raft::getHexStrFromBytes(groupResponseData[i].data(), groupResponseData[i].size(), hexStr);
+            extraJson += ",\"" + groupNames[i] + "\":\"" + hexStr + "\"";
         }
+
+        // Unchanged results not stored (change-only mode) are published as a repeat count
+        uint32_t repeatCount = _busStatusMgr.getPollResultRepeatCount(address);
+        if (repeatCount > 0)
+            extraJson += ",\"_r\":" + String(repeatCount);
+
+        // Convert to JSON
+        String jsonData = deviceStatusToJson(address, devIsOnline, devTypeIndex, pollResponseData, 
+                        devResponseSize, extraJson);
+        if (jsonData.length() == 0)
+            continue;
+        sink.append(",");
+        sink.append(jsonData);
     }
-    return jsonStr.length() == 0 ? "{}" : jsonStr + "}";
+    sink.append("}");
+    sink.finish();
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -356,31 +800,69 @@ String DeviceIdentMgr::getQueuedDeviceDataJson() const
 /// @return Binary data vector
 std::vector<uint8_t> DeviceIdentMgr::getQueuedDeviceDataBinary(uint32_t connMode) const
 {
-    // Return buffer
     std::vector<uint8_t> binData;
+    DeviceDataVectorSink sink(binData);
+    sink.reserve(estimateQueuedDeviceDataSize(true));
+    getQueuedDeviceDataBinary(connMode, sink);
+    return binData;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Write queued device data in binary format to a sink
+/// @param connMode connection mode (inc bus number - DeviceDataCompactBinary::CONN_MODE_COMPACT_FLAG selects
+///                 the compact format)
+/// @param sink sink to write to
+void DeviceIdentMgr::getQueuedDeviceDataBinary(uint32_t connMode, DeviceDataSink& sink) const
+{
+    // Each device message is generated into this buffer (its storage is reused for all devices)
+    std::vector<uint8_t> devMsg;
+
+    // Compact format has a header for the whole message
+    bool isCompact = DeviceDataCompactBinary::isCompact(connMode);
+    if (isCompact)
+        DeviceDataCompactBinary::writeHeader(sink, connMode);
 
     // Get list of all bus element addresses
     std::vector<BusElemAddrType> addresses;
     _busStatusMgr.getBusElemAddresses(addresses, false);
     for (auto address : addresses)
     {
-        // Get bus status for each address
-        bool isOnline = false;
-        uint16_t deviceTypeIndex = 0;
-        std::vector<uint8_t> devicePollResponseData;
-        uint32_t responseSize = 0;
-        _busStatusMgr.getBusElemPollResponses(address, isOnline, deviceTypeIndex, devicePollResponseData, responseSize, 0);
-
-        // Get poll response JSON
-        if (devicePollResponseData.size() > 0)
-        {
-            // Generate binary device message
-            RaftDevice::genBinaryDataMsg(binData, connMode, address, deviceTypeIndex, isOnline, devicePollResponseData);
-        }
+        // Visit poll responses for each address and generate binary device message (in the compact format a
+        // device with only unchanged results has a block so that the repeat count is published)
+        uint32_t repeatCount = isCompact ? _busStatusMgr.getPollResultRepeatCount(address) : 0;
+        _busStatusMgr.visitBusElemPollResponses(address, 0,
+            [address, connMode, isCompact, repeatCount, &sink, &devMsg](bool isOnline, uint16_t deviceTypeIndex, 
+                        const std::vector<uint8_t>& devicePollResponseData, uint32_t responseSize, uint32_t numResponses)
+            {
+                if ((devicePollResponseData.size() == 0) && (repeatCount == 0))
+                    return;
+                devMsg.clear();
+                if (isCompact)
+                    DeviceDataCompactBinary::genDeviceBlock(devMsg, address, deviceTypeIndex, isOnline, 
+                                devicePollResponseData, responseSize, DevicePollingInfo::POLL_RESULT_TIMESTAMP_SIZE,
+                                repeatCount);
+                else if (devicePollResponseData.size() == 0)
+                    return;
+                else
+                    RaftDevice::genBinaryDataMsg(devMsg, connMode, address, deviceTypeIndex, isOnline, devicePollResponseData);
+                sink.append(devMsg);
+            });
     }
+    sink.finish();
+}
 
-    // Return binary data
-    return binData;
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Estimate the size of queued device data
+/// @param binary true for binary format, false for JSON
+/// @return estimated size in bytes
+uint32_t DeviceIdentMgr::estimateQueuedDeviceDataSize(bool binary) const
+{
+    uint32_t numAddresses = 0;
+    uint32_t numResponses = 0;
+    uint32_t responseBytes = _busStatusMgr.getQueuedPollResponsesSize(numAddresses, numResponses);
+    if (binary)
+        return responseBytes + numAddresses * BINARY_EST_BYTES_PER_DEVICE;
+    return responseBytes * JSON_EST_BYTES_PER_RESPONSE_BYTE + numAddresses * JSON_EST_BYTES_PER_DEVICE + JSON_EST_BYTES_HEADER;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -397,17 +879,80 @@ uint32_t DeviceIdentMgr::getDecodedPollResponses(BusElemAddrType address,
                 void* pStructOut, uint32_t structOutSize, 
                 uint16_t maxRecCount, RaftBusDeviceDecodeState& decodeState) const
 {
-    // Get poll result for each address
-    bool isOnline = false;
-    uint16_t deviceTypeIndex = 0;
-    std::vector<uint8_t> devicePollResponseData;
-    uint32_t responseSize = 0;
-    _busStatusMgr.getBusElemPollResponses(address, isOnline, deviceTypeIndex, devicePollResponseData, responseSize, 0);
+    // Decode poll responses in place (only as many responses as can be decoded are consumed)
+    uint32_t numDecoded = 0;
+    _busStatusMgr.visitBusElemPollResponses(address, maxRecCount,
+        [this, pStructOut, structOutSize, maxRecCount, &decodeState, &numDecoded](bool isOnline, uint16_t deviceTypeIndex, 
+                    const std::vector<uint8_t>& devicePollResponseData, uint32_t responseSize, uint32_t numResponses)
+        {
+            numDecoded = decodePollResponses(deviceTypeIndex, devicePollResponseData.data(), devicePollResponseData.size(), 
+                        pStructOut, structOutSize, 
+                        maxRecCount, decodeState);
+        });
+    return numDecoded;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get decoded poll responses as columns (one array per attribute in the response schema)
+/// @param address address of device to get data from
+/// @param pTimeMsCol (out) array to receive timestamps (ms) - may be nullptr
+/// @param pAttrCols (out) arrays to receive attribute values (in schema order) - nullptr entries are skipped
+/// @param numAttrCols number of entries in pAttrCols (attributes beyond this are not decoded)
+/// @param maxRecCount maximum number of records to decode (size of each array)
+/// @param decodeState decode state for this device
+/// @return number of records decoded
+uint32_t DeviceIdentMgr::getDecodedPollResponsesColumns(BusElemAddrType address, 
+                uint32_t* pTimeMsCol, float* const* pAttrCols, uint32_t numAttrCols,
+                uint16_t maxRecCount, RaftBusDeviceDecodeState& decodeState) const
+{
+    // Get the batch decoder for the device type and check it matches the device's poll results (before
+    // consuming any responses)
+    uint32_t pollResultSize = 0;
+    uint16_t deviceTypeIndex = _busStatusMgr.getDeviceTypeIndexByAddr(address, &pollResultSize);
+    if (!_batchDecoderCacheMutex || (xSemaphoreTake(_batchDecoderCacheMutex, pdMS_TO_TICKS(10)) != pdTRUE))
+        return 0;
+    const BatchDecoderCacheEntry* pCacheEntry = getBatchDecoder(deviceTypeIndex);
+    if (!pCacheEntry || (pCacheEntry->decoder.getRecordSize() != pollResultSize))
+    {
+        xSemaphoreGive(_batchDecoderCacheMutex);
+        return 0;
+    }
+    const PollRecordBatchDecoder& decoder = pCacheEntry->decoder;
+
+    // Columns beyond those supplied are skipped
+    float* attrCols[PollRecordBatchDecoder::MAX_ATTRS] = {};
+    for (uint32_t i = 0; (i < numAttrCols) && (i < decoder.getNumAttrs()); i++)
+        attrCols[i] = pAttrCols ? pAttrCols[i] : nullptr;
+
+    // Decode
+    uint32_t numDecoded = 0;
+    _busStatusMgr.visitBusElemPollResponses(address, maxRecCount,
+        [&decoder, pTimeMsCol, &attrCols, maxRecCount, &decodeState, &numDecoded](bool isOnline, uint16_t deviceTypeIndex, 
+                    const std::vector<uint8_t>& devicePollResponseData, uint32_t responseSize, uint32_t numResponses)
+        {
+            numDecoded = decoder.decode(devicePollResponseData.data(), devicePollResponseData.size(), 
+                        pTimeMsCol, attrCols, maxRecCount, decodeState);
+        });
+    xSemaphoreGive(_batchDecoderCacheMutex);
+    return numDecoded;
+}
 
-    // Decode the poll response
-    return decodePollResponses(deviceTypeIndex, devicePollResponseData.data(), responseSize, 
-                pStructOut, structOutSize, 
-                maxRecCount, decodeState);
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get names of the columns returned by getDecodedPollResponsesColumns()
+/// @param address address of device
+/// @param attrNames (out) attribute names (in schema order)
+/// @return true if the device responses can be decoded into columns
+bool DeviceIdentMgr::getDecodedPollResponsesColumnNames(BusElemAddrType address, std::vector<String>& attrNames) const
+{
+    attrNames.clear();
+    uint16_t deviceTypeIndex = _busStatusMgr.getDeviceTypeIndexByAddr(address);
+    if (!_batchDecoderCacheMutex || (xSemaphoreTake(_batchDecoderCacheMutex, pdMS_TO_TICKS(10)) != pdTRUE))
+        return false;
+    const BatchDecoderCacheEntry* pCacheEntry = getBatchDecoder(deviceTypeIndex);
+    if (pCacheEntry)
+        attrNames = pCacheEntry->attrNames;
+    xSemaphoreGive(_batchDecoderCacheMutex);
+    return pCacheEntry != nullptr;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -415,6 +960,8 @@ uint32_t DeviceIdentMgr::getDecodedPollResponses(BusElemAddrType address,
 /// @return JSON string
 String DeviceIdentMgr::getDebugJSON(bool includeBraces) const
 {
+    if (_busDebugJSONFn)
+        return _busDebugJSONFn(includeBraces);
     return _busStatusMgr.getDebugJSON(includeBraces);
 }
 
@@ -444,3 +991,32 @@ uint32_t DeviceIdentMgr::decodePollResponses(uint16_t deviceTypeIndex,
     // Decode the poll response
     return devTypeRec.pollResultDecodeFn(pPollBuf, pollBufLen, pStructOut, structOutSize, maxRecCount, decodeState);
 }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get batch decoder for a device type (set up from the response schema on first use) - the caller must hold
+// _batchDecoderCacheMutex while the entry is in use
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+const DeviceIdentMgr::BatchDecoderCacheEntry* DeviceIdentMgr::getBatchDecoder(uint16_t deviceTypeIndex) const
+{
+    // Check valid
+    if ((deviceTypeIndex == DeviceStatus::DEVICE_TYPE_INDEX_INVALID) || (deviceTypeIndex >= DETECTION_RECS_CACHE_MAX_TYPES))
+        return nullptr;
+
+    // Set up on first use
+    if (deviceTypeIndex >= _batchDecoderCache.size())
+        _batchDecoderCache.resize(deviceTypeIndex + 1);
+    BatchDecoderCacheEntry& cacheEntry = _batchDecoderCache[deviceTypeIndex];
+    if (!cacheEntry.isValid)
+    {
+        DeviceTypeRecord devTypeRec;
+        if (deviceTypeRecords.getDeviceInfo(deviceTypeIndex, devTypeRec))
+            cacheEntry.isDecodable = cacheEntry.decoder.setupFromDevInfoJson(devTypeRec.devInfoJson, &cacheEntry.attrNames);
+        cacheEntry.isValid = true;
+#ifdef DEBUG_DEVICE_IDENT_MGR
+        LOG_I(MODULE_PREFIX, "getBatchDecoder typeIdx %d %s numAttrs %d", deviceTypeIndex, 
+                    cacheEntry.isDecodable ? "OK" : "NOT DECODABLE", cacheEntry.decoder.getNumAttrs());
+#endif
+    }
+    return cacheEntry.isDecodable ? &cacheEntry : nullptr;
+}
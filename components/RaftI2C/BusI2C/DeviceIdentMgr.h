@@ -13,9 +13,16 @@
 #include "BusStatusMgr.h"
 #include "DeviceStatus.h"
 #include "RaftJson.h"
+#include "DeviceDataSink.h"
+#include "DeviceDataCompactBinary.h"
+#include "PollRecordBatchDecoder.h"
+#include "BusI2CMemPlacement.h"
 #include <vector>
 #include <list>
 
+// Bus debug JSON function (debug info for the whole bus which includes the bus status manager's)
+typedef std::function<String(bool includeBraces)> BusDebugJSONFn;
+
 class DeviceIdentMgr : public RaftBusDevicesIF
 {
 public:
@@ -23,7 +30,9 @@ public:
     /// @brief Constructor
     /// @param busStatusMgr bus status manager
     /// @param busReqSyncFn bus synchronous access request function
-    DeviceIdentMgr(BusStatusMgr& busStatusMgr, BusReqSyncFn busReqSyncFn);
+    /// @param busDebugJSONFn bus debug JSON function (if nullptr only the bus status manager's debug JSON is used)
+    DeviceIdentMgr(BusStatusMgr& busStatusMgr, BusReqSyncFn busReqSyncFn, BusDebugJSONFn busDebugJSONFn = nullptr);
+    virtual ~DeviceIdentMgr();
 
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Setup
@@ -68,6 +77,24 @@ public:
     /// @return Binary data vector
     virtual std::vector<uint8_t> getQueuedDeviceDataBinary(uint32_t connMode) const override final;
 
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Write queued device data in JSON format to a sink
+    /// @param sink sink to write to
+    void getQueuedDeviceDataJson(DeviceDataSink& sink) const;
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Write queued device data in binary format to a sink
+    /// @param connMode connection mode (inc bus number - DeviceDataCompactBinary::CONN_MODE_COMPACT_FLAG selects
+    ///                 the compact format)
+    /// @param sink sink to write to
+    void getQueuedDeviceDataBinary(uint32_t connMode, DeviceDataSink& sink) const;
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Estimate the size of queued device data (so that a single allocation can hold a whole publish)
+    /// @param binary true for binary format, false for JSON
+    /// @return estimated size in bytes
+    uint32_t estimateQueuedDeviceDataSize(bool binary) const;
+
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Get decoded poll responses
     /// @param address address of device to get data from
@@ -82,6 +109,30 @@ public:
                     void* pStructOut, uint32_t structOutSize, 
                     uint16_t maxRecCount, RaftBusDeviceDecodeState& decodeState) const override final;
 
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get decoded poll responses as columns (one array per attribute in the response schema)
+    /// @param address address of device to get data from
+    /// @param pTimeMsCol (out) array to receive timestamps (ms) - may be nullptr
+    /// @param pAttrCols (out) arrays to receive attribute values (in schema order) - nullptr entries are skipped
+    /// @param numAttrCols number of entries in pAttrCols (attributes beyond this are not decoded)
+    /// @param maxRecCount maximum number of records to decode (size of each array)
+    /// @param decodeState decode state for this device
+    /// @return number of records decoded
+    /// @note this decodes from the schema in the device type info (so doesn't need a generated decode function) but
+    ///       schemas with custom decode code can't be decoded this way (0 is returned and no responses are consumed).
+    ///       Responses are also left in place (and 0 returned) if the device's poll result size doesn't match the
+    ///       schema
+    uint32_t getDecodedPollResponsesColumns(BusElemAddrType address, 
+                    uint32_t* pTimeMsCol, float* const* pAttrCols, uint32_t numAttrCols,
+                    uint16_t maxRecCount, RaftBusDeviceDecodeState& decodeState) const;
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get names of the columns returned by getDecodedPollResponsesColumns()
+    /// @param address address of device
+    /// @param attrNames (out) attribute names (in schema order)
+    /// @return true if the device responses can be decoded into columns
+    bool getDecodedPollResponsesColumnNames(BusElemAddrType address, std::vector<String>& attrNames) const;
+
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Handle poll results
     /// @param timeNowUs time in us (passed in to aid testing)
@@ -113,17 +164,91 @@ public:
     virtual String getDebugJSON(bool includeBraces) const override final;
 
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-    /// @brief Identify device
+    /// @brief Identify device (performs all steps of identification, blocking while waits are required)
     /// @param 
     /// @param deviceStatus (out) device status
-    void identifyDevice(BusElemAddrType address, DeviceStatus& deviceStatus);
+    /// @param deviceTypeIdxHint device type to check first (e.g. from a cached topology) or UINT16_MAX if none
+    void identifyDevice(BusElemAddrType address, DeviceStatus& deviceStatus, uint16_t deviceTypeIdxHint = UINT16_MAX);
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Queue incremental identification of a device (performed by stepIdentify - restarts identification
+    ///        if the address is already queued)
+    /// @param address address
+    /// @param deviceTypeIdxHint device type to check first (e.g. from a cached topology) or UINT16_MAX if none
+    void queueIdentify(BusElemAddrType address, uint16_t deviceTypeIdxHint = UINT16_MAX);
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Cancel incremental identification of a device (e.g. when it goes offline)
+    /// @param address address
+    void cancelIdentify(BusElemAddrType address);
+
+    // Check if any incremental identification is in progress
+    bool isIdentPending() const
+    {
+        return _identJobs.size() > 0;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the address of the next identification step which is ready to perform (in the order queued)
+    /// @param timeNowUs time now
+    /// @param address (out) address (the caller enables its slot before calling stepIdentify)
+    /// @return true if a step is ready
+    bool getNextIdentStepAddr(uint64_t timeNowUs, BusElemAddrType& address) const;
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get time until the next identification step is ready
+    /// @param timeNowUs time now
+    /// @return time in ms (0 if ready now, UINT32_MAX if no identification in progress)
+    uint32_t getMsUntilIdentStepDue(uint64_t timeNowUs) const;
+
+    // Result of an identification step
+    enum IdentStepResult
+    {
+        IDENT_STEP_PERFORMED,
+        IDENT_STEP_WAITING,
+        IDENT_STEP_COMPLETE,
+    };
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Perform one step of incremental identification (at most one detection read or init write)
+    /// @param timeNowUs time now
+    /// @param address address (slot must be enabled if it is on a bus extender)
+    /// @param deviceStatus (out) device status (set when the result is IDENT_STEP_COMPLETE - device type is
+    ///        invalid if the device wasn't identified)
+    /// @return result
+    IdentStepResult stepIdentify(uint64_t timeNowUs, BusElemAddrType address, DeviceStatus& deviceStatus);
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get hash of the device type table (used to check a cached topology is still valid)
+    /// @return hash
+    uint32_t getDeviceTypeTableHash() const;
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get version of the device type info (clients which have cached type info can skip refetching
+    ///        while this is unchanged - it is published with the queued device data as "_tv")
+    /// @return version (the device type table hash - computed once)
+    uint32_t getDevTypeInfoVersion() const;
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the bus frequency a device type can be accessed at
+    /// @param deviceTypeIdx device type index
+    /// @return frequency (from i2cFreq in the device type info) or 0 if not specified
+    uint32_t getDeviceTypeI2CFreq(uint16_t deviceTypeIdx) const;
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the transaction overhead (max clock stretching, etc) of a device type
+    /// @param deviceTypeIdx device type index
+    /// @return overhead in us (from i2cStretchUs in the device type info) or 0 if not specified
+    uint32_t getDeviceTypeI2CStretchUs(uint16_t deviceTypeIdx) const;
 
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Check device type match (communicates with the device to check its type)
     /// @param address address
     /// @param pDevTypeRec device type record
+    /// @param deviceTypeIdx index of device type (used to cache parsed detection records - UINT16_MAX if unknown)
     /// @return true if device type matches
-    bool checkDeviceTypeMatch(BusElemAddrType address, const DeviceTypeRecord* pDevTypeRec);
+    bool checkDeviceTypeMatch(BusElemAddrType address, const DeviceTypeRecord* pDevTypeRec, 
+                uint16_t deviceTypeIdx = UINT16_MAX);
 
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Process device initialisation
@@ -136,12 +261,118 @@ private:
     // Device indentification enabled
     bool _isEnabled = false;
 
+    // Incremental identification - each job steps through the candidate device types for an address, checking
+    // one detection record at a time and then performing one init request at a time (pauses between steps are
+    // waits rather than delays so other work on the bus continues)
+    class IdentJob
+    {
+    public:
+        BusElemAddrType address = 0;
+        std::vector<uint16_t> deviceTypeIdxs;
+        uint32_t typeListPos = 0;
+        uint32_t detectionRecPos = 0;
+        bool detectionValuesMatch = true;
+        bool isInitialising = false;
+        std::vector<BusRequestInfo> initBusRequests;
+        uint32_t initReqPos = 0;
+        uint64_t waitStartUs = 0;
+        uint32_t waitUs = 0;
+        void nextType()
+        {
+            typeListPos++;
+            detectionRecPos = 0;
+            detectionValuesMatch = true;
+            isInitialising = false;
+            initBusRequests.clear();
+            initReqPos = 0;
+        }
+        void startWait(uint64_t timeNowUs, uint32_t waitMs)
+        {
+            waitStartUs = timeNowUs;
+            waitUs = waitMs * 1000;
+        }
+        bool isWaiting(uint64_t timeNowUs) const
+        {
+            return (waitUs != 0) && (timeNowUs - waitStartUs < waitUs);
+        }
+    };
+    std::vector<IdentJob> _identJobs;
+    static const uint32_t IDENT_JOBS_MAX = 50;
+
+    // Check one detection record (returns result of the bus access, checkValueMatch is set if ok)
+    RaftRetCode checkDetectionRec(BusElemAddrType address, const DeviceTypeRecords::DeviceDetectionRec& detectionRec,
+                bool& checkValueMatch);
+
+    // Set device status for an identified device
+    void setIdentifiedDeviceStatus(BusElemAddrType address, const DeviceTypeRecord* pDevTypeRec, 
+                uint16_t deviceTypeIdx, DeviceStatus& deviceStatus);
+
     // Bus status
     BusStatusMgr& _busStatusMgr;
 
     // Bus request function
     BusReqSyncFn _busReqSyncFn = nullptr;
 
+    // Bus debug JSON function
+    BusDebugJSONFn _busDebugJSONFn = nullptr;
+
+    // Parsed detection records for each device type index - device type records are immutable so these are
+    // parsed from the device type strings the first time a type is checked and then reused
+    class DetectionRecsCacheEntry
+    {
+    public:
+        bool isValid = false;
+        std::vector<DeviceTypeRecords::DeviceDetectionRec> detectionRecs;
+    };
+    std::vector<DetectionRecsCacheEntry, BusI2CBulkAllocator<DetectionRecsCacheEntry>> _detectionRecsCache;
+    static const uint32_t DETECTION_RECS_CACHE_MAX_TYPES = 1000;
+    const std::vector<DeviceTypeRecords::DeviceDetectionRec>& getDetectionRecs(const DeviceTypeRecord* pDevTypeRec, 
+                uint16_t deviceTypeIdx, std::vector<DeviceTypeRecords::DeviceDetectionRec>& uncachedRecs);
+
+    // Detection read data (storage reused between checks)
+    std::vector<uint8_t> _detectionReadData;
+
+    // Batch decoders for each device type index - set up from the response schema on first use. The decoding
+    // functions may be called from API handlers on any task so the cache is protected by a mutex which is held
+    // while a decoder is in use (entries move when the cache grows)
+    class BatchDecoderCacheEntry
+    {
+    public:
+        bool isValid = false;
+        bool isDecodable = false;
+        PollRecordBatchDecoder decoder;
+        std::vector<String> attrNames;
+    };
+    mutable std::vector<BatchDecoderCacheEntry, BusI2CBulkAllocator<BatchDecoderCacheEntry>> _batchDecoderCache;
+    mutable SemaphoreHandle_t _batchDecoderCacheMutex = nullptr;
+    const BatchDecoderCacheEntry* getBatchDecoder(uint16_t deviceTypeIndex) const;
+
+    // Device type info JSON for recently requested device types (keyed on type index and plug and play info)
+    // reused as device type records are immutable - the least recently used entry is replaced when the cache is
+    // full. The cache and name index are accessed from API handlers as well as the main loop so are protected
+    // by a mutex
+    class DevTypeInfoJsonCacheEntry
+    {
+    public:
+        uint16_t deviceTypeIdx = DeviceStatus::DEVICE_TYPE_INDEX_INVALID;
+        bool includePlugAndPlayInfo = false;
+        uint32_t lastUsed = 0;
+        String devTypeInfoJson;
+    };
+    static const uint32_t DEV_TYPE_INFO_JSON_CACHE_SIZE = 8;
+    mutable DevTypeInfoJsonCacheEntry _devTypeInfoJsonCache[DEV_TYPE_INFO_JSON_CACHE_SIZE];
+    mutable uint32_t _devTypeInfoJsonCacheUseCounter = 0;
+    mutable SemaphoreHandle_t _devTypeInfoCacheMutex = nullptr;
+
+    // Device type indices sorted by device type name (built on first lookup by name)
+    mutable std::vector<uint16_t, BusI2CBulkAllocator<uint16_t>> _devTypeNameIndex;
+    mutable bool _devTypeNameIndexValid = false;
+    uint16_t findDeviceTypeIdxByName(const char* pDeviceType) const;
+
+    // Device type info version (computed on first use - protected by the type info cache mutex)
+    mutable uint32_t _devTypeInfoVersion = 0;
+    mutable bool _devTypeInfoVersionValid = false;
+
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Format device status to JSON
     /// @param address address
@@ -149,9 +380,12 @@ private:
     /// @param deviceTypeIndex index of device type
     /// @param devicePollResponseData poll response data
     /// @param responseSize size of poll response data
-    /// @return JSON string
+    /// @param extraJson further members (poll group responses as ,"name":"hex" and the repeat count as ,"_r":N)
+    ///        - empty if none
+    /// @return JSON string ("addr":{...} - empty if the device type is unknown)
     String deviceStatusToJson(BusElemAddrType address, bool isOnline, uint16_t deviceTypeIndex, 
-                    const std::vector<uint8_t>& devicePollResponseData, uint32_t responseSize) const;
+                    const std::vector<uint8_t>& devicePollResponseData, uint32_t responseSize,
+                    const String& extraJson) const;
 
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Decode one or more poll responses for a device
@@ -167,6 +401,12 @@ private:
                     void* pStructOut, uint32_t structOutSize, 
                     uint16_t maxRecCount, RaftBusDeviceDecodeState& decodeState) const;
 
+    // Size estimates for published data (JSON poll data is hex encoded)
+    static const uint32_t JSON_EST_BYTES_PER_DEVICE = 64;
+    static const uint32_t JSON_EST_BYTES_PER_RESPONSE_BYTE = 2;
+    static const uint32_t JSON_EST_BYTES_HEADER = 20;
+    static const uint32_t BINARY_EST_BYTES_PER_DEVICE = 16;
+
     // Debug
     static constexpr const char* MODULE_PREFIX = "RaftDevIdentMgr";
 };
@@ -0,0 +1,137 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Device Poll Group
+// Additional polls of a device each with its own interval, result size and storage
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "RaftJson.h"
+#include "RaftJsonPrefixed.h"
+#include "Logger.h"
+#include "DevicePollingInfo.h"
+#include "DeviceTypeRecords.h"
+#include "PollRecordBatchDecoder.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class DevicePollGroup
+/// @brief Definition of a poll group
+/// @note The ident poll of a device type is group 0 (stored in the device status and published as "x"). Further
+///       groups are defined in the "g" array of the device type's pollInfo - each has its own poll requests ("c"),
+///       interval ("i") and number of results stored ("s") and is published under its name ("n" - default g1, g2
+///       ...) e.g. "pollInfo":{"c":"0x3b=r6","i":10,"s":20,"g":[{"n":"temp","c":"0x41=r2","i":1000,"s":2},
+///       {"n":"fifo","c":"0x72=r2&0x74=r192","i":50,"s":4,"v":{"at":0,"t":">H","x":6}}]}. With "v" the read length
+///       of the group's last request is a count read earlier in the same poll (at byte offset "at" of type "t")
+///       multiplied by "x" and limited to the length in "c" - results are stored at the maximum size with unread
+///       bytes zeroed (the count in the result gives the valid length)
+class DevicePollGroup
+{
+public:
+    // Name
+    String name;
+
+    // Poll requests, interval and result size (including the timestamp)
+    DevicePollingInfo pollInfo;
+
+    // Variable length read of the last request (the count is read by the requests before it)
+    class VarLenRead
+    {
+    public:
+        bool isVarLen = false;
+        PollRecordBatchDecoder::AttrDesc countAttr;
+        uint32_t bytesPerCount = 1;
+
+        /////////////////////////////////////////////////////////////////////////////////////////////////////////
+        /// @brief Get the read length of the last request
+        /// @param pRecData data read so far (after the timestamp - must include the count)
+        /// @param maxReadLen max read length (from the request)
+        /// @return read length
+        uint32_t getReadLen(const uint8_t* pRecData, uint32_t maxReadLen) const
+        {
+            int64_t count = PollRecordBatchDecoder::readRawValue(pRecData, countAttr);
+            if (count <= 0)
+                return 0;
+            uint64_t readLen = (uint64_t)count * bytesPerCount;
+            return readLen < maxReadLen ? readLen : maxReadLen;
+        }
+    };
+    VarLenRead varLenRead;
+
+    // Max number of groups (including group 0)
+    static const uint32_t MAX_POLL_GROUPS = 8;
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get poll groups (other than group 0) for a device
+    /// @param address address of the device
+    /// @param devTypeRec device type record
+    /// @param groups (out) groups (element i is group i+1)
+    static void getPollGroups(BusElemAddrType address, const DeviceTypeRecord& devTypeRec,
+                std::vector<DevicePollGroup>& groups)
+    {
+        groups.clear();
+        if (!devTypeRec.pollInfo)
+            return;
+        RaftJson pollInfoJson(devTypeRec.pollInfo, false);
+        std::vector<String> groupConfigs;
+        pollInfoJson.getArrayElems("g", groupConfigs);
+        for (const String& groupConfigStr : groupConfigs)
+        {
+            // The poll requests are parsed as for the ident poll (using a copy of the record with this group's
+            // pollInfo) and the result size is from the read lengths
+            if (groups.size() + 1 >= MAX_POLL_GROUPS)
+                break;
+            DeviceTypeRecord groupTypeRec = devTypeRec;
+            groupTypeRec.pollInfo = groupConfigStr.c_str();
+            DevicePollGroup group;
+            deviceTypeRecords.getPollInfo(address, &groupTypeRec, group.pollInfo);
+            uint32_t readLen = 0;
+            for (const BusRequestInfo& pollReq : group.pollInfo.pollReqs)
+                readLen += pollReq.getReadReqLen();
+            RaftJson groupConfig(groupConfigStr);
+            group.name = groupConfig.getString("n", ("g" + String(groups.size() + 1)).c_str());
+            if ((group.pollInfo.pollReqs.size() == 0) || (readLen == 0) ||
+                        (group.pollInfo.numPollResultsToStore == 0) ||
+                        !group.setupVarLen(RaftJsonPrefixed(groupConfig, "v")))
+            {
+                LOG_W(MODULE_PREFIX, "getPollGroups %s group %s INVALID", devTypeRec.deviceType, group.name.c_str());
+                continue;
+            }
+            group.pollInfo.pollResultSizeIncTimestamp = readLen + DevicePollingInfo::POLL_RESULT_TIMESTAMP_SIZE;
+            groups.push_back(group);
+        }
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup variable length read
+    /// @param config variable length config ("v" section - e.g. {"at":0,"t":">H","x":6}) - empty for fixed length
+    /// @return false if the config is invalid
+    bool setupVarLen(const RaftJsonIF& config)
+    {
+        varLenRead = VarLenRead();
+        String countType = config.getString("t", "");
+        if (countType.length() == 0)
+            return true;
+        if (!PollRecordBatchDecoder::parseValueType(countType.c_str(), varLenRead.countAttr))
+            return false;
+        varLenRead.countAttr.offset = config.getLong("at", 0);
+        varLenRead.bytesPerCount = config.getLong("x", 1);
+
+        // The count must be read by the requests before the last
+        uint32_t countReadLen = 0;
+        for (uint32_t i = 0; i + 1 < pollInfo.pollReqs.size(); i++)
+            countReadLen += pollInfo.pollReqs[i].getReadReqLen();
+        if (varLenRead.countAttr.offset + PollRecordBatchDecoder::getValueSize(varLenRead.countAttr.valueType) > countReadLen)
+            return false;
+        varLenRead.isVarLen = true;
+        return true;
+    }
+
+private:
+    // Debug
+    static constexpr const char* MODULE_PREFIX = "RaftI2CPollGroup";
+};
@@ -11,15 +11,50 @@
 
 // #define DEBUG_POLL_REQUEST
 // #define DEBUG_POLL_RESULT
+// #define DEBUG_SYNC_SAMPLE
+
+// Count heap allocations made by the I2C task while polling (requires CONFIG_HEAP_USE_HOOKS)
+// #define DEBUG_POLL_HEAP_ALLOC_COUNT
+
+#ifdef DEBUG_POLL_HEAP_ALLOC_COUNT
+#include "RaftArduino.h"
+static volatile TaskHandle_t _debugPollHeapAllocTask = nullptr;
+static volatile uint32_t _debugPollHeapAllocCount = 0;
+extern "C" void esp_heap_trace_alloc_hook(void* ptr, size_t size, uint32_t caps)
+{
+    if (_debugPollHeapAllocTask && (xTaskGetCurrentTaskHandle() == _debugPollHeapAllocTask))
+        _debugPollHeapAllocCount = _debugPollHeapAllocCount + 1;
+}
+static const uint32_t DEBUG_POLL_HEAP_ALLOC_REPORT_MS = 10000;
+
+// Counts allocations by the current task while in scope (so every exit from a poll stops counting)
+class DebugPollHeapAllocGuard
+{
+public:
+    DebugPollHeapAllocGuard()
+    {
+        _debugPollHeapAllocTask = xTaskGetCurrentTaskHandle();
+    }
+    ~DebugPollHeapAllocGuard()
+    {
+        _debugPollHeapAllocTask = nullptr;
+    }
+};
+#endif
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Constructor
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-DevicePollingMgr::DevicePollingMgr(BusStatusMgr& busStatusMgr, BusMultiplexers& BusMultiplexers, BusReqSyncFn busI2CReqSyncFn) :
+DevicePollingMgr::DevicePollingMgr(BusStatusMgr& busStatusMgr, BusMultiplexers& BusMultiplexers, BusReqSyncFn busI2CReqSyncFn,
+            BusReqSyncBatchFn busI2CReqSyncBatchFn, const BusI2CSyncSample* pSyncSample, 
+            BusGeneralCallFn busGeneralCallFn) :
     _busStatusMgr(busStatusMgr),
     _busMultiplexers(BusMultiplexers),
-    _busReqSyncFn(busI2CReqSyncFn)
+    _busReqSyncFn(busI2CReqSyncFn),
+    _busReqSyncBatchFn(busI2CReqSyncBatchFn),
+    _pSyncSample(pSyncSample),
+    _busGeneralCallFn(busGeneralCallFn)
 {
 }
 
@@ -29,51 +64,295 @@ DevicePollingMgr::DevicePollingMgr(BusStatusMgr& busStatusMgr, BusMultiplexers&
 
 void DevicePollingMgr::setup(const RaftJsonIF& config)
 {
+    // Slot affinity
+    _slotAffinity = config.getBool("pollSlotAffinity", true);
+    _isSlotHeld = false;
+
+    // Slot groups
+    _slotGroups = _slotAffinity && config.getBool("pollSlotGroups", false);
+    _slotGroupsStatusTimeMs = 0;
+    _slotGroupsAddrCount = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Poll a device
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool DevicePollingMgr::pollDevice(uint64_t timeNowUs, BusElemAddrType address)
+{
+    if (_busStatusMgr.getIdentPoll(timeNowUs, address, _pollInfo))
+        return performPoll(timeNowUs, _pollInfo);
+    return true;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Service from I2C task
+// Poll a device's poll group
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void DevicePollingMgr::taskService(uint64_t timeNowUs)
+bool DevicePollingMgr::pollDeviceGroup(uint64_t timeNowUs, BusElemAddrType address, uint32_t groupIdx)
 {
-    // See if any devices need polling
-    DevicePollingInfo pollInfo;
-    if (_busStatusMgr.getPendingIdentPoll(timeNowUs, pollInfo))
+    if (_busStatusMgr.getPollGroup(address, groupIdx, _pollGroupInfo, _pollGroupVarLenRead))
+        return performPoll(timeNowUs, _pollGroupInfo, groupIdx, &_pollGroupVarLenRead);
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Sync sample
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool DevicePollingMgr::syncSample(uint64_t timeNowUs)
+{
+    if (!_pSyncSample || !_pSyncSample->isEnabled() || !_busGeneralCallFn)
+        return true;
+
+    // Skip the trigger if the previous readout hasn't completed
+    if (_syncReadoutPending)
     {
-        // Get the address and slot
-        if (pollInfo.pollReqs.size() == 0)
-            return;
-        BusElemAddrType address = pollInfo.pollReqs[0].getAddress();
-        BusI2CAddrAndSlot addrAndSlot = BusI2CAddrAndSlot::fromBusElemAddrType(address);
+#ifdef DEBUG_SYNC_SAMPLE
+        LOG_I(MODULE_PREFIX, "syncSample skipped - readout in progress");
+#endif
+        return true;
+    }
+
+    // Broadcast the trigger once with all of the slots enabled so every device (including those on the main
+    // bus) is triggered by the same broadcast (devices which don't support the general call don't acknowledge
+    // it so a NACK isn't a failure)
+    releaseSlot();
+    RaftRetCode rslt = _busMultiplexers.enableSlotSet(_pSyncSample->getSlots());
+    uint64_t triggerUs = micros();
+    if (rslt == RAFT_OK)
+    {
+        _pSyncSample->getTriggerData(triggerUs / 1000, _syncTriggerData);
+        rslt = _busGeneralCallFn(_syncTriggerData.data(), _syncTriggerData.size());
+    }
+    _busMultiplexers.disableAllSlots(false);
+
+#ifdef DEBUG_SYNC_SAMPLE
+    LOG_I(MODULE_PREFIX, "syncSample trigger numSlots %d rslt %s", _pSyncSample->getSlots().size(), Raft::getRetCodeStr(rslt));
+#endif
+    if ((rslt != RAFT_OK) && (rslt != RAFT_BUS_ACK_ERROR))
+        return false;
+
+    // Start the readout after the read delay (the addresses are obtained now so participants are fixed)
+    _syncAddrs.clear();
+    _busStatusMgr.getBusElemAddresses(_syncAddrs, false);
+    _syncTriggerUs = triggerUs;
+    _syncReadoutDueUs = triggerUs + _pSyncSample->getReadDelayMs() * 1000ULL;
+    _syncReadoutSlotIdx = 0;
+    _syncReadoutAddrIdx = 0;
+    _syncReadoutPending = true;
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Sync sample readout
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t DevicePollingMgr::syncReadout(uint64_t timeNowUs, uint32_t budgetUs)
+{
+    if (!isSyncReadoutDue(timeNowUs) || !_pSyncSample)
+        return 0;
+
+    // Read out the online participating devices slot by slot (resuming where the last call stopped)
+    uint64_t readoutStartUs = micros();
+    const std::vector<uint32_t>& slots = _pSyncSample->getSlots();
+    bool anyPolled = false;
+    while (_syncReadoutSlotIdx < slots.size())
+    {
+        uint32_t slotNum = slots[_syncReadoutSlotIdx];
+        while (_syncReadoutAddrIdx < _syncAddrs.size())
+        {
+            if (anyPolled && (micros() - readoutStartUs >= budgetUs))
+            {
+                releaseSlot();
+                return micros() - readoutStartUs;
+            }
+            BusElemAddrType address = _syncAddrs[_syncReadoutAddrIdx++];
+            if ((BusI2CAddrAndSlot::getSlotNum(address) != slotNum) || 
+                        (_busStatusMgr.isElemOnline(address) != BUS_OPERATION_OK))
+                continue;
+            if (_busStatusMgr.getIdentPoll(_syncTriggerUs, address, _pollInfo))
+            {
+                performPoll(_syncTriggerUs, _pollInfo);
+                anyPolled = true;
+            }
+        }
+        _syncReadoutSlotIdx++;
+        _syncReadoutAddrIdx = 0;
+    }
+    releaseSlot();
+    _syncReadoutPending = false;
+
+#ifdef DEBUG_SYNC_SAMPLE
+    LOG_I(MODULE_PREFIX, "syncReadout complete numAddrs %d sinceTriggerUs %d", 
+                _syncAddrs.size(), (int)(micros() - _syncTriggerUs));
+#endif
+    return micros() - readoutStartUs;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Probe a device (address only)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool DevicePollingMgr::probeDevice(BusElemAddrType address)
+{
+    // Enable the slot
+    BusI2CAddrAndSlot addrAndSlot = BusI2CAddrAndSlot::fromBusElemAddrType(address);
+    uint32_t slotKey = 0;
+    if (!enableSlotForAddress(addrAndSlot, slotKey))
+        return false;
+
+    // Zero length write - the device only needs to ACK its address
+    BusRequestInfo reqRec(BUS_REQ_TYPE_FAST_SCAN,
+                address,
+                0, 
+                0,
+                nullptr,
+                0,
+                0, 
+                nullptr, 
+                this);
+    RaftRetCode rslt = _busReqSyncFn(&reqRec, nullptr);
+
+#ifdef DEBUG_POLL_RESULT
+    LOG_I(MODULE_PREFIX, "probeDevice addr %s (%04x) rslt %s", 
+                    addrAndSlot.toString().c_str(), address, Raft::getRetCodeStr(rslt));
+#endif
+
+    finishSlotAccess(slotKey);
+    return rslt == RAFT_OK;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Release slot held from slot affinity polling
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void DevicePollingMgr::releaseSlot()
+{
+    if (!_isSlotHeld)
+        return;
+    _busMultiplexers.disableAllSlots(false);
+    _isSlotHeld = false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Update slot groups if the topology has changed
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void DevicePollingMgr::updateSlotGroups(const BusI2CClockSpeeds* pClockSpeeds)
+{
+    // Check if the bus elements have changed
+    if (!_slotGroups)
+        return;
+    uint64_t statusTimeMs = _busStatusMgr.getDeviceInfoTimestampMs(true, false);
+    uint32_t addrCount = _busStatusMgr.getAddrStatusCount();
+    if ((statusTimeMs == _slotGroupsStatusTimeMs) && (addrCount == _slotGroupsAddrCount))
+        return;
+
+    // All elements found (including those currently offline) are used so that a device which goes offline
+    // and returns can't conflict with another in its group
+    _slotGroupsAddrs.clear();
+    _busStatusMgr.getBusElemAddresses(_slotGroupsAddrs, false);
+    releaseSlot();
+    _busMultiplexers.updateSlotGroups(_slotGroupsAddrs, pClockSpeeds);
+    _slotGroupsStatusTimeMs = statusTimeMs;
+    _slotGroupsAddrCount = addrCount;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Perform ident poll (or poll group) and store result
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool DevicePollingMgr::performPoll(uint64_t timeNowUs, DevicePollingInfo& pollInfo, uint32_t groupIdx,
+                const DevicePollGroup::VarLenRead* pVarLenRead)
+{
+#ifdef DEBUG_POLL_HEAP_ALLOC_COUNT
+    DebugPollHeapAllocGuard debugPollHeapAllocGuard;
+    _debugPollCount++;
+#endif
+
+    // Get the address and slot
+    if (pollInfo.pollReqs.size() == 0)
+        return true;
+    BusElemAddrType address = pollInfo.pollReqs[0].getAddress();
+    BusI2CAddrAndSlot addrAndSlot = BusI2CAddrAndSlot::fromBusElemAddrType(address);
 
 #ifdef DEBUG_POLL_REQUEST
-        LOG_I(MODULE_PREFIX, "taskService poll %s (%04x)", addrAndSlot.toString().c_str(), address);
+    LOG_I(MODULE_PREFIX, "performPoll %s (%04x) group %d", addrAndSlot.toString().c_str(), address, groupIdx);
 #endif
 
-        // Enable the slot
-        auto rslt = _busMultiplexers.enableOneSlot(addrAndSlot.slotNum);
-        if (rslt != RAFT_OK)
-            return;
+    // Enable the slot
+    uint32_t slotKey = 0;
+    if (!enableSlotForAddress(addrAndSlot, slotKey))
+        return false;
 
-        // Prep poll req data
-        pollResultPrepare(timeNowUs, pollInfo);
+    // Prep poll req data
+    pollResultPrepare(timeNowUs, pollInfo);
 
+    // Perform all requests together if possible
+    bool allResultsOk = true;
+    bool isVarLen = pVarLenRead && pVarLenRead->isVarLen;
+    if (_busReqSyncBatchFn)
+    {
+        // Read data goes directly into the poll result - with a variable length read the requests before the last
+        // are performed first as the count they read sets the length of the last read (the result is padded to
+        // the max length with zeros)
+        uint32_t numReqs = pollInfo.pollReqs.size();
+        uint32_t numFirstReqs = isVarLen ? numReqs - 1 : numReqs;
+        uint32_t readBufLen = _pollDataResult.data() + _pollDataResult.size() - _pPollDataResult;
+        auto rslt = _busReqSyncBatchFn(pollInfo.pollReqs.data(), numFirstReqs, _pPollDataResult, readBufLen, UINT32_MAX);
+        if ((rslt == RAFT_OK) && isVarLen)
+        {
+            uint32_t firstReadLen = 0;
+            for (uint32_t reqIdx = 0; reqIdx < numFirstReqs; reqIdx++)
+                firstReadLen += pollInfo.pollReqs[reqIdx].getReadReqLen();
+            const BusRequestInfo& lastReqRec = pollInfo.pollReqs[numReqs - 1];
+            uint32_t maxReadLen = lastReqRec.getReadReqLen();
+            if (firstReadLen + maxReadLen > readBufLen)
+                rslt = RAFT_BUS_INVALID;
+            else
+            {
+                uint32_t readLen = pVarLenRead->getReadLen(_pPollDataResult, maxReadLen);
+                memset(_pPollDataResult + firstReadLen, 0, maxReadLen);
+                if (readLen > 0)
+                    rslt = _busReqSyncBatchFn(&lastReqRec, 1, _pPollDataResult + firstReadLen, 
+                                readBufLen - firstReadLen, readLen);
+            }
+        }
+
+#ifdef DEBUG_POLL_RESULT
+        String readDataHexStr;
+        Raft::getHexStrFromBytes(_pPollDataResult, readBufLen, readDataHexStr);
+        LOG_I(MODULE_PREFIX, "performPoll batch addr %s (%04x) numReqs %d readData %s rslt %s", 
+                        addrAndSlot.toString().c_str(),
+                        address,
+                        pollInfo.pollReqs.size(),
+                        readDataHexStr.c_str(),
+                        Raft::getRetCodeStr(rslt));
+#endif
+        allResultsOk = rslt == RAFT_OK;
+    }
+    else if (isVarLen)
+    {
+        // Variable length reads require the batch function
+        allResultsOk = false;
+    }
+    else
+    {
         // Loop through the requests
-        bool allResultsOk = true;
-        for (auto& busReqRec : pollInfo.pollReqs)
+        for (uint32_t reqIdx = 0; reqIdx < pollInfo.pollReqs.size(); reqIdx++)
         {
             // Perform the polling
-            std::vector<uint8_t> readData;
-            BusRequestInfo reqRec(busReqRec);
-            auto rslt = _busReqSyncFn(&reqRec, &readData);
+            const BusRequestInfo& busReqRec = pollInfo.pollReqs[reqIdx];
+            std::vector<uint8_t>& readData = _pollReadData;
+            auto rslt = _busReqSyncFn(&busReqRec, &readData);
 
 #ifdef DEBUG_POLL_RESULT
             String writeDataHexStr;
             Raft::getHexStrFromBytes(busReqRec.getWriteData(), busReqRec.getWriteDataLen(), writeDataHexStr);
             String readDataHexStr;
             Raft::getHexStrFromBytes(readData.data(), readData.size(), readDataHexStr);
-            LOG_I(MODULE_PREFIX, "taskService poll addr %s (%04x) writeData %s readData %s rslt %s", 
+            LOG_I(MODULE_PREFIX, "performPoll addr %s (%04x) writeData %s readData %s rslt %s", 
                             addrAndSlot.toString().c_str(),
                             address,
                             writeDataHexStr.c_str(),
@@ -90,12 +369,66 @@ void DevicePollingMgr::taskService(uint64_t timeNowUs)
             // Add to data aggregator
             pollResultAdd(pollInfo, readData);
         }
+    }
 
-        // Store the poll result if all requests succeeded
-        if (allResultsOk)
-            _busStatusMgr.handlePollResult(timeNowUs, address, _pollDataResult, &pollInfo);
+    // Store the poll result if all requests succeeded
+    if (allResultsOk && (groupIdx == 0))
+        _busStatusMgr.handlePollResult(timeNowUs, address, _pollDataResult, &pollInfo);
+    else if (allResultsOk)
+        _busStatusMgr.handlePollGroupResult(timeNowUs, address, groupIdx, _pollDataResult);
 
-        // Restore the bus multiplexers if necessary
+    // Restore the bus multiplexers (or hold the slot for further polls on it)
+    finishSlotAccess(slotKey);
+
+#ifdef DEBUG_POLL_HEAP_ALLOC_COUNT
+    if (Raft::isTimeout(millis(), _debugLastHeapAllocReportMs, DEBUG_POLL_HEAP_ALLOC_REPORT_MS))
+    {
+        LOG_I(MODULE_PREFIX, "performPoll heap allocs %d in %d polls", _debugPollHeapAllocCount, _debugPollCount);
+        _debugLastHeapAllocReportMs = millis();
+        _debugPollHeapAllocCount = 0;
+        _debugPollCount = 0;
+    }
+#endif
+
+    return allResultsOk;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Enable the slot (or slot group) for an address
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool DevicePollingMgr::enableSlotForAddress(const BusI2CAddrAndSlot& addrAndSlot, uint32_t& slotKey)
+{
+    // Release a slot held from a previous poll if this poll is on a different slot or slot group (slots on
+    // different multiplexers could otherwise be enabled together)
+    slotKey = getSlotKey(addrAndSlot.slotNum);
+    if (_isSlotHeld && (_heldSlotNum != slotKey))
+        releaseSlot();
+
+    // Enable the slot (no mux write is needed if the slot is still enabled from the previous poll)
+    auto rslt = _slotGroups ? _busMultiplexers.enableSlotGroup(addrAndSlot.slotNum) : 
+                _busMultiplexers.enableOneSlot(addrAndSlot.slotNum);
+    if (rslt != RAFT_OK)
+    {
+        releaseSlot();
+        return false;
+    }
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Restore the bus multiplexers after a poll (or hold the slot for further polls on it)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void DevicePollingMgr::finishSlotAccess(uint32_t slotKey)
+{
+    if (_slotAffinity)
+    {
+        _isSlotHeld = true;
+        _heldSlotNum = slotKey;
+    }
+    else
+    {
         _busMultiplexers.disableAllSlots(false);
     }
 }
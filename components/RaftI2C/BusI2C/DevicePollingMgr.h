@@ -11,23 +11,92 @@
 #include "RaftJson.h"
 #include "BusStatusMgr.h"
 #include "BusMultiplexers.h"
+#include "BusI2CAddrAndSlot.h"
+#include "BusI2CSyncSample.h"
+#include "DevicePollGroup.h"
+
+// Bus request batch function (synchronous) - read data for all requests is stored sequentially in pReadBuf
+// and the read of the last request is limited to maxLastReadLen (used for variable length reads)
+typedef std::function<RaftRetCode(const BusRequestInfo* pReqRecs, uint32_t numReqs, 
+                uint8_t* pReadBuf, uint32_t readBufLen, uint32_t maxLastReadLen)> BusReqSyncBatchFn;
+
+// General call function (synchronous broadcast to address 0x00 on the main bus and enabled slots)
+typedef std::function<RaftRetCode(const uint8_t* pData, uint32_t dataLen)> BusGeneralCallFn;
 
 class DevicePollingMgr
 {
 public:
     // Constructor
-    DevicePollingMgr(BusStatusMgr& busStatusMgr, BusMultiplexers& BusMultiplexers, BusReqSyncFn busI2CReqSyncFn);
+    // Sync sampling requires the sync sample settings and the general call function
+    DevicePollingMgr(BusStatusMgr& busStatusMgr, BusMultiplexers& BusMultiplexers, BusReqSyncFn busI2CReqSyncFn,
+                BusReqSyncBatchFn busI2CReqSyncBatchFn = nullptr, const BusI2CSyncSample* pSyncSample = nullptr,
+                BusGeneralCallFn busGeneralCallFn = nullptr);
 
     // Setup
     void setup(const RaftJsonIF& config);
 
-    // Service from I2C task
-    void taskService(uint64_t timeNowUs);
+    // Poll a device (the poll scheduler has determined that the device's ident poll is due)
+    // With slot affinity the slot is left enabled after the poll (so further polls on the same slot don't need
+    // mux writes) and releaseSlot() must be called once the polls for this loop are complete
+    // Returns false if the poll failed (true if it succeeded or the device has no ident poll)
+    bool pollDevice(uint64_t timeNowUs, BusElemAddrType address);
+
+    // Poll a device's poll group (1 onwards - the poll scheduler has determined that the group's poll is due)
+    // Slot affinity applies as for pollDevice() - returns false if the poll failed
+    bool pollDeviceGroup(uint64_t timeNowUs, BusElemAddrType address, uint32_t groupIdx);
+
+    // Sync sample - broadcast the trigger once with all of the sync sample slots enabled and start the readout
+    // which is due after the sync sample read delay (a trigger due while the previous readout is in progress is
+    // skipped). Returns false if the trigger couldn't be sent
+    bool syncSample(uint64_t timeNowUs);
+
+    // Sync sample readout - poll participating devices (with the time of the trigger as the timestamp of their
+    // results) until budgetUs of bus time has been used (at least one device is polled) - the readout continues
+    // on following calls until all devices have been polled. Returns the bus time used (us)
+    uint32_t syncReadout(uint64_t timeNowUs, uint32_t budgetUs);
+
+    // Check if a sync sample readout is due
+    bool isSyncReadoutDue(uint64_t timeNowUs) const
+    {
+        return _syncReadoutPending && (timeNowUs >= _syncReadoutDueUs);
+    }
+
+    // Get time until a sync sample readout is due (UINT32_MAX if no readout is pending)
+    uint32_t getMsUntilSyncReadoutDue(uint64_t timeNowUs) const
+    {
+        if (!_syncReadoutPending)
+            return UINT32_MAX;
+        return timeNowUs >= _syncReadoutDueUs ? 0 : (_syncReadoutDueUs - timeNowUs + 999) / 1000;
+    }
+
+    // Probe a device with an address-only access (used instead of a full poll while a device is quarantined)
+    // Slot affinity applies as for pollDevice() - returns true if the device responded
+    bool probeDevice(BusElemAddrType address);
+
+    // Release the slot (or slot group) held enabled from slot affinity polling (disables all slots)
+    void releaseSlot();
+
+    // Check if slot affinity (polls grouped by slot with the slot enabled once per group) is enabled
+    bool isSlotAffinity() const
+    {
+        return _slotAffinity;
+    }
+
+    // Update slot groups if the topology has changed (call before polls are grouped using getSlotKey()) - slots
+    // are only grouped with others of the same frequency
+    void updateSlotGroups(const BusI2CClockSpeeds* pClockSpeeds = nullptr);
+
+    // Get the key of the slot (or slot group) enabled to poll a device on the slot - polls with the same key
+    // can be performed without mux switching
+    uint32_t getSlotKey(uint32_t slotNum) const
+    {
+        return _slotGroups ? _busMultiplexers.getSlotGroupKey(slotNum) : slotNum;
+    }
 
     // Poll result handling
     void pollResultPrepare(uint64_t timeNowUs, const DevicePollingInfo& pollInfo)
     {
-        // Set buffer size
+        // Set buffer size (storage is retained between polls so this only allocates when a larger poll is seen)
         _pollDataResult.resize(pollInfo.pollResultSizeIncTimestamp);
         _pPollDataResult = _pollDataResult.data();
         
@@ -41,7 +110,7 @@ public:
         // Move the pointer to the start of the data
         _pPollDataResult += DevicePollingInfo::POLL_RESULT_TIMESTAMP_SIZE;
     }
-    void pollResultAdd(const DevicePollingInfo& pollInfo, std::vector<uint8_t>& readData)
+    void pollResultAdd(const DevicePollingInfo& pollInfo, const std::vector<uint8_t>& readData)
     {
         // Add the data to the poll data result
         if (_pPollDataResult + readData.size() <= _pollDataResult.data() + _pollDataResult.size())
@@ -53,6 +122,16 @@ public:
 
 private:
 
+    // Perform ident poll (or poll group if groupIdx is non-zero) and store result (returns false if the poll failed)
+    bool performPoll(uint64_t timeNowUs, DevicePollingInfo& pollInfo, uint32_t groupIdx = 0, 
+                const DevicePollGroup::VarLenRead* pVarLenRead = nullptr);
+
+    // Enable the slot (or slot group) for an address - releasing a slot held for a different slot key
+    bool enableSlotForAddress(const BusI2CAddrAndSlot& addrAndSlot, uint32_t& slotKey);
+
+    // Restore the bus multiplexers after a poll (or hold the slot for further polls on it)
+    void finishSlotAccess(uint32_t slotKey);
+
     // Bus status manager
     BusStatusMgr& _busStatusMgr;
 
@@ -62,10 +141,46 @@ private:
     // I2C request sync function
     BusReqSyncFn _busReqSyncFn;
 
-    // Poll data result
+    // I2C request sync batch function (performs all requests of a poll together if available)
+    BusReqSyncBatchFn _busReqSyncBatchFn;
+
+    // Sync sample settings, general call function and the trigger data and addresses (members so their storage
+    // is reused on each sync sample)
+    const BusI2CSyncSample* _pSyncSample = nullptr;
+    BusGeneralCallFn _busGeneralCallFn;
+    std::vector<uint8_t> _syncTriggerData;
+    std::vector<BusElemAddrType> _syncAddrs;
+
+    // Sync sample readout state (the readout resumes from the slot and address index)
+    bool _syncReadoutPending = false;
+    uint64_t _syncTriggerUs = 0;
+    uint64_t _syncReadoutDueUs = 0;
+    uint32_t _syncReadoutSlotIdx = 0;
+    uint32_t _syncReadoutAddrIdx = 0;
+
+    // Slot affinity - the slot enabled for the last poll is held until a poll on a different slot or releaseSlot()
+    bool _slotAffinity = true;
+    bool _isSlotHeld = false;
+    uint32_t _heldSlotNum = 0;
+
+    // Slot groups - slots with no conflicting addresses are enabled together (requires slot affinity)
+    // the groups are updated when the count or online status of bus elements changes
+    bool _slotGroups = false;
+    uint64_t _slotGroupsStatusTimeMs = 0;
+    uint32_t _slotGroupsAddrCount = 0;
+    std::vector<BusElemAddrType> _slotGroupsAddrs;
+
+    // Poll info, read data and result - these are members (rather than locals) so that their storage is
+    // reused from poll to poll and steady-state polling doesn't touch the heap
+    DevicePollingInfo _pollInfo;
+    DevicePollingInfo _pollGroupInfo;
+    DevicePollGroup::VarLenRead _pollGroupVarLenRead;
+    std::vector<uint8_t> _pollReadData;
     std::vector<uint8_t> _pollDataResult;
     uint8_t* _pPollDataResult = nullptr;
 
     // Debug
+    uint32_t _debugPollCount = 0;
+    uint32_t _debugLastHeapAllocReportMs = 0;
     static constexpr const char* MODULE_PREFIX = "RaftI2CDevPollMgr";    
 };
@@ -0,0 +1,256 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Poll Buffer Budget
+// Bounds the total memory used by device poll result aggregators on a bus
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include "RaftArduino.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class PollBufferBudget
+/// @brief Per-device quotas (number of poll results stored) within a bus-wide limit on poll buffer bytes
+/// @note Each device requests the number of results given by its device type. When the total requested fits in
+///       the limit (or there is no limit) every device gets its request - otherwise the space is shared out fairly
+///       (devices asking for less than an equal share get their request and the remainder is split between the
+///       others) with every device getting at least one result. Quotas are recalculated as devices come and go.
+///       The caller records the size each aggregator actually has (setApplied()) and resizes those which differ
+///       from their quota (getPendingAddrs()) - as resizing discards the results held the caller may defer growth
+///       (which isn't needed to keep within the limit) until the aggregator is empty. Not thread-safe (the owner
+///       locks) - storage is reused so rebalancing doesn't allocate once the number of devices is stable
+class PollBufferBudget
+{
+public:
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup
+    /// @param maxBytes max total bytes of poll results (0 for no limit)
+    void setup(uint32_t maxBytes)
+    {
+        _maxBytes = maxBytes;
+        _devices.clear();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Set the request for a device (adding it if not present)
+    /// @param address address
+    /// @param numResults number of results requested
+    /// @param resultSize size of each result in bytes (including timestamp)
+    void setRequest(uint32_t address, uint32_t numResults, uint32_t resultSize)
+    {
+        DeviceBudget* pDevice = findDevice(address);
+        if (!pDevice)
+        {
+            _devices.push_back(DeviceBudget());
+            pDevice = &_devices.back();
+            pDevice->address = address;
+        }
+        pDevice->numResultsRequested = numResults;
+        pDevice->resultSize = resultSize;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Remove a device
+    /// @param address address
+    void remove(uint32_t address)
+    {
+        _devices.erase(std::remove_if(_devices.begin(), _devices.end(),
+                    [address](const DeviceBudget& device) { return device.address == address; }),
+                    _devices.end());
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Recalculate quotas
+    /// @param changedAddrs (out) addresses of devices whose quota has changed (including newly added devices)
+    void rebalance(std::vector<uint32_t>& changedAddrs)
+    {
+        changedAddrs.clear();
+
+        // Check if all requests fit
+        uint32_t totalRequested = 0;
+        for (const DeviceBudget& device : _devices)
+            totalRequested += device.numResultsRequested * device.resultSize;
+        std::vector<uint32_t>& quotas = _quotas;
+        quotas.assign(_devices.size(), 0);
+        if ((_maxBytes == 0) || (totalRequested <= _maxBytes))
+        {
+            for (uint32_t i = 0; i < _devices.size(); i++)
+                quotas[i] = _devices[i].numResultsRequested;
+        }
+        else
+        {
+            // Every device gets at least one result (if requested)
+            uint32_t bytesLeft = _maxBytes;
+            std::vector<uint32_t>& order = _order;
+            order.clear();
+            for (uint32_t i = 0; i < _devices.size(); i++)
+            {
+                if (_devices[i].numResultsRequested == 0)
+                    continue;
+                quotas[i] = 1;
+                bytesLeft = bytesLeft > _devices[i].resultSize ? bytesLeft - _devices[i].resultSize : 0;
+                order.push_back(i);
+            }
+
+            // Share out the remainder - smallest extra requests first so unused share passes to the others
+            std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+                return getExtraBytes(_devices[a]) < getExtraBytes(_devices[b]);
+            });
+            uint32_t numLeft = order.size();
+            for (uint32_t idx : order)
+            {
+                const DeviceBudget& device = _devices[idx];
+                uint32_t fairShare = bytesLeft / numLeft;
+                uint32_t extraBytes = std::min(getExtraBytes(device), fairShare);
+                uint32_t extraResults = device.resultSize > 0 ? extraBytes / device.resultSize : 0;
+                quotas[idx] += extraResults;
+                bytesLeft -= extraResults * device.resultSize;
+                numLeft--;
+            }
+        }
+
+        // Find changes
+        for (uint32_t i = 0; i < _devices.size(); i++)
+        {
+            if (_devices[i].isAllocated && (_devices[i].numResultsAllocated == quotas[i]))
+                continue;
+            _devices[i].numResultsAllocated = quotas[i];
+            _devices[i].isAllocated = true;
+            changedAddrs.push_back(_devices[i].address);
+        }
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Record the number of results a device's aggregator actually holds
+    /// @param address address
+    /// @param numResults number of results the aggregator is sized for
+    void setApplied(uint32_t address, uint32_t numResults)
+    {
+        DeviceBudget* pDevice = findDevice(address);
+        if (pDevice)
+            pDevice->numResultsApplied = numResults;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get devices whose aggregator size differs from their quota
+    /// @param pendingAddrs (out) addresses
+    void getPendingAddrs(std::vector<uint32_t>& pendingAddrs) const
+    {
+        pendingAddrs.clear();
+        for (const DeviceBudget& device : _devices)
+            if (device.isAllocated && (device.numResultsApplied != device.numResultsAllocated))
+                pendingAddrs.push_back(device.address);
+    }
+
+    // Get the number of results applied for a device (0 if not present)
+    uint32_t getApplied(uint32_t address) const
+    {
+        for (const DeviceBudget& device : _devices)
+            if (device.address == address)
+                return device.numResultsApplied;
+        return 0;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get quota for a device
+    /// @param address address
+    /// @param numResults (out) number of results allocated
+    /// @param resultSize (out) size of each result
+    /// @return true if the device has a quota
+    bool getQuota(uint32_t address, uint32_t& numResults, uint32_t& resultSize) const
+    {
+        for (const DeviceBudget& device : _devices)
+        {
+            if ((device.address == address) && device.isAllocated)
+            {
+                numResults = device.numResultsAllocated;
+                resultSize = device.resultSize;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Get bytes allocated and requested
+    uint32_t getAllocatedBytes() const
+    {
+        uint32_t totalBytes = 0;
+        for (const DeviceBudget& device : _devices)
+            totalBytes += device.numResultsAllocated * device.resultSize;
+        return totalBytes;
+    }
+    uint32_t getRequestedBytes() const
+    {
+        uint32_t totalBytes = 0;
+        for (const DeviceBudget& device : _devices)
+            totalBytes += device.numResultsRequested * device.resultSize;
+        return totalBytes;
+    }
+    uint32_t getMaxBytes() const
+    {
+        return _maxBytes;
+    }
+
+    // Get count of devices whose quota is less than their request
+    uint32_t getNumReduced() const
+    {
+        uint32_t numReduced = 0;
+        for (const DeviceBudget& device : _devices)
+            if (device.numResultsAllocated < device.numResultsRequested)
+                numReduced++;
+        return numReduced;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get JSON
+    /// @return JSON string {"max":<maxBytes>,"req":<requestedBytes>,"alloc":<allocatedBytes>,"n":<numDevices>,
+    ///         "cut":<numDevicesWithReducedQuota>}
+    String getJSON() const
+    {
+        char jsonStr[100];
+        snprintf(jsonStr, sizeof(jsonStr), R"({"max":%u,"req":%u,"alloc":%u,"n":%u,"cut":%u})",
+                    (unsigned)_maxBytes, (unsigned)getRequestedBytes(), (unsigned)getAllocatedBytes(),
+                    (unsigned)_devices.size(), (unsigned)getNumReduced());
+        return jsonStr;
+    }
+
+private:
+    // Max bytes (0 for no limit)
+    uint32_t _maxBytes = 0;
+
+    // Devices
+    class DeviceBudget
+    {
+    public:
+        uint32_t address = 0;
+        uint32_t numResultsRequested = 0;
+        uint32_t resultSize = 0;
+        uint32_t numResultsAllocated = 0;
+        uint32_t numResultsApplied = 0;
+        bool isAllocated = false;
+    };
+    std::vector<DeviceBudget> _devices;
+
+    // Storage reused when rebalancing
+    std::vector<uint32_t> _quotas;
+    std::vector<uint32_t> _order;
+
+    // Helpers
+    DeviceBudget* findDevice(uint32_t address)
+    {
+        for (DeviceBudget& device : _devices)
+            if (device.address == address)
+                return &device;
+        return nullptr;
+    }
+    static uint32_t getExtraBytes(const DeviceBudget& device)
+    {
+        return device.numResultsRequested > 1 ? (device.numResultsRequested - 1) * device.resultSize : 0;
+    }
+};
@@ -0,0 +1,426 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Poll Record Batch Decoder
+// Decodes a batch of fixed-size poll records into per-attribute columns
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+#include "RaftJson.h"
+#include "DevicePollingInfo.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class PollRecordBatchDecoder
+/// @brief Decoder for poll records described by a device type response schema ("resp" in devInfoJson)
+/// @note This decodes from the schema at runtime into one column per attribute so it works for device types
+///       without a generated decode function and for callers wanting columns rather than structures - where a
+///       generated decode function exists getDecodedPollResponses() uses it. The attribute processing follows
+///       the same steps as the schema decoder in the web UI (xor, mask, sign bit, shift, divisor, add). Schemas
+///       with custom decode code ("c") can't be handled.
+class PollRecordBatchDecoder
+{
+public:
+    // Value types (from the struct-style type strings in the schema)
+    enum ValueType : uint8_t
+    {
+        VALUE_TYPE_U8,
+        VALUE_TYPE_S8,
+        VALUE_TYPE_U16,
+        VALUE_TYPE_S16,
+        VALUE_TYPE_U32,
+        VALUE_TYPE_S32,
+    };
+
+    // Attribute description
+    class AttrDesc
+    {
+    public:
+        // Position of attribute relative to the start of the record data (after the timestamp)
+        uint16_t offset = 0;
+        ValueType valueType = VALUE_TYPE_U8;
+        bool isBigEndian = false;
+
+        // Processing (defaults leave the value unchanged)
+        uint32_t xorMask = 0;
+        uint32_t andMask = 0xffffffff;
+        int8_t signBitPos = -1;
+        bool hasSignSubtract = false;
+        int32_t signSubtract = 0;
+        int8_t shift = 0;
+        float divisor = 1;
+        float addValue = 0;
+    };
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup
+    /// @param recordDataSize size of the data in each record (excluding the timestamp - "b" in the schema)
+    void setup(uint32_t recordDataSize)
+    {
+        _recordDataSize = recordDataSize;
+        _attrs.clear();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup from the response schema in device info JSON
+    /// @param pDevInfoJson device info JSON
+    /// @param pAttrNames (out) attribute names (in schema order) - may be nullptr
+    /// @return true if the schema can be decoded (custom decode code isn't supported)
+    bool setupFromDevInfoJson(const char* pDevInfoJson, std::vector<String>* pAttrNames = nullptr)
+    {
+        // Response schema (custom decode code isn't supported)
+        if (pAttrNames)
+            pAttrNames->clear();
+        if (!pDevInfoJson)
+            return false;
+        RaftJson devInfo(pDevInfoJson, false);
+        uint32_t recordDataSize = devInfo.getLong("resp/b", 0);
+        if ((recordDataSize == 0) || (devInfo.getString("resp/c", "").length() > 0))
+            return false;
+        std::vector<String> attrDefs;
+        devInfo.getArrayElems("resp/a", attrDefs);
+        if ((attrDefs.size() == 0) || (attrDefs.size() > MAX_ATTRS))
+            return false;
+
+        // Attributes (positions are sequential unless "at" is specified)
+        setup(recordDataSize);
+        uint32_t curPos = 0;
+        for (RaftJson attrDef : attrDefs)
+        {
+            AttrDesc attrDesc;
+            if (!parseValueType(attrDef.getString("t", "").c_str(), attrDesc))
+                return false;
+            int atPos = attrDef.getLong("at", -1);
+            attrDesc.offset = atPos >= 0 ? atPos : curPos;
+            if (atPos < 0)
+                curPos += getValueSize(attrDesc.valueType);
+            String xorStr = attrDef.getString("x", "");
+            if (xorStr.length() > 0)
+                attrDesc.xorMask = strtoul(xorStr.c_str(), nullptr, 0);
+            String maskStr = attrDef.getString("m", "");
+            if (maskStr.length() > 0)
+                attrDesc.andMask = strtoul(maskStr.c_str(), nullptr, 0);
+            attrDesc.signBitPos = attrDef.getLong("sb", -1);
+            String signSubtractStr = attrDef.getString("ss", "");
+            attrDesc.hasSignSubtract = signSubtractStr.length() > 0;
+            if (attrDesc.hasSignSubtract)
+                attrDesc.signSubtract = strtol(signSubtractStr.c_str(), nullptr, 0);
+            attrDesc.shift = attrDef.getLong("s", 0);
+            attrDesc.divisor = attrDef.getDouble("d", 1);
+            attrDesc.addValue = attrDef.getDouble("a", 0);
+            if (!addAttr(attrDesc))
+                return false;
+            if (pAttrNames)
+                pAttrNames->push_back(attrDef.getString("n", ""));
+        }
+        return true;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Add an attribute
+    /// @param attrDesc attribute description
+    /// @return true if the attribute fits in the record
+    bool addAttr(const AttrDesc& attrDesc)
+    {
+        if ((_attrs.size() >= MAX_ATTRS) || (attrDesc.offset + getValueSize(attrDesc.valueType) > _recordDataSize))
+            return false;
+        _attrs.push_back(attrDesc);
+        return true;
+    }
+
+    // Max attributes
+    static const uint32_t MAX_ATTRS = 32;
+
+    // Get number of attributes
+    uint32_t getNumAttrs() const
+    {
+        return _attrs.size();
+    }
+
+    // Get an attribute description (attrIdx must be less than getNumAttrs())
+    const AttrDesc& getAttr(uint32_t attrIdx) const
+    {
+        return _attrs[attrIdx];
+    }
+
+    // Get size of each record (inc timestamp)
+    uint32_t getRecordSize() const
+    {
+        return DevicePollingInfo::POLL_RESULT_TIMESTAMP_SIZE + _recordDataSize;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Parse a schema type string (e.g. "<H", ">i", "B")
+    /// @param pTypeStr type string
+    /// @param attrDesc (out) value type and endianness are set
+    /// @return true if the type is supported
+    static bool parseValueType(const char* pTypeStr, AttrDesc& attrDesc)
+    {
+        if (!pTypeStr)
+            return false;
+        attrDesc.isBigEndian = false;
+        if ((*pTypeStr == '<') || (*pTypeStr == '>'))
+        {
+            attrDesc.isBigEndian = *pTypeStr == '>';
+            pTypeStr++;
+        }
+        if (strlen(pTypeStr) != 1)
+            return false;
+        switch (*pTypeStr)
+        {
+            case 'B': attrDesc.valueType = VALUE_TYPE_U8; return true;
+            case 'b': attrDesc.valueType = VALUE_TYPE_S8; return true;
+            case '?': attrDesc.valueType = VALUE_TYPE_U8; return true;
+            case 'H': attrDesc.valueType = VALUE_TYPE_U16; return true;
+            case 'h': attrDesc.valueType = VALUE_TYPE_S16; return true;
+            case 'I': attrDesc.valueType = VALUE_TYPE_U32; return true;
+            case 'i': attrDesc.valueType = VALUE_TYPE_S32; return true;
+            case 'L': attrDesc.valueType = VALUE_TYPE_U32; return true;
+            case 'l': attrDesc.valueType = VALUE_TYPE_S32; return true;
+        }
+        return false;
+    }
+
+    // Get size of a value type
+    static uint32_t getValueSize(ValueType valueType)
+    {
+        switch (valueType)
+        {
+            case VALUE_TYPE_U8: case VALUE_TYPE_S8: return 1;
+            case VALUE_TYPE_U16: case VALUE_TYPE_S16: return 2;
+            default: return 4;
+        }
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Decode poll records
+    /// @param pBuf buffer containing poll records (each starting with a timestamp)
+    /// @param bufLen length of buffer
+    /// @param pTimeMsCol (out) timestamp column (ms) - may be nullptr
+    /// @param pAttrCols (out) array of columns (one per attribute in the order added) - a nullptr column is skipped
+    /// @param maxRecCount maximum number of records to decode (size of each column)
+    /// @param decodeState decode state for the device (RaftBusDeviceDecodeState - used for timestamp wrap handling)
+    /// @return number of records decoded
+    template <typename DecodeState>
+    uint32_t decode(const uint8_t* pBuf, uint32_t bufLen, uint32_t* pTimeMsCol, float* const* pAttrCols,
+                uint32_t maxRecCount, DecodeState& decodeState) const
+    {
+        // Number of complete records
+        const uint32_t recSize = getRecordSize();
+        uint32_t numRecs = bufLen / recSize;
+        if (numRecs > maxRecCount)
+            numRecs = maxRecCount;
+        if (numRecs == 0)
+            return 0;
+
+        // Timestamps (handling wrap-around is inherently sequential) - the calculation is done in poll units so the
+        // conversion to ms is a multiply when the resolution is a whole number of ms
+        const uint32_t tsSize = DevicePollingInfo::POLL_RESULT_TIMESTAMP_SIZE;
+        const uint64_t resolutionUs = DevicePollingInfo::POLL_RESULT_RESOLUTION_US;
+        uint64_t lastTimestampUnits = decodeState.lastReportTimestampUs / resolutionUs;
+        uint64_t timestampOffsetUnits = decodeState.reportTimestampOffsetUs / resolutionUs;
+        for (uint32_t i = 0; i < numRecs; i++)
+        {
+            const uint8_t* pTs = pBuf + i * recSize;
+            uint32_t timestampUnits = tsSize == 2 ? readBE16(pTs) : readBE32(pTs);
+            if (timestampUnits < lastTimestampUnits)
+                timestampOffsetUnits += DevicePollingInfo::POLL_RESULT_WRAP_VALUE;
+            lastTimestampUnits = timestampUnits;
+            if (pTimeMsCol)
+            {
+                if (resolutionUs % 1000 == 0)
+                    pTimeMsCol[i] = (timestampUnits + timestampOffsetUnits) * (resolutionUs / 1000);
+                else
+                    pTimeMsCol[i] = (timestampUnits + timestampOffsetUnits) * resolutionUs / 1000;
+            }
+        }
+        decodeState.lastReportTimestampUs = lastTimestampUnits * resolutionUs;
+        decodeState.reportTimestampOffsetUs = timestampOffsetUnits * resolutionUs;
+
+        // Attributes (one column at a time)
+        for (uint32_t attrIdx = 0; attrIdx < _attrs.size(); attrIdx++)
+        {
+            if (!pAttrCols || !pAttrCols[attrIdx])
+                continue;
+            const AttrDesc& attr = _attrs[attrIdx];
+            const uint8_t* pData = pBuf + tsSize + attr.offset;
+            float* pCol = pAttrCols[attrIdx];
+            switch (attr.valueType)
+            {
+                case VALUE_TYPE_U8:
+                    decodeColumn(pData, recSize, numRecs, attr, pCol, [](const uint8_t* p) -> int32_t { return p[0]; });
+                    break;
+                case VALUE_TYPE_S8:
+                    decodeColumn(pData, recSize, numRecs, attr, pCol, [](const uint8_t* p) -> int32_t { return (int8_t)p[0]; });
+                    break;
+                case VALUE_TYPE_U16:
+                    if (attr.isBigEndian)
+                        decodeColumn(pData, recSize, numRecs, attr, pCol, [](const uint8_t* p) -> int32_t { return readBE16(p); });
+                    else
+                        decodeColumn(pData, recSize, numRecs, attr, pCol, [](const uint8_t* p) -> int32_t { return readLE16(p); });
+                    break;
+                case VALUE_TYPE_S16:
+                    if (attr.isBigEndian)
+                        decodeColumn(pData, recSize, numRecs, attr, pCol, [](const uint8_t* p) -> int32_t { return (int16_t)readBE16(p); });
+                    else
+                        decodeColumn(pData, recSize, numRecs, attr, pCol, [](const uint8_t* p) -> int32_t { return (int16_t)readLE16(p); });
+                    break;
+                case VALUE_TYPE_U32:
+                    if (attr.isBigEndian)
+                        decodeColumn(pData, recSize, numRecs, attr, pCol, [](const uint8_t* p) -> int64_t { return readBE32(p); });
+                    else
+                        decodeColumn(pData, recSize, numRecs, attr, pCol, [](const uint8_t* p) -> int64_t { return readLE32(p); });
+                    break;
+                case VALUE_TYPE_S32:
+                    if (attr.isBigEndian)
+                        decodeColumn(pData, recSize, numRecs, attr, pCol, [](const uint8_t* p) -> int64_t { return (int32_t)readBE32(p); });
+                    else
+                        decodeColumn(pData, recSize, numRecs, attr, pCol, [](const uint8_t* p) -> int64_t { return (int32_t)readLE32(p); });
+                    break;
+            }
+        }
+        return numRecs;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Check if an attribute is a plain value (no xor, mask, sign bit or shift) - the decoded value is then
+    ///        a linear function of the raw value so raw values can be averaged and written back
+    /// @param attr attribute description
+    /// @return true if plain
+    static bool isPlainAttr(const AttrDesc& attr)
+    {
+        uint32_t valueMask = getValueSize(attr.valueType) == 1 ? 0xff : (getValueSize(attr.valueType) == 2 ? 0xffff : 0xffffffff);
+        return ((attr.andMask & valueMask) == valueMask) && ((attr.xorMask & valueMask) == 0) && 
+                    (attr.signBitPos < 0) && (attr.shift == 0);
+    }
+
+    // Read the raw value of an attribute from record data (after the timestamp)
+    static int64_t readRawValue(const uint8_t* pRecData, const AttrDesc& attr)
+    {
+        const uint8_t* p = pRecData + attr.offset;
+        switch (attr.valueType)
+        {
+            case VALUE_TYPE_U8: return p[0];
+            case VALUE_TYPE_S8: return (int8_t)p[0];
+            case VALUE_TYPE_U16: return attr.isBigEndian ? readBE16(p) : readLE16(p);
+            case VALUE_TYPE_S16: return (int16_t)(attr.isBigEndian ? readBE16(p) : readLE16(p));
+            case VALUE_TYPE_U32: return attr.isBigEndian ? readBE32(p) : readLE32(p);
+            default: return (int32_t)(attr.isBigEndian ? readBE32(p) : readLE32(p));
+        }
+    }
+
+    // Write the raw value of an attribute into record data (after the timestamp)
+    static void writeRawValue(uint8_t* pRecData, const AttrDesc& attr, int64_t value)
+    {
+        uint8_t* p = pRecData + attr.offset;
+        uint32_t valueSize = getValueSize(attr.valueType);
+        for (uint32_t i = 0; i < valueSize; i++)
+            p[attr.isBigEndian ? valueSize - 1 - i : i] = (value >> (i * 8)) & 0xff;
+    }
+
+    // Decode the raw value of a plain attribute
+    static float decodePlainValue(int64_t rawValue, const AttrDesc& attr)
+    {
+        return rawValue / (attr.divisor != 0 ? attr.divisor : 1) + attr.addValue;
+    }
+
+private:
+    // Record layout
+    uint32_t _recordDataSize = 0;
+    std::vector<AttrDesc> _attrs;
+
+    // Decode a column (the read function is a lambda so each value type gets its own inlined loop - values of up
+    // to 16 bits are processed as int32_t and 32 bit values as int64_t)
+    template <typename ReadFn>
+    static void decodeColumn(const uint8_t* __restrict pData, uint32_t stride, uint32_t numRecs, const AttrDesc& attr,
+                float* __restrict pCol, ReadFn readFn)
+    {
+        typedef decltype(readFn(pData)) ValueT;
+
+        // Processing which applies to all records (held in locals so it stays in registers)
+        const bool isSigned = (attr.valueType == VALUE_TYPE_S8) || (attr.valueType == VALUE_TYPE_S16) ||
+                        (attr.valueType == VALUE_TYPE_S32);
+        const ValueT valueMask = (attr.valueType == VALUE_TYPE_U8) || (attr.valueType == VALUE_TYPE_S8) ? 0xff :
+                    ((attr.valueType == VALUE_TYPE_U16) || (attr.valueType == VALUE_TYPE_S16) ? 0xffff : (ValueT)0xffffffff);
+        const bool hasMask = (attr.andMask & valueMask) != (uint32_t)valueMask;
+        const ValueT xorMask = attr.xorMask & valueMask;
+        const ValueT andMask = attr.andMask & valueMask;
+        const ValueT maskSignBit = isSigned ? (andMask + 1) >> 1 : 0;
+        const ValueT signBit = (attr.signBitPos >= 0) && (attr.signBitPos < 32) ? ((ValueT)1 << attr.signBitPos) : 0;
+        const bool hasSignSubtract = attr.hasSignSubtract;
+        const ValueT signSubtract = attr.signSubtract;
+        const int32_t rightShift = attr.shift > 0 ? attr.shift : 0;
+        const int32_t leftShift = attr.shift < 0 ? -attr.shift : 0;
+        const float divisor = attr.divisor != 0 ? attr.divisor : 1;
+        const float addValue = attr.addValue;
+
+        // Plain values (the common case) only need scaling - a multiply is used when the divisor is a power of 2
+        // (so the result is identical)
+        if (!hasMask && !xorMask && !signBit && !rightShift && !leftShift)
+        {
+            int divisorExp = 0;
+            if (frexpf(divisor, &divisorExp) == 0.5f)
+            {
+                const float scale = 1 / divisor;
+                for (uint32_t i = 0; i < numRecs; i++)
+                    pCol[i] = readFn(pData + i * stride) * scale + addValue;
+            }
+            else
+            {
+                for (uint32_t i = 0; i < numRecs; i++)
+                    pCol[i] = readFn(pData + i * stride) / divisor + addValue;
+            }
+            return;
+        }
+
+        for (uint32_t i = 0; i < numRecs; i++)
+        {
+            ValueT value = readFn(pData + i * stride);
+
+            // A mask on a signed value is applied to the unsigned value and then sign extended
+            if (hasMask)
+            {
+                value = ((value & valueMask) ^ xorMask) & andMask;
+                if (value & maskSignBit)
+                    value |= ~andMask;
+            }
+            else
+            {
+                value ^= xorMask;
+            }
+
+            // Sign bit
+            if (value & signBit)
+                value = hasSignSubtract ? signSubtract - value : value - (signBit << 1);
+
+            // Shift (positive is right)
+            value = (value >> rightShift) << leftShift;
+            pCol[i] = value / divisor + addValue;
+        }
+    }
+
+    // Readers
+    static uint32_t readBE16(const uint8_t* p)
+    {
+        return (p[0] << 8) | p[1];
+    }
+    static uint32_t readLE16(const uint8_t* p)
+    {
+        return p[0] | (p[1] << 8);
+    }
+    static uint32_t readBE32(const uint8_t* p)
+    {
+        return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    }
+    static uint32_t readLE32(const uint8_t* p)
+    {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+};
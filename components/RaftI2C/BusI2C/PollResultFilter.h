@@ -0,0 +1,291 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Poll Result Filter
+// Decodes poll results and reduces them (window average/min/max, decimation and threshold capture) before storing
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "RaftJsonIF.h"
+#include "Logger.h"
+#include "PollRecordBatchDecoder.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class PollResultFilter
+/// @brief Processing stage between the poll of a device and the storage of its results
+/// @note Poll results are decoded using the device type's response schema and collected over a window of
+///       window results. At the end of the window one result is output: fields with an op take the average,
+///       minimum or maximum over the window and all other fields (and the timestamp) are from the last result
+///       in the window - so with no ops the stream is simply decimated. If a trigger field is set a result is
+///       output immediately (ending the window early) when the trigger field's value differs from the last
+///       output value by at least trigDelta - with a window of 0 results are only output when triggered.
+///       Output results keep the raw record layout (the reduced raw values are written back) so they are stored,
+///       published and decoded exactly as unfiltered results. Ops are only applied to plain fields (no xor, mask,
+///       sign bit or shift) whose decoded value is a linear function of the raw value.
+///       Config: {"devType":"VCNL4040","window":10,"fields":[{"name":"prox","op":"avg"}],
+///       "trigField":"prox","trigDelta":50}. Not thread-safe (used from the I2C task)
+class PollResultFilter
+{
+public:
+    // Field ops
+    enum FieldOp : uint8_t
+    {
+        FIELD_OP_LAST,
+        FIELD_OP_AVG,
+        FIELD_OP_MIN,
+        FIELD_OP_MAX,
+    };
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup
+    /// @param decoder decoder for the device type's poll results (copied)
+    /// @param window number of results per output result (0 to only output when triggered)
+    void setup(const PollRecordBatchDecoder& decoder, uint32_t window)
+    {
+        _decoder = decoder;
+        _window = window;
+        _fieldOps.assign(_decoder.getNumAttrs(), FIELD_OP_LAST);
+        _fieldStates.assign(_decoder.getNumAttrs(), FieldState());
+        _trigFieldIdx = -1;
+        _trigDelta = 0;
+        _windowCount = 0;
+        _hasLastTrigValue = false;
+        _numIn = 0;
+        _numOut = 0;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Setup from config
+    /// @param config filter config (see class notes)
+    /// @param pDevInfoJson device info JSON of the device type (containing the response schema)
+    /// @return true if the filter is valid
+    bool setupFromConfig(const RaftJsonIF& config, const char* pDevInfoJson)
+    {
+        // Decoder
+        PollRecordBatchDecoder decoder;
+        std::vector<String> fieldNames;
+        if (!decoder.setupFromDevInfoJson(pDevInfoJson, &fieldNames))
+        {
+            LOG_W(MODULE_PREFIX, "setupFromConfig devType %s not decodable", config.getString("devType", "").c_str());
+            return false;
+        }
+        setup(decoder, config.getLong("window", 1));
+
+        // Field ops
+        std::vector<String> fieldConfigs;
+        config.getArrayElems("fields", fieldConfigs);
+        for (RaftJson fieldConfig : fieldConfigs)
+        {
+            String name = fieldConfig.getString("name", "");
+            int fieldIdx = findField(fieldNames, name);
+            FieldOp op = FIELD_OP_LAST;
+            if ((fieldIdx < 0) || !parseFieldOp(fieldConfig.getString("op", "").c_str(), op) || !setFieldOp(fieldIdx, op))
+                LOG_W(MODULE_PREFIX, "setupFromConfig field %s op %s INVALID",
+                            name.c_str(), fieldConfig.getString("op", "").c_str());
+        }
+
+        // Trigger
+        String trigField = config.getString("trigField", "");
+        if (trigField.length() > 0)
+        {
+            int fieldIdx = findField(fieldNames, trigField);
+            if ((fieldIdx < 0) || !setTrigger(fieldIdx, config.getDouble("trigDelta", 0)))
+                LOG_W(MODULE_PREFIX, "setupFromConfig trigField %s INVALID", trigField.c_str());
+        }
+        return true;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Set the op for a field
+    /// @param fieldIdx field index (in schema order)
+    /// @param op op
+    /// @return false if the field doesn't exist or the op can't be applied to it
+    bool setFieldOp(uint32_t fieldIdx, FieldOp op)
+    {
+        if (fieldIdx >= _fieldOps.size())
+            return false;
+        if ((op != FIELD_OP_LAST) && !PollRecordBatchDecoder::isPlainAttr(_decoder.getAttr(fieldIdx)))
+            return false;
+        _fieldOps[fieldIdx] = op;
+        return true;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Set the trigger field
+    /// @param fieldIdx field index (in schema order)
+    /// @param trigDelta change in the field's value from the last output which triggers an output
+    /// @return false if the field doesn't exist or isn't a plain field
+    bool setTrigger(uint32_t fieldIdx, float trigDelta)
+    {
+        if ((fieldIdx >= _fieldOps.size()) || !PollRecordBatchDecoder::isPlainAttr(_decoder.getAttr(fieldIdx)))
+            return false;
+        _trigFieldIdx = fieldIdx;
+        _trigDelta = fabsf(trigDelta);
+        return true;
+    }
+
+    // Parse a field op name
+    static bool parseFieldOp(const char* pOpStr, FieldOp& op)
+    {
+        if (strcmp(pOpStr, "avg") == 0)
+            op = FIELD_OP_AVG;
+        else if (strcmp(pOpStr, "min") == 0)
+            op = FIELD_OP_MIN;
+        else if (strcmp(pOpStr, "max") == 0)
+            op = FIELD_OP_MAX;
+        else if (strcmp(pOpStr, "last") == 0)
+            op = FIELD_OP_LAST;
+        else
+            return false;
+        return true;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Process a poll result
+    /// @param pollResult poll result (timestamp followed by data)
+    /// @param outResult (out) result to store (storage is reused so this doesn't allocate once sized)
+    /// @return true if a result is output (results of an unexpected size are passed through unchanged)
+    bool process(const std::vector<uint8_t>& pollResult, std::vector<uint8_t>& outResult)
+    {
+        _numIn++;
+        if (pollResult.size() != _decoder.getRecordSize())
+        {
+            outResult.assign(pollResult.begin(), pollResult.end());
+            _numOut++;
+            return true;
+        }
+
+        // Accumulate fields with ops over the window
+        const uint8_t* pRecData = pollResult.data() + DevicePollingInfo::POLL_RESULT_TIMESTAMP_SIZE;
+        for (uint32_t fieldIdx = 0; fieldIdx < _fieldOps.size(); fieldIdx++)
+        {
+            if (_fieldOps[fieldIdx] == FIELD_OP_LAST)
+                continue;
+            const PollRecordBatchDecoder::AttrDesc& attr = _decoder.getAttr(fieldIdx);
+            FieldState& state = _fieldStates[fieldIdx];
+            int64_t rawValue = PollRecordBatchDecoder::readRawValue(pRecData, attr);
+            float value = PollRecordBatchDecoder::decodePlainValue(rawValue, attr);
+            if (_windowCount == 0)
+            {
+                state.rawSum = 0;
+                state.minValue = state.maxValue = value;
+                state.minRaw = state.maxRaw = rawValue;
+            }
+            state.rawSum += rawValue;
+            if (value < state.minValue)
+            {
+                state.minValue = value;
+                state.minRaw = rawValue;
+            }
+            if (value > state.maxValue)
+            {
+                state.maxValue = value;
+                state.maxRaw = rawValue;
+            }
+        }
+        _windowCount++;
+
+        // Check for trigger or end of window
+        bool isTriggered = false;
+        if (_trigFieldIdx >= 0)
+        {
+            const PollRecordBatchDecoder::AttrDesc& attr = _decoder.getAttr(_trigFieldIdx);
+            float value = PollRecordBatchDecoder::decodePlainValue(PollRecordBatchDecoder::readRawValue(pRecData, attr), attr);
+            isTriggered = !_hasLastTrigValue || (fabsf(value - _lastTrigValue) >= _trigDelta);
+        }
+        if (!isTriggered && ((_window == 0) || (_windowCount < _window)))
+            return false;
+
+        // Output the last result with the reduced fields written back
+        outResult.assign(pollResult.begin(), pollResult.end());
+        uint8_t* pOutData = outResult.data() + DevicePollingInfo::POLL_RESULT_TIMESTAMP_SIZE;
+        for (uint32_t fieldIdx = 0; fieldIdx < _fieldOps.size(); fieldIdx++)
+        {
+            const FieldState& state = _fieldStates[fieldIdx];
+            const PollRecordBatchDecoder::AttrDesc& attr = _decoder.getAttr(fieldIdx);
+            switch (_fieldOps[fieldIdx])
+            {
+                case FIELD_OP_AVG:
+                    PollRecordBatchDecoder::writeRawValue(pOutData, attr, llround((double)state.rawSum / _windowCount));
+                    break;
+                case FIELD_OP_MIN:
+                    PollRecordBatchDecoder::writeRawValue(pOutData, attr, state.minRaw);
+                    break;
+                case FIELD_OP_MAX:
+                    PollRecordBatchDecoder::writeRawValue(pOutData, attr, state.maxRaw);
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        // The trigger compares against the value output
+        if (_trigFieldIdx >= 0)
+        {
+            const PollRecordBatchDecoder::AttrDesc& attr = _decoder.getAttr(_trigFieldIdx);
+            _lastTrigValue = PollRecordBatchDecoder::decodePlainValue(PollRecordBatchDecoder::readRawValue(pOutData, attr), attr);
+            _hasLastTrigValue = true;
+        }
+        _windowCount = 0;
+        _numOut++;
+        return true;
+    }
+
+    // Get counts of results in and out
+    uint32_t getNumIn() const
+    {
+        return _numIn;
+    }
+    uint32_t getNumOut() const
+    {
+        return _numOut;
+    }
+
+private:
+    // Decoder
+    PollRecordBatchDecoder _decoder;
+
+    // Settings
+    uint32_t _window = 1;
+    std::vector<FieldOp> _fieldOps;
+    int32_t _trigFieldIdx = -1;
+    float _trigDelta = 0;
+
+    // Window state
+    class FieldState
+    {
+    public:
+        int64_t rawSum = 0;
+        float minValue = 0;
+        float maxValue = 0;
+        int64_t minRaw = 0;
+        int64_t maxRaw = 0;
+    };
+    std::vector<FieldState> _fieldStates;
+    uint32_t _windowCount = 0;
+    bool _hasLastTrigValue = false;
+    float _lastTrigValue = 0;
+
+    // Counts
+    uint32_t _numIn = 0;
+    uint32_t _numOut = 0;
+
+    // Helpers
+    static int findField(const std::vector<String>& fieldNames, const String& name)
+    {
+        for (uint32_t i = 0; i < fieldNames.size(); i++)
+            if (fieldNames[i] == name)
+                return i;
+        return -1;
+    }
+
+    // Debug
+    static constexpr const char* MODULE_PREFIX = "RaftI2CPollFilter";
+};
@@ -0,0 +1,154 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Poll Result Ring
+// Lock-free single-producer/single-consumer ring of variable length poll results
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include "BusI2CMemPlacement.h"
+
+class PollResultRing
+{
+public:
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Constructor
+    /// @param sizeBytes size of ring in bytes (rounded up to a power of 2)
+    PollResultRing(uint32_t sizeBytes = DEFAULT_SIZE_BYTES)
+    {
+        setSize(sizeBytes);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Set size (re-allocates the ring according to the current memory placement policy and discards any
+    ///        results - must not be called while the producer or consumer is active)
+    /// @param sizeBytes size of ring in bytes (rounded up to a power of 2)
+    void setSize(uint32_t sizeBytes)
+    {
+        uint32_t ringSize = 64;
+        while (ringSize < sizeBytes)
+            ringSize <<= 1;
+        RingBufType newRingBuf(ringSize);
+        _ringBuf.swap(newRingBuf);
+        _ringMask = ringSize - 1;
+        discardAll();
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Put a poll result (producer only)
+    /// @param address address of device
+    /// @param timeUs time of poll result (us)
+    /// @param pData poll result data
+    /// @param dataLen length of poll result data
+    /// @return true if stored (false if there is no space - the dropped count is incremented)
+    bool put(uint32_t address, uint64_t timeUs, const uint8_t* pData, uint32_t dataLen)
+    {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        uint32_t tail = _tail.load(std::memory_order_acquire);
+        uint32_t recLen = RECORD_HEADER_SIZE + dataLen;
+        if ((dataLen > UINT16_MAX) || (recLen > _ringBuf.size() - (head - tail)))
+        {
+            _droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        // Write header and data then publish
+        uint8_t header[RECORD_HEADER_SIZE];
+        memcpy(header, &address, sizeof(address));
+        memcpy(header + 4, &timeUs, sizeof(timeUs));
+        header[12] = dataLen & 0xff;
+        header[13] = (dataLen >> 8) & 0xff;
+        copyIn(head, header, RECORD_HEADER_SIZE);
+        copyIn(head + RECORD_HEADER_SIZE, pData, dataLen);
+        _head.store(head + recLen, std::memory_order_release);
+        return true;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get a poll result (consumer only)
+    /// @param address (out) address of device
+    /// @param timeUs (out) time of poll result (us)
+    /// @param data (out) poll result data (storage is reused)
+    /// @return true if a result was available
+    bool get(uint32_t& address, uint64_t& timeUs, std::vector<uint8_t>& data)
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        uint32_t head = _head.load(std::memory_order_acquire);
+        if (head == tail)
+            return false;
+
+        // Read header and data then release space
+        uint8_t header[RECORD_HEADER_SIZE];
+        copyOut(tail, header, RECORD_HEADER_SIZE);
+        memcpy(&address, header, sizeof(address));
+        memcpy(&timeUs, header + 4, sizeof(timeUs));
+        uint32_t dataLen = header[12] | (header[13] << 8);
+        data.resize(dataLen);
+        copyOut(tail + RECORD_HEADER_SIZE, data.data(), dataLen);
+        _tail.store(tail + RECORD_HEADER_SIZE + dataLen, std::memory_order_release);
+        return true;
+    }
+
+    // Check if empty
+    bool isEmpty() const
+    {
+        return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_relaxed);
+    }
+
+    // Discard all results (consumer only)
+    void discardAll()
+    {
+        _tail.store(_head.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    // Get count of results dropped because the ring was full
+    uint32_t getDroppedCount() const
+    {
+        return _droppedCount.load(std::memory_order_relaxed);
+    }
+
+    // Default size
+    static const uint32_t DEFAULT_SIZE_BYTES = 1024;
+
+private:
+    // Ring storage (bulk memory) and free-running indices (masked on access)
+    typedef std::vector<uint8_t, BusI2CBulkAllocator<uint8_t>> RingBufType;
+    RingBufType _ringBuf;
+    uint32_t _ringMask = 0;
+    std::atomic<uint32_t> _head{0};
+    std::atomic<uint32_t> _tail{0};
+
+    // Dropped count
+    std::atomic<uint32_t> _droppedCount{0};
+
+    // Record header is address (4 bytes), time (8 bytes) and data length (2 bytes)
+    static const uint32_t RECORD_HEADER_SIZE = 14;
+
+    // Copy helpers (handle wrap)
+    void copyIn(uint32_t pos, const uint8_t* pData, uint32_t len)
+    {
+        uint32_t startIdx = pos & _ringMask;
+        uint32_t firstLen = std::min(len, (uint32_t)_ringBuf.size() - startIdx);
+        if (firstLen > 0)
+            memcpy(_ringBuf.data() + startIdx, pData, firstLen);
+        if (len > firstLen)
+            memcpy(_ringBuf.data(), pData + firstLen, len - firstLen);
+    }
+    void copyOut(uint32_t pos, uint8_t* pData, uint32_t len) const
+    {
+        uint32_t startIdx = pos & _ringMask;
+        uint32_t firstLen = std::min(len, (uint32_t)_ringBuf.size() - startIdx);
+        if (firstLen > 0)
+            memcpy(pData, _ringBuf.data() + startIdx, firstLen);
+        if (len > firstLen)
+            memcpy(pData + firstLen, _ringBuf.data(), len - firstLen);
+    }
+};
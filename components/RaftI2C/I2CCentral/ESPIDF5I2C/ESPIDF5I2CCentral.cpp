@@ -14,6 +14,8 @@
 #include "sdkconfig.h"
 #include "esp_idf_version.h"
 
+// #define DEBUG_ESPIDF5_DEVICE_HANDLES
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Consts
 static const char *MODULE_PREFIX = "ESPIDF5I2CCentral";
@@ -88,6 +90,9 @@ void ESPIDF5I2CCentral::deinit()
 {
     if (_isInitialised)
     {
+        // Devices must be removed before the bus can be deleted
+        removeAllDeviceHandles();
+
         // Delete I2C master bus
         i2c_del_master_bus(_i2cMasterBusHandle);
         _isInitialised = false;
@@ -161,37 +166,10 @@ RaftRetCode ESPIDF5I2CCentral::access(uint32_t address, const uint8_t *pWriteBuf
         }
     }
 
-    // Check if device is already added to the bus
-    i2c_master_dev_handle_t devHandle = nullptr;
-    for (const auto& devAddrHandle : _deviceAddrHandles)
-    {
-        if (devAddrHandle.address == address)
-        {
-            devHandle = devAddrHandle.handle;
-            break;
-        }
-    }
-
-    // If not found then add the device
+    // Get the device handle (adding the device to the bus if required)
+    i2c_master_dev_handle_t devHandle = getDeviceHandle(address);
     if (devHandle == nullptr)
-    {
-        i2c_device_config_t dev_cfg = {
-            .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-            .device_address = (uint16_t)address,
-            .scl_speed_hz = _busFrequency,
-#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
-            .scl_wait_us = 0,
-            .flags = 0
-#endif
-        };
-        if (i2c_master_bus_add_device(_i2cMasterBusHandle, &dev_cfg, &devHandle) != ESP_OK)
-        {
-            LOG_E(MODULE_PREFIX, "access failed to create I2C device handle address 0x%02x", address);
-            return RAFT_BUS_NOT_INIT;
-        }
-        LOG_I(MODULE_PREFIX, "access adding device address 0x%02x devHandle %p", address, devHandle);
-        _deviceAddrHandles.push_back({address, devHandle});
-    }
+        return RAFT_BUS_NOT_INIT;
 
     // LOG_I(MODULE_PREFIX, "access addr 0x%02x numToWrite %d numToRead %d deviceHandle %p", address, numToWrite, numToRead, devHandle);
 
@@ -232,6 +210,74 @@ RaftRetCode ESPIDF5I2CCentral::access(uint32_t address, const uint8_t *pWriteBuf
     return RAFT_OK;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the device handle for an address (adding the device to the bus if required)
+/// @param address - 7-bit address
+/// @return handle or nullptr if the device couldn't be added
+/// @note Probes (zero length accesses) use i2c_master_probe() so scanning doesn't add devices
+i2c_master_dev_handle_t ESPIDF5I2CCentral::getDeviceHandle(uint32_t address)
+{
+    // Check address
+    if (address >= I2C_7BIT_ADDR_COUNT)
+        return nullptr;
+
+    // Check for an existing handle (its frequency must match as it is fixed when the device is added)
+    I2CAddrAndHandle& devHandle = _deviceHandles[address];
+    if (devHandle.handle != nullptr)
+    {
+        if (devHandle.sclSpeedHz == _busFrequency)
+            return devHandle.handle;
+        removeDeviceHandle(address);
+    }
+
+    // Add the device
+    i2c_device_config_t dev_cfg = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = (uint16_t)address,
+        .scl_speed_hz = _busFrequency,
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+        .scl_wait_us = 0,
+        .flags = 0
+#endif
+    };
+    i2c_master_dev_handle_t handle = nullptr;
+    if (i2c_master_bus_add_device(_i2cMasterBusHandle, &dev_cfg, &handle) != ESP_OK)
+    {
+        LOG_E(MODULE_PREFIX, "getDeviceHandle failed to create I2C device handle address 0x%02x", address);
+        return nullptr;
+    }
+#ifdef DEBUG_ESPIDF5_DEVICE_HANDLES
+    LOG_I(MODULE_PREFIX, "getDeviceHandle adding device address 0x%02x freq %d devHandle %p", 
+                address, _busFrequency, handle);
+#endif
+    devHandle.sclSpeedHz = _busFrequency;
+    devHandle.handle = handle;
+    return handle;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Remove a device handle (removing the device from the bus)
+/// @param address - 7-bit address
+void ESPIDF5I2CCentral::removeDeviceHandle(uint32_t address)
+{
+    I2CAddrAndHandle& devHandle = _deviceHandles[address];
+    if (devHandle.handle == nullptr)
+        return;
+#ifdef DEBUG_ESPIDF5_DEVICE_HANDLES
+    LOG_I(MODULE_PREFIX, "removeDeviceHandle address 0x%02x", address);
+#endif
+    i2c_master_bus_rm_device(devHandle.handle);
+    devHandle = I2CAddrAndHandle();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Remove all device handles
+void ESPIDF5I2CCentral::removeAllDeviceHandles()
+{
+    for (uint32_t address = 0; address < I2C_7BIT_ADDR_COUNT; address++)
+        removeDeviceHandle(address);
+}
+
 // /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // // Check that the I2C module is ready and reset it if not
 // /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -34,6 +34,16 @@ public:
 
     // Check if bus operating ok
     virtual bool isOperatingOk() const override final;
+
+    // Change the bus frequency between accesses (a device accessed at a different frequency to that of its
+    // handle has its handle re-created)
+    virtual bool setBusFrequency(uint32_t busFrequency) override final
+    {
+        if (!_isInitialised || (busFrequency == 0))
+            return false;
+        _busFrequency = busFrequency;
+        return true;
+    }
      
 private:
     // Settings
@@ -53,10 +63,17 @@ private:
     class I2CAddrAndHandle
     {
     public:
-        uint32_t address;
-        i2c_master_dev_handle_t handle;
+        uint32_t sclSpeedHz = 0;
+        i2c_master_dev_handle_t handle = nullptr;
     };
 
-    // Device handles
-    std::vector<I2CAddrAndHandle> _deviceAddrHandles;
+    // Device handle table - indexed by 7-bit address so lookup is O(1) and handles are never evicted (a device
+    // is only added to the bus when it is first accessed so the table just holds the devices in use)
+    static const uint32_t I2C_7BIT_ADDR_COUNT = 128;
+    I2CAddrAndHandle _deviceHandles[I2C_7BIT_ADDR_COUNT];
+
+    // Helpers
+    i2c_master_dev_handle_t getDeviceHandle(uint32_t address);
+    void removeDeviceHandle(uint32_t address);
+    void removeAllDeviceHandles();
 };
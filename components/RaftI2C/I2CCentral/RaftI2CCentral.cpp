@@ -22,9 +22,12 @@
 #include "esp_rom_gpio.h"
 #include "soc/io_mux_reg.h"
 #include "hal/gpio_hal.h"
+#include "hal/gpio_ll.h"
+#include "soc/gpio_sig_map.h"
 #include "esp_private/esp_clk.h"
 #include "esp_private/periph_ctrl.h"
 #include "esp_idf_version.h"
+#include <string.h>
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Consts
@@ -78,12 +81,19 @@ RaftI2CCentral::RaftI2CCentral()
 #else
     vPortCPUInitializeMutex(&_i2cAccessMutex);
 #endif
+
+    // Semaphore used to signal access completion in blocking wait mode
+    _accessCompleteSem = xSemaphoreCreateBinary();
 }
 
 RaftI2CCentral::~RaftI2CCentral()
 {
     // De-init
     deinit();
+
+    // Remove semaphore
+    if (_accessCompleteSem)
+        vSemaphoreDelete(_accessCompleteSem);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -235,6 +245,50 @@ bool RaftI2CCentral::isOperatingOk() const
 RaftRetCode RaftI2CCentral::access(uint32_t address, const uint8_t *pWriteBuf, uint32_t numToWrite,
                                                           uint8_t *pReadBuf, uint32_t numToRead, uint32_t &numRead)
 {
+    // Start the access
+    numRead = 0;
+    RaftRetCode rsltCode = startAccess(address, pWriteBuf, numToWrite, pReadBuf, numToRead);
+    if (rsltCode != RAFT_OK)
+        return rsltCode;
+
+    // Wait for a result
+    return waitForAccessComplete(numRead);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Wait for an access to complete
+// In blocking mode wait for the ISR to signal completion (up to the maximum expected time rounded up to
+// whole ticks) - the polling loop then handles any remaining time
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RaftRetCode RaftI2CCentral::waitForAccessComplete(uint32_t& numRead)
+{
+    if (_blockingWait)
+    {
+        uint32_t waitTicks = (_accessMaxExpectedUs + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000);
+        xSemaphoreTake(_accessCompleteSem, waitTicks + 1);
+    }
+    while (true)
+    {
+        RaftRetCode rsltCode = pollAccess(numRead);
+        if (rsltCode != RAFT_BUS_PENDING)
+            return rsltCode;
+        vTaskDelay(0);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Start an access to the I2C bus (returns once the engine is started - use pollAccess() to get the result)
+// The write and read buffers must remain valid until pollAccess() returns a result other than RAFT_BUS_PENDING
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RaftRetCode RaftI2CCentral::startAccess(uint32_t address, const uint8_t *pWriteBuf, uint32_t numToWrite,
+                                                          uint8_t *pReadBuf, uint32_t numToRead)
+{
+    // Check not already in progress
+    if (_accessInProgress)
+        return RAFT_BUS_NOT_READY;
+
     // Check valid
     if ((numToWrite > 0) && !pWriteBuf)
         return RAFT_BUS_INVALID;
@@ -356,14 +410,31 @@ RaftRetCode RaftI2CCentral::access(uint32_t address, const uint8_t *pWriteBuf, u
     debugShowStatus("access before: ", address);
 #endif
 
+    // Record details of this access for completion handling
+    _accessAddress = address;
+    _accessNumToWrite = numToWrite;
+    _accessNumToRead = numToRead;
+
+    // Start the engine
+    startEngine(cmdIdx, numToRead + 1 + numToWrite + 1);
+    return RAFT_OK;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Start the I2C engine once the command list and FIFO have been prepared
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RaftI2CCentral::startEngine(uint32_t cmdCount, uint32_t totalBytesTxAndRx)
+{
     // Calculate minimum time for entire transaction based on number of bits written/read
-    uint32_t totalBytesTxAndRx = (numToRead + 1 + numToWrite + 1);
     uint32_t totalBitsTxAndRx = totalBytesTxAndRx * 10;
     uint32_t minTotalUs = (totalBitsTxAndRx * 1000) / (_busFrequency / 1000);
 
-    // Add overhead for starting/restarting/ending transmission and any clock stretching, etc
+    // Add overhead for starting/restarting/ending transmission and any clock stretching, etc (the allowance
+    // may have been set from the measured timing of the device - otherwise a worst case is used)
     static const uint32_t CLOCK_STRETCH_MAX_PER_BYTE_US = 250;
-    uint32_t I2C_START_RESTART_END_OVERHEAD_US = 500 + totalBytesTxAndRx * CLOCK_STRETCH_MAX_PER_BYTE_US;
+    uint32_t I2C_START_RESTART_END_OVERHEAD_US = _accessOverheadUs != 0 ? _accessOverheadUs :
+                500 + totalBytesTxAndRx * CLOCK_STRETCH_MAX_PER_BYTE_US;
     uint64_t maxExpectedUs = minTotalUs + I2C_START_RESTART_END_OVERHEAD_US;
 
 #ifdef DEBUG_TIMEOUT_CALCS
@@ -379,9 +450,17 @@ RaftRetCode RaftI2CCentral::access(uint32_t address, const uint8_t *pWriteBuf, u
     _accessNackDetected = false;
     _accessResultCode = RAFT_BUS_PENDING;
 
+    // Clear any stale completion signal
+    if (_blockingWait)
+        xSemaphoreTake(_accessCompleteSem, 0);
+
+    // Record command count and timeout for completion handling
+    _accessCmdCount = cmdCount;
+    _accessMaxExpectedUs = maxExpectedUs;
+
     // Debug
 #ifdef DEBUG_RICI2C_ACCESS
-    debugShowStatus("access ready: ", address);
+    debugShowStatus("access ready: ", _accessAddress);
 #endif
 
     // Debug
@@ -394,17 +473,26 @@ RaftRetCode RaftI2CCentral::access(uint32_t address, const uint8_t *pWriteBuf, u
     I2C_DEVICE.ctr.clk_en = 1;
     I2C_DEVICE.ctr.conf_upgate = 1;
 #endif
+    _accessStartUs = micros();
+    _accessInProgress = true;
     I2C_DEVICE.ctr.trans_start = 1;
+}
 
-    // Wait for a result
-    uint64_t startUs = micros();
-    while ((_accessResultCode == RAFT_BUS_PENDING) &&
-           !Raft::isTimeout((uint64_t)micros(), startUs, maxExpectedUs))
-    {
-        vTaskDelay(0);
-    }
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Poll for completion of an access started with startAccess()
+// Returns RAFT_BUS_PENDING while the access is in progress - otherwise the result of the access
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RaftRetCode RaftI2CCentral::pollAccess(uint32_t &numRead)
+{
+    // Check in progress
+    if (!_accessInProgress)
+        return RAFT_BUS_INVALID;
 
     // Check for software time-out
+    if ((_accessResultCode == RAFT_BUS_PENDING) && 
+            !Raft::isTimeout((uint64_t)micros(), _accessStartUs, _accessMaxExpectedUs))
+        return RAFT_BUS_PENDING;
     if (_accessResultCode == RAFT_BUS_PENDING)
     {
         _accessResultCode = RAFT_BUS_SW_TIME_OUT;
@@ -414,14 +502,14 @@ RaftRetCode RaftI2CCentral::access(uint32_t address, const uint8_t *pWriteBuf, u
     // Check all of the I2C commands to ensure everything was marked done
     if (_accessResultCode == RAFT_OK)
     {
-        for (uint32_t i = 0; i < cmdIdx; i++)
+        for (uint32_t i = 0; i < _accessCmdCount; i++)
         {
             I2C_COMMAND_REG_TYPE *pCmd = (I2C_COMMAND_REG_TYPE*) &(I2C_DEVICE.I2C_COMMAND_0_REGISTER_NAME);
             if (pCmd[i].done == 0)
             {
 #ifdef WARN_RICI2C_ACCESS_INCOMPLETE
                 LOG_I(MODULE_PREFIX, "access incomplete addr %02x writeLen %d readLen %d cmdIdx %d cmd %08lx not done",
-                      address, numToWrite, numToRead, i, pCmd[i]);
+                      _accessAddress, _accessNumToWrite, _accessNumToRead, i, pCmd[i]);
 #endif
                 _accessResultCode = RAFT_BUS_INCOMPLETE;
                 _i2cStats.recordIncompleteTransaction();
@@ -436,7 +524,7 @@ RaftRetCode RaftI2CCentral::access(uint32_t address, const uint8_t *pWriteBuf, u
     String errorMsg;
     bool linesOk = checkI2CLinesOk(errorMsg);
     LOG_I(MODULE_PREFIX, "access timing now %lld elapsedUs %lld maxExpectedUs %lld startUs %lld accessResult %s linesOk %d linesHeld %d",
-          nowUs, nowUs - startUs, maxExpectedUs, startUs, getAccessResultStr(_accessResultCode), linesOk, errorMsg.c_str());
+          nowUs, nowUs - _accessStartUs, _accessMaxExpectedUs, _accessStartUs, getAccessResultStr(_accessResultCode), linesOk, errorMsg.c_str());
 #endif
 
 #if defined(DEBUG_RAFT_I2C_CENTRAL_ISR) || defined(DEBUG_RAFT_I2C_CENTRAL_ISR_ON_FAIL)
@@ -445,7 +533,7 @@ RaftRetCode RaftI2CCentral::access(uint32_t address, const uint8_t *pWriteBuf, u
 #endif
     {
         uint32_t numDebugElems = _debugI2CISR.getCount();
-        debugShowStatus("access after: ", address);
+        debugShowStatus("access after: ", _accessAddress);
         LOG_I(MODULE_PREFIX, "access rslt %s ISR calls ...", getAccessResultStr(_accessResultCode));
         for (uint32_t i = 0; i < numDebugElems; i++)
             LOG_I(MODULE_PREFIX, "... %s", _debugI2CISR.getElem(i).toStr().c_str());
@@ -459,16 +547,240 @@ RaftRetCode RaftI2CCentral::access(uint32_t address, const uint8_t *pWriteBuf, u
     // Clear the read and write buffer pointers defensively - in case of spurious ISRs after this point
     _readBufStartPtr = nullptr;
     _writeBufStartPtr = nullptr;
+    _accessInProgress = false;
 
     // Debug
 #ifdef DEBUG_RICI2C_ACCESS
-    LOG_I(MODULE_PREFIX, "access addr %02x %s", address, getAccessResultStr(_accessResultCode));
-    debugShowStatus("access end: ", address);
+    LOG_I(MODULE_PREFIX, "access addr %02x %s", _accessAddress, getAccessResultStr(_accessResultCode));
+    debugShowStatus("access end: ", _accessAddress);
 #endif
 
     return _accessResultCode;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Access the I2C bus with a batch of transactions
+// Transactions are chained using repeated-start conditions so that as many as will fit into the engine
+// command list (and staging buffers) are performed in a single engine run - this avoids the setup,
+// interrupt and wakeup overhead of separate accesses for (e.g.) multi-register device polls
+// Transactions which can't be chained (e.g. probes or long reads/writes) are performed individually
+// Note that a failure within a chained run is reported against all transactions in that run
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RaftRetCode RaftI2CCentral::accessBatch(AccessBatchItem* pItems, uint32_t numItems)
+{
+    // Check valid
+    if (!pItems)
+        return RAFT_BUS_INVALID;
+
+    // Process items in runs (stopping on the first failure)
+    RaftRetCode rsltCode = RAFT_OK;
+    uint32_t itemIdx = 0;
+    while ((itemIdx < numItems) && (rsltCode == RAFT_OK))
+    {
+        // Handle items that can't be chained
+        if (!isBatchable(pItems[itemIdx]))
+        {
+            AccessBatchItem& item = pItems[itemIdx];
+            item.numRead = 0;
+            item.rslt = access(item.address, item.pWriteBuf, item.numToWrite, item.pReadBuf, item.numToRead, item.numRead);
+            rsltCode = item.rslt;
+            itemIdx++;
+            continue;
+        }
+
+        // Find how many items fit into the run (STOP command is added at the end)
+        uint32_t cmdCount = 1;
+        uint32_t txBytes = 0;
+        uint32_t rxBytes = 0;
+        uint32_t runLen = 0;
+        while (itemIdx + runLen < numItems)
+        {
+            const AccessBatchItem& item = pItems[itemIdx + runLen];
+            if (!isBatchable(item))
+                break;
+            uint32_t itemCmds = getBatchItemCmdCount(item);
+            uint32_t itemTxBytes = 1 + item.numToWrite + (((item.numToWrite > 0) && (item.numToRead > 0)) ? 1 : 0);
+            if ((cmdCount + itemCmds > I2C_ENGINE_CMD_QUEUE_SIZE) ||
+                        (txBytes + itemTxBytes > BATCH_TX_BUF_SIZE) ||
+                        (rxBytes + item.numToRead > BATCH_RX_BUF_SIZE))
+                break;
+            cmdCount += itemCmds;
+            txBytes += itemTxBytes;
+            rxBytes += item.numToRead;
+            runLen++;
+        }
+
+        // Perform the run
+        rsltCode = accessBatchRun(pItems + itemIdx, runLen);
+        itemIdx += runLen;
+    }
+
+    // Items after a failure are not attempted
+    for (; itemIdx < numItems; itemIdx++)
+    {
+        pItems[itemIdx].numRead = 0;
+        pItems[itemIdx].rslt = RAFT_BUS_INCOMPLETE;
+    }
+    return rsltCode;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Probe a set of addresses
+// A NACK ends an engine run so each probe is a separate run - but a probe only takes around 2 byte times
+// so completion is waited for by spinning (rather than yielding or blocking on the ISR) which removes most of
+// the per-probe overhead when scanning
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RaftI2CCentral::probeAddresses(const uint8_t* pAddrs, uint32_t numAddrs, RaftRetCode* pResults)
+{
+    for (uint32_t i = 0; i < numAddrs; i++)
+    {
+        pResults[i] = startAccess(pAddrs[i], nullptr, 0, nullptr, 0);
+        if (pResults[i] != RAFT_OK)
+            continue;
+        uint32_t numRead = 0;
+        while ((pResults[i] = pollAccess(numRead)) == RAFT_BUS_PENDING)
+            ;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Check if a batch item can be chained with others in a single engine run
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RaftI2CCentral::isBatchable(const AccessBatchItem& item)
+{
+    // Probes (zero length) and items needing multiple write/read commands are performed on their own
+    if ((item.numToWrite == 0) && (item.numToRead == 0))
+        return false;
+    if ((item.numToWrite > 0) && !item.pWriteBuf)
+        return false;
+    if ((item.numToRead > 0) && !item.pReadBuf)
+        return false;
+    return (item.numToWrite + 1 <= I2C_ENGINE_CMD_MAX_TX_BYTES) && (item.numToRead <= I2C_ENGINE_CMD_MAX_RX_BYTES);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Get the number of engine commands required for a batch item
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t RaftI2CCentral::getBatchItemCmdCount(const AccessBatchItem& item)
+{
+    // Start (or restart) and address (+ write data)
+    uint32_t cmdCount = 2;
+    // Restart and address+READ
+    if ((item.numToWrite > 0) && (item.numToRead > 0))
+        cmdCount += 2;
+    // Read (the last byte is read in a separate NACKed command)
+    if (item.numToRead > 0)
+        cmdCount += (item.numToRead > 1) ? 2 : 1;
+    return cmdCount;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Perform one engine run for a set of chained batch items
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RaftRetCode RaftI2CCentral::accessBatchRun(AccessBatchItem* pItems, uint32_t numItems)
+{
+#if defined(DEBUG_RAFT_I2C_CENTRAL_ISR) || defined(DEBUG_RAFT_I2C_CENTRAL_ISR_ON_FAIL)
+    _debugI2CISR.clear();
+#endif
+
+    // Check not already in progress
+    if (_accessInProgress)
+        return RAFT_BUS_NOT_READY;
+
+    // Ensure the engine is ready
+    if (!ensureI2CReady())
+        return RAFT_BUS_NOT_READY;
+
+    // Prepare I2C engine for access
+    prepareI2CAccess();
+
+    // Build the command list and the staging buffer of bytes to send (including addresses)
+    uint32_t cmdIdx = 0;
+    uint32_t txPos = 0;
+    uint32_t totalRead = 0;
+    uint32_t totalWrite = 0;
+    for (uint32_t i = 0; i < numItems; i++)
+    {
+        const AccessBatchItem& item = pItems[i];
+        bool writeThenRead = (item.numToWrite > 0) && (item.numToRead > 0);
+
+        // Start/restart and address+RW followed by any write data
+        setI2CCommand(cmdIdx++, ESP32_I2C_CMD_RSTART, 0, false, false, false);
+        setI2CCommand(cmdIdx++, ESP32_I2C_CMD_WRITE, item.numToWrite + 1, false, false, true);
+        _batchTxBuf[txPos++] = (item.address << 1) | ((item.numToWrite == 0) ? 1 : 0);
+        if (item.numToWrite > 0)
+            memcpy(_batchTxBuf + txPos, item.pWriteBuf, item.numToWrite);
+        txPos += item.numToWrite;
+
+        // Restart and address+READ
+        if (writeThenRead)
+        {
+            setI2CCommand(cmdIdx++, ESP32_I2C_CMD_RSTART, 0, false, false, false);
+            setI2CCommand(cmdIdx++, ESP32_I2C_CMD_WRITE, 1, false, false, true);
+            _batchTxBuf[txPos++] = (item.address << 1) | 1;
+        }
+
+        // Reads - ACK all but the last byte which is NACKed
+        if (item.numToRead > 1)
+            setI2CCommand(cmdIdx++, ESP32_I2C_CMD_READ, item.numToRead - 1, false, false, false);
+        if (item.numToRead > 0)
+            setI2CCommand(cmdIdx++, ESP32_I2C_CMD_READ, 1, true, false, false);
+        totalRead += item.numToRead;
+        totalWrite += item.numToWrite;
+    }
+
+    // Stop condition
+    setI2CCommand(cmdIdx++, ESP32_I2C_CMD_STOP, 0, false, false, false);
+
+    // Store the read and write buffer pointers and lengths - address bytes are in the staging buffer
+    _readBufStartPtr = _batchRxBuf;
+    _readBufMaxLen = totalRead;
+    _readBufPos = 0;
+    _writeBufStartPtr = _batchTxBuf;
+    _writeBufPos = 0;
+    _writeBufLen = txPos;
+    _startAddrPlusRWRequired = false;
+    _restartAddrPlusRWRequired = false;
+
+    // Fill the Tx FIFO and ensure that FIFO interrupts are disabled if they are not required
+    uint32_t interruptsToDisable = fillTxFifo();
+    _interruptEnFlags = INTERRUPT_BASE_ENABLES & ~interruptsToDisable;
+
+#ifdef DEBUG_I2C_COMMANDS
+    LOG_I(MODULE_PREFIX, "accessBatchRun numItems %d cmdIdx %d txBytes %d rxBytes %d",
+          numItems, cmdIdx, txPos, totalRead);
+#endif
+
+    // Record details of this access for completion handling
+    _accessAddress = pItems[0].address;
+    _accessNumToWrite = totalWrite;
+    _accessNumToRead = totalRead;
+
+    // Start the engine and wait for completion
+    startEngine(cmdIdx, txPos + totalRead);
+    uint32_t numRead = 0;
+    RaftRetCode rsltCode = waitForAccessComplete(numRead);
+
+    // Scatter the read data into the item buffers
+    uint32_t rxPos = 0;
+    for (uint32_t i = 0; i < numItems; i++)
+    {
+        AccessBatchItem& item = pItems[i];
+        uint32_t toCopy = (rxPos + item.numToRead <= numRead) ? item.numToRead : (rxPos < numRead ? numRead - rxPos : 0);
+        if (toCopy > 0)
+            memcpy(item.pReadBuf, _batchRxBuf + rxPos, toCopy);
+        rxPos += toCopy;
+        item.numRead = toCopy;
+        item.rslt = rsltCode;
+    }
+    return rsltCode;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Check that the I2C module is ready and reset it if not
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -635,14 +947,101 @@ void RaftI2CCentral::reinitI2CModule()
 #endif
 
     // Set bus frequency
-    setBusFrequency(_busFrequency);
+    applyBusFrequency(_busFrequency);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Change I2C bus frequency between accesses
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RaftI2CCentral::setBusFrequency(uint32_t busFrequency)
+{
+    // Check ok to change
+    if (!_isInitialised || _accessInProgress || (busFrequency == 0))
+        return false;
+    if (busFrequency == _busFrequency)
+        return true;
+
+    // Apply (the frequency is also used for access time-out calculations)
+    _busFrequency = busFrequency;
+    return applyBusFrequency(_busFrequency);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Set I2C bus frequency
+// Bus recovery by clocking - SCL is pulsed until the device holding SDA low releases it and then a STOP
+// condition is generated (if required)
+// The pins are driven with direct GPIO register writes (detached from the I2C engine) so pulses are at close
+// to the bus frequency, the I2C engine is re-initialised afterwards
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-bool RaftI2CCentral::setBusFrequency(uint32_t busFreq)
+bool RaftI2CCentral::busRecoveryClocking(uint32_t maxSCLPulses, bool sendStop)
+{
+    // Check ok
+    if (!_isInitialised || _accessInProgress || (_pinSDA < 0) || (_pinSCL < 0))
+        return false;
+
+    // Half period of the bus clock (pins are open-drain so a high level releases the line)
+    uint32_t halfPeriodUs = (500000 + _busFrequency - 1) / _busFrequency;
+    gpio_ll_set_level(&GPIO, (gpio_num_t)_pinSDA, 1);
+    gpio_ll_set_level(&GPIO, (gpio_num_t)_pinSCL, 1);
+    connectBusPinOutputs(false);
+
+    // Pulse SCL until SDA is released
+    for (uint32_t pulseIdx = 0; pulseIdx < maxSCLPulses; pulseIdx++)
+    {
+        if (gpio_ll_get_level(&GPIO, (gpio_num_t)_pinSDA))
+            break;
+        gpio_ll_set_level(&GPIO, (gpio_num_t)_pinSCL, 0);
+        delayMicroseconds(halfPeriodUs);
+        gpio_ll_set_level(&GPIO, (gpio_num_t)_pinSCL, 1);
+        delayMicroseconds(halfPeriodUs);
+    }
+
+    // STOP condition (SDA rising while SCL is high)
+    if (sendStop)
+    {
+        gpio_ll_set_level(&GPIO, (gpio_num_t)_pinSCL, 0);
+        delayMicroseconds(halfPeriodUs);
+        gpio_ll_set_level(&GPIO, (gpio_num_t)_pinSDA, 0);
+        delayMicroseconds(halfPeriodUs);
+        gpio_ll_set_level(&GPIO, (gpio_num_t)_pinSCL, 1);
+        delayMicroseconds(halfPeriodUs);
+        gpio_ll_set_level(&GPIO, (gpio_num_t)_pinSDA, 1);
+        delayMicroseconds(halfPeriodUs);
+    }
+
+    // Check lines released
+    bool linesReleased = gpio_ll_get_level(&GPIO, (gpio_num_t)_pinSDA) && gpio_ll_get_level(&GPIO, (gpio_num_t)_pinSCL);
+
+    // Reconnect to the I2C engine and re-init it as it may have been part way through a transaction
+    connectBusPinOutputs(true);
+    reinitI2CModule();
+    return linesReleased;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Connect SDA and SCL outputs to the I2C engine or to the GPIO output registers (inputs remain connected
+// to the I2C engine)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void RaftI2CCentral::connectBusPinOutputs(bool toI2CEngine)
+{
+#if defined(CONFIG_IDF_TARGET_ESP32S3) || defined(CONFIG_IDF_TARGET_ESP32C3) || defined(CONFIG_IDF_TARGET_ESP32C6)
+    uint32_t sdaOutSig = i2c_periph_signal[_i2cPort].sda_out_sig;
+    uint32_t sclOutSig = i2c_periph_signal[_i2cPort].scl_out_sig;
+#else
+    uint32_t sdaOutSig = _i2cPort == 0 ? I2CEXT0_SDA_OUT_IDX : I2CEXT1_SDA_OUT_IDX;
+    uint32_t sclOutSig = _i2cPort == 0 ? I2CEXT0_SCL_OUT_IDX : I2CEXT1_SCL_OUT_IDX;
+#endif
+    esp_rom_gpio_connect_out_signal((gpio_num_t)_pinSDA, toI2CEngine ? sdaOutSig : SIG_GPIO_OUT_IDX, false, false);
+    esp_rom_gpio_connect_out_signal((gpio_num_t)_pinSCL, toI2CEngine ? sclOutSig : SIG_GPIO_OUT_IDX, false, false);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Set I2C bus frequency registers
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool RaftI2CCentral::applyBusFrequency(uint32_t busFreq)
 {
 #if defined(CONFIG_IDF_TARGET_ESP32S3) || defined(CONFIG_IDF_TARGET_ESP32C3) || defined(CONFIG_IDF_TARGET_ESP32C6)
 
@@ -668,7 +1067,7 @@ bool RaftI2CCentral::setBusFrequency(uint32_t busFreq)
     // log(20*half_cycle)/log(2) = log(half_cycle)/log(2) +  log(20)/log(2)
     clk_cal.tout = (int)(sizeof(half_cycle) * 8 - __builtin_clz(5 * half_cycle)) + 2;
 
-    // LOG_I(MODULE_PREFIX, "setBusFrequency %ld, sourceClockFreq %ld, clkm_div %ld, sclk_freq %ld, half_cycle %ld, scl_low %ld, scl_wait_high %ld, scl_high %ld, sda_hold %ld, sda_sample %ld, setup %ld, hold %ld, tout %ld",
+    // LOG_I(MODULE_PREFIX, "applyBusFrequency %ld, sourceClockFreq %ld, clkm_div %ld, sclk_freq %ld, half_cycle %ld, scl_low %ld, scl_wait_high %ld, scl_high %ld, sda_hold %ld, sda_sample %ld, setup %ld, hold %ld, tout %ld",
     //     busFreq, sourceClockFreq, clkm_div, sclk_freq, half_cycle, clk_cal.scl_low, clk_cal.scl_wait_high, clk_cal.scl_high, clk_cal.sda_hold, clk_cal.sda_sample, clk_cal.setup, clk_cal.hold, clk_cal.tout);
 
     // Ensure 32bit access
@@ -926,6 +1325,15 @@ void RaftI2CCentral::i2cISR()
         // Set flag indicating successful completion
         if (_accessResultCode == RAFT_BUS_PENDING)
             _accessResultCode = rsltCode;
+
+        // Signal completion to a blocked access()
+        if (_blockingWait)
+        {
+            BaseType_t higherPriorityTaskWoken = pdFALSE;
+            xSemaphoreGiveFromISR(_accessCompleteSem, &higherPriorityTaskWoken);
+            if (higherPriorityTaskWoken)
+                portYIELD_FROM_ISR();
+        }
         return;
     }
 
@@ -38,8 +38,32 @@ public:
     virtual RaftRetCode access(uint32_t address, const uint8_t* pWriteBuf, uint32_t numToWrite,
                     uint8_t* pReadBuf, uint32_t numToRead, uint32_t& numRead) override final;
 
+    // Access the bus with a batch of transactions (chained with repeated-starts in as few engine runs as possible)
+    virtual RaftRetCode accessBatch(AccessBatchItem* pItems, uint32_t numItems) override final;
+
+    // Probe a set of addresses back-to-back (waits for each probe without yielding)
+    virtual void probeAddresses(const uint8_t* pAddrs, uint32_t numAddrs, RaftRetCode* pResults) override final;
+
     // Check if bus operating ok
     virtual bool isOperatingOk() const override final;
+
+    // Change the bus frequency between accesses (the clock registers are only written when it changes)
+    virtual bool setBusFrequency(uint32_t busFrequency) override final;
+
+    // Bus recovery by driving SCL and SDA with direct GPIO register writes
+    virtual bool busRecoveryClocking(uint32_t maxSCLPulses, bool sendStop) override final;
+
+    // Set the timeout allowance for overhead and clock stretching
+    virtual void setAccessOverheadUs(uint32_t overheadUs) override final
+    {
+        _accessOverheadUs = overheadUs;
+    }
+
+    // Set blocking wait mode
+    virtual void setBlockingWait(bool blockingWait) override final
+    {
+        _blockingWait = blockingWait && _accessCompleteSem;
+    }
      
 private:
     // Settings
@@ -72,6 +96,28 @@ private:
     volatile bool _accessNackDetected = false;
     volatile RaftRetCode _accessResultCode = RAFT_BUS_PENDING;
 
+    // Access in progress (started by startAccess and completed by pollAccess)
+    bool _accessInProgress = false;
+    uint32_t _accessAddress = 0;
+    uint32_t _accessNumToWrite = 0;
+    uint32_t _accessNumToRead = 0;
+    uint32_t _accessCmdCount = 0;
+    uint64_t _accessStartUs = 0;
+    uint64_t _accessMaxExpectedUs = 0;
+
+    // Timeout allowance for overhead and clock stretching (0 for default worst case)
+    uint32_t _accessOverheadUs = 0;
+
+    // Batch staging buffers - all bytes (including address bytes) sent in one engine run and all bytes read
+    static const uint32_t BATCH_TX_BUF_SIZE = 64;
+    static const uint32_t BATCH_RX_BUF_SIZE = 128;
+    uint8_t _batchTxBuf[BATCH_TX_BUF_SIZE];
+    uint8_t _batchRxBuf[BATCH_RX_BUF_SIZE];
+
+    // Blocking wait - the ISR gives the semaphore when the access completes
+    volatile bool _blockingWait = false;
+    SemaphoreHandle_t _accessCompleteSem = nullptr;
+
     // Interrupt handle, clear and enable flags
     intr_handle_t _i2cISRHandle = nullptr;
     uint32_t _interruptClearFlags = 0;
@@ -254,7 +300,8 @@ private:
     bool ensureI2CReady();
     void prepareI2CAccess();
     void reinitI2CModule();
-    bool setBusFrequency(uint32_t busFreq);
+    bool applyBusFrequency(uint32_t busFreq);
+    void connectBusPinOutputs(bool toI2CEngine);
     uint32_t getApbFrequency();
     void setI2CCommand(uint32_t cmdIdx, uint8_t op_code, uint8_t byte_num, bool ack_val, bool ack_exp, bool ack_en);
     bool initInterrupts();
@@ -265,6 +312,14 @@ private:
     uint32_t IRAM_ATTR fillTxFifo();
     uint32_t IRAM_ATTR emptyRxFifo();
     void setDefaultTimeout();
+    void startEngine(uint32_t cmdCount, uint32_t totalBytesTxAndRx);
+    RaftRetCode waitForAccessComplete(uint32_t& numRead);
+    RaftRetCode startAccess(uint32_t address, const uint8_t* pWriteBuf, uint32_t numToWrite,
+                    uint8_t* pReadBuf, uint32_t numToRead);
+    RaftRetCode pollAccess(uint32_t& numRead);
+    uint32_t getBatchItemCmdCount(const AccessBatchItem& item);
+    bool isBatchable(const AccessBatchItem& item);
+    RaftRetCode accessBatchRun(AccessBatchItem* pItems, uint32_t numItems);
 
     // Debugging
     static String debugMainStatusStr(const char* prefix, uint32_t statusFlags);
@@ -36,9 +36,84 @@ public:
     virtual RaftRetCode access(uint32_t address, const uint8_t* pWriteBuf, uint32_t numToWrite,
                     uint8_t* pReadBuf, uint32_t numToRead, uint32_t& numRead) = 0;
 
+    // Batch access item - each item is a write, read or write-restart-read to one address
+    class AccessBatchItem
+    {
+    public:
+        uint32_t address = 0;
+        const uint8_t* pWriteBuf = nullptr;
+        uint32_t numToWrite = 0;
+        uint8_t* pReadBuf = nullptr;
+        uint32_t numToRead = 0;
+        uint32_t numRead = 0;
+        RaftRetCode rslt = RAFT_BUS_PENDING;
+    };
+
+    // Access the bus with a batch of transactions - results are stored in each item and the return
+    // value is RAFT_OK if all succeeded (otherwise the first failure)
+    // The batch stops on the first failure and items which are not attempted have RAFT_BUS_INCOMPLETE results
+    // The default implementation performs each access in turn
+    virtual RaftRetCode accessBatch(AccessBatchItem* pItems, uint32_t numItems)
+    {
+        RaftRetCode rsltCode = RAFT_OK;
+        for (uint32_t i = 0; i < numItems; i++)
+        {
+            AccessBatchItem& item = pItems[i];
+            item.numRead = 0;
+            if (rsltCode != RAFT_OK)
+            {
+                item.rslt = RAFT_BUS_INCOMPLETE;
+                continue;
+            }
+            item.rslt = access(item.address, item.pWriteBuf, item.numToWrite, item.pReadBuf, item.numToRead, item.numRead);
+            rsltCode = item.rslt;
+        }
+        return rsltCode;
+    }
+
+    // Probe a set of addresses (zero-length access to each) - a result is stored for each address and,
+    // unlike accessBatch(), a failed probe doesn't stop the remainder
+    // The default implementation performs each probe with access()
+    virtual void probeAddresses(const uint8_t* pAddrs, uint32_t numAddrs, RaftRetCode* pResults)
+    {
+        for (uint32_t i = 0; i < numAddrs; i++)
+        {
+            uint32_t numRead = 0;
+            pResults[i] = access(pAddrs[i], nullptr, 0, nullptr, 0, numRead);
+        }
+    }
+
     // Check if bus operating ok
     virtual bool isOperatingOk() const = 0;
 
+    // Change the bus frequency between accesses (if supported) - returns false if not supported or if an
+    // access is in progress (the frequency passed to init() remains in use)
+    virtual bool setBusFrequency(uint32_t busFrequency)
+    {
+        return false;
+    }
+
+    // Bus recovery by driving the bus lines directly (if supported) - SCL is pulsed (up to maxSCLPulses times)
+    // until SDA is released and then a STOP condition is generated if sendStop is true (maxSCLPulses may be 0
+    // to just send a STOP) - returns false if not supported or if either line is still held low
+    virtual bool busRecoveryClocking(uint32_t maxSCLPulses, bool sendStop)
+    {
+        return false;
+    }
+
+    // Set the allowance added to the bit time of an access for start/stop overhead and clock stretching when
+    // calculating the software timeout (if supported) - applies to subsequent accesses (and to each engine run
+    // of a batch) and 0 reverts to the default worst case allowance
+    virtual void setAccessOverheadUs(uint32_t overheadUs)
+    {
+    }
+
+    // Set blocking wait mode (if supported) - when true access() blocks until the transaction completes
+    // rather than yielding repeatedly while waiting
+    virtual void setBlockingWait(bool blockingWait)
+    {
+    }
+
     // Debugging
     class I2CStats
     {
@@ -125,5 +200,4 @@ public:
 protected:
     // I2C stats
     I2CStats _i2cStats;
-
 };
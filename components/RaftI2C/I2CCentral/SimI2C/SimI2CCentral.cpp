@@ -0,0 +1,222 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// SimI2CCentral.cpp
+// Simulated I2C Central (for host-side tests and repeatable performance measurements)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include "SimI2CCentral.h"
+#include "Logger.h"
+
+// #define DEBUG_SIM_I2C_ACCESS
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Constructor
+SimI2CCentral::SimI2CCentral()
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Destructor
+SimI2CCentral::~SimI2CCentral()
+{
+    deinit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Initialise the simulated bus
+/// @param i2cPort (unused)
+/// @param pinSDA (unused)
+/// @param pinSCL (unused)
+/// @param busFrequency bus frequency
+/// @param busFilteringLevel (unused)
+/// @return true if successful
+bool SimI2CCentral::init(uint8_t i2cPort, uint16_t pinSDA, uint16_t pinSCL, uint32_t busFrequency,
+            uint32_t busFilteringLevel)
+{
+    if (busFrequency == 0)
+        return false;
+    _busFrequency = busFrequency;
+    _isInitialised = true;
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief De-initialise
+void SimI2CCentral::deinit()
+{
+    _isInitialised = false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Access a simulated device
+/// @param address I2C address
+/// @param pWriteBuf data to write
+/// @param numToWrite number of bytes to write
+/// @param pReadBuf buffer for read data
+/// @param numToRead number of bytes to read
+/// @param numRead (out) number of bytes read
+/// @return result code
+RaftRetCode SimI2CCentral::access(uint32_t address, const uint8_t* pWriteBuf, uint32_t numToWrite,
+                uint8_t* pReadBuf, uint32_t numToRead, uint32_t& numRead)
+{
+    numRead = 0;
+    if (!_isInitialised)
+        return RAFT_BUS_NOT_INIT;
+    _accessCount++;
+    _i2cStats.update(true, false, false, false, false, false, false);
+
+    // Stuck lines prevent the start condition
+    if (_sdaStuck || _sclStuck)
+    {
+        recordAccessTime(getAccessTimeUs(0, 0));
+        return RAFT_BUS_STUCK;
+    }
+
+    // General call is received by all visible devices which support it (acknowledged if any do)
+    if (address == GENERAL_CALL_ADDR)
+        return accessGeneralCall(pWriteBuf, numToWrite);
+
+    // Address phase
+    SimI2CDevice* pDevice = findVisibleDevice(address);
+    if (!pDevice || !pDevice->checkAck())
+    {
+        recordAccessTime(getAccessTimeUs(0, 0));
+        _i2cStats.update(false, true, false, false, false, false, false);
+#ifdef DEBUG_SIM_I2C_ACCESS
+        LOG_I(MODULE_PREFIX, "access addr 0x%02x NACK", address);
+#endif
+        return RAFT_BUS_ACK_ERROR;
+    }
+
+    // Clock stretching beyond the software timeout allowance
+    uint32_t accessTimeUs = getAccessTimeUs(numToWrite, numToRead);
+    uint32_t timeoutOverheadUs = _accessOverheadUs != 0 ? _accessOverheadUs : DEFAULT_SW_TIMEOUT_OVERHEAD_US;
+    if (pDevice->getClockStretchUs() > timeoutOverheadUs)
+    {
+        recordAccessTime(accessTimeUs + timeoutOverheadUs);
+        _i2cStats.recordSoftwareTimeout();
+        return RAFT_BUS_SW_TIME_OUT;
+    }
+
+    // Data phases
+    if (numToWrite > 0)
+        pDevice->write(pWriteBuf, numToWrite);
+    if ((numToRead > 0) && pReadBuf)
+    {
+        pDevice->read(pReadBuf, numToRead);
+        numRead = numToRead;
+    }
+    recordAccessTime(accessTimeUs + pDevice->getClockStretchUs());
+    _i2cStats.update(false, false, false, true, false, true, false);
+
+#ifdef DEBUG_SIM_I2C_ACCESS
+    LOG_I(MODULE_PREFIX, "access addr 0x%02x numToWrite %d numToRead %d timeUs %d",
+                address, numToWrite, numToRead, accessTimeUs + pDevice->getClockStretchUs());
+#endif
+    return RAFT_OK;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief General call (write to address 0x00)
+/// @param pWriteBuf data to write
+/// @param numToWrite number of bytes to write
+/// @return result code (RAFT_BUS_ACK_ERROR if no device acknowledged)
+RaftRetCode SimI2CCentral::accessGeneralCall(const uint8_t* pWriteBuf, uint32_t numToWrite)
+{
+    bool isAcked = false;
+    for (SimI2CDevice* pDevice : _devices)
+    {
+        if (!pDevice->isGeneralCallEnabled() || !pDevice->isOnline() || !isVisible(pDevice) || !pDevice->checkAck())
+            continue;
+        pDevice->generalCall(pWriteBuf, numToWrite);
+        isAcked = true;
+    }
+    recordAccessTime(getAccessTimeUs(isAcked ? numToWrite : 0, 0));
+    if (!isAcked)
+    {
+        _i2cStats.update(false, true, false, false, false, false, false);
+        return RAFT_BUS_ACK_ERROR;
+    }
+    _i2cStats.update(false, false, false, true, false, true, false);
+    return RAFT_OK;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Bus recovery by clocking
+/// @param maxSCLPulses max SCL pulses
+/// @param sendStop true to send a STOP
+/// @return true if the bus lines are released
+bool SimI2CCentral::busRecoveryClocking(uint32_t maxSCLPulses, bool sendStop)
+{
+    if (_sclStuck)
+        return false;
+    if (_sdaStuck && (_sdaStuckPulsesToClear != 0) && (_sdaStuckPulsesToClear <= maxSCLPulses))
+        _sdaStuck = false;
+    return !_sdaStuck;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Attach a device
+/// @param pDevice device (owned by the caller)
+void SimI2CCentral::addDevice(SimI2CDevice* pDevice)
+{
+    if (pDevice && (std::find(_devices.begin(), _devices.end(), pDevice) == _devices.end()))
+        _devices.push_back(pDevice);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Detach a device
+/// @param pDevice device
+void SimI2CCentral::removeDevice(SimI2CDevice* pDevice)
+{
+    _devices.erase(std::remove(_devices.begin(), _devices.end(), pDevice), _devices.end());
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the time taken by an access on the bus (excluding clock stretching)
+/// @param numToWrite number of bytes written
+/// @param numToRead number of bytes read
+/// @return time in us (nine bits per byte including the address byte(s) plus start, restart and stop)
+uint32_t SimI2CCentral::getAccessTimeUs(uint32_t numToWrite, uint32_t numToRead) const
+{
+    uint32_t numBits = 2 + (1 + numToWrite) * 9;
+    if (numToRead > 0)
+        numBits += 1 + (1 + numToRead) * 9;
+    return ((uint64_t)numBits * 1000000) / _busFrequency;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Find a visible (acknowledging) device at an address
+/// @param i2cAddr address
+/// @return device or nullptr if none
+SimI2CDevice* SimI2CCentral::findVisibleDevice(uint32_t i2cAddr) const
+{
+    for (SimI2CDevice* pDevice : _devices)
+    {
+        if ((pDevice->getI2CAddr() == i2cAddr) && pDevice->isOnline() && isVisible(pDevice))
+            return pDevice;
+    }
+    return nullptr;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Check a device is visible (on the main bus or downstream of enabled mux channels)
+/// @param pDevice device
+/// @return true if visible
+bool SimI2CCentral::isVisible(const SimI2CDevice* pDevice)
+{
+    for (uint32_t depth = 0; depth < MAX_MUX_DEPTH; depth++)
+    {
+        const SimI2CMuxPCA9548* pMux = pDevice->getParentMux();
+        if (!pMux)
+            return true;
+        if (!pMux->isOnline() || !pMux->isChannelEnabled(pDevice->getParentChannel()))
+            return false;
+        pDevice = pMux;
+    }
+    return false;
+}
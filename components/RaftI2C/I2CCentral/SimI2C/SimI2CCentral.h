@@ -0,0 +1,157 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// SimI2CCentral.h
+// Simulated I2C Central (for host-side tests and repeatable performance measurements)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+#include "RaftI2CCentralIF.h"
+#include "SimI2CDevices.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class SimI2CCentral
+/// @brief I2C central which accesses simulated devices
+/// @note Time is simulated - each access advances the simulated time by the bit time at the current bus frequency
+///       plus any clock stretching by the device so results don't depend on the host. Faults (NACKs, offline
+///       devices, stuck SDA/SCL lines and clock stretching beyond the software timeout) can be injected.
+///       Devices are owned by the caller and must remain valid while attached
+class SimI2CCentral : public RaftI2CCentralIF
+{
+public:
+    SimI2CCentral();
+    virtual ~SimI2CCentral();
+
+    // Init/de-init
+    virtual bool init(uint8_t i2cPort, uint16_t pinSDA, uint16_t pinSCL, uint32_t busFrequency,
+                uint32_t busFilteringLevel = DEFAULT_BUS_FILTER_LEVEL) override final;
+    virtual void deinit() override final;
+
+    // Busy
+    virtual bool isBusy() override final
+    {
+        return false;
+    }
+
+    // Access the bus
+    virtual RaftRetCode access(uint32_t address, const uint8_t* pWriteBuf, uint32_t numToWrite,
+                    uint8_t* pReadBuf, uint32_t numToRead, uint32_t& numRead) override final;
+
+    // Check if bus operating ok
+    virtual bool isOperatingOk() const override final
+    {
+        return !_sdaStuck && !_sclStuck;
+    }
+
+    // Change the bus frequency between accesses
+    virtual bool setBusFrequency(uint32_t busFrequency) override final
+    {
+        if (!_isInitialised || (busFrequency == 0))
+            return false;
+        _busFrequency = busFrequency;
+        return true;
+    }
+
+    // Bus recovery - SDA stuck is cleared if enough SCL pulses are sent (SCL stuck can't be cleared)
+    virtual bool busRecoveryClocking(uint32_t maxSCLPulses, bool sendStop) override final;
+
+    // Set the allowance for timeout calculation (clock stretching beyond this results in a software timeout)
+    virtual void setAccessOverheadUs(uint32_t overheadUs) override final
+    {
+        _accessOverheadUs = overheadUs;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Attach a device to the bus (or downstream of a mux if its parent is set)
+    /// @param pDevice device (owned by the caller)
+    void addDevice(SimI2CDevice* pDevice);
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Detach a device
+    /// @param pDevice device
+    void removeDevice(SimI2CDevice* pDevice);
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Set SDA stuck low (e.g. a device part way through a read when the controller was reset)
+    /// @param isStuck true if stuck
+    /// @param pulsesToClear number of SCL pulses required to release SDA (0 if clocking doesn't release it)
+    void setSDAStuck(bool isStuck, uint32_t pulsesToClear = 9)
+    {
+        _sdaStuck = isStuck;
+        _sdaStuckPulsesToClear = pulsesToClear;
+    }
+
+    // Set SCL stuck low
+    void setSCLStuck(bool isStuck)
+    {
+        _sclStuck = isStuck;
+    }
+
+    // Simulated time (advanced by each access)
+    uint64_t getSimTimeUs() const
+    {
+        return _simTimeUs;
+    }
+    void advanceSimTimeUs(uint64_t timeUs)
+    {
+        _simTimeUs += timeUs;
+    }
+
+    // Get counts
+    uint32_t getAccessCount() const
+    {
+        return _accessCount;
+    }
+    uint64_t getBusBusyUs() const
+    {
+        return _busBusyUs;
+    }
+
+    // Get the time taken by an access (excluding clock stretching)
+    uint32_t getAccessTimeUs(uint32_t numToWrite, uint32_t numToRead) const;
+
+    // Software timeout when no allowance is set
+    static const uint32_t DEFAULT_SW_TIMEOUT_OVERHEAD_US = 10000;
+
+    // Max depth of nested muxes
+    static const uint32_t MAX_MUX_DEPTH = 4;
+
+    // General call address
+    static const uint32_t GENERAL_CALL_ADDR = 0x00;
+
+private:
+    // Settings
+    uint32_t _busFrequency = 100000;
+    uint32_t _accessOverheadUs = 0;
+    bool _isInitialised = false;
+
+    // Devices
+    std::vector<SimI2CDevice*> _devices;
+
+    // Faults
+    bool _sdaStuck = false;
+    uint32_t _sdaStuckPulsesToClear = 0;
+    bool _sclStuck = false;
+
+    // Time and counts
+    uint64_t _simTimeUs = 0;
+    uint64_t _busBusyUs = 0;
+    uint32_t _accessCount = 0;
+
+    // Helpers
+    RaftRetCode accessGeneralCall(const uint8_t* pWriteBuf, uint32_t numToWrite);
+    SimI2CDevice* findVisibleDevice(uint32_t i2cAddr) const;
+    static bool isVisible(const SimI2CDevice* pDevice);
+    void recordAccessTime(uint32_t timeUs)
+    {
+        _simTimeUs += timeUs;
+        _busBusyUs += timeUs;
+    }
+
+    // Debug
+    static constexpr const char* MODULE_PREFIX = "SimI2CCentral";
+};
@@ -0,0 +1,210 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// SimI2CDevices.cpp
+// Models of I2C devices for the simulated I2C central
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string>
+#include "SimI2CDevices.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Create a register file device from the detectionValues of a device type record
+/// @param i2cAddr address
+/// @param pDetectionValues detection values
+/// @return device (caller owns)
+SimI2CRegDevice* SimI2CRegDevice::createFromDetectionValues(uint8_t i2cAddr, const char* pDetectionValues)
+{
+    // Parse each detection value (reg=value separated by &)
+    class RegAndValue
+    {
+    public:
+        uint32_t regAddr;
+        std::vector<uint8_t> value;
+    };
+    std::vector<RegAndValue> regValues;
+    uint32_t regAddrBytes = 1;
+    std::string detStr = pDetectionValues ? pDetectionValues : "";
+    size_t itemStart = 0;
+    while (itemStart < detStr.length())
+    {
+        size_t itemEnd = detStr.find('&', itemStart);
+        if (itemEnd == std::string::npos)
+            itemEnd = detStr.length();
+        std::string item = detStr.substr(itemStart, itemEnd - itemStart);
+        itemStart = itemEnd + 1;
+
+        // Only simple register reads are modelled (register address and expected value each in 0x or 0b form)
+        size_t eqPos = item.find('=');
+        if ((eqPos == std::string::npos) || (item.compare(0, 2, "0x") != 0))
+            continue;
+        std::string regStr = item.substr(2, eqPos - 2);
+        std::string valStr = item.substr(eqPos + 1);
+        size_t commaPos = valStr.find(',');
+        if (commaPos != std::string::npos)
+            valStr = valStr.substr(0, commaPos);
+        if ((regStr.length() == 0) || (valStr.length() < 3) || (valStr[0] != '0'))
+            continue;
+
+        // Value bytes (X bits are 0)
+        RegAndValue regValue;
+        regValue.regAddr = strtoul(regStr.c_str(), nullptr, 16);
+        std::string digits = valStr.substr(2);
+        if (valStr[1] == 'x')
+        {
+            for (size_t i = 0; i < digits.length(); i += 2)
+                regValue.value.push_back(strtoul(digits.substr(i, 2).c_str(), nullptr, 16));
+        }
+        else if (valStr[1] == 'b')
+        {
+            uint8_t byteVal = 0;
+            for (size_t i = 0; i < digits.length(); i++)
+            {
+                byteVal = (byteVal << 1) | (digits[i] == '1' ? 1 : 0);
+                if ((i % 8 == 7) || (i == digits.length() - 1))
+                {
+                    regValue.value.push_back(byteVal);
+                    byteVal = 0;
+                }
+            }
+        }
+        if (regValue.value.size() == 0)
+            continue;
+        if (regValues.size() == 0)
+            regAddrBytes = (regStr.length() + 1) / 2;
+        regValues.push_back(regValue);
+    }
+
+    // Create device
+    uint32_t regWidthBytes = regValues.size() > 0 ? regValues[0].value.size() : 1;
+    SimI2CRegDevice* pDevice = new SimI2CRegDevice(i2cAddr, regAddrBytes, regWidthBytes);
+    for (const RegAndValue& regValue : regValues)
+        pDevice->setReg(regValue.regAddr, regValue.value);
+    return pDevice;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Set register value
+/// @param regAddr register address
+/// @param value bytes in the order they are read (truncated or padded with 0 to the register width)
+void SimI2CRegDevice::setReg(uint32_t regAddr, const std::vector<uint8_t>& value)
+{
+    SimReg* pReg = findReg(regAddr, true);
+    for (uint32_t i = 0; i < _regWidthBytes; i++)
+        pReg->value[i] = i < value.size() ? value[i] : 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get register value
+/// @param regAddr register address
+/// @return register bytes (0 if not set)
+std::vector<uint8_t> SimI2CRegDevice::getReg(uint32_t regAddr) const
+{
+    for (const SimReg& reg : _regs)
+        if (reg.regAddr == regAddr)
+            return reg.value;
+    return std::vector<uint8_t>(_regWidthBytes, 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Write phase of a transaction
+/// @param pData data written
+/// @param len length
+void SimI2CRegDevice::write(const uint8_t* pData, uint32_t len)
+{
+    // Register pointer (big-endian)
+    uint32_t pos = 0;
+    if (len >= _regAddrBytes)
+    {
+        _regPtr = 0;
+        for (; pos < _regAddrBytes; pos++)
+            _regPtr = (_regPtr << 8) | pData[pos];
+        _regBytePos = 0;
+    }
+
+    // Register data
+    for (; pos < len; pos++)
+    {
+        SimReg* pReg = findReg(_regPtr, true);
+        pReg->value[_regBytePos] = pData[pos];
+        advancePtr();
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Read phase of a transaction
+/// @param pData buffer for data read
+/// @param len length
+void SimI2CRegDevice::read(uint8_t* pData, uint32_t len)
+{
+    for (uint32_t pos = 0; pos < len; pos++)
+    {
+        SimReg* pReg = findReg(_regPtr, false);
+        pData[pos] = pReg ? pReg->value[_regBytePos] : 0;
+        advancePtr();
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Find register (optionally creating it)
+SimI2CRegDevice::SimReg* SimI2CRegDevice::findReg(uint32_t regAddr, bool create)
+{
+    for (SimReg& reg : _regs)
+        if (reg.regAddr == regAddr)
+            return &reg;
+    if (!create)
+        return nullptr;
+    SimReg reg;
+    reg.regAddr = regAddr;
+    reg.value.resize(_regWidthBytes, 0);
+    _regs.push_back(reg);
+    return &_regs.back();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Write phase of a transaction (PCA9535)
+/// @param pData data written (command byte then data for the register pair)
+/// @param len length
+void SimI2CExpanderPCA9535::write(const uint8_t* pData, uint32_t len)
+{
+    if (len == 0)
+        return;
+    _regPtr = pData[0] % NUM_REGS;
+    bool outputsChanged = false;
+    for (uint32_t pos = 1; pos < len; pos++)
+    {
+        if ((_regPtr != REG_INPUT_0) && (_regPtr != REG_INPUT_1))
+        {
+            outputsChanged |= _regs[_regPtr] != pData[pos];
+            _regs[_regPtr] = pData[pos];
+        }
+        _regPtr ^= 1;
+    }
+    if (outputsChanged && _outputsCB)
+        _outputsCB(getOutputs(), getConfig());
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Read phase of a transaction (PCA9535)
+/// @param pData buffer for data read
+/// @param len length
+void SimI2CExpanderPCA9535::read(uint8_t* pData, uint32_t len)
+{
+    for (uint32_t pos = 0; pos < len; pos++)
+    {
+        uint8_t val = _regs[_regPtr];
+        if ((_regPtr == REG_INPUT_0) || (_regPtr == REG_INPUT_1))
+        {
+            // Input pins read their level, output pins the output register (with polarity inversion of inputs)
+            uint32_t port = _regPtr & 1;
+            uint8_t config = _regs[REG_CONFIG_0 + port];
+            uint8_t pinLevels = (_inputs >> (port * 8)) & 0xff;
+            val = ((pinLevels ^ _regs[REG_POLARITY_0 + port]) & config) | (_regs[REG_OUTPUT_0 + port] & ~config);
+        }
+        pData[pos] = val;
+        _regPtr ^= 1;
+    }
+}
@@ -0,0 +1,293 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// SimI2CDevices.h
+// Models of I2C devices for the simulated I2C central
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <functional>
+
+class SimI2CMuxPCA9548;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class SimI2CDevice
+/// @brief Base class for simulated devices - a device responds to its address when online and visible (either
+///        on the main bus or downstream of an enabled mux channel)
+class SimI2CDevice
+{
+public:
+    SimI2CDevice(uint8_t i2cAddr) : _i2cAddr(i2cAddr)
+    {
+    }
+    virtual ~SimI2CDevice()
+    {
+    }
+
+    // Address
+    uint8_t getI2CAddr() const
+    {
+        return _i2cAddr;
+    }
+
+    // Attach downstream of a mux channel (nullptr for the main bus)
+    void setParent(SimI2CMuxPCA9548* pParentMux, uint32_t parentChannel)
+    {
+        _pParentMux = pParentMux;
+        _parentChannel = parentChannel;
+    }
+    SimI2CMuxPCA9548* getParentMux() const
+    {
+        return _pParentMux;
+    }
+    uint32_t getParentChannel() const
+    {
+        return _parentChannel;
+    }
+
+    // Online (an offline device doesn't acknowledge its address - e.g. unplugged or unpowered)
+    void setOnline(bool isOnline)
+    {
+        _isOnline = isOnline;
+    }
+    bool isOnline() const
+    {
+        return _isOnline;
+    }
+
+    // NACK the next N accesses
+    void setNackCount(uint32_t nackCount)
+    {
+        _nackCount = nackCount;
+    }
+
+    // Clock stretching on each access
+    void setClockStretchUs(uint32_t clockStretchUs)
+    {
+        _clockStretchUs = clockStretchUs;
+    }
+    uint32_t getClockStretchUs() const
+    {
+        return _clockStretchUs;
+    }
+
+    // Check if the device acknowledges an access (consumes a pending NACK)
+    bool checkAck()
+    {
+        if (!_isOnline)
+            return false;
+        if (_nackCount == 0)
+            return true;
+        _nackCount--;
+        return false;
+    }
+
+    // Transaction phases (called after the address has been acknowledged)
+    virtual void write(const uint8_t* pData, uint32_t len)
+    {
+    }
+    virtual void read(uint8_t* pData, uint32_t len)
+    {
+        memset(pData, 0xff, len);
+    }
+
+    // General call (address 0x00) - devices only acknowledge (and count) the general call when enabled
+    void setGeneralCallEnabled(bool isEnabled)
+    {
+        _generalCallEnabled = isEnabled;
+    }
+    bool isGeneralCallEnabled() const
+    {
+        return _generalCallEnabled;
+    }
+    virtual void generalCall(const uint8_t* pData, uint32_t len)
+    {
+        _generalCallCount++;
+    }
+    uint32_t getGeneralCallCount() const
+    {
+        return _generalCallCount;
+    }
+
+private:
+    uint8_t _i2cAddr = 0;
+    SimI2CMuxPCA9548* _pParentMux = nullptr;
+    uint32_t _parentChannel = 0;
+    bool _isOnline = true;
+    uint32_t _nackCount = 0;
+    uint32_t _clockStretchUs = 0;
+    bool _generalCallEnabled = false;
+    uint32_t _generalCallCount = 0;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class SimI2CRegDevice
+/// @brief Register file device - the first regAddrBytes written set the register pointer, further bytes written
+///        are stored in registers and reads return register contents (in both cases the pointer auto-increments
+///        over bytes, each register being regWidthBytes wide). Registers not set read as 0
+class SimI2CRegDevice : public SimI2CDevice
+{
+public:
+    SimI2CRegDevice(uint8_t i2cAddr, uint32_t regAddrBytes = 1, uint32_t regWidthBytes = 1) :
+        SimI2CDevice(i2cAddr),
+        _regAddrBytes(regAddrBytes == 0 ? 1 : regAddrBytes),
+        _regWidthBytes(regWidthBytes == 0 ? 1 : regWidthBytes)
+    {
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Create a device from the detectionValues of a device type record
+    /// @param i2cAddr address
+    /// @param pDetectionValues detection values (e.g. "0x0c=0b100001100000XXXX&0x0d=0x12") - X bits are set to 0
+    ///        and the first of several alternative values is used
+    /// @return device (caller owns) - the register address and width are taken from the first detection value
+    /// @note Detection values which aren't a simple register read (pauses, writes, etc) are ignored
+    static SimI2CRegDevice* createFromDetectionValues(uint8_t i2cAddr, const char* pDetectionValues);
+
+    // Set register value (bytes in the order they are read)
+    void setReg(uint32_t regAddr, const std::vector<uint8_t>& value);
+
+    // Get register value
+    std::vector<uint8_t> getReg(uint32_t regAddr) const;
+
+    // Register pointer
+    uint32_t getRegPtr() const
+    {
+        return _regPtr;
+    }
+
+    // Transaction phases
+    virtual void write(const uint8_t* pData, uint32_t len) override;
+    virtual void read(uint8_t* pData, uint32_t len) override;
+
+private:
+    // Register address and width
+    uint32_t _regAddrBytes = 1;
+    uint32_t _regWidthBytes = 1;
+
+    // Registers (sparse)
+    class SimReg
+    {
+    public:
+        uint32_t regAddr = 0;
+        std::vector<uint8_t> value;
+    };
+    std::vector<SimReg> _regs;
+
+    // Pointer (register address and byte within the register)
+    uint32_t _regPtr = 0;
+    uint32_t _regBytePos = 0;
+
+    // Helpers
+    SimReg* findReg(uint32_t regAddr, bool create);
+    void advancePtr()
+    {
+        if (++_regBytePos >= _regWidthBytes)
+        {
+            _regBytePos = 0;
+            _regPtr++;
+        }
+    }
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class SimI2CMuxPCA9548
+/// @brief PCA9548 8-channel mux - a single control register (written and read as one byte) has a bit per channel
+class SimI2CMuxPCA9548 : public SimI2CDevice
+{
+public:
+    SimI2CMuxPCA9548(uint8_t i2cAddr) : SimI2CDevice(i2cAddr)
+    {
+    }
+
+    // Check channel enabled
+    bool isChannelEnabled(uint32_t channel) const
+    {
+        return (channel < NUM_CHANNELS) && ((_controlReg & (1 << channel)) != 0);
+    }
+
+    // Reset (all channels disabled)
+    void reset()
+    {
+        _controlReg = 0;
+    }
+
+    // Transaction phases
+    virtual void write(const uint8_t* pData, uint32_t len) override
+    {
+        if (len > 0)
+            _controlReg = pData[len - 1];
+    }
+    virtual void read(uint8_t* pData, uint32_t len) override
+    {
+        memset(pData, _controlReg, len);
+    }
+
+    static const uint32_t NUM_CHANNELS = 8;
+
+private:
+    uint8_t _controlReg = 0;
+};
+
+// Called when the outputs of a simulated expander change (config bits set are inputs)
+typedef std::function<void(uint16_t outputs, uint16_t config)> SimI2CExpanderOutputsCB;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class SimI2CExpanderPCA9535
+/// @brief PCA9535 16-bit IO expander - registers are input, output, polarity and config (each a pair of ports),
+///        sequential accesses toggle between the two ports of a pair
+class SimI2CExpanderPCA9535 : public SimI2CDevice
+{
+public:
+    SimI2CExpanderPCA9535(uint8_t i2cAddr, SimI2CExpanderOutputsCB outputsCB = nullptr) :
+        SimI2CDevice(i2cAddr),
+        _outputsCB(outputsCB)
+    {
+    }
+
+    // Set the levels on input pins
+    void setInputs(uint16_t inputs)
+    {
+        _inputs = inputs;
+    }
+
+    // Get output and config registers
+    uint16_t getOutputs() const
+    {
+        return _regs[REG_OUTPUT_0] | (_regs[REG_OUTPUT_1] << 8);
+    }
+    uint16_t getConfig() const
+    {
+        return _regs[REG_CONFIG_0] | (_regs[REG_CONFIG_1] << 8);
+    }
+
+    // Transaction phases
+    virtual void write(const uint8_t* pData, uint32_t len) override;
+    virtual void read(uint8_t* pData, uint32_t len) override;
+
+    // Registers
+    static const uint32_t REG_INPUT_0 = 0;
+    static const uint32_t REG_INPUT_1 = 1;
+    static const uint32_t REG_OUTPUT_0 = 2;
+    static const uint32_t REG_OUTPUT_1 = 3;
+    static const uint32_t REG_POLARITY_0 = 4;
+    static const uint32_t REG_POLARITY_1 = 5;
+    static const uint32_t REG_CONFIG_0 = 6;
+    static const uint32_t REG_CONFIG_1 = 7;
+    static const uint32_t NUM_REGS = 8;
+
+private:
+    // Registers (outputs default high and all pins are inputs after power-on)
+    uint8_t _regs[NUM_REGS] = { 0, 0, 0xff, 0xff, 0, 0, 0xff, 0xff };
+    uint8_t _regPtr = 0;
+    uint16_t _inputs = 0xffff;
+
+    // Callback on output change
+    SimI2CExpanderOutputsCB _outputsCB = nullptr;
+};
@@ -0,0 +1,5 @@
+// Minimal RaftCore.h for host builds (the full RaftCore.h includes ESP-IDF headers)
+#pragma once
+
+#include "RaftArduino.h"
+#include "RaftUtils.h"
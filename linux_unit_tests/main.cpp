@@ -5,6 +5,8 @@
 #include "DevicePollingInfo.h"
 #include "DeviceTypeRecords_generated.h"
 #include "DevicePollRecords_generated.h"
+#include "PollRecordBatchDecoder.h"
+#include "SimI2CCentral.h"
 
 #define TEST_ASSERT(cond, msg) if (!(cond)) { printf("TEST_ASSERT failed %s\n", msg); failCount++; }
 
@@ -108,6 +110,148 @@ int main()
         }
     }
     
+    // Test batch decode of VCNL4040 against the generated decoder
+    {
+        // Device type
+        const char* pDevTypeStr = "VCNL4040";
+        const uint32_t NUM_RECS = 100;
+        const uint32_t REC_SIZE = 8;
+
+        // Poll responses
+        uint8_t pollResp[NUM_RECS * REC_SIZE];
+        for (uint32_t i = 0; i < NUM_RECS; i++)
+        {
+            Raft::setBEUint16(pollResp, i * REC_SIZE, 1234 + i * 10);
+            Raft::setLEUint16(pollResp, i * REC_SIZE + 2, 5678 + i);
+            Raft::setLEUint16(pollResp, i * REC_SIZE + 4, 9012 + i * 3);
+            Raft::setLEUint16(pollResp, i * REC_SIZE + 6, 3456 + i * 7);
+        }
+
+        // Batch decoder for the VCNL4040 schema
+        PollRecordBatchDecoder batchDecoder;
+        batchDecoder.setup(6);
+        const float divisors[] = { 1, 10, 10 };
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            PollRecordBatchDecoder::AttrDesc attrDesc;
+            PollRecordBatchDecoder::parseValueType("<H", attrDesc);
+            attrDesc.offset = i * 2;
+            attrDesc.divisor = divisors[i];
+            batchDecoder.addAttr(attrDesc);
+        }
+
+        // Decode with both decoders
+        BusI2CDevTypeRecord* pDevTypeRecord = getBusI2CDevTypeRecord(pDevTypeStr);
+        if (pDevTypeRecord)
+        {
+            poll_VCNL4040 pollRespStruct[NUM_RECS];
+            RaftBusDeviceDecodeState decodeState;
+            uint32_t recCount = pDevTypeRecord->pollResultDecodeFn(pollResp, sizeof(pollResp), pollRespStruct,
+                            sizeof(pollRespStruct[0]), NUM_RECS, decodeState);
+            uint32_t timeMsCol[NUM_RECS];
+            float proxCol[NUM_RECS], alsCol[NUM_RECS], whiteCol[NUM_RECS];
+            float* attrCols[] = { proxCol, alsCol, whiteCol };
+            RaftBusDeviceDecodeState batchDecodeState;
+            uint32_t batchRecCount = batchDecoder.decode(pollResp, sizeof(pollResp), timeMsCol, attrCols, NUM_RECS, batchDecodeState);
+            TEST_ASSERT(recCount == NUM_RECS, "VCNL4040 decode failed recCount");
+            TEST_ASSERT(batchRecCount == NUM_RECS, "VCNL4040 batch decode failed recCount");
+            for (uint32_t i = 0; i < batchRecCount; i++)
+            {
+                TEST_ASSERT(timeMsCol[i] == pollRespStruct[i].timeMs, "VCNL4040 batch timeMs decode failed");
+                TEST_ASSERT(proxCol[i] == pollRespStruct[i].prox, "VCNL4040 batch prox decode failed");
+                TEST_ASSERT(isApprox(alsCol[i], pollRespStruct[i].als), "VCNL4040 batch als decode failed");
+                TEST_ASSERT(isApprox(whiteCol[i], pollRespStruct[i].white), "VCNL4040 batch white decode failed");
+            }
+        }
+        else
+        {
+            printf("%s device type record not found\n", pDevTypeStr);
+            failCount++;
+        }
+    }
+
+    // Test simulated I2C bus (devices from device type records, mux and expander)
+    {
+        SimI2CCentral simI2C;
+        TEST_ASSERT(simI2C.init(0, 0, 0, 100000), "SimI2C init failed");
+
+        // VCNL4040 from its detection values (16 bit registers) on the main bus
+        BusI2CDevTypeRecord* pDevTypeRecord = getBusI2CDevTypeRecord("VCNL4040");
+        TEST_ASSERT(pDevTypeRecord != nullptr, "SimI2C VCNL4040 record not found");
+        SimI2CRegDevice* pVCNL4040 = SimI2CRegDevice::createFromDetectionValues(0x60,
+                    pDevTypeRecord ? pDevTypeRecord->detectionValues : "");
+        simI2C.addDevice(pVCNL4040);
+
+        // Read the detection register
+        uint8_t regAddr = 0x0c;
+        uint8_t readBuf[4] = {};
+        uint32_t numRead = 0;
+        RaftRetCode rslt = simI2C.access(0x60, &regAddr, 1, readBuf, 2, numRead);
+        TEST_ASSERT((rslt == RAFT_OK) && (numRead == 2), "SimI2C VCNL4040 read failed");
+        TEST_ASSERT((readBuf[0] == 0x86) && (readBuf[1] == 0x00), "SimI2C VCNL4040 detection value wrong");
+
+        // Bit time at 100kHz (2 + 2*9 + 1 + 3*9 bits)
+        TEST_ASSERT(simI2C.getSimTimeUs() == 480, "SimI2C access time wrong");
+
+        // Unoccupied address NACKs
+        rslt = simI2C.access(0x61, nullptr, 0, nullptr, 0, numRead);
+        TEST_ASSERT(rslt == RAFT_BUS_ACK_ERROR, "SimI2C NACK expected");
+
+        // Device on mux channel 3 is only visible when the channel is enabled
+        SimI2CMuxPCA9548 mux(0x70);
+        SimI2CRegDevice muxedDev(0x60);
+        muxedDev.setParent(&mux, 3);
+        muxedDev.setReg(0x01, {0x42});
+        simI2C.addDevice(&mux);
+        simI2C.addDevice(&muxedDev);
+        pVCNL4040->setOnline(false);
+        TEST_ASSERT(simI2C.access(0x60, nullptr, 0, nullptr, 0, numRead) == RAFT_BUS_ACK_ERROR, "SimI2C muxed dev visible");
+        uint8_t muxCtrl = 1 << 3;
+        TEST_ASSERT(simI2C.access(0x70, &muxCtrl, 1, nullptr, 0, numRead) == RAFT_OK, "SimI2C mux write failed");
+        regAddr = 0x01;
+        rslt = simI2C.access(0x60, &regAddr, 1, readBuf, 1, numRead);
+        TEST_ASSERT((rslt == RAFT_OK) && (readBuf[0] == 0x42), "SimI2C muxed dev read failed");
+
+        // Expander outputs
+        uint16_t lastOutputs = 0;
+        SimI2CExpanderPCA9535 expander(0x25, [&lastOutputs](uint16_t outputs, uint16_t config) {
+            lastOutputs = outputs & ~config;
+        });
+        simI2C.addDevice(&expander);
+        uint8_t configWr[] = { SimI2CExpanderPCA9535::REG_CONFIG_0, 0x00, 0xff };
+        uint8_t outputWr[] = { SimI2CExpanderPCA9535::REG_OUTPUT_0, 0x55, 0x00 };
+        simI2C.access(0x25, configWr, sizeof(configWr), nullptr, 0, numRead);
+        simI2C.access(0x25, outputWr, sizeof(outputWr), nullptr, 0, numRead);
+        TEST_ASSERT(lastOutputs == 0x0055, "SimI2C expander outputs wrong");
+
+        // General call reaches the devices which support it on the main bus and on enabled mux channels
+        uint8_t generalCallCmd = 0x08;
+        TEST_ASSERT(simI2C.access(0x00, &generalCallCmd, 1, nullptr, 0, numRead) == RAFT_BUS_ACK_ERROR, 
+                    "SimI2C general call NACK expected");
+        muxedDev.setGeneralCallEnabled(true);
+        expander.setGeneralCallEnabled(true);
+        TEST_ASSERT(simI2C.access(0x00, &generalCallCmd, 1, nullptr, 0, numRead) == RAFT_OK, "SimI2C general call failed");
+        muxCtrl = 0;
+        simI2C.access(0x70, &muxCtrl, 1, nullptr, 0, numRead);
+        TEST_ASSERT(simI2C.access(0x00, &generalCallCmd, 1, nullptr, 0, numRead) == RAFT_OK, "SimI2C general call failed");
+        TEST_ASSERT((expander.getGeneralCallCount() == 2) && (muxedDev.getGeneralCallCount() == 1), 
+                    "SimI2C general call counts wrong");
+        muxCtrl = 1 << 3;
+        simI2C.access(0x70, &muxCtrl, 1, nullptr, 0, numRead);
+
+        // Stuck SDA is cleared by clocking
+        simI2C.setSDAStuck(true, 9);
+        TEST_ASSERT(simI2C.access(0x25, nullptr, 0, nullptr, 0, numRead) == RAFT_BUS_STUCK, "SimI2C stuck expected");
+        TEST_ASSERT(simI2C.busRecoveryClocking(24, true), "SimI2C recovery failed");
+        TEST_ASSERT(simI2C.isOperatingOk(), "SimI2C not operating ok after recovery");
+
+        // Clock stretching beyond the timeout allowance
+        muxedDev.setClockStretchUs(500);
+        simI2C.setAccessOverheadUs(100);
+        TEST_ASSERT(simI2C.access(0x60, &regAddr, 1, readBuf, 1, numRead) == RAFT_BUS_SW_TIME_OUT, "SimI2C timeout expected");
+        delete pVCNL4040;
+    }
+
     // Check failCount
     if (failCount > 0)
         printf("testPrimitives FAILED %d tests\n", failCount);
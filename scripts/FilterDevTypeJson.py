@@ -0,0 +1,87 @@
+import json
+import sys
+import argparse
+
+# Fields in devInfoJson which are only descriptive
+DEV_INFO_VERBOSE_FIELDS = ["desc", "manu"]
+
+# Fields in response attributes which are only used for display (decoding uses t, n, d, o, etc)
+RESP_ATTR_VERBOSE_FIELDS = ["u", "r", "f"]
+
+# Fields in the response schema from which decode functions are generated
+RESP_DECODE_FIELDS = ["a", "c"]
+
+def filter_dev_types(dev_types_json, allowed_types, strip_schema, no_decode):
+    dev_types = dev_types_json.get("devTypes", {})
+
+    # Check all allowed types exist
+    if allowed_types:
+        missing_types = [dev_type for dev_type in allowed_types if dev_type not in dev_types]
+        if missing_types:
+            raise ValueError(f"Device types not found: {', '.join(missing_types)}")
+
+    # Filter (the order of records is retained as it determines the detection order)
+    filtered_types = {}
+    for dev_type_name, dev_type_rec in dev_types.items():
+        if allowed_types and dev_type_name not in allowed_types:
+            continue
+
+        # Notes are never used in the generated records
+        dev_type_rec = {key: val for key, val in dev_type_rec.items() if not key.startswith("_")}
+        dev_info = dev_type_rec.get("devInfoJson")
+        if isinstance(dev_info, dict):
+            dev_info = dict(dev_info)
+            resp = dev_info.get("resp")
+            if isinstance(resp, dict):
+                resp = dict(resp)
+
+            # Strip descriptive and display-only fields from the schema
+            if strip_schema:
+                for field in DEV_INFO_VERBOSE_FIELDS:
+                    dev_info.pop(field, None)
+                if isinstance(resp, dict) and isinstance(resp.get("a"), list):
+                    resp["a"] = [{key: val for key, val in attr.items() if key not in RESP_ATTR_VERBOSE_FIELDS}
+                                    for attr in resp["a"]]
+
+            # Remove the attributes and custom code so no decode function is generated
+            if no_decode and isinstance(resp, dict):
+                for field in RESP_DECODE_FIELDS:
+                    resp.pop(field, None)
+
+            if resp is not None:
+                dev_info["resp"] = resp
+            dev_type_rec["devInfoJson"] = dev_info
+        filtered_types[dev_type_name] = dev_type_rec
+
+    filtered_json = dict(dev_types_json)
+    filtered_json["devTypes"] = filtered_types
+    return filtered_json
+
+def filter_dev_types_file(json_in_path, json_out_path, allowed_types, strip_schema, no_decode):
+    with open(json_in_path, 'r') as json_file:
+        dev_types_json = json.load(json_file)
+
+    filtered_json = filter_dev_types(dev_types_json, allowed_types, strip_schema, no_decode)
+
+    with open(json_out_path, 'w') as json_file:
+        json.dump(filtered_json, json_file, indent=4)
+        json_file.write('\n')
+
+    print(f"FilterDevTypeJson: {len(filtered_json['devTypes'])} of {len(dev_types_json.get('devTypes', {}))} device types written to {json_out_path}")
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Filter device type records JSON before generating the device type table")
+    parser.add_argument("json_in", help="device type records JSON file")
+    parser.add_argument("json_out", help="filtered device type records JSON file")
+    parser.add_argument("--types", default="", help="comma separated list of device types to keep (default all)")
+    parser.add_argument("--strip-schema", action="store_true", help="strip descriptive and display-only fields from devInfoJson")
+    parser.add_argument("--no-decode", action="store_true", help="remove response attributes so no decode functions are generated")
+    args = parser.parse_args()
+
+    allowed_types = [dev_type.strip() for dev_type in args.types.split(",") if dev_type.strip()]
+    try:
+        filter_dev_types_file(args.json_in, args.json_out, allowed_types, args.strip_schema, args.no_decode)
+    except (OSError, ValueError) as excp:
+        print(f"FilterDevTypeJson: {excp}", file=sys.stderr)
+        sys.exit(1)
+    sys.exit(0)
@@ -0,0 +1,264 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Benchmarks of scan, identification, polling and publishing (using the simulated I2C central)
+//
+// Rob Dobson 2024
+//
+// Benchmarks are tagged [ignore] so they don't run with all tests - run them from the menu with [Benchmark]
+// Results are printed one per line prefixed with BENCH and followed by JSON, e.g.
+//   BENCH {"name":"coldBoot","devices":16,"slots":8,"ms":1234,"busMs":56,"accesses":789}
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "unity.h"
+#include "unity_test_runner.h"
+#include "RaftJson.h"
+#include "RaftUtils.h"
+#include "DeviceTypeRecords.h"
+#include "BusI2C.h"
+#include "BusI2CConsts.h"
+#include "SimI2CCentral.h"
+
+// static const char* MODULE_PREFIX = "test_benchmarks";
+
+// Bus config (pins are needed by setup and the bus stuck check so the board must have pull-ups on them)
+static const char* BENCH_BUS_CONFIG = R"({"name":"I2CBench","i2cPort":0,"sdaPin":21,"sclPin":22,"i2cFreq":400000,)"
+            R"("taskPriority":24,"taskStack":10000})";
+
+// Timeout waiting for devices
+static const uint32_t BENCH_IDENT_TIMEOUT_MS = 60000;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class BenchBus
+/// @brief BusI2C with a simulated central populated with devices (types taken from the device type records)
+/// @note Each device type with simple detection values provides one address - when more devices are requested
+///       than there are addresses the devices are placed on mux slots (addresses repeat on each slot)
+class BenchBus
+{
+public:
+    BenchBus(uint32_t numDevices, uint32_t numMuxes, bool placeOnLastSlot = false)
+    {
+        // Muxes
+        for (uint32_t muxIdx = 0; muxIdx < numMuxes; muxIdx++)
+        {
+            SimI2CMuxPCA9548* pMux = new SimI2CMuxPCA9548(I2C_BUS_MUX_BASE_DEFAULT + muxIdx);
+            _muxes.push_back(pMux);
+            _simI2C.addDevice(pMux);
+        }
+
+        // Devices
+        std::vector<uint32_t> devAddrs;
+        std::vector<const char*> devDetectionValues;
+        getSimulatableDeviceTypes(devAddrs, devDetectionValues);
+        uint32_t numSlots = numMuxes * SimI2CMuxPCA9548::NUM_CHANNELS;
+        for (uint32_t devIdx = 0; (devIdx < numDevices) && (devAddrs.size() > 0); devIdx++)
+        {
+            uint32_t typeIdx = devIdx % devAddrs.size();
+            uint32_t slotNum = placeOnLastSlot ? numSlots : (numSlots == 0 ? 0 : devIdx / devAddrs.size() + 1);
+            if (slotNum > numSlots)
+                break;
+            SimI2CRegDevice* pDevice = SimI2CRegDevice::createFromDetectionValues(devAddrs[typeIdx],
+                        devDetectionValues[typeIdx]);
+            if (slotNum > 0)
+                pDevice->setParent(_muxes[(slotNum - 1) / SimI2CMuxPCA9548::NUM_CHANNELS],
+                        (slotNum - 1) % SimI2CMuxPCA9548::NUM_CHANNELS);
+            _devices.push_back(pDevice);
+            _simI2C.addDevice(pDevice);
+        }
+
+        // Bus
+        _pBus = new BusI2C(nullptr, nullptr, &_simI2C);
+    }
+
+    ~BenchBus()
+    {
+        delete _pBus;
+        for (SimI2CDevice* pDevice : _devices)
+            delete pDevice;
+        for (SimI2CDevice* pMux : _muxes)
+            delete pMux;
+    }
+
+    // Setup the bus
+    bool setup()
+    {
+        RaftJson config(BENCH_BUS_CONFIG);
+        _startUs = micros();
+        return _pBus->setup(config);
+    }
+
+    // Service the bus until all devices have ident poll responses (or timeout)
+    bool waitForAllIdentified(uint32_t timeoutMs)
+    {
+        while (!Raft::isTimeout(millis(), _startUs / 1000, timeoutMs))
+        {
+            _pBus->loop();
+            std::vector<uint32_t> addresses;
+            _pBus->getBusElemAddresses(addresses, true);
+            if (addresses.size() >= _devices.size())
+                return true;
+            vTaskDelay(1);
+        }
+        return false;
+    }
+
+    // Service the bus for a period
+    void serviceFor(uint32_t periodMs)
+    {
+        uint32_t startMs = millis();
+        while (!Raft::isTimeout(millis(), startMs, periodMs))
+        {
+            _pBus->loop();
+            vTaskDelay(1);
+        }
+    }
+
+    // Consume queued poll responses (returns number of responses)
+    uint32_t consumePollResponses()
+    {
+        std::vector<uint32_t> addresses;
+        _pBus->getBusElemAddresses(addresses, false);
+        uint32_t numResponses = 0;
+        for (uint32_t address : addresses)
+        {
+            bool isOnline = false;
+            uint16_t deviceTypeIndex = 0;
+            std::vector<uint8_t> pollResponseData;
+            uint32_t responseSize = 0;
+            numResponses += _pBus->getBusElemPollResponses(address, isOnline, deviceTypeIndex, pollResponseData,
+                        responseSize, 0);
+        }
+        return numResponses;
+    }
+
+    uint32_t getElapsedMs() const
+    {
+        return (micros() - _startUs) / 1000;
+    }
+    uint32_t getNumDevices() const
+    {
+        return _devices.size();
+    }
+    SimI2CCentral& getSim()
+    {
+        return _simI2C;
+    }
+    BusI2C& getBus()
+    {
+        return *_pBus;
+    }
+
+private:
+    SimI2CCentral _simI2C;
+    std::vector<SimI2CMuxPCA9548*> _muxes;
+    std::vector<SimI2CRegDevice*> _devices;
+    BusI2C* _pBus = nullptr;
+    uint64_t _startUs = 0;
+
+    // Get the first address of each device type whose detection values can be simulated
+    static void getSimulatableDeviceTypes(std::vector<uint32_t>& addrs, std::vector<const char*>& detectionValues)
+    {
+        for (uint32_t addr = I2C_BUS_ADDRESS_MIN; addr <= I2C_BUS_ADDRESS_MAX; addr++)
+        {
+            if ((addr >= I2C_BUS_MUX_BASE_DEFAULT) && (addr < I2C_BUS_MUX_BASE_DEFAULT + I2C_BUS_MUX_MAX_DEFAULT))
+                continue;
+            for (uint16_t devTypeIdx : deviceTypeRecords.getDeviceTypeIdxsForAddr(addr))
+            {
+                DeviceTypeRecord devTypeRec;
+                if (!deviceTypeRecords.getDeviceInfo(devTypeIdx, devTypeRec) || !devTypeRec.detectionValues)
+                    continue;
+                const char* pDet = devTypeRec.detectionValues;
+                if ((strncmp(pDet, "0x", 2) != 0) || strstr(pDet, "=p") || strstr(pDet, "=r"))
+                    continue;
+                addrs.push_back(addr);
+                detectionValues.push_back(pDet);
+                break;
+            }
+        }
+    }
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Cold boot to all devices identified (and polled)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("Benchmark cold boot to all devices identified", "[Benchmark][ignore]")
+{
+    const uint32_t deviceCounts[] = { 4, 16, 60 };
+    for (uint32_t numDevices : deviceCounts)
+    {
+        BenchBus benchBus(numDevices, 8);
+        TEST_ASSERT_TRUE(benchBus.setup());
+        bool allIdentified = benchBus.waitForAllIdentified(BENCH_IDENT_TIMEOUT_MS);
+        printf("BENCH {\"name\":\"coldBoot\",\"devices\":%d,\"slots\":%d,\"ok\":%d,\"ms\":%d,\"busMs\":%d,\"accesses\":%d}\n",
+                    (int)benchBus.getNumDevices(), 8 * SimI2CMuxPCA9548::NUM_CHANNELS, allIdentified ? 1 : 0,
+                    (int)benchBus.getElapsedMs(), (int)(benchBus.getSim().getBusBusyUs() / 1000),
+                    (int)benchBus.getSim().getAccessCount());
+        TEST_ASSERT_TRUE(allIdentified);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Full sweep scan time against slot count (time to find a device on the last slot)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("Benchmark scan sweep against slot count", "[Benchmark][ignore]")
+{
+    const uint32_t muxCounts[] = { 1, 2, 4, 8 };
+    for (uint32_t numMuxes : muxCounts)
+    {
+        BenchBus benchBus(1, numMuxes, true);
+        TEST_ASSERT_TRUE(benchBus.setup());
+        bool found = benchBus.waitForAllIdentified(BENCH_IDENT_TIMEOUT_MS);
+        printf("BENCH {\"name\":\"scanSweep\",\"slots\":%d,\"ok\":%d,\"ms\":%d,\"busMs\":%d,\"accesses\":%d}\n",
+                    (int)(numMuxes * SimI2CMuxPCA9548::NUM_CHANNELS), found ? 1 : 0, (int)benchBus.getElapsedMs(),
+                    (int)(benchBus.getSim().getBusBusyUs() / 1000), (int)benchBus.getSim().getAccessCount());
+        TEST_ASSERT_TRUE(found);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Sustained polling against device count and publish serialisation cost
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("Benchmark sustained polling and publishing", "[Benchmark][ignore]")
+{
+    const uint32_t deviceCounts[] = { 4, 16, 60 };
+    const uint32_t POLL_PERIOD_MS = 2000;
+    for (uint32_t numDevices : deviceCounts)
+    {
+        BenchBus benchBus(numDevices, 8);
+        TEST_ASSERT_TRUE(benchBus.setup());
+        TEST_ASSERT_TRUE(benchBus.waitForAllIdentified(BENCH_IDENT_TIMEOUT_MS));
+
+        // Polls per second
+        benchBus.consumePollResponses();
+        uint64_t busBusyStartUs = benchBus.getSim().getBusBusyUs();
+        uint32_t accessStartCount = benchBus.getSim().getAccessCount();
+        benchBus.serviceFor(POLL_PERIOD_MS);
+        uint32_t numPolls = benchBus.consumePollResponses();
+        uint32_t numAccesses = benchBus.getSim().getAccessCount() - accessStartCount;
+        uint32_t busUtilPC = (benchBus.getSim().getBusBusyUs() - busBusyStartUs) * 100 / (POLL_PERIOD_MS * 1000);
+        printf("BENCH {\"name\":\"polling\",\"devices\":%d,\"pollsPerSec\":%d,\"accessesPerSec\":%d,\"busUtilPC\":%d}\n",
+                    (int)benchBus.getNumDevices(), (int)(numPolls * 1000 / POLL_PERIOD_MS),
+                    (int)(numAccesses * 1000 / POLL_PERIOD_MS), (int)busUtilPC);
+
+        // Publish as JSON
+        RaftBusDevicesIF* pDevicesIF = benchBus.getBus().getBusDevicesIF();
+        benchBus.serviceFor(POLL_PERIOD_MS);
+        uint64_t startUs = micros();
+        String jsonStr = pDevicesIF->getQueuedDeviceDataJson();
+        uint32_t jsonUs = micros() - startUs;
+
+        // Publish as binary
+        benchBus.serviceFor(POLL_PERIOD_MS);
+        startUs = micros();
+        std::vector<uint8_t> binData = pDevicesIF->getQueuedDeviceDataBinary(0);
+        uint32_t binaryUs = micros() - startUs;
+        printf("BENCH {\"name\":\"publish\",\"devices\":%d,\"jsonUs\":%d,\"jsonBytes\":%d,\"binaryUs\":%d,\"binaryBytes\":%d}\n",
+                    (int)benchBus.getNumDevices(), (int)jsonUs, (int)jsonStr.length(), (int)binaryUs, (int)binData.size());
+    }
+}
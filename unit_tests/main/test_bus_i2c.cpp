@@ -323,6 +323,43 @@ TEST_CASE("raft_i2c_bus_extender_next_slot", "[rafti2c_busi2c_tests]")
     TEST_ASSERT_MESSAGE(busMultiplexers.getNextSlotNum(48) == 0, "getNextSlotNum 48 not 0");
 }
 
+TEST_CASE("raft_i2c_bus_elem_tracker_slots", "[rafti2c_busi2c_tests]")
+{
+    // Elements on the main bus and on slots
+    BusI2CElemTracker elemTracker;
+    elemTracker.setElemFound(0x10, 0);
+    elemTracker.setElemFound(0x47, 0);
+    elemTracker.setElemFound(0x47, 3);
+    elemTracker.setElemFound(0x20, 3);
+    elemTracker.setElemFound(0x77, 63);
+    elemTracker.setElemFound(0x21, 64);
+
+    // Membership
+    TEST_ASSERT_MESSAGE(elemTracker.isAddrFoundOnMainBus(0x47), "0x47 not on main bus");
+    TEST_ASSERT_MESSAGE(!elemTracker.isAddrFoundOnMainBus(0x20), "0x20 on main bus");
+    TEST_ASSERT_MESSAGE(elemTracker.isAddrFoundOnMux(0x20), "0x20 not on mux");
+    TEST_ASSERT_MESSAGE(!elemTracker.isAddrFoundOnMux(0x10), "0x10 on mux");
+    TEST_ASSERT_MESSAGE(elemTracker.isAddrFoundOnSlot(0x20, 3), "0x20 not on slot 3");
+    TEST_ASSERT_MESSAGE(!elemTracker.isAddrFoundOnSlot(0x20, 4), "0x20 on slot 4");
+    TEST_ASSERT_MESSAGE(elemTracker.isAddrFoundOnSlot(0x77, 63), "0x77 not on slot 63");
+    TEST_ASSERT_MESSAGE(!elemTracker.isAddrFoundOnMux(0x21), "slot 64 not ignored");
+    TEST_ASSERT_MESSAGE(elemTracker.getSlotsWithElemsMask() == ((1ULL << 0) | (1ULL << 3) | (1ULL << 63)), "slots mask not correct");
+
+    // Address list includes the slot
+    std::vector<BusElemAddrType> addrList;
+    elemTracker.getAddrList(3, addrList);
+    TEST_ASSERT_MESSAGE(addrList.size() == 2, "slot 3 addr list size not 2");
+    TEST_ASSERT_MESSAGE(addrList[0] == BusI2CAddrAndSlot(0x20, 3).toBusElemAddrType(), "slot 3 addr list 0 not 0x20");
+    TEST_ASSERT_MESSAGE(addrList[1] == BusI2CAddrAndSlot(0x47, 3).toBusElemAddrType(), "slot 3 addr list 1 not 0x47");
+
+    // Conflicts with the main bus
+    BusI2CAddrBits conflictBits = elemTracker.getMainBusAndSlotAddrBits(3);
+    TEST_ASSERT_MESSAGE((conflictBits.count() == 1) && conflictBits.isSet(0x47), "main bus and slot 3 not 0x47");
+    TEST_ASSERT_MESSAGE(elemTracker.isConflict(0, 3), "no conflict main bus and slot 3");
+    TEST_ASSERT_MESSAGE(!elemTracker.isConflict(3, 63), "conflict slot 3 and slot 63");
+    TEST_ASSERT_MESSAGE(elemTracker.getMainBusAndSlotAddrBits(5).isEmpty(), "main bus and slot 5 not empty");
+}
+
 TEST_CASE("test_rafti2c_bus_status", "[rafti2c_busi2c_adv_tests]")
 {
     static const uint32_t testAddr = lockupDetectAddr;
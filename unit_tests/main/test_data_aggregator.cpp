@@ -14,6 +14,13 @@
 #include "unity_test_runner.h"
 
 #include "PollDataAggregator.h"
+#include "PollResultRing.h"
+#include "DeviceDataCompactBinary.h"
+#include "PollRecordBatchDecoder.h"
+#include "PollBufferBudget.h"
+#include "PollResultFilter.h"
+#include "DevicePollGroup.h"
+#include "RaftJson.h"
 
 // static const char* MODULE_PREFIX = "test_i2c_data_agg";
 
@@ -156,3 +163,304 @@ TEST_CASE("Test PollDataAggregator Put and Get Multiple", "[PollDataAggregator]"
     TEST_ASSERT_TRUE(dataTest5to7 == dataOut);
     TEST_ASSERT_FALSE(aggregator.get(dataOut));
 }
+
+TEST_CASE("Test PollResultRing Put and Get Wrap", "[PollDataAggregator]")
+{
+    // Ring of 64 bytes holds three 20 byte records (14 byte header + 6 bytes data)
+    PollResultRing ring(64);
+    std::vector<uint8_t> data = {1, 2, 3, 4, 5, 6};
+    std::vector<uint8_t> dataOut;
+    uint32_t address = 0;
+    uint64_t timeUs = 0;
+    for (uint32_t i = 0; i < 10; i++)
+    {
+        data[0] = i;
+        TEST_ASSERT_TRUE(ring.put(0x120 + i, 1000 * i, data.data(), data.size()));
+        TEST_ASSERT_TRUE(ring.get(address, timeUs, dataOut));
+        TEST_ASSERT_TRUE(address == 0x120 + i);
+        TEST_ASSERT_TRUE(timeUs == 1000 * i);
+        TEST_ASSERT_TRUE(data == dataOut);
+    }
+    TEST_ASSERT_TRUE(ring.isEmpty());
+
+    // Fill and check dropped count
+    TEST_ASSERT_TRUE(ring.put(0x20, 0, data.data(), data.size()));
+    TEST_ASSERT_TRUE(ring.put(0x21, 0, data.data(), data.size()));
+    TEST_ASSERT_TRUE(ring.put(0x22, 0, data.data(), data.size()));
+    TEST_ASSERT_FALSE(ring.put(0x23, 0, data.data(), data.size()));
+    TEST_ASSERT_TRUE(ring.getDroppedCount() == 1);
+    TEST_ASSERT_TRUE(ring.get(address, timeUs, dataOut));
+    TEST_ASSERT_TRUE(address == 0x20);
+    ring.discardAll();
+    TEST_ASSERT_FALSE(ring.get(address, timeUs, dataOut));
+}
+
+TEST_CASE("Test DeviceDataCompactBinary device block", "[PollDataAggregator]")
+{
+    // Three responses (2 byte timestamp and 2 bytes of data) with the last timestamp wrapping
+    std::vector<uint8_t> pollResponses = {
+        0x01, 0x00, 0x11, 0x12,
+        0x01, 0x0a, 0x21, 0x22,
+        0x00, 0x05, 0x31, 0x32 };
+    std::vector<uint8_t> devMsg;
+    DeviceDataCompactBinary::genDeviceBlock(devMsg, 0x125, 3, true, pollResponses, 4, 2);
+    std::vector<uint8_t> expected = {
+        0,                              // block length (set below)
+        0xa5, 0x02, 0x03, 0x01,         // address, type index, flags
+        0x03, 0x02,                     // number of responses, response size
+        0x80, 0x02, 0x11, 0x12,         // full timestamp 0x100
+        0x0a, 0x21, 0x22,               // delta 10
+        0xfb, 0xfd, 0x03, 0x31, 0x32 }; // delta 0xfefb (wrapped)
+    expected[0] = expected.size() - 1;
+    TEST_ASSERT_TRUE(expected == devMsg);
+
+    // Message header
+    std::vector<uint8_t> hdr;
+    DeviceDataVectorSink sink(hdr);
+    DeviceDataCompactBinary::writeHeader(sink, 2 | DeviceDataCompactBinary::CONN_MODE_COMPACT_FLAG);
+    std::vector<uint8_t> expectedHdr = { DeviceDataCompactBinary::FORMAT_MAGIC, DeviceDataCompactBinary::FORMAT_VERSION, 2 };
+    TEST_ASSERT_TRUE(expectedHdr == hdr);
+}
+
+TEST_CASE("Test DeviceDataCompactBinary repeat count", "[PollDataAggregator]")
+{
+    // One response (2 byte timestamp and 2 bytes of data) after 200 unchanged results which weren't stored
+    std::vector<uint8_t> pollResponses = { 0x00, 0x10, 0x41, 0x42 };
+    std::vector<uint8_t> devMsg;
+    DeviceDataCompactBinary::genDeviceBlock(devMsg, 0x25, 3, true, pollResponses, 4, 2, 200);
+    std::vector<uint8_t> expected = {
+        0,                              // block length (set below)
+        0x25, 0x03, 0x03,               // address, type index, flags (online and repeat count)
+        0xc8, 0x01,                     // repeat count
+        0x01, 0x02,                     // number of responses, response size
+        0x10, 0x41, 0x42 };             // full timestamp 0x10
+    expected[0] = expected.size() - 1;
+    TEST_ASSERT_TRUE(expected == devMsg);
+
+    // No stored responses - the block still publishes the repeat count
+    std::vector<uint8_t> noResponses;
+    DeviceDataCompactBinary::genDeviceBlock(devMsg, 0x25, 3, true, noResponses, 0, 2, 5);
+    std::vector<uint8_t> expectedNoResp = { 6, 0x25, 0x03, 0x03, 0x05, 0x00, 0x00 };
+    TEST_ASSERT_TRUE(expectedNoResp == devMsg);
+}
+
+TEST_CASE("Test PollRecordBatchDecoder columns", "[PollDataAggregator]")
+{
+    // Two records (timestamp then 7 bytes of data)
+    const uint32_t tsSize = DevicePollingInfo::POLL_RESULT_TIMESTAMP_SIZE;
+    const uint8_t recData[] = { 0x04, 0x12, 0x34, 0x56, 0x78, 0x1f, 0x0e };
+    std::vector<uint8_t> pollResponses;
+    for (uint32_t recIdx = 0; recIdx < 2; recIdx++)
+    {
+        uint32_t tsUnits = 100 + recIdx * 10;
+        for (uint32_t i = 0; i < tsSize; i++)
+            pollResponses.push_back((tsUnits >> ((tsSize - 1 - i) * 8)) & 0xff);
+        pollResponses.insert(pollResponses.end(), recData, recData + sizeof(recData));
+    }
+
+    // Attributes: masked bit, masked and shifted 32 bit value, sign bit with subtract, sign extended masked value
+    PollRecordBatchDecoder decoder;
+    decoder.setup(sizeof(recData));
+    PollRecordBatchDecoder::AttrDesc attrDesc;
+    TEST_ASSERT_TRUE(PollRecordBatchDecoder::parseValueType("B", attrDesc));
+    attrDesc.andMask = 0x04;
+    attrDesc.shift = 2;
+    TEST_ASSERT_TRUE(decoder.addAttr(attrDesc));
+    attrDesc = PollRecordBatchDecoder::AttrDesc();
+    TEST_ASSERT_TRUE(PollRecordBatchDecoder::parseValueType(">I", attrDesc));
+    attrDesc.offset = 1;
+    attrDesc.andMask = 0xfffff000;
+    attrDesc.shift = 12;
+    TEST_ASSERT_TRUE(decoder.addAttr(attrDesc));
+    attrDesc = PollRecordBatchDecoder::AttrDesc();
+    TEST_ASSERT_TRUE(PollRecordBatchDecoder::parseValueType(">H", attrDesc));
+    attrDesc.offset = 5;
+    attrDesc.andMask = 0x1fff;
+    attrDesc.signBitPos = 12;
+    attrDesc.hasSignSubtract = true;
+    attrDesc.signSubtract = 4096;
+    attrDesc.divisor = 16;
+    TEST_ASSERT_TRUE(decoder.addAttr(attrDesc));
+    attrDesc = PollRecordBatchDecoder::AttrDesc();
+    TEST_ASSERT_TRUE(PollRecordBatchDecoder::parseValueType("b", attrDesc));
+    attrDesc.offset = 6;
+    attrDesc.andMask = 0x0f;
+    attrDesc.addValue = 0.5;
+    TEST_ASSERT_TRUE(decoder.addAttr(attrDesc));
+    attrDesc = PollRecordBatchDecoder::AttrDesc();
+    TEST_ASSERT_TRUE(PollRecordBatchDecoder::parseValueType("<H", attrDesc));
+    attrDesc.offset = 6;
+    TEST_ASSERT_FALSE(decoder.addAttr(attrDesc));
+
+    // Decode
+    struct
+    {
+        uint64_t lastReportTimestampUs = 0;
+        uint64_t reportTimestampOffsetUs = 0;
+    } decodeState;
+    uint32_t timeMsCol[2] = {};
+    float cols[4][2] = {};
+    float* pCols[4] = { cols[0], cols[1], cols[2], cols[3] };
+    TEST_ASSERT_TRUE(decoder.decode(pollResponses.data(), pollResponses.size(), timeMsCol, pCols, 2, decodeState) == 2);
+    for (uint32_t recIdx = 0; recIdx < 2; recIdx++)
+    {
+        TEST_ASSERT_TRUE(timeMsCol[recIdx] == (100 + recIdx * 10) * DevicePollingInfo::POLL_RESULT_RESOLUTION_US / 1000);
+        TEST_ASSERT_TRUE(cols[0][recIdx] == 1);
+        TEST_ASSERT_TRUE(cols[1][recIdx] == 0x12345);
+        TEST_ASSERT_TRUE(cols[2][recIdx] == (4096.0f - 0x1f0e) / 16);
+        TEST_ASSERT_TRUE(cols[3][recIdx] == -1.5f);
+    }
+}
+
+TEST_CASE("Test PollBufferBudget quotas", "[PollDataAggregator]")
+{
+    // No limit - all requests granted
+    PollBufferBudget budget;
+    budget.setup(0);
+    budget.setRequest(0x10, 10, 8);
+    budget.setRequest(0x20, 4, 16);
+    std::vector<uint32_t> changedAddrs;
+    budget.rebalance(changedAddrs);
+    TEST_ASSERT_TRUE(changedAddrs.size() == 2);
+    uint32_t numResults = 0, resultSize = 0;
+    TEST_ASSERT_TRUE(budget.getQuota(0x10, numResults, resultSize));
+    TEST_ASSERT_TRUE((numResults == 10) && (resultSize == 8));
+    budget.rebalance(changedAddrs);
+    TEST_ASSERT_TRUE(changedAddrs.size() == 0);
+
+    // Limited - the small request is granted and the remainder goes to the large one
+    budget.setup(200);
+    budget.setRequest(0x10, 20, 8);
+    budget.setRequest(0x20, 2, 16);
+    budget.setRequest(0x30, 50, 4);
+    budget.rebalance(changedAddrs);
+    TEST_ASSERT_TRUE(changedAddrs.size() == 3);
+    TEST_ASSERT_TRUE(budget.getAllocatedBytes() <= 200);
+    TEST_ASSERT_TRUE(budget.getQuota(0x20, numResults, resultSize) && (numResults == 2));
+    TEST_ASSERT_TRUE(budget.getQuota(0x10, numResults, resultSize) && (numResults >= 1) && (numResults < 20));
+    TEST_ASSERT_TRUE(budget.getNumReduced() == 2);
+
+    // Removing a device frees space for the others
+    uint32_t prevNumResults = numResults;
+    budget.remove(0x30);
+    budget.rebalance(changedAddrs);
+    TEST_ASSERT_TRUE(changedAddrs.size() == 1);
+    TEST_ASSERT_TRUE(budget.getQuota(0x10, numResults, resultSize) && (numResults > prevNumResults));
+    TEST_ASSERT_TRUE(budget.getAllocatedBytes() <= 200);
+    TEST_ASSERT_FALSE(budget.getQuota(0x30, numResults, resultSize));
+
+    // Every device gets at least one result even when over budget
+    budget.setup(16);
+    budget.setRequest(0x10, 5, 8);
+    budget.setRequest(0x20, 5, 8);
+    budget.setRequest(0x30, 5, 8);
+    budget.rebalance(changedAddrs);
+    TEST_ASSERT_TRUE(budget.getQuota(0x30, numResults, resultSize) && (numResults == 1));
+
+    // Aggregators whose applied size differs from their quota are pending
+    std::vector<uint32_t> pendingAddrs;
+    budget.getPendingAddrs(pendingAddrs);
+    TEST_ASSERT_TRUE(pendingAddrs.size() == 3);
+    budget.setApplied(0x10, 5);
+    budget.setApplied(0x20, 1);
+    budget.setApplied(0x30, 1);
+    budget.getPendingAddrs(pendingAddrs);
+    TEST_ASSERT_TRUE((pendingAddrs.size() == 1) && (pendingAddrs[0] == 0x10));
+    TEST_ASSERT_TRUE(budget.getApplied(0x10) == 5);
+}
+
+TEST_CASE("Test PollResultFilter window and trigger", "[PollDataAggregator]")
+{
+    // Records are timestamp then a big-endian 16 bit value and an 8 bit value
+    const uint32_t tsSize = DevicePollingInfo::POLL_RESULT_TIMESTAMP_SIZE;
+    auto makeResult = [tsSize](uint32_t tsUnits, uint16_t val16, uint8_t val8) {
+        std::vector<uint8_t> pollResult;
+        for (uint32_t i = 0; i < tsSize; i++)
+            pollResult.push_back((tsUnits >> ((tsSize - 1 - i) * 8)) & 0xff);
+        pollResult.push_back(val16 >> 8);
+        pollResult.push_back(val16 & 0xff);
+        pollResult.push_back(val8);
+        return pollResult;
+    };
+    PollRecordBatchDecoder decoder;
+    decoder.setup(3);
+    PollRecordBatchDecoder::AttrDesc attrDesc;
+    TEST_ASSERT_TRUE(PollRecordBatchDecoder::parseValueType(">H", attrDesc));
+    TEST_ASSERT_TRUE(decoder.addAttr(attrDesc));
+    attrDesc = PollRecordBatchDecoder::AttrDesc();
+    TEST_ASSERT_TRUE(PollRecordBatchDecoder::parseValueType("B", attrDesc));
+    attrDesc.offset = 2;
+    TEST_ASSERT_TRUE(decoder.addAttr(attrDesc));
+
+    // Window of 4 - average of the first field, max of the second
+    PollResultFilter filter;
+    filter.setup(decoder, 4);
+    TEST_ASSERT_TRUE(filter.setFieldOp(0, PollResultFilter::FIELD_OP_AVG));
+    TEST_ASSERT_TRUE(filter.setFieldOp(1, PollResultFilter::FIELD_OP_MAX));
+    const uint16_t vals16[] = { 1000, 1002, 1004, 1006 };
+    const uint8_t vals8[] = { 5, 9, 3, 7 };
+    std::vector<uint8_t> outResult;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        bool isOut = filter.process(makeResult(100 + i, vals16[i], vals8[i]), outResult);
+        TEST_ASSERT_TRUE(isOut == (i == 3));
+    }
+    TEST_ASSERT_TRUE(outResult == makeResult(103, 1003, 9));
+    TEST_ASSERT_TRUE((filter.getNumIn() == 4) && (filter.getNumOut() == 1));
+
+    // Ops other than last can't be applied to masked fields
+    PollRecordBatchDecoder maskedDecoder;
+    maskedDecoder.setup(3);
+    attrDesc = PollRecordBatchDecoder::AttrDesc();
+    TEST_ASSERT_TRUE(PollRecordBatchDecoder::parseValueType("B", attrDesc));
+    attrDesc.andMask = 0x0f;
+    TEST_ASSERT_TRUE(maskedDecoder.addAttr(attrDesc));
+    PollResultFilter maskedFilter;
+    maskedFilter.setup(maskedDecoder, 2);
+    TEST_ASSERT_FALSE(maskedFilter.setFieldOp(0, PollResultFilter::FIELD_OP_MIN));
+
+    // Trigger only (window 0) - the first result and then changes of at least 10 from the last output
+    filter.setup(decoder, 0);
+    TEST_ASSERT_TRUE(filter.setTrigger(0, 10));
+    TEST_ASSERT_TRUE(filter.process(makeResult(200, 500, 0), outResult));
+    TEST_ASSERT_FALSE(filter.process(makeResult(201, 505, 0), outResult));
+    TEST_ASSERT_FALSE(filter.process(makeResult(202, 491, 0), outResult));
+    TEST_ASSERT_TRUE(filter.process(makeResult(203, 510, 0), outResult));
+    TEST_ASSERT_TRUE(outResult == makeResult(203, 510, 0));
+    TEST_ASSERT_FALSE(filter.process(makeResult(204, 501, 0), outResult));
+
+    // Results of an unexpected size are passed through
+    std::vector<uint8_t> shortResult = { 0x00, 0x01 };
+    TEST_ASSERT_TRUE(filter.process(shortResult, outResult));
+    TEST_ASSERT_TRUE(outResult == shortResult);
+}
+
+TEST_CASE("Test DevicePollGroup variable length read", "[PollDataAggregator]")
+{
+    // Count read (big-endian 16 bit) then a burst read of up to 12 bytes (6 bytes per count)
+    DevicePollGroup group;
+    const uint8_t countReg = 0x72;
+    const uint8_t fifoReg = 0x74;
+    group.pollInfo.pollReqs.push_back(BusRequestInfo(BUS_REQ_TYPE_FAST_SCAN, 0x68, 0, 1, &countReg, 2, 0, nullptr, nullptr));
+    group.pollInfo.pollReqs.push_back(BusRequestInfo(BUS_REQ_TYPE_FAST_SCAN, 0x68, 0, 1, &fifoReg, 12, 0, nullptr, nullptr));
+
+    // Fixed length if there is no config
+    RaftJson emptyConfig = "{}";
+    TEST_ASSERT_TRUE(group.setupVarLen(emptyConfig));
+    TEST_ASSERT_FALSE(group.varLenRead.isVarLen);
+
+    // The count must be read by the requests before the last
+    RaftJson badConfig = "{\"at\":1,\"t\":\">H\",\"x\":6}";
+    TEST_ASSERT_FALSE(group.setupVarLen(badConfig));
+
+    // Read length from the count (limited to the length of the request)
+    RaftJson varLenConfig = "{\"at\":0,\"t\":\">H\",\"x\":6}";
+    TEST_ASSERT_TRUE(group.setupVarLen(varLenConfig));
+    TEST_ASSERT_TRUE(group.varLenRead.isVarLen);
+    const uint8_t oneCount[] = { 0x00, 0x01 };
+    const uint8_t manyCounts[] = { 0x01, 0x00 };
+    const uint8_t noCounts[] = { 0x00, 0x00 };
+    TEST_ASSERT_TRUE(group.varLenRead.getReadLen(oneCount, 12) == 6);
+    TEST_ASSERT_TRUE(group.varLenRead.getReadLen(manyCounts, 12) == 12);
+    TEST_ASSERT_TRUE(group.varLenRead.getReadLen(noCounts, 12) == 0);
+}
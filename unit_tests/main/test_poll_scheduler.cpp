@@ -0,0 +1,167 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Poll scheduler test
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "unity_test_runner.h"
+
+#include "RaftJson.h"
+#include "BusPollScheduler.h"
+#include "BusI2CSchedulerEDF.h"
+
+// static const char* MODULE_PREFIX = "test_i2c_poll_sched";
+
+TEST_CASE("Test BusI2CSchedulerEDF rates", "[PollScheduler]")
+{
+    // 100Hz and 30Hz (not an integer multiple) over one second
+    BusI2CSchedulerEDF scheduler;
+    scheduler.addNode(100, 0);
+    scheduler.addNode(30, 0);
+    uint32_t pollCounts[2] = {0, 0};
+    for (uint64_t timeUs = 0; timeUs < 1000000; timeUs += 100)
+    {
+        int idx = scheduler.getNext(timeUs);
+        while (idx >= 0)
+        {
+            pollCounts[idx]++;
+            idx = scheduler.getNext(timeUs);
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(100, pollCounts[0]);
+    TEST_ASSERT_EQUAL_UINT32(30, pollCounts[1]);
+
+    // Jitter is bounded by the time step
+    uint32_t pollCount = 0, avgLateUs = 0, maxLateUs = 0, missedCount = 0;
+    TEST_ASSERT_TRUE(scheduler.getJitterStats(1, pollCount, avgLateUs, maxLateUs, missedCount));
+    TEST_ASSERT_TRUE(maxLateUs < 100);
+    TEST_ASSERT_EQUAL_UINT32(0, missedCount);
+}
+
+TEST_CASE("Test BusPollScheduler priority and removal", "[PollScheduler]")
+{
+    BusPollScheduler scheduler;
+    scheduler.addOrUpdate(0x20, 10000, BusPollScheduler::POLL_PRIORITY_NORMAL, 0);
+    scheduler.addOrUpdate(BusPollScheduler::pollListKey(0), 10000, BusPollScheduler::POLL_PRIORITY_LOW, 0);
+    scheduler.addOrUpdate(0x30, 5000, BusPollScheduler::POLL_PRIORITY_HIGH, 0);
+    TEST_ASSERT_EQUAL_UINT32(3, scheduler.getCount());
+
+    // All are due - highest priority first
+    uint32_t pollKey = 0, pollHandle = 0;
+    TEST_ASSERT_TRUE(scheduler.getNextDue(0, UINT32_MAX, pollKey, pollHandle));
+    TEST_ASSERT_EQUAL_UINT32(0x30, pollKey);
+    TEST_ASSERT_TRUE(scheduler.getNextDue(0, UINT32_MAX, pollKey, pollHandle));
+    TEST_ASSERT_EQUAL_UINT32(0x20, pollKey);
+    TEST_ASSERT_TRUE(scheduler.getNextDue(0, UINT32_MAX, pollKey, pollHandle));
+    TEST_ASSERT_TRUE(BusPollScheduler::isPollListKey(pollKey));
+    TEST_ASSERT_EQUAL_UINT32(0, BusPollScheduler::getPollListIdx(pollKey));
+    TEST_ASSERT_FALSE(scheduler.getNextDue(0, UINT32_MAX, pollKey, pollHandle));
+    TEST_ASSERT_EQUAL_UINT32(5, scheduler.getMsUntilNextDue(0));
+
+    // Bus time estimate gates polls when the budget is too small
+    TEST_ASSERT_TRUE(scheduler.getNextDue(5000, UINT32_MAX, pollKey, pollHandle));
+    TEST_ASSERT_EQUAL_UINT32(0x30, pollKey);
+    scheduler.recordBusTime(pollHandle, pollKey, 800);
+    TEST_ASSERT_FALSE(scheduler.getNextDue(10000, 500, pollKey, pollHandle));
+    uint32_t estBusTimeUs = 0;
+    TEST_ASSERT_TRUE(scheduler.getNextDue(10000, 1000, pollKey, pollHandle, &estBusTimeUs));
+    TEST_ASSERT_EQUAL_UINT32(0x30, pollKey);
+    TEST_ASSERT_EQUAL_UINT32(800, estBusTimeUs);
+
+    // Remove polling list entries
+    scheduler.removeMatching(BusPollScheduler::POLL_KEY_POLL_LIST_FLAG, BusPollScheduler::POLL_KEY_POLL_LIST_FLAG);
+    TEST_ASSERT_EQUAL_UINT32(2, scheduler.getCount());
+    scheduler.remove(0x30);
+    TEST_ASSERT_TRUE(scheduler.getNextDue(20000, UINT32_MAX, pollKey, pollHandle));
+    TEST_ASSERT_EQUAL_UINT32(0x20, pollKey);
+    TEST_ASSERT_FALSE(scheduler.getNextDue(20000, UINT32_MAX, pollKey, pollHandle));
+}
+
+TEST_CASE("Test BusPollScheduler back-off and quarantine", "[PollScheduler]")
+{
+    BusPollScheduler scheduler;
+    RaftJson config = "{\"pollBackoffMaxMs\":1000,\"pollQuarantineFails\":3,\"pollQuarantineProbeMs\":100}";
+    scheduler.setup(config);
+    scheduler.addOrUpdate(0x20, 10000, BusPollScheduler::POLL_PRIORITY_NORMAL, 0);
+    uint32_t pollKey = 0, pollHandle = 0;
+    bool isQuarantined = true;
+    TEST_ASSERT_TRUE(scheduler.getNextDue(0, UINT32_MAX, pollKey, pollHandle, nullptr, &isQuarantined));
+    TEST_ASSERT_FALSE(isQuarantined);
+
+    // First failure doubles the interval (with +/- 25% jitter)
+    scheduler.recordPollResult(pollHandle, pollKey, false, 0);
+    TEST_ASSERT_FALSE(scheduler.getNextDue(14999, UINT32_MAX, pollKey, pollHandle));
+    TEST_ASSERT_TRUE(scheduler.getNextDue(25000, UINT32_MAX, pollKey, pollHandle));
+
+    // Second failure doubles it again
+    scheduler.recordPollResult(pollHandle, pollKey, false, 25000);
+    TEST_ASSERT_FALSE(scheduler.getNextDue(54999, UINT32_MAX, pollKey, pollHandle));
+    TEST_ASSERT_TRUE(scheduler.getNextDue(75000, UINT32_MAX, pollKey, pollHandle));
+
+    // Third failure quarantines the entry - it is then only due for probing at the probe interval
+    scheduler.recordPollResult(pollHandle, pollKey, false, 75000);
+    TEST_ASSERT_EQUAL_UINT32(1, scheduler.getQuarantinedCount());
+    TEST_ASSERT_FALSE(scheduler.getNextDue(149999, UINT32_MAX, pollKey, pollHandle));
+    TEST_ASSERT_TRUE(scheduler.getNextDue(175000, UINT32_MAX, pollKey, pollHandle, nullptr, &isQuarantined));
+    TEST_ASSERT_TRUE(isQuarantined);
+
+    // A successful probe restores the full poll rate (with a poll due immediately)
+    scheduler.recordPollResult(pollHandle, pollKey, true, 175000);
+    TEST_ASSERT_EQUAL_UINT32(0, scheduler.getQuarantinedCount());
+    TEST_ASSERT_TRUE(scheduler.getNextDue(175000, UINT32_MAX, pollKey, pollHandle, nullptr, &isQuarantined));
+    TEST_ASSERT_FALSE(isQuarantined);
+    TEST_ASSERT_FALSE(scheduler.getNextDue(184999, UINT32_MAX, pollKey, pollHandle));
+    TEST_ASSERT_TRUE(scheduler.getNextDue(185000, UINT32_MAX, pollKey, pollHandle));
+}
+
+TEST_CASE("Test BusPollScheduler achieved rate", "[PollScheduler]")
+{
+    BusPollScheduler scheduler;
+    scheduler.addOrUpdate(0x20, 10000, BusPollScheduler::POLL_PRIORITY_NORMAL, 0);
+    uint32_t pollKey = 0, pollHandle = 0;
+
+    // Polled late every time (every 20ms rather than 10ms)
+    for (uint64_t timeUs = 0; timeUs < 200000; timeUs += 20000)
+        TEST_ASSERT_TRUE(scheduler.getNextDue(timeUs, UINT32_MAX, pollKey, pollHandle));
+    TEST_ASSERT_EQUAL_STRING("[{\"k\":32,\"c\":10000,\"a\":20000,\"q\":0}]", scheduler.getRateJSON().c_str());
+}
+
+TEST_CASE("Test BusPollScheduler poll groups", "[PollScheduler]")
+{
+    // Ident poll (group 0) and two further groups of a device on slot 3 at different rates
+    BusPollScheduler scheduler;
+    const uint32_t address = 0x0368;
+    uint32_t groupKeys[3] = { address, BusPollScheduler::pollGroupKey(address, 1), 
+                BusPollScheduler::pollGroupKey(address, 2) };
+    TEST_ASSERT_EQUAL_UINT32(address, groupKeys[0]);
+    TEST_ASSERT_EQUAL_UINT32(address, BusPollScheduler::getPollKeyAddr(groupKeys[2]));
+    TEST_ASSERT_EQUAL_UINT32(2, BusPollScheduler::getPollGroupIdx(groupKeys[2]));
+    TEST_ASSERT_EQUAL_UINT32(0, BusPollScheduler::getPollGroupIdx(groupKeys[0]));
+    TEST_ASSERT_FALSE(BusPollScheduler::isPollListKey(groupKeys[2]));
+    scheduler.addOrUpdate(groupKeys[0], 10000, BusPollScheduler::POLL_PRIORITY_NORMAL, 0);
+    scheduler.addOrUpdate(groupKeys[1], 50000, BusPollScheduler::POLL_PRIORITY_NORMAL, 0);
+    scheduler.addOrUpdate(groupKeys[2], 500000, BusPollScheduler::POLL_PRIORITY_NORMAL, 0);
+
+    // Each group is polled at its own rate
+    uint32_t pollCounts[3] = { 0, 0, 0 };
+    uint32_t pollKey = 0, pollHandle = 0;
+    for (uint64_t timeUs = 0; timeUs < 1000000; timeUs += 1000)
+    {
+        while (scheduler.getNextDue(timeUs, UINT32_MAX, pollKey, pollHandle))
+            pollCounts[BusPollScheduler::getPollGroupIdx(pollKey)]++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(100, pollCounts[0]);
+    TEST_ASSERT_EQUAL_UINT32(20, pollCounts[1]);
+    TEST_ASSERT_EQUAL_UINT32(2, pollCounts[2]);
+
+    // Removing the ident poll leaves the groups
+    scheduler.remove(address);
+    TEST_ASSERT_EQUAL_UINT32(2, scheduler.getCount());
+}